@@ -23,11 +23,15 @@
 #include <random.h>
 #include <streams.h>
 #include <tinyformat.h>
+#include <uint256.h>
 #include <univalue.h>
 #include <util/fs.h>
 #include <util/fs_helpers.h>
 #include <util/translation.h>
 
+#include <cstdio>
+#include <optional>
+
 namespace {
 
 class DbNotFoundError : public std::exception
@@ -124,6 +128,122 @@ void DeserializeFileDB(const fs::path& path, Data&& data)
     }
     DeserializeDB(filein, data);
 }
+
+/** Read the checksum SerializeDB() stored at the end of a file. */
+std::optional<uint256> ReadFileChecksum(const fs::path& path)
+{
+    AutoFile file{fsbridge::fopen(path, "rb")};
+    if (file.IsNull() || std::fseek(file.Get(), -static_cast<long>(uint256::size()), SEEK_END) != 0) {
+        return std::nullopt;
+    }
+    uint256 checksum;
+    try {
+        file >> checksum;
+    } catch (const std::ios_base::failure&) {
+        return std::nullopt;
+    }
+    return checksum;
+}
+
+/**
+ * The addrman journal (peers.journal) holds the changes made to addrman since peers.dat was last
+ * written, so that the periodic flushes only need to append those rather than rewrite the whole table.
+ *
+ * It starts with the network magic and the checksum of the peers.dat it applies to, followed by one
+ * block per flush: the records written by AddrMan::WriteChanges() and their hash.
+ */
+bool CreatePeersJournal(const fs::path& path, const uint256& base_checksum)
+{
+    AutoFile file{fsbridge::fopen(path, "wb")};
+    if (file.IsNull()) {
+        return error("%s: Failed to open file %s", __func__, fs::PathToString(path));
+    }
+    try {
+        file << Params().MessageStart() << base_checksum;
+    } catch (const std::exception& e) {
+        return error("%s: Serialize or I/O error - %s", __func__, e.what());
+    }
+    if (!FileCommit(file.Get())) {
+        return error("%s: Failed to flush file %s", __func__, fs::PathToString(path));
+    }
+    return true;
+}
+
+/** Append a block of records to the journal, unless it doesn't belong to the current peers.dat or
+ *  would grow larger than max_size. */
+bool AppendPeersJournal(const fs::path& path, const uint256& base_checksum, const DataStream& records, uint64_t max_size)
+{
+    AutoFile file{fsbridge::fopen(path, "rb+")};
+    if (file.IsNull()) return false;
+    try {
+        MessageStartChars magic;
+        uint256 checksum;
+        file >> magic >> checksum;
+        if (magic != Params().MessageStart() || checksum != base_checksum) return false;
+        if (std::fseek(file.Get(), 0, SEEK_END) != 0) return false;
+        const long size{std::ftell(file.Get())};
+        if (size < 0 || static_cast<uint64_t>(size) + records.size() > max_size) return false;
+
+        WriteCompactSize(file, records.size());
+        file << Span{records} << Hash(records);
+    } catch (const std::exception& e) {
+        return error("%s: Serialize or I/O error - %s", __func__, e.what());
+    }
+    if (!FileCommit(file.Get())) {
+        return error("%s: Failed to flush file %s", __func__, fs::PathToString(path));
+    }
+    return true;
+}
+
+/**
+ * Apply the journal written on top of the peers.dat with the given checksum to addrman.
+ *
+ * @return  Whether more blocks can be appended to the journal, i.e. it exists, belongs to this
+ *          peers.dat and was read completely.
+ */
+bool ReplayPeersJournal(const fs::path& path, const uint256& base_checksum, AddrMan& addrman, size_t& num_blocks)
+{
+    num_blocks = 0;
+    AutoFile file{fsbridge::fopen(path, "rb")};
+    if (file.IsNull()) return false;
+    try {
+        if (std::fseek(file.Get(), 0, SEEK_END) != 0) return false;
+        const long size{std::ftell(file.Get())};
+        std::rewind(file.Get());
+
+        MessageStartChars magic;
+        uint256 checksum;
+        file >> magic >> checksum;
+        if (magic != Params().MessageStart() || checksum != base_checksum) {
+            LogPrintf("Ignoring %s, which was written for a different peers.dat\n", fs::quoted(fs::PathToString(path.filename())));
+            return false;
+        }
+        while (std::ftell(file.Get()) < size) {
+            std::vector<std::byte> records;
+            uint256 hash;
+            file >> records >> hash;
+            if (hash != Hash(records)) {
+                throw std::ios_base::failure{"Checksum mismatch, data corrupted"};
+            }
+            DataStream stream{records};
+            addrman.ApplyChanges(stream);
+            ++num_blocks;
+        }
+    } catch (const std::exception& e) {
+        // Most likely a flush interrupted by a crash. Everything before it is still good.
+        LogPrintf("Stopped reading %s after %d flushes: %s\n", fs::quoted(fs::PathToString(path.filename())), num_blocks, e.what());
+        return false;
+    }
+    return true;
+}
+
+/** Write all of addrman to peers.dat, and start a new, empty journal on top of it. */
+bool RewritePeerAddresses(const fs::path& path_addr, const fs::path& path_journal, const AddrMan& addr)
+{
+    if (!SerializeFileDB("peers", path_addr, addr)) return false;
+    const auto checksum{ReadFileChecksum(path_addr)};
+    return checksum && CreatePeersJournal(path_journal, *checksum);
+}
 } // namespace
 
 CBanDB::CBanDB(fs::path ban_list_path)
@@ -175,10 +295,29 @@ bool CBanDB::Read(banmap_t& banSet)
     return true;
 }
 
-bool DumpPeerAddresses(const ArgsManager& args, const AddrMan& addr)
+bool DumpPeerAddresses(const ArgsManager& args, AddrMan& addr)
 {
-    const auto pathAddr = args.GetDataDirNet() / "peers.dat";
-    return SerializeFileDB("peers", pathAddr, addr);
+    const auto path_addr{args.GetDataDirNet() / "peers.dat"};
+    const auto path_journal{args.GetDataDirNet() / "peers.journal"};
+
+    // Take the changes before a possible rewrite, which then covers them (and anything after).
+    DataStream changes{};
+    const size_t num_changes{addr.WriteChanges(changes)};
+
+    if (const auto checksum{ReadFileChecksum(path_addr)}) {
+        if (num_changes == 0) return true;
+        // Keep appending until the journal reaches half the size of peers.dat.
+        std::error_code ec;
+        const auto max_size{fs::file_size(path_addr, ec) / 2};
+        if (!ec && AppendPeersJournal(path_journal, *checksum, changes, max_size)) {
+            LogPrint(BCLog::ADDRMAN, "Appended %d changes to peers.journal\n", num_changes);
+            return true;
+        }
+    }
+    if (RewritePeerAddresses(path_addr, path_journal, addr)) return true;
+    // Nothing was persisted, so the next flush still has to write these changes.
+    addr.RestoreChanges(changes);
+    return false;
 }
 
 void ReadFromStream(AddrMan& addr, DataStream& ssPeers)
@@ -193,9 +332,17 @@ util::Result<std::unique_ptr<AddrMan>> LoadAddrman(const NetGroupManager& netgro
 
     const auto start{SteadyClock::now()};
     const auto path_addr{args.GetDataDirNet() / "peers.dat"};
+    const auto path_journal{args.GetDataDirNet() / "peers.journal"};
     try {
         DeserializeFileDB(path_addr, *addrman);
-        LogPrintf("Loaded %i addresses from peers.dat  %dms\n", addrman->Size(), Ticks<std::chrono::milliseconds>(SteadyClock::now() - start));
+        size_t num_blocks{0};
+        const auto checksum{ReadFileChecksum(path_addr)};
+        if (!checksum || !ReplayPeersJournal(path_journal, *checksum, *addrman, num_blocks)) {
+            // Appending to a missing or unusable journal would lose the changes, so start over.
+            RewritePeerAddresses(path_addr, path_journal, *addrman);
+        }
+        LogPrintf("Loaded %i addresses from peers.dat and %d flushes from peers.journal  %dms\n",
+                  addrman->Size(), num_blocks, Ticks<std::chrono::milliseconds>(SteadyClock::now() - start));
     } catch (const DbNotFoundError&) {
         // Addrman can be in an inconsistent state after failure, reset it
         addrman = std::make_unique<AddrMan>(netgroupman, /*deterministic=*/false, /*consistency_check_ratio=*/check_addrman);
@@ -22,7 +22,11 @@ class NetGroupManager;
 /** Only used by tests. */
 void ReadFromStream(AddrMan& addr, DataStream& ssPeers);
 
-bool DumpPeerAddresses(const ArgsManager& args, const AddrMan& addr);
+/**
+ * Persist addrman: append the changes since the last call to peers.journal, or rewrite peers.dat
+ * (and start a new journal) if the journal got too large or can't be used.
+ */
+bool DumpPeerAddresses(const ArgsManager& args, AddrMan& addr);
 
 /** Access to the banlist database (banlist.json) */
 class CBanDB
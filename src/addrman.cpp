@@ -398,6 +398,10 @@ void AddrManImpl::Unserialize(Stream& s_)
             "Corrupt data. Consistency check failed with code %s",
             check_code));
     }
+
+    // What was just loaded is by definition persisted.
+    m_changed.clear();
+    m_deleted.clear();
 }
 
 AddrInfo* AddrManImpl::Find(const CService& addr, int* pnId)
@@ -426,6 +430,7 @@ AddrInfo* AddrManImpl::Create(const CAddress& addr, const CNetAddr& addrSource,
     vRandom.push_back(nId);
     nNew++;
     m_network_counts[addr.GetNetwork()].n_new++;
+    m_changed.insert(nId);
     if (pnId)
         *pnId = nId;
     return &mapInfo[nId];
@@ -467,6 +472,8 @@ void AddrManImpl::Delete(int nId)
     SwapRandom(info.nRandomPos, vRandom.size() - 1);
     m_network_counts[info.GetNetwork()].n_new--;
     vRandom.pop_back();
+    m_changed.erase(nId);
+    m_deleted.insert(info);
     mapAddr.erase(info);
     mapInfo.erase(nId);
     nNew--;
@@ -538,6 +545,7 @@ void AddrManImpl::MakeTried(AddrInfo& info, int nId)
         vvNew[nUBucket][nUBucketPos] = nIdEvict;
         nNew++;
         m_network_counts[infoOld.GetNetwork()].n_new++;
+        m_changed.insert(nIdEvict);
         LogPrint(BCLog::ADDRMAN, "Moved %s from tried[%i][%i] to new[%i][%i] to make space\n",
                  infoOld.ToStringAddrPort(), nKBucket, nKBucketPos, nUBucket, nUBucketPos);
     }
@@ -547,6 +555,7 @@ void AddrManImpl::MakeTried(AddrInfo& info, int nId)
     nTried++;
     info.fInTried = true;
     m_network_counts[info.GetNetwork()].n_tried++;
+    m_changed.insert(nId);
 }
 
 bool AddrManImpl::AddSingle(const CAddress& addr, const CNetAddr& source, std::chrono::seconds time_penalty)
@@ -570,10 +579,14 @@ bool AddrManImpl::AddSingle(const CAddress& addr, const CNetAddr& source, std::c
         const auto update_interval{currently_online ? 1h : 24h};
         if (pinfo->nTime < addr.nTime - update_interval - time_penalty) {
             pinfo->nTime = std::max(NodeSeconds{0s}, addr.nTime - time_penalty);
+            m_changed.insert(nId);
         }
 
         // add services
-        pinfo->nServices = ServiceFlags(pinfo->nServices | addr.nServices);
+        if ((pinfo->nServices | addr.nServices) != pinfo->nServices) {
+            pinfo->nServices = ServiceFlags(pinfo->nServices | addr.nServices);
+            m_changed.insert(nId);
+        }
 
         // do not update if no new information is present
         if (addr.nTime <= pinfo->nTime) {
@@ -644,6 +657,7 @@ bool AddrManImpl::Good_(const CService& addr, bool test_before_evict, NodeSecond
     info.m_last_success = time;
     info.m_last_try = time;
     info.nAttempts = 0;
+    m_changed.insert(nId);
     // nTime is not updated here, to avoid leaking information about
     // currently-connected peers.
 
@@ -696,7 +710,8 @@ void AddrManImpl::Attempt_(const CService& addr, bool fCountFailure, NodeSeconds
 {
     AssertLockHeld(cs);
 
-    AddrInfo* pinfo = Find(addr);
+    int nId;
+    AddrInfo* pinfo = Find(addr, &nId);
 
     // if not found, bail out
     if (!pinfo)
@@ -709,6 +724,7 @@ void AddrManImpl::Attempt_(const CService& addr, bool fCountFailure, NodeSeconds
     if (fCountFailure && info.m_last_count_attempt < m_last_good) {
         info.m_last_count_attempt = time;
         info.nAttempts++;
+        m_changed.insert(nId);
     }
 }
 
@@ -871,7 +887,8 @@ void AddrManImpl::Connected_(const CService& addr, NodeSeconds time)
 {
     AssertLockHeld(cs);
 
-    AddrInfo* pinfo = Find(addr);
+    int nId;
+    AddrInfo* pinfo = Find(addr, &nId);
 
     // if not found, bail out
     if (!pinfo)
@@ -883,6 +900,7 @@ void AddrManImpl::Connected_(const CService& addr, NodeSeconds time)
     const auto update_interval{20min};
     if (time - info.nTime > update_interval) {
         info.nTime = time;
+        m_changed.insert(nId);
     }
 }
 
@@ -890,7 +908,8 @@ void AddrManImpl::SetServices_(const CService& addr, ServiceFlags nServices)
 {
     AssertLockHeld(cs);
 
-    AddrInfo* pinfo = Find(addr);
+    int nId;
+    AddrInfo* pinfo = Find(addr, &nId);
 
     // if not found, bail out
     if (!pinfo)
@@ -899,7 +918,64 @@ void AddrManImpl::SetServices_(const CService& addr, ServiceFlags nServices)
     AddrInfo& info = *pinfo;
 
     // update info
-    info.nServices = nServices;
+    if (info.nServices != nServices) {
+        info.nServices = nServices;
+        m_changed.insert(nId);
+    }
+}
+
+void AddrManImpl::ApplyUpsert_(const AddrInfo& info, bool in_tried)
+{
+    AssertLockHeld(cs);
+
+    // Don't store the entry if it's not a valid address for our addrman
+    if (!info.IsValid()) return;
+
+    int nId;
+    AddrInfo* pinfo = Find(info, &nId);
+    if (!pinfo) {
+        pinfo = Create(info, info.source, &nId);
+        // Entries for tried go straight there below: records aren't in the order the changes
+        // were made, so passing through the new table could evict an entry that belongs there.
+        if (!in_tried) {
+            // As when re-bucketing in Unserialize(), new entries only get the bucket of their
+            // primary source. Whatever occupies it was replaced after the last full write.
+            const int bucket{info.GetNewBucket(nKey, m_netgroupman)};
+            const int bucket_pos{info.GetBucketPosition(nKey, true, bucket)};
+            ClearNew(bucket, bucket_pos);
+            pinfo->nRefCount = 1;
+            vvNew[bucket][bucket_pos] = nId;
+        }
+    }
+
+    pinfo->nTime = info.nTime;
+    pinfo->nServices = info.nServices;
+    pinfo->m_last_success = info.m_last_success;
+    pinfo->nAttempts = info.nAttempts;
+
+    // An entry that left tried was evicted by another one entering it, which has its own record.
+    if (in_tried && !pinfo->fInTried) {
+        MakeTried(*pinfo, nId);
+    }
+}
+
+void AddrManImpl::ApplyErase_(const CService& addr)
+{
+    AssertLockHeld(cs);
+
+    int nId;
+    AddrInfo* pinfo = Find(addr, &nId);
+    if (!pinfo || pinfo->fInTried) return;
+
+    // remove the entry from all new buckets
+    for (int bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT && pinfo->nRefCount > 0; ++bucket) {
+        const int pos{pinfo->GetBucketPosition(nKey, true, bucket)};
+        if (vvNew[bucket][pos] == nId) {
+            vvNew[bucket][pos] = -1;
+            pinfo->nRefCount--;
+        }
+    }
+    Delete(nId);
 }
 
 void AddrManImpl::ResolveCollisions_()
@@ -1262,6 +1338,89 @@ std::optional<AddressPosition> AddrManImpl::FindAddressEntry(const CAddress& add
     return entry;
 }
 
+size_t AddrManImpl::WriteChanges(DataStream& s_)
+{
+    LOCK(cs);
+
+    ParamsStream s{CAddress::V2_DISK, s_};
+
+    size_t written{0};
+    for (const CService& addr : m_deleted) {
+        // Re-added entries are covered by their upsert.
+        if (mapAddr.count(addr)) continue;
+        s << static_cast<uint8_t>(CHANGE_ERASE) << addr;
+        ++written;
+    }
+    for (const int nId : m_changed) {
+        const AddrInfo& info{mapInfo.at(nId)};
+        s << static_cast<uint8_t>(CHANGE_UPSERT) << info << info.fInTried;
+        ++written;
+    }
+    m_changed.clear();
+    m_deleted.clear();
+    return written;
+}
+
+void AddrManImpl::RestoreChanges(DataStream& s_)
+{
+    LOCK(cs);
+
+    ParamsStream s{CAddress::V2_DISK, s_};
+
+    while (!s_.empty()) {
+        uint8_t type;
+        s >> type;
+        CService addr;
+        if (type == CHANGE_UPSERT) {
+            AddrInfo info;
+            bool in_tried;
+            s >> info >> in_tried;
+            addr = info;
+        } else if (type == CHANGE_ERASE) {
+            s >> addr;
+        } else {
+            throw std::ios_base::failure(strprintf("Unknown addrman change record type %u", type));
+        }
+        // Record the entry's current state, which may have changed again since.
+        int nId;
+        if (Find(addr, &nId)) {
+            m_changed.insert(nId);
+        } else {
+            m_deleted.insert(addr);
+        }
+    }
+}
+
+void AddrManImpl::ApplyChanges(DataStream& s_)
+{
+    LOCK(cs);
+    Check();
+
+    ParamsStream s{CAddress::V2_DISK, s_};
+
+    while (!s_.empty()) {
+        uint8_t type;
+        s >> type;
+        if (type == CHANGE_UPSERT) {
+            AddrInfo info;
+            bool in_tried;
+            s >> info >> in_tried;
+            ApplyUpsert_(info, in_tried);
+        } else if (type == CHANGE_ERASE) {
+            CService addr;
+            s >> addr;
+            ApplyErase_(addr);
+        } else {
+            throw std::ios_base::failure(strprintf("Unknown addrman change record type %u", type));
+        }
+    }
+
+    // The applied records are already persisted.
+    m_changed.clear();
+    m_deleted.clear();
+    Check();
+}
+
 AddrMan::AddrMan(const NetGroupManager& netgroupman, bool deterministic, int32_t consistency_check_ratio)
     : m_impl(std::make_unique<AddrManImpl>(netgroupman, deterministic, consistency_check_ratio)) {}
 
@@ -1346,3 +1505,18 @@ std::optional<AddressPosition> AddrMan::FindAddressEntry(const CAddress& addr)
 {
     return m_impl->FindAddressEntry(addr);
 }
+
+size_t AddrMan::WriteChanges(DataStream& s)
+{
+    return m_impl->WriteChanges(s);
+}
+
+void AddrMan::RestoreChanges(DataStream& s)
+{
+    m_impl->RestoreChanges(s);
+}
+
+void AddrMan::ApplyChanges(DataStream& s)
+{
+    m_impl->ApplyChanges(s);
+}
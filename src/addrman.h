@@ -58,7 +58,8 @@ struct AddressPosition {
 /** Stochastic address manager
  *
  * Design goals:
- *  * Keep the address tables in-memory, and asynchronously dump the entire table to peers.dat.
+ *  * Keep the address tables in-memory, and asynchronously persist them to peers.dat, appending changes
+ *    to a journal in between rewrites of the entire table.
  *  * Make sure no (localized) attacker can fill the entire table with his nodes/addresses.
  *
  * To that end:
@@ -208,6 +209,24 @@ public:
      *                       or nullopt if address is not found.
      */
     std::optional<AddressPosition> FindAddressEntry(const CAddress& addr);
+
+    /**
+     * Write records for all entries that were added, changed or deleted since the last call (or since
+     * the addrman was unserialized), and forget about those changes. Replaying the records with
+     * ApplyChanges() on top of the state serialized before them brings it up to date, except that
+     * entries in the new table are only restored to the bucket of their primary source.
+     *
+     * @param[out] s   Stream to append the records to.
+     * @return         The number of records written.
+     */
+    size_t WriteChanges(DataStream& s);
+
+    /** Remember the changes covered by records in s, as written by WriteChanges(), again, so
+     *  the next WriteChanges() includes them. Used when persisting the records failed. */
+    void RestoreChanges(DataStream& s);
+
+    /** Replay all records in s, as written by WriteChanges(). */
+    void ApplyChanges(DataStream& s);
 };
 
 #endif // BITCOIN_ADDRMAN_H
@@ -144,6 +144,12 @@ public:
     std::optional<AddressPosition> FindAddressEntry(const CAddress& addr)
         EXCLUSIVE_LOCKS_REQUIRED(!cs);
 
+    size_t WriteChanges(DataStream& s_) EXCLUSIVE_LOCKS_REQUIRED(!cs);
+
+    void RestoreChanges(DataStream& s_) EXCLUSIVE_LOCKS_REQUIRED(!cs);
+
+    void ApplyChanges(DataStream& s_) EXCLUSIVE_LOCKS_REQUIRED(!cs);
+
     friend class AddrManDeterministic;
 
 private:
@@ -179,6 +185,12 @@ private:
     //! @note Don't increment this. Increment `lowest_compatible` in `Serialize()` instead.
     static constexpr uint8_t INCOMPATIBILITY_BASE = 32;
 
+    //! Record types written by WriteChanges().
+    enum ChangeType : uint8_t {
+        CHANGE_UPSERT = 0, //!< an entry's persisted fields and whether it is in tried
+        CHANGE_ERASE = 1,  //!< an entry was deleted from the new table
+    };
+
     //! last used nId
     int nIdCount GUARDED_BY(cs){0};
 
@@ -225,6 +237,12 @@ private:
     /** Number of entries in addrman per network and new/tried table. */
     std::unordered_map<Network, NewTriedCount> m_network_counts GUARDED_BY(cs);
 
+    //! nIds of entries whose persisted state changed since the last WriteChanges() (memory only)
+    std::unordered_set<int> m_changed GUARDED_BY(cs);
+
+    //! Addresses deleted since the last WriteChanges() (memory only)
+    std::unordered_set<CService, CServiceHash> m_deleted GUARDED_BY(cs);
+
     //! Find an entry.
     AddrInfo* Find(const CService& addr, int* pnId = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
@@ -275,6 +293,12 @@ private:
 
     std::optional<AddressPosition> FindAddressEntry_(const CAddress& addr) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
+    //! Bring an entry in line with a CHANGE_UPSERT record, creating it if needed.
+    void ApplyUpsert_(const AddrInfo& info, bool in_tried) EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+    //! Remove an entry from the new table, following a CHANGE_ERASE record.
+    void ApplyErase_(const CService& addr) EXCLUSIVE_LOCKS_REQUIRED(cs);
+
     size_t Size_(std::optional<Network> net, std::optional<bool> in_new) const EXCLUSIVE_LOCKS_REQUIRED(cs);
 
     //! Consistency check, taking into account m_consistency_check_ratio.
@@ -5,10 +5,12 @@
 #include <bench/bench.h>
 #include <checkqueue.h>
 #include <common/system.h>
+#include <hash.h>
 #include <key.h>
 #include <prevector.h>
 #include <pubkey.h>
 #include <random.h>
+#include <uint256.h>
 
 #include <vector>
 
@@ -64,4 +66,43 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::Bench& bench)
     });
     ECC_Stop();
 }
+
+// This Benchmark tests the CheckQueue when the master adds many tiny batches,
+// similar to blocks made of 1-2 input transactions, which is where contention
+// on the queue's synchronization dominates over the checks themselves.
+static void CCheckQueueSpeedSmallBatches(benchmark::Bench& bench)
+{
+    if (GetNumCores() <= 1) return;
+
+    struct HashJob {
+        uint256 m_data;
+        explicit HashJob(FastRandomContext& insecure_rand) : m_data{insecure_rand.rand256()} {}
+        bool operator()()
+        {
+            // A little bit of work per check, about as cheap as a cached signature lookup.
+            m_data = Hash(m_data);
+            return true;
+        }
+    };
+
+    int worker_threads_num{GetNumCores() - 1};
+    CCheckQueue<HashJob> queue{QUEUE_BATCH_SIZE, worker_threads_num};
+
+    FastRandomContext insecure_rand(true);
+    std::vector<std::vector<HashJob>> vBatches(BATCHES * BATCH_SIZE / 2);
+    for (auto& vChecks : vBatches) {
+        vChecks.reserve(2);
+        for (size_t x = 0; x < 2; ++x)
+            vChecks.emplace_back(insecure_rand);
+    }
+
+    bench.minEpochIterations(10).batch(BATCH_SIZE * BATCHES).unit("job").run([&] {
+        CCheckQueueControl<HashJob> control(&queue);
+        for (auto vChecks : vBatches) {
+            control.Add(std::move(vChecks));
+        }
+        control.Wait();
+    });
+}
 BENCHMARK(CCheckQueueSpeedPrevectorJob, benchmark::PriorityLevel::HIGH);
+BENCHMARK(CCheckQueueSpeedSmallBatches, benchmark::PriorityLevel::HIGH);
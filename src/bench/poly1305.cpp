@@ -23,6 +23,21 @@ static void POLY1305(benchmark::Bench& bench, size_t buffersize)
     });
 }
 
+/** Feed the input one 16-byte block at a time, which bypasses multi-block processing. */
+static void POLY1305_SINGLE_BLOCKS(benchmark::Bench& bench, size_t buffersize)
+{
+    std::vector<std::byte> tag(Poly1305::TAGLEN, {});
+    std::vector<std::byte> key(Poly1305::KEYLEN, {});
+    std::vector<std::byte> in(buffersize, {});
+    bench.batch(in.size()).unit("byte").run([&] {
+        Poly1305 poly1305{key};
+        for (size_t pos = 0; pos < in.size(); pos += POLY1305_BLOCK_SIZE) {
+            poly1305.Update(Span{in}.subspan(pos, POLY1305_BLOCK_SIZE));
+        }
+        poly1305.Finalize(tag);
+    });
+}
+
 static void POLY1305_64BYTES(benchmark::Bench& bench)
 {
     POLY1305(bench, BUFFER_SIZE_TINY);
@@ -38,6 +53,12 @@ static void POLY1305_1MB(benchmark::Bench& bench)
     POLY1305(bench, BUFFER_SIZE_LARGE);
 }
 
+static void POLY1305_1MB_SINGLE_BLOCKS(benchmark::Bench& bench)
+{
+    POLY1305_SINGLE_BLOCKS(bench, BUFFER_SIZE_LARGE);
+}
+
 BENCHMARK(POLY1305_64BYTES, benchmark::PriorityLevel::HIGH);
 BENCHMARK(POLY1305_256BYTES, benchmark::PriorityLevel::HIGH);
 BENCHMARK(POLY1305_1MB, benchmark::PriorityLevel::HIGH);
+BENCHMARK(POLY1305_1MB_SINGLE_BLOCKS, benchmark::PriorityLevel::HIGH);
@@ -0,0 +1,96 @@
+// Copyright (c) 2024 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <common/system.h>
+#include <primitives/transaction.h>
+#include <random.h>
+#include <txrequest.h>
+#include <uint256.h>
+
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <cassert>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+static constexpr int NUM_PEERS{512};
+static constexpr int NUM_TXS{32};
+/** As in net_processing, only used to give the count checks a realistic outcome. */
+static constexpr size_t MAX_PEER_TX_ANNOUNCEMENTS{5000};
+
+/** Every peer announces the same transactions, as on a well-connected relay node. The announcements are
+ *  processed by num_threads threads, each handling a slice of the peers and checking the peer's announcement
+ *  counts first as net_processing does, after which every transaction is requested from one peer and received.
+ *  The threads are started once, outside of the measured runs. */
+static void TxRequestManyPeers(benchmark::Bench& bench, size_t num_shards, int num_threads)
+{
+    FastRandomContext rng{/*fDeterministic=*/true};
+    std::vector<GenTxid> txs;
+    for (int i = 0; i < NUM_TXS; ++i) txs.push_back(GenTxid::Wtxid(rng.rand256()));
+
+    TxRequestTracker tracker{/*deterministic=*/true, num_shards};
+    const std::chrono::microseconds now{1'000'000};
+
+    // Every run, the threads wait for the start, announce, and wait for each other to finish.
+    std::barrier sync{num_threads + 1};
+    std::atomic<bool> stop{false};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&, t] {
+            // Start every thread at a different transaction, as peers relay in different orders.
+            const int offset{t * NUM_TXS / num_threads};
+            while (true) {
+                sync.arrive_and_wait();
+                if (stop) return;
+                for (NodeId peer = t; peer < NUM_PEERS; peer += num_threads) {
+                    for (int i = 0; i < NUM_TXS; ++i) {
+                        if (tracker.Count(peer) + tracker.CountInFlight(peer) >= MAX_PEER_TX_ANNOUNCEMENTS) continue;
+                        tracker.ReceivedInv(peer, txs[(offset + i) % NUM_TXS], /*preferred=*/peer % 8 == 0, now);
+                    }
+                }
+                sync.arrive_and_wait();
+            }
+        });
+    }
+
+    bench.batch(NUM_PEERS * NUM_TXS).unit("announcement").run([&] {
+        sync.arrive_and_wait();
+        sync.arrive_and_wait();
+
+        for (NodeId peer = 0; peer < NUM_PEERS; ++peer) {
+            for (const GenTxid& gtxid : tracker.GetRequestable(peer, now)) {
+                tracker.RequestedTx(peer, gtxid.GetHash(), now + std::chrono::seconds{60});
+                tracker.ReceivedResponse(peer, gtxid.GetHash());
+                tracker.ForgetTxHash(gtxid.GetHash());
+            }
+        }
+        assert(tracker.Size() == 0);
+    });
+
+    stop = true;
+    sync.arrive_and_wait();
+    for (auto& thread : threads) thread.join();
+}
+
+static void TxRequestManyPeersSingleShard(benchmark::Bench& bench)
+{
+    TxRequestManyPeers(bench, /*num_shards=*/1, /*num_threads=*/1);
+}
+
+static void TxRequestManyPeersSharded(benchmark::Bench& bench)
+{
+    TxRequestManyPeers(bench, DEFAULT_TXREQUEST_SHARDS, /*num_threads=*/1);
+}
+
+static void TxRequestManyPeersShardedParallel(benchmark::Bench& bench)
+{
+    TxRequestManyPeers(bench, DEFAULT_TXREQUEST_SHARDS, std::max(GetNumCores(), 2));
+}
+
+BENCHMARK(TxRequestManyPeersSingleShard, benchmark::PriorityLevel::HIGH);
+BENCHMARK(TxRequestManyPeersSharded, benchmark::PriorityLevel::HIGH);
+BENCHMARK(TxRequestManyPeersShardedParallel, benchmark::PriorityLevel::HIGH);
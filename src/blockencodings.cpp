@@ -15,6 +15,7 @@
 #include <txmempool.h>
 #include <validation.h>
 
+#include <algorithm>
 #include <unordered_map>
 
 CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block) :
@@ -47,7 +48,25 @@ uint64_t CBlockHeaderAndShortTxIDs::GetShortID(const uint256& txhash) const {
 
 
 
-ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const std::vector<std::pair<uint256, CTransactionRef>>& extra_txn) {
+CompactBlockMempoolTxs PartiallyDownloadedBlock::FindMempoolTxs(const CBlockHeaderAndShortTxIDs& cmpctblock, const CTxMemPool& pool)
+{
+    // Short IDs are chosen by the peer, so use a sorted vector rather than a hash table.
+    std::vector<uint64_t> shorttxids{cmpctblock.shorttxids};
+    std::sort(shorttxids.begin(), shorttxids.end());
+
+    CompactBlockMempoolTxs ret;
+    LOCK(pool.cs);
+    ret.mempool_sequence = pool.GetSequence();
+    for (size_t i = 0; i < pool.wtxids_randomized.size(); i++) {
+        if (std::binary_search(shorttxids.begin(), shorttxids.end(), cmpctblock.GetShortID(pool.wtxids_randomized[i]))) {
+            ret.txs.push_back(pool.txns_randomized[i]);
+        }
+    }
+    return ret;
+}
+
+ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const std::vector<std::pair<uint256, CTransactionRef>>& extra_txn,
+                                              const CompactBlockMempoolTxs* mempool_txs) {
     if (cmpctblock.header.IsNull() || (cmpctblock.shorttxids.empty() && cmpctblock.prefilledtxn.empty()))
         return READ_STATUS_INVALID;
     if (cmpctblock.shorttxids.size() + cmpctblock.prefilledtxn.size() > MAX_BLOCK_WEIGHT / MIN_SERIALIZABLE_TRANSACTION_WEIGHT)
@@ -105,14 +124,40 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
         return READ_STATUS_FAILED; // Short ID collision
 
     std::vector<bool> have_txn(txn_available.size());
-    {
+    if (mempool_txs) {
+        // Another scan already found the mempool transactions in this block; only those and the
+        // ones added since need to be checked against this announcement's short IDs.
+        std::vector<CTransactionRef> candidates{WITH_LOCK(pool->cs, return pool->GetTxsAddedSince(mempool_txs->mempool_sequence))};
+        candidates.insert(candidates.end(), mempool_txs->txs.begin(), mempool_txs->txs.end());
+        for (const auto& tx : candidates) {
+            uint64_t shortid = cmpctblock.GetShortID(tx->GetWitnessHash());
+            std::unordered_map<uint64_t, uint16_t>::iterator idit = shorttxids.find(shortid);
+            if (idit != shorttxids.end()) {
+                if (!have_txn[idit->second]) {
+                    txn_available[idit->second] = tx;
+                    have_txn[idit->second]  = true;
+                    mempool_count++;
+                } else {
+                    // As below, request the transaction if two different ones match the short
+                    // id. A transaction may be among the candidates twice if it was re-added.
+                    if (txn_available[idit->second] &&
+                            txn_available[idit->second]->GetWitnessHash() != tx->GetWitnessHash()) {
+                        txn_available[idit->second].reset();
+                        mempool_count--;
+                    }
+                }
+            }
+            if (mempool_count == shorttxids.size())
+                break;
+        }
+    } else {
     LOCK(pool->cs);
-    for (const auto& tx : pool->txns_randomized) {
-        uint64_t shortid = cmpctblock.GetShortID(tx->GetWitnessHash());
+    for (size_t i = 0; i < pool->wtxids_randomized.size(); i++) {
+        uint64_t shortid = cmpctblock.GetShortID(pool->wtxids_randomized[i]);
         std::unordered_map<uint64_t, uint16_t>::iterator idit = shorttxids.find(shortid);
         if (idit != shorttxids.end()) {
             if (!have_txn[idit->second]) {
-                txn_available[idit->second] = tx;
+                txn_available[idit->second] = pool->txns_randomized[i];
                 have_txn[idit->second]  = true;
                 mempool_count++;
             } else {
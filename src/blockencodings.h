@@ -127,6 +127,15 @@ public:
     }
 };
 
+/** The mempool transactions that are in a block announced by compact block. The mempool can be
+ *  scanned for these ahead of processing the announcement, which then only needs to check these
+ *  and the transactions added since, rather than the whole mempool. */
+struct CompactBlockMempoolTxs {
+    std::vector<CTransactionRef> txs;
+    //! CTxMemPool::GetSequence() when the mempool was scanned, to find transactions added since
+    uint64_t mempool_sequence{0};
+};
+
 class PartiallyDownloadedBlock {
 protected:
     std::vector<CTransactionRef> txn_available;
@@ -141,8 +150,14 @@ public:
 
     explicit PartiallyDownloadedBlock(CTxMemPool* poolIn) : pool(poolIn) {}
 
+    // Scan the mempool for the transactions matching cmpctblock's short IDs
+    static CompactBlockMempoolTxs FindMempoolTxs(const CBlockHeaderAndShortTxIDs& cmpctblock, const CTxMemPool& pool);
+
     // extra_txn is a list of extra transactions to look at, in <witness hash, reference> form
-    ReadStatus InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const std::vector<std::pair<uint256, CTransactionRef>>& extra_txn);
+    // If mempool_txs is given (from FindMempoolTxs for this announcement, e.g. ahead of time), only
+    // those and the transactions added to the mempool since are looked at, instead of the whole mempool.
+    ReadStatus InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const std::vector<std::pair<uint256, CTransactionRef>>& extra_txn,
+                        const CompactBlockMempoolTxs* mempool_txs = nullptr);
     bool IsTxAvailable(size_t index) const;
     ReadStatus FillBlock(CBlock& block, const std::vector<CTransactionRef>& vtx_missing);
 };
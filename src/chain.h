@@ -407,6 +407,7 @@ public:
         hashPrev = (pprev ? pprev->GetBlockHash() : uint256());
     }
 
+    //! kernel::BlockTreeDB::LoadBlockIndexGuts reads this format without cs_main, keep them in sync.
     SERIALIZE_METHODS(CDiskBlockIndex, obj)
     {
         LOCK(::cs_main);
@@ -10,7 +10,12 @@
 #include <util/threadnames.h>
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <iterator>
+#include <string>
+#include <thread>
 #include <vector>
 
 /**
@@ -22,12 +27,28 @@
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every participant owns a deque of pending verifications, guarded by its
+  * own mutex. The master spreads added checks over all deques in chunks;
+  * participants take work from the back of their own deque and steal from
+  * the front of the others' when it runs dry. Idle participants spin
+  * briefly before parking on a condition variable, so the shared mutex is
+  * only touched when going to sleep or waking others up.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    //! A participant's own pending verifications.
+    struct WorkQueue {
+        Mutex m_mutex;
+        std::deque<T> m_checks GUARDED_BY(m_mutex);
+    };
+
+    //! Number of times an idle participant looks for new work before parking.
+    static constexpr int SPIN_ITERATIONS{64};
+
+    //! Mutex used for parking idle participants
     Mutex m_mutex;
 
     //! Worker threads block on this when out of work
@@ -36,89 +57,104 @@ private:
     //! Master thread blocks on this when out of work
     std::condition_variable m_master_cv;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue GUARDED_BY(m_mutex);
+    //! One deque per participant: index 0 belongs to the master, index n + 1 to worker n.
+    std::vector<WorkQueue> m_queues;
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle GUARDED_BY(m_mutex){0};
+    //! Deque the next chunk of added checks goes to. Only used by the master.
+    size_t m_next_queue{0};
 
-    //! The total number of workers (including the master).
-    int nTotal GUARDED_BY(m_mutex){0};
-
-    //! The temporary evaluation result.
-    bool fAllOk GUARDED_BY(m_mutex){true};
+    //! Number of elements sitting in the deques, not yet taken by a participant.
+    std::atomic<size_t> m_queued{0};
 
     /**
      * Number of verifications that haven't completed yet.
-     * This includes elements that are no longer queued, but still in the
-     * worker's own batches.
+     * This includes elements that are no longer queued, but still in a
+     * participant's own batch.
      */
-    unsigned int nTodo GUARDED_BY(m_mutex){0};
+    std::atomic<size_t> m_todo{0};
+
+    //! The temporary evaluation result.
+    std::atomic<bool> m_all_ok{true};
 
     //! The maximum number of elements to be processed in one batch
     const unsigned int nBatchSize;
 
     std::vector<std::thread> m_worker_threads;
-    bool m_request_stop GUARDED_BY(m_mutex){false};
+    std::atomic<bool> m_request_stop{false};
+
+    /**
+     * Move a batch of checks into vChecks, preferring the back of the
+     * participant's own deque and otherwise stealing from the front of
+     * another one. Returns false if all deques were empty.
+     */
+    bool TakeWork(size_t index, std::vector<T>& vChecks)
+    {
+        for (size_t i = 0; i < m_queues.size(); ++i) {
+            const bool own{i == 0};
+            WorkQueue& queue{m_queues[(index + i) % m_queues.size()]};
+            LOCK(queue.m_mutex);
+            if (queue.m_checks.empty()) continue;
+            // Do not take everything at once, but aim for increasingly smaller
+            // batches so all participants finish approximately simultaneously.
+            const size_t now{std::max<size_t>(1, std::min<size_t>(nBatchSize, queue.m_checks.size() / 2))};
+            if (own) {
+                auto start_it = queue.m_checks.end() - now;
+                vChecks.assign(std::make_move_iterator(start_it), std::make_move_iterator(queue.m_checks.end()));
+                queue.m_checks.erase(start_it, queue.m_checks.end());
+            } else {
+                auto end_it = queue.m_checks.begin() + now;
+                vChecks.assign(std::make_move_iterator(queue.m_checks.begin()), std::make_move_iterator(end_it));
+                queue.m_checks.erase(queue.m_checks.begin(), end_it);
+            }
+            m_queued -= now;
+            return true;
+        }
+        return false;
+    }
 
     /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster) EXCLUSIVE_LOCKS_REQUIRED(!m_mutex)
+    bool Loop(size_t index, bool fMaster) EXCLUSIVE_LOCKS_REQUIRED(!m_mutex)
     {
-        std::condition_variable& cond = fMaster ? m_master_cv : m_worker_cv;
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
         do {
-            {
-                WAIT_LOCK(m_mutex, lock);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        m_master_cv.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty() && !m_request_stop) {
-                    if (fMaster && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
-                }
-                if (m_request_stop) {
-                    return false;
-                }
-
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                auto start_it = queue.end() - nNow;
-                vChecks.assign(std::make_move_iterator(start_it), std::make_move_iterator(queue.end()));
-                queue.erase(start_it, queue.end());
+            if (m_request_stop) {
+                return false;
+            }
+            if (TakeWork(index, vChecks)) {
                 // Check whether we need to do work at all
-                fOk = fAllOk;
+                bool fOk = m_all_ok;
+                // execute work
+                for (T& check : vChecks)
+                    if (fOk)
+                        fOk = check();
+                const size_t nNow{vChecks.size()};
+                vChecks.clear();
+                if (!fOk) m_all_ok = false;
+                if (m_todo.fetch_sub(nNow) == nNow && !fMaster) {
+                    // We processed the last element; inform the master it can exit and return the result
+                    WITH_LOCK(m_mutex, m_master_cv.notify_one());
+                }
+                continue;
+            }
+            if (fMaster && m_todo == 0) {
+                // return the current status, and reset it for new work later
+                return m_all_ok.exchange(true);
+            }
+            // Out of work: spin for a short while, as new checks or the
+            // completion of the last ones are usually imminent.
+            const auto has_work = [&] {
+                return m_queued > 0 || m_request_stop || (fMaster && m_todo == 0);
+            };
+            bool found{false};
+            for (int i = 0; i < SPIN_ITERATIONS && !found; ++i) {
+                std::this_thread::yield();
+                found = has_work();
+            }
+            if (!found) {
+                WAIT_LOCK(m_mutex, lock);
+                (fMaster ? m_master_cv : m_worker_cv).wait(lock, has_work);
             }
-            // execute work
-            for (T& check : vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
         } while (true);
     }
 
@@ -127,14 +163,14 @@ public:
     Mutex m_control_mutex;
 
     //! Create a new check queue
-    explicit CCheckQueue(unsigned int batch_size, int worker_threads_num)
-        : nBatchSize(batch_size)
+    explicit CCheckQueue(unsigned int batch_size, int worker_threads_num, const std::string& thread_name = "scriptch")
+        : m_queues(worker_threads_num + 1), nBatchSize(batch_size)
     {
         m_worker_threads.reserve(worker_threads_num);
         for (int n = 0; n < worker_threads_num; ++n) {
-            m_worker_threads.emplace_back([this, n]() {
-                util::ThreadRename(strprintf("scriptch.%i", n));
-                Loop(false /* worker thread */);
+            m_worker_threads.emplace_back([this, n, thread_name]() {
+                util::ThreadRename(strprintf("%s.%i", thread_name, n));
+                Loop(n + 1, false /* worker thread */);
             });
         }
     }
@@ -149,7 +185,7 @@ public:
     //! Wait until execution finishes, and return whether all evaluations were successful.
     bool Wait() EXCLUSIVE_LOCKS_REQUIRED(!m_mutex)
     {
-        return Loop(true /* master thread */);
+        return Loop(0, true /* master thread */);
     }
 
     //! Add a batch of checks to the queue
@@ -159,12 +195,21 @@ public:
             return;
         }
 
-        {
-            LOCK(m_mutex);
-            queue.insert(queue.end(), std::make_move_iterator(vChecks.begin()), std::make_move_iterator(vChecks.end()));
-            nTodo += vChecks.size();
+        m_todo += vChecks.size();
+        // Spread the checks over the deques in chunks, so that every
+        // participant can start on its own work without stealing.
+        const size_t chunk{std::max<size_t>(1, std::min<size_t>(nBatchSize, vChecks.size() / m_queues.size()))};
+        for (auto it = vChecks.begin(); it != vChecks.end();) {
+            const size_t now{std::min<size_t>(chunk, vChecks.end() - it)};
+            WorkQueue& queue{m_queues[m_next_queue]};
+            m_next_queue = (m_next_queue + 1) % m_queues.size();
+            LOCK(queue.m_mutex);
+            queue.m_checks.insert(queue.m_checks.end(), std::make_move_iterator(it), std::make_move_iterator(it + now));
+            m_queued += now;
+            it += now;
         }
 
+        LOCK(m_mutex);
         if (vChecks.size() == 1) {
             m_worker_cv.notify_one();
         } else {
@@ -174,8 +219,8 @@ public:
 
     ~CCheckQueue()
     {
-        WITH_LOCK(m_mutex, m_request_stop = true);
-        m_worker_cv.notify_all();
+        m_request_stop = true;
+        WITH_LOCK(m_mutex, m_worker_cv.notify_all());
         for (std::thread& t : m_worker_threads) {
             t.join();
         }
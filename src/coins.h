@@ -294,6 +294,13 @@ public:
      */
     void EmplaceCoinInternalDANGER(COutPoint&& outpoint, Coin&& coin);
 
+    /**
+     * Add a coin that was read from the base view outside of this cache (e.g.
+     * by a prefetching thread) as a non-dirty entry. Has no effect if the
+     * coin is spent or if the outpoint already has a cache entry.
+     */
+    void EmplaceCoinFromBase(const COutPoint& outpoint, Coin&& coin);
+
     /**
      * Spend a coin. Pass moveto in order to get the deleted data.
      * If no unspent output exists for the passed outpoint, this call
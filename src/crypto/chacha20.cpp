@@ -5,6 +5,10 @@
 // Based on the public domain implementation 'merged' by D. J. Bernstein
 // See https://cr.yp.to/chacha.html.
 
+#if defined(HAVE_CONFIG_H)
+#include <config/bitcoin-config.h>
+#endif
+
 #include <crypto/common.h>
 #include <crypto/chacha20.h>
 #include <support/cleanse.h>
@@ -14,6 +18,94 @@
 #include <bit>
 #include <string.h>
 
+#if !defined(DISABLE_OPTIMIZED_CHACHA20)
+#include <compat/cpuid.h>
+
+namespace chacha20_sse2
+{
+void Crypt_4way(const uint32_t* input, const unsigned char* in, unsigned char* out, size_t blocks);
+}
+
+namespace chacha20_avx2
+{
+void Crypt_8way(const uint32_t* input, const unsigned char* in, unsigned char* out, size_t blocks);
+}
+#endif // DISABLE_OPTIMIZED_CHACHA20
+
+namespace {
+/** Multi-block implementations (see ChaCha20AutoDetect). They process a multiple of 4 resp. 8 blocks
+ *  starting at the block counter in input, without updating it, and output the keystream if in is nullptr. */
+using CryptMultiFn = void (*)(const uint32_t* input, const unsigned char* in, unsigned char* out, size_t blocks);
+#if !defined(DISABLE_OPTIMIZED_CHACHA20) && defined(__SSE2__)
+CryptMultiFn Crypt_4way = chacha20_sse2::Crypt_4way;
+#else
+CryptMultiFn Crypt_4way = nullptr;
+#endif
+CryptMultiFn Crypt_8way = nullptr;
+
+/** Process as many of the blocks as possible using the multi-block implementations, advancing the block
+ *  counter in input, m (unless nullptr) and c. Returns the number of blocks left. */
+size_t CryptMultiBlock(uint32_t* input, const unsigned char*& m, unsigned char*& c, size_t blocks) noexcept
+{
+    for (const auto& [fn, width] : {std::pair{Crypt_8way, size_t{8}}, std::pair{Crypt_4way, size_t{4}}}) {
+        if (!fn || blocks < width) continue;
+        const size_t now = blocks - blocks % width;
+        fn(input, m, c, now);
+        const uint64_t counter = (input[8] | (uint64_t{input[9]} << 32)) + now;
+        input[8] = uint32_t(counter);
+        input[9] = uint32_t(counter >> 32);
+        if (m) m += now * ChaCha20Aligned::BLOCKLEN;
+        c += now * ChaCha20Aligned::BLOCKLEN;
+        blocks -= now;
+    }
+    return blocks;
+}
+
+#if !defined(DISABLE_OPTIMIZED_CHACHA20) && defined(HAVE_GETCPUID)
+/** Check whether the OS has enabled AVX registers. */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+} // namespace
+
+std::string ChaCha20AutoDetect(chacha20_implementation::UseImplementation use_implementation)
+{
+    std::string ret = "standard";
+    Crypt_4way = nullptr;
+    Crypt_8way = nullptr;
+
+#if !defined(DISABLE_OPTIMIZED_CHACHA20)
+#if defined(__SSE2__)
+    if (use_implementation & chacha20_implementation::USE_SSE2) {
+        Crypt_4way = chacha20_sse2::Crypt_4way;
+        ret = "sse2(4way)";
+    }
+#endif
+
+#if defined(HAVE_GETCPUID) && defined(ENABLE_AVX2)
+    if (use_implementation & chacha20_implementation::USE_AVX2) {
+        uint32_t eax, ebx, ecx, edx;
+        GetCPUID(1, 0, eax, ebx, ecx, edx);
+        const bool have_xsave = (ecx >> 27) & 1;
+        const bool have_avx = (ecx >> 28) & 1;
+        if (have_xsave && have_avx && AVXEnabled()) {
+            GetCPUID(7, 0, eax, ebx, ecx, edx);
+            if ((ebx >> 5) & 1) {
+                Crypt_8way = chacha20_avx2::Crypt_8way;
+                ret += Crypt_4way ? ",avx2(8way)" : "avx2(8way)";
+            }
+        }
+    }
+#endif
+#endif // DISABLE_OPTIMIZED_CHACHA20
+
+    return ret;
+}
+
 #define QUARTERROUND(a,b,c,d) \
   a += b; d = std::rotl(d ^ a, 16); \
   c += d; b = std::rotl(b ^ c, 12); \
@@ -66,6 +158,8 @@ inline void ChaCha20Aligned::Keystream(Span<std::byte> output) noexcept
     uint32_t x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, x10, x11, x12, x13, x14, x15;
     uint32_t j4, j5, j6, j7, j8, j9, j10, j11, j12, j13, j14, j15;
 
+    const unsigned char* m = nullptr;
+    blocks = CryptMultiBlock(input, m, c, blocks);
     if (!blocks) return;
 
     j4 = input[0];
@@ -169,6 +263,7 @@ inline void ChaCha20Aligned::Crypt(Span<const std::byte> in_bytes, Span<std::byt
     uint32_t x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, x10, x11, x12, x13, x14, x15;
     uint32_t j4, j5, j6, j7, j8, j9, j10, j11, j12, j13, j14, j15;
 
+    blocks = CryptMultiBlock(input, m, c, blocks);
     if (!blocks) return;
 
     j4 = input[0];
@@ -11,6 +11,7 @@
 #include <cstddef>
 #include <cstdlib>
 #include <stdint.h>
+#include <string>
 #include <utility>
 
 // classes for ChaCha20 256-bit stream cipher developed by Daniel J. Bernstein
@@ -21,6 +22,21 @@
 // the first 32-bit part of the nonce is automatically incremented, making it
 // conceptually compatible with variants that use a 64/64 split instead.
 
+namespace chacha20_implementation {
+enum UseImplementation : uint8_t {
+    STANDARD = 0,
+    USE_SSE2 = 1 << 0,
+    USE_AVX2 = 1 << 1,
+    USE_ALL = USE_SSE2 | USE_AVX2,
+};
+}
+
+/** Autodetect the best available multi-block ChaCha20 implementation.
+ *  Returns the name of the implementation. Until this is called, the SSE2
+ *  implementation is used where the compiler targets it.
+ */
+std::string ChaCha20AutoDetect(chacha20_implementation::UseImplementation use_implementation = chacha20_implementation::USE_ALL);
+
 /** ChaCha20 cipher that only operates on multiples of 64 bytes. */
 class ChaCha20Aligned
 {
@@ -0,0 +1,117 @@
+// Copyright (c) 2024 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// 8-way parallel ChaCha20 using AVX2, with the same layout as the SSE2 version: each vector
+// holds the same state word of 8 consecutive blocks.
+
+#ifdef ENABLE_AVX2
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include <attributes.h>
+
+#include <cstddef>
+
+namespace chacha20_avx2 {
+namespace {
+
+__m256i inline K(uint32_t x) { return _mm256_set1_epi32(x); }
+__m256i inline Add(__m256i x, __m256i y) { return _mm256_add_epi32(x, y); }
+__m256i inline Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+template <int N>
+__m256i inline RotL(__m256i x) { return _mm256_or_si256(_mm256_slli_epi32(x, N), _mm256_srli_epi32(x, 32 - N)); }
+/** Rotations by whole bytes are a single shuffle. */
+__m256i inline RotL16(__m256i x) { return _mm256_shuffle_epi8(x, _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13, 2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13)); }
+__m256i inline RotL8(__m256i x) { return _mm256_shuffle_epi8(x, _mm256_setr_epi8(3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14, 3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14)); }
+
+void ALWAYS_INLINE QuarterRound(__m256i& a, __m256i& b, __m256i& c, __m256i& d)
+{
+    a = Add(a, b); d = RotL16(Xor(d, a));
+    c = Add(c, d); b = RotL<12>(Xor(b, c));
+    a = Add(a, b); d = RotL8(Xor(d, a));
+    c = Add(c, d); b = RotL<7>(Xor(b, c));
+}
+
+/** Transpose words 4*group..4*group+3 of 8 blocks and write them to each block's output, XORed with the input if there is one. */
+void ALWAYS_INLINE Write(__m256i a, __m256i b, __m256i c, __m256i d, const unsigned char* in, unsigned char* out, int group)
+{
+    // Unpacking works within 128-bit lanes, so this yields blocks i and i + 4 in the two lanes of blocks[i].
+    const __m256i t0 = _mm256_unpacklo_epi32(a, b), t1 = _mm256_unpackhi_epi32(a, b);
+    const __m256i t2 = _mm256_unpacklo_epi32(c, d), t3 = _mm256_unpackhi_epi32(c, d);
+    const __m256i blocks[4] = {_mm256_unpacklo_epi64(t0, t2), _mm256_unpackhi_epi64(t0, t2), _mm256_unpacklo_epi64(t1, t3), _mm256_unpackhi_epi64(t1, t3)};
+    for (int i = 0; i < 4; ++i) {
+        const size_t offset_lo = i * 64 + group * 16, offset_hi = (i + 4) * 64 + group * 16;
+        __m128i lo = _mm256_castsi256_si128(blocks[i]), hi = _mm256_extracti128_si256(blocks[i], 1);
+        if (in) {
+            lo = _mm_xor_si128(lo, _mm_loadu_si128((const __m128i*)(in + offset_lo)));
+            hi = _mm_xor_si128(hi, _mm_loadu_si128((const __m128i*)(in + offset_hi)));
+        }
+        _mm_storeu_si128((__m128i*)(out + offset_lo), lo);
+        _mm_storeu_si128((__m128i*)(out + offset_hi), hi);
+    }
+}
+
+} // namespace
+
+/** Process blocks (a multiple of 8) starting at the block counter in input, without updating it. in may be nullptr to output the keystream. */
+void Crypt_8way(const uint32_t* input, const unsigned char* in, unsigned char* out, size_t blocks)
+{
+    uint64_t counter = input[8] | (uint64_t{input[9]} << 32);
+    for (; blocks >= 8; blocks -= 8) {
+        alignas(32) uint32_t counter_lo[8], counter_hi[8];
+        for (int i = 0; i < 8; ++i) {
+            counter_lo[i] = uint32_t(counter + i);
+            counter_hi[i] = uint32_t((counter + i) >> 32);
+        }
+        const __m256i j12 = _mm256_load_si256((const __m256i*)counter_lo);
+        const __m256i j13 = _mm256_load_si256((const __m256i*)counter_hi);
+
+        __m256i x0 = K(0x61707865), x1 = K(0x3320646e), x2 = K(0x79622d32), x3 = K(0x6b206574);
+        __m256i x4 = K(input[0]), x5 = K(input[1]), x6 = K(input[2]), x7 = K(input[3]);
+        __m256i x8 = K(input[4]), x9 = K(input[5]), x10 = K(input[6]), x11 = K(input[7]);
+        __m256i x12 = j12, x13 = j13, x14 = K(input[10]), x15 = K(input[11]);
+
+        for (int i = 0; i < 10; ++i) {
+            QuarterRound(x0, x4, x8, x12);
+            QuarterRound(x1, x5, x9, x13);
+            QuarterRound(x2, x6, x10, x14);
+            QuarterRound(x3, x7, x11, x15);
+            QuarterRound(x0, x5, x10, x15);
+            QuarterRound(x1, x6, x11, x12);
+            QuarterRound(x2, x7, x8, x13);
+            QuarterRound(x3, x4, x9, x14);
+        }
+
+        x0 = Add(x0, K(0x61707865));
+        x1 = Add(x1, K(0x3320646e));
+        x2 = Add(x2, K(0x79622d32));
+        x3 = Add(x3, K(0x6b206574));
+        x4 = Add(x4, K(input[0]));
+        x5 = Add(x5, K(input[1]));
+        x6 = Add(x6, K(input[2]));
+        x7 = Add(x7, K(input[3]));
+        x8 = Add(x8, K(input[4]));
+        x9 = Add(x9, K(input[5]));
+        x10 = Add(x10, K(input[6]));
+        x11 = Add(x11, K(input[7]));
+        x12 = Add(x12, j12);
+        x13 = Add(x13, j13);
+        x14 = Add(x14, K(input[10]));
+        x15 = Add(x15, K(input[11]));
+
+        Write(x0, x1, x2, x3, in, out, 0);
+        Write(x4, x5, x6, x7, in, out, 1);
+        Write(x8, x9, x10, x11, in, out, 2);
+        Write(x12, x13, x14, x15, in, out, 3);
+
+        counter += 8;
+        if (in) in += 8 * 64;
+        out += 8 * 64;
+    }
+}
+
+} // namespace chacha20_avx2
+
+#endif
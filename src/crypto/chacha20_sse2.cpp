@@ -0,0 +1,103 @@
+// Copyright (c) 2024 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// 4-way parallel ChaCha20 using SSE2: each vector holds the same state word of 4 consecutive
+// blocks, so the 20 rounds run on 4 blocks at once and the results are transposed on output.
+
+#if defined(__SSE2__)
+
+#include <stdint.h>
+#include <emmintrin.h>
+
+#include <attributes.h>
+
+#include <cstddef>
+
+namespace chacha20_sse2 {
+namespace {
+
+__m128i inline K(uint32_t x) { return _mm_set1_epi32(x); }
+__m128i inline Add(__m128i x, __m128i y) { return _mm_add_epi32(x, y); }
+__m128i inline Xor(__m128i x, __m128i y) { return _mm_xor_si128(x, y); }
+template <int N>
+__m128i inline RotL(__m128i x) { return _mm_or_si128(_mm_slli_epi32(x, N), _mm_srli_epi32(x, 32 - N)); }
+
+void ALWAYS_INLINE QuarterRound(__m128i& a, __m128i& b, __m128i& c, __m128i& d)
+{
+    a = Add(a, b); d = RotL<16>(Xor(d, a));
+    c = Add(c, d); b = RotL<12>(Xor(b, c));
+    a = Add(a, b); d = RotL<8>(Xor(d, a));
+    c = Add(c, d); b = RotL<7>(Xor(b, c));
+}
+
+/** Transpose words 4*group..4*group+3 of 4 blocks and write them to each block's output, XORed with the input if there is one. */
+void ALWAYS_INLINE Write(__m128i a, __m128i b, __m128i c, __m128i d, const unsigned char* in, unsigned char* out, int group)
+{
+    const __m128i t0 = _mm_unpacklo_epi32(a, b), t1 = _mm_unpackhi_epi32(a, b);
+    const __m128i t2 = _mm_unpacklo_epi32(c, d), t3 = _mm_unpackhi_epi32(c, d);
+    __m128i blocks[4] = {_mm_unpacklo_epi64(t0, t2), _mm_unpackhi_epi64(t0, t2), _mm_unpacklo_epi64(t1, t3), _mm_unpackhi_epi64(t1, t3)};
+    for (int i = 0; i < 4; ++i) {
+        const size_t offset = i * 64 + group * 16;
+        if (in) blocks[i] = Xor(blocks[i], _mm_loadu_si128((const __m128i*)(in + offset)));
+        _mm_storeu_si128((__m128i*)(out + offset), blocks[i]);
+    }
+}
+
+} // namespace
+
+/** Process blocks (a multiple of 4) starting at the block counter in input, without updating it. in may be nullptr to output the keystream. */
+void Crypt_4way(const uint32_t* input, const unsigned char* in, unsigned char* out, size_t blocks)
+{
+    uint64_t counter = input[8] | (uint64_t{input[9]} << 32);
+    for (; blocks >= 4; blocks -= 4) {
+        const __m128i j12 = _mm_setr_epi32(uint32_t(counter), uint32_t(counter + 1), uint32_t(counter + 2), uint32_t(counter + 3));
+        const __m128i j13 = _mm_setr_epi32(uint32_t(counter >> 32), uint32_t((counter + 1) >> 32), uint32_t((counter + 2) >> 32), uint32_t((counter + 3) >> 32));
+
+        __m128i x0 = K(0x61707865), x1 = K(0x3320646e), x2 = K(0x79622d32), x3 = K(0x6b206574);
+        __m128i x4 = K(input[0]), x5 = K(input[1]), x6 = K(input[2]), x7 = K(input[3]);
+        __m128i x8 = K(input[4]), x9 = K(input[5]), x10 = K(input[6]), x11 = K(input[7]);
+        __m128i x12 = j12, x13 = j13, x14 = K(input[10]), x15 = K(input[11]);
+
+        for (int i = 0; i < 10; ++i) {
+            QuarterRound(x0, x4, x8, x12);
+            QuarterRound(x1, x5, x9, x13);
+            QuarterRound(x2, x6, x10, x14);
+            QuarterRound(x3, x7, x11, x15);
+            QuarterRound(x0, x5, x10, x15);
+            QuarterRound(x1, x6, x11, x12);
+            QuarterRound(x2, x7, x8, x13);
+            QuarterRound(x3, x4, x9, x14);
+        }
+
+        x0 = Add(x0, K(0x61707865));
+        x1 = Add(x1, K(0x3320646e));
+        x2 = Add(x2, K(0x79622d32));
+        x3 = Add(x3, K(0x6b206574));
+        x4 = Add(x4, K(input[0]));
+        x5 = Add(x5, K(input[1]));
+        x6 = Add(x6, K(input[2]));
+        x7 = Add(x7, K(input[3]));
+        x8 = Add(x8, K(input[4]));
+        x9 = Add(x9, K(input[5]));
+        x10 = Add(x10, K(input[6]));
+        x11 = Add(x11, K(input[7]));
+        x12 = Add(x12, j12);
+        x13 = Add(x13, j13);
+        x14 = Add(x14, K(input[10]));
+        x15 = Add(x15, K(input[11]));
+
+        Write(x0, x1, x2, x3, in, out, 0);
+        Write(x4, x5, x6, x7, in, out, 1);
+        Write(x8, x9, x10, x11, in, out, 2);
+        Write(x12, x13, x14, x15, in, out, 3);
+
+        counter += 4;
+        if (in) in += 4 * 64;
+        out += 4 * 64;
+    }
+}
+
+} // namespace chacha20_sse2
+
+#endif // __SSE2__
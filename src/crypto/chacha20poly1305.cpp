@@ -14,6 +14,7 @@
 #include <span.h>
 #include <support/cleanse.h>
 
+#include <algorithm>
 #include <assert.h>
 #include <cstddef>
 
@@ -30,6 +31,11 @@ void AEADChaCha20Poly1305::SetKey(Span<const std::byte> key) noexcept
 
 namespace {
 
+const std::byte PADDING[16] = {{}};
+
+/** Encrypt and authenticate this many bytes at a time, so the ciphertext is still in L1 cache when poly1305 reads it. */
+constexpr size_t ENCRYPT_CHUNK_SIZE{4096};
+
 #ifndef HAVE_TIMINGSAFE_BCMP
 #define HAVE_TIMINGSAFE_BCMP
 
@@ -44,11 +50,9 @@ int timingsafe_bcmp(const unsigned char* b1, const unsigned char* b2, size_t n)
 
 #endif
 
-/** Compute poly1305 tag. chacha20 must be set to the right nonce, block 0. Will be at block 1 after. */
-void ComputeTag(ChaCha20& chacha20, Span<const std::byte> aad, Span<const std::byte> cipher, Span<std::byte> tag) noexcept
+/** Start computing a poly1305 tag. chacha20 must be set to the right nonce, block 0. Will be at block 1 after. */
+Poly1305 StartTag(ChaCha20& chacha20, Span<const std::byte> aad) noexcept
 {
-    static const std::byte PADDING[16] = {{}};
-
     // Get block of keystream (use a full 64 byte buffer to avoid the need for chacha20's own buffering).
     std::byte first_block[ChaCha20Aligned::BLOCKLEN];
     chacha20.Keystream(first_block);
@@ -56,37 +60,59 @@ void ComputeTag(ChaCha20& chacha20, Span<const std::byte> aad, Span<const std::b
     // Use the first 32 bytes of the first keystream block as poly1305 key.
     Poly1305 poly1305{Span{first_block}.first(Poly1305::KEYLEN)};
 
-    // Compute tag:
-    // - Process the padded AAD with Poly1305.
+    // Process the padded AAD with Poly1305.
     const unsigned aad_padding_length = (16 - (aad.size() % 16)) % 16;
     poly1305.Update(aad).Update(Span{PADDING}.first(aad_padding_length));
-    // - Process the padded ciphertext with Poly1305.
-    const unsigned cipher_padding_length = (16 - (cipher.size() % 16)) % 16;
-    poly1305.Update(cipher).Update(Span{PADDING}.first(cipher_padding_length));
+    return poly1305;
+}
+
+/** Finish a poly1305 tag, after the ciphertext has been processed. */
+void FinishTag(Poly1305& poly1305, size_t aad_size, size_t cipher_size, Span<std::byte> tag) noexcept
+{
+    // - Pad the ciphertext.
+    const unsigned cipher_padding_length = (16 - (cipher_size % 16)) % 16;
+    poly1305.Update(Span{PADDING}.first(cipher_padding_length));
     // - Process the AAD and plaintext length with Poly1305.
     std::byte length_desc[Poly1305::TAGLEN];
-    WriteLE64(UCharCast(length_desc), aad.size());
-    WriteLE64(UCharCast(length_desc + 8), cipher.size());
+    WriteLE64(UCharCast(length_desc), aad_size);
+    WriteLE64(UCharCast(length_desc + 8), cipher_size);
     poly1305.Update(length_desc);
 
     // Output tag.
     poly1305.Finalize(tag);
 }
 
+/** Compute poly1305 tag. chacha20 must be set to the right nonce, block 0. Will be at block 1 after. */
+void ComputeTag(ChaCha20& chacha20, Span<const std::byte> aad, Span<const std::byte> cipher, Span<std::byte> tag) noexcept
+{
+    Poly1305 poly1305{StartTag(chacha20, aad)};
+    poly1305.Update(cipher);
+    FinishTag(poly1305, aad.size(), cipher.size(), tag);
+}
+
 } // namespace
 
 void AEADChaCha20Poly1305::Encrypt(Span<const std::byte> plain1, Span<const std::byte> plain2, Span<const std::byte> aad, Nonce96 nonce, Span<std::byte> cipher) noexcept
 {
     assert(cipher.size() == plain1.size() + plain2.size() + EXPANSION);
 
-    // Encrypt using ChaCha20 (starting at block 1).
-    m_chacha20.Seek(nonce, 1);
-    m_chacha20.Crypt(plain1, cipher.first(plain1.size()));
-    m_chacha20.Crypt(plain2, cipher.subspan(plain1.size()).first(plain2.size()));
-
-    // Seek to block 0, and compute tag using key drawn from there.
+    // Draw the poly1305 key from block 0, which leaves the cipher at block 1 for encryption.
     m_chacha20.Seek(nonce, 0);
-    ComputeTag(m_chacha20, aad, cipher.first(cipher.size() - EXPANSION), cipher.last(EXPANSION));
+    Poly1305 poly1305{StartTag(m_chacha20, aad)};
+
+    // Encrypt using ChaCha20 and authenticate the result in a single pass, chunk by chunk, rather
+    // than in two passes over the whole (possibly multi-megabyte) message.
+    Span<std::byte> out{cipher.first(cipher.size() - EXPANSION)};
+    for (Span<const std::byte> plain : {plain1, plain2}) {
+        while (!plain.empty()) {
+            const size_t now{std::min(plain.size(), ENCRYPT_CHUNK_SIZE)};
+            m_chacha20.Crypt(plain.first(now), out.first(now));
+            poly1305.Update(out.first(now));
+            plain = plain.subspan(now);
+            out = out.subspan(now);
+        }
+    }
+    FinishTag(poly1305, aad.size(), cipher.size() - EXPANSION, cipher.last(EXPANSION));
 }
 
 bool AEADChaCha20Poly1305::Decrypt(Span<const std::byte> cipher, Span<const std::byte> aad, Nonce96 nonce, Span<std::byte> plain1, Span<std::byte> plain2) noexcept
@@ -35,6 +35,103 @@ void poly1305_init(poly1305_context *st, const unsigned char key[32]) noexcept {
 
     st->leftover = 0;
     st->final = 0;
+    st->have_r_pow = 0;
+}
+
+/* out = a * b (partially reduced mod 2^130 - 5, like h in poly1305_blocks). */
+static void poly1305_mul(uint32_t out[5], const uint32_t a[5], const uint32_t b[5]) noexcept {
+    const uint32_t s1 = b[1] * 5, s2 = b[2] * 5, s3 = b[3] * 5, s4 = b[4] * 5;
+    uint64_t d0,d1,d2,d3,d4;
+    uint32_t c;
+
+    d0 = ((uint64_t)a[0] * b[0]) + ((uint64_t)a[1] * s4) + ((uint64_t)a[2] * s3) + ((uint64_t)a[3] * s2) + ((uint64_t)a[4] * s1);
+    d1 = ((uint64_t)a[0] * b[1]) + ((uint64_t)a[1] * b[0]) + ((uint64_t)a[2] * s4) + ((uint64_t)a[3] * s3) + ((uint64_t)a[4] * s2);
+    d2 = ((uint64_t)a[0] * b[2]) + ((uint64_t)a[1] * b[1]) + ((uint64_t)a[2] * b[0]) + ((uint64_t)a[3] * s4) + ((uint64_t)a[4] * s3);
+    d3 = ((uint64_t)a[0] * b[3]) + ((uint64_t)a[1] * b[2]) + ((uint64_t)a[2] * b[1]) + ((uint64_t)a[3] * b[0]) + ((uint64_t)a[4] * s4);
+    d4 = ((uint64_t)a[0] * b[4]) + ((uint64_t)a[1] * b[3]) + ((uint64_t)a[2] * b[2]) + ((uint64_t)a[3] * b[1]) + ((uint64_t)a[4] * b[0]);
+
+                  c = (uint32_t)(d0 >> 26); out[0] = (uint32_t)d0 & 0x3ffffff;
+    d1 += c;      c = (uint32_t)(d1 >> 26); out[1] = (uint32_t)d1 & 0x3ffffff;
+    d2 += c;      c = (uint32_t)(d2 >> 26); out[2] = (uint32_t)d2 & 0x3ffffff;
+    d3 += c;      c = (uint32_t)(d3 >> 26); out[3] = (uint32_t)d3 & 0x3ffffff;
+    d4 += c;      c = (uint32_t)(d4 >> 26); out[4] = (uint32_t)d4 & 0x3ffffff;
+    out[0] += c * 5; c = (out[0] >> 26); out[0] = out[0] & 0x3ffffff;
+    out[1] += c;
+}
+
+/* Process 4 blocks at a time: h = (h + m[0]) * r^4 + m[1] * r^3 + m[2] * r^2 + m[3] * r.
+ * The four products are independent of each other (and of the previous iteration's
+ * reduction, except for the first), so they can be computed in parallel and share a
+ * single reduction. The sums stay below 2^62, so the accumulators cannot overflow. */
+static void poly1305_blocks_4way(poly1305_context *st, const unsigned char *m, size_t bytes) noexcept {
+    const uint32_t hibit = 1UL << 24; /* 1 << 128 */
+    uint32_t r[4][5], s[4][5];
+    uint32_t h0,h1,h2,h3,h4;
+    uint64_t c;
+
+    if (!st->have_r_pow) {
+        poly1305_mul(st->r_pow[0], st->r, st->r);
+        poly1305_mul(st->r_pow[1], st->r_pow[0], st->r);
+        poly1305_mul(st->r_pow[2], st->r_pow[1], st->r);
+        st->have_r_pow = 1;
+    }
+    for (int j = 0; j < 5; ++j) {
+        r[0][j] = st->r_pow[2][j];
+        r[1][j] = st->r_pow[1][j];
+        r[2][j] = st->r_pow[0][j];
+        r[3][j] = st->r[j];
+    }
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 5; ++j) {
+            s[i][j] = r[i][j] * 5;
+        }
+    }
+
+    h0 = st->h[0];
+    h1 = st->h[1];
+    h2 = st->h[2];
+    h3 = st->h[3];
+    h4 = st->h[4];
+
+    while (bytes >= 4 * POLY1305_BLOCK_SIZE) {
+        uint64_t d[5] = {0, 0, 0, 0, 0};
+        for (int i = 0; i < 4; ++i) {
+            const unsigned char* b = m + i * POLY1305_BLOCK_SIZE;
+            uint32_t t0 = (ReadLE32(b+ 0)     ) & 0x3ffffff;
+            uint32_t t1 = (ReadLE32(b+ 3) >> 2) & 0x3ffffff;
+            uint32_t t2 = (ReadLE32(b+ 6) >> 4) & 0x3ffffff;
+            uint32_t t3 = (ReadLE32(b+ 9) >> 6) & 0x3ffffff;
+            uint32_t t4 = (ReadLE32(b+12) >> 8) | hibit;
+            if (i == 0) {
+                t0 += h0; t1 += h1; t2 += h2; t3 += h3; t4 += h4;
+            }
+            const uint32_t* ri = r[i];
+            const uint32_t* si = s[i];
+            d[0] += ((uint64_t)t0 * ri[0]) + ((uint64_t)t1 * si[4]) + ((uint64_t)t2 * si[3]) + ((uint64_t)t3 * si[2]) + ((uint64_t)t4 * si[1]);
+            d[1] += ((uint64_t)t0 * ri[1]) + ((uint64_t)t1 * ri[0]) + ((uint64_t)t2 * si[4]) + ((uint64_t)t3 * si[3]) + ((uint64_t)t4 * si[2]);
+            d[2] += ((uint64_t)t0 * ri[2]) + ((uint64_t)t1 * ri[1]) + ((uint64_t)t2 * ri[0]) + ((uint64_t)t3 * si[4]) + ((uint64_t)t4 * si[3]);
+            d[3] += ((uint64_t)t0 * ri[3]) + ((uint64_t)t1 * ri[2]) + ((uint64_t)t2 * ri[1]) + ((uint64_t)t3 * ri[0]) + ((uint64_t)t4 * si[4]);
+            d[4] += ((uint64_t)t0 * ri[4]) + ((uint64_t)t1 * ri[3]) + ((uint64_t)t2 * ri[2]) + ((uint64_t)t3 * ri[1]) + ((uint64_t)t4 * ri[0]);
+        }
+
+        /* (partial) h %= p, with 64-bit carries as the sums are wider than in poly1305_blocks */
+                        c = d[0] >> 26; h0 = (uint32_t)d[0] & 0x3ffffff;
+        d[1] += c;      c = d[1] >> 26; h1 = (uint32_t)d[1] & 0x3ffffff;
+        d[2] += c;      c = d[2] >> 26; h2 = (uint32_t)d[2] & 0x3ffffff;
+        d[3] += c;      c = d[3] >> 26; h3 = (uint32_t)d[3] & 0x3ffffff;
+        d[4] += c;      c = d[4] >> 26; h4 = (uint32_t)d[4] & 0x3ffffff;
+        c = h0 + c * 5; h0 = (uint32_t)c & 0x3ffffff; c >>= 26;
+        h1 += (uint32_t)c;
+
+        m += 4 * POLY1305_BLOCK_SIZE;
+        bytes -= 4 * POLY1305_BLOCK_SIZE;
+    }
+
+    st->h[0] = h0;
+    st->h[1] = h1;
+    st->h[2] = h2;
+    st->h[3] = h3;
+    st->h[4] = h4;
 }
 
 static void poly1305_blocks(poly1305_context *st, const unsigned char *m, size_t bytes) noexcept {
@@ -181,6 +278,12 @@ void poly1305_finish(poly1305_context *st, unsigned char mac[16]) noexcept {
     st->pad[1] = 0;
     st->pad[2] = 0;
     st->pad[3] = 0;
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 5; ++j) {
+            st->r_pow[i][j] = 0;
+        }
+    }
+    st->have_r_pow = 0;
 }
 
 void poly1305_update(poly1305_context *st, const unsigned char *m, size_t bytes) noexcept {
@@ -203,7 +306,13 @@ void poly1305_update(poly1305_context *st, const unsigned char *m, size_t bytes)
         st->leftover = 0;
     }
 
-    /* process full blocks */
+    /* process full blocks, 4 at a time while possible */
+    if (bytes >= 4 * POLY1305_BLOCK_SIZE) {
+        size_t want = bytes - bytes % (4 * POLY1305_BLOCK_SIZE);
+        poly1305_blocks_4way(st, m, want);
+        m += want;
+        bytes -= want;
+    }
     if (bytes >= POLY1305_BLOCK_SIZE) {
         size_t want = (bytes & ~(POLY1305_BLOCK_SIZE - 1));
         poly1305_blocks(st, m, want);
@@ -20,6 +20,9 @@ namespace poly1305_donna {
 
 typedef struct {
     uint32_t r[5];
+    /* r^2, r^3 and r^4, for processing 4 blocks at a time; computed on first use */
+    uint32_t r_pow[3][5];
+    unsigned char have_r_pow;
     uint32_t h[5];
     uint32_t pad[4];
     size_t leftover;
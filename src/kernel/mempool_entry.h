@@ -10,16 +10,18 @@
 #include <core_memusage.h>
 #include <policy/policy.h>
 #include <policy/settings.h>
+#include <prevector.h>
 #include <primitives/transaction.h>
 #include <util/epochguard.h>
 #include <util/overflow.h>
 
+#include <algorithm>
 #include <chrono>
 #include <functional>
 #include <memory>
-#include <set>
 #include <stddef.h>
 #include <stdint.h>
+#include <utility>
 
 class CBlockIndex;
 
@@ -66,9 +68,71 @@ class CTxMemPoolEntry
 {
 public:
     typedef std::reference_wrapper<const CTxMemPoolEntry> CTxMemPoolEntryRef;
+
+    /**
+     * Set of in-mempool entries ordered by txid, with the subset of the std::set
+     * interface the mempool uses. The entries are kept in a sorted prevector:
+     * most transactions have only one or two parents and children, which are
+     * then stored inside the entry instead of in separately allocated tree nodes.
+     */
+    class Links
+    {
+    private:
+        prevector<2, CTxMemPoolEntryRef> m_entries;
+
+        prevector<2, CTxMemPoolEntryRef>::iterator LowerBound(const CTxMemPoolEntry& entry)
+        {
+            return std::lower_bound(m_entries.begin(), m_entries.end(), CTxMemPoolEntryRef{entry}, CompareIteratorByHash{});
+        }
+
+    public:
+        typedef CTxMemPoolEntryRef value_type;
+        typedef prevector<2, CTxMemPoolEntryRef>::const_iterator const_iterator;
+        typedef const_iterator iterator;
+
+        Links() = default;
+        Links(const Links&) = default;
+        Links& operator=(const Links& other)
+        {
+            // prevector's assignment operator needs default-constructible elements
+            prevector<2, CTxMemPoolEntryRef> copy{other.m_entries};
+            m_entries.swap(copy);
+            return *this;
+        }
+
+        const_iterator begin() const { return m_entries.begin(); }
+        const_iterator end() const { return m_entries.end(); }
+        const_iterator cbegin() const { return m_entries.begin(); }
+        const_iterator cend() const { return m_entries.end(); }
+        size_t size() const { return m_entries.size(); }
+        bool empty() const { return m_entries.empty(); }
+
+        const_iterator find(const CTxMemPoolEntry& entry) const
+        {
+            auto it{std::lower_bound(begin(), end(), CTxMemPoolEntryRef{entry}, CompareIteratorByHash{})};
+            return it != end() && !CompareIteratorByHash{}(CTxMemPoolEntryRef{entry}, *it) ? it : end();
+        }
+        size_t count(const CTxMemPoolEntry& entry) const { return find(entry) != end(); }
+
+        std::pair<const_iterator, bool> insert(const CTxMemPoolEntry& entry)
+        {
+            auto it{LowerBound(entry)};
+            if (it != m_entries.end() && !CompareIteratorByHash{}(CTxMemPoolEntryRef{entry}, *it)) return {it, false};
+            return {m_entries.insert(it, CTxMemPoolEntryRef{entry}), true};
+        }
+        size_t erase(const CTxMemPoolEntry& entry)
+        {
+            auto it{LowerBound(entry)};
+            if (it == m_entries.end() || CompareIteratorByHash{}(CTxMemPoolEntryRef{entry}, *it)) return 0;
+            m_entries.erase(it);
+            return 1;
+        }
+
+        size_t DynamicMemoryUsage() const { return memusage::DynamicUsage(m_entries); }
+    };
     // two aliases, should the types ever diverge
-    typedef std::set<CTxMemPoolEntryRef, CompareIteratorByHash> Parents;
-    typedef std::set<CTxMemPoolEntryRef, CompareIteratorByHash> Children;
+    typedef Links Parents;
+    typedef Links Children;
 
 private:
     CTxMemPoolEntry(const CTxMemPoolEntry&) = default;
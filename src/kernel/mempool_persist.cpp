@@ -4,9 +4,13 @@
 
 #include <kernel/mempool_persist.h>
 
+#include <checkqueue.h>
 #include <clientversion.h>
+#include <coins.h>
 #include <consensus/amount.h>
+#include <hash.h>
 #include <logging.h>
+#include <policy/policy.h>
 #include <primitives/transaction.h>
 #include <random.h>
 #include <serialize.h>
@@ -24,6 +28,7 @@
 #include <cstdio>
 #include <exception>
 #include <functional>
+#include <limits>
 #include <map>
 #include <memory>
 #include <set>
@@ -36,7 +41,89 @@ using fsbridge::FopenFn;
 namespace kernel {
 
 static const uint64_t MEMPOOL_DUMP_VERSION_NO_XOR_KEY{1};
-static const uint64_t MEMPOOL_DUMP_VERSION{2};
+static const uint64_t MEMPOOL_DUMP_VERSION_UNCHUNKED{2};
+static const uint64_t MEMPOOL_DUMP_VERSION{3};
+
+/** Maximum number of transactions in one chunk of a version 3 dump */
+static constexpr uint32_t MEMPOOL_DUMP_CHUNK_TXS{1000};
+/** A chunk of a version 3 dump is closed once its serialized size exceeds this */
+static constexpr size_t MEMPOOL_DUMP_CHUNK_BYTES{4 << 20};
+/** Number of loaded transactions whose scripts are checked ahead of submission under one cs_main hold */
+static constexpr size_t PREVALIDATE_SLICE_TXS{100};
+
+namespace {
+/** A transaction read from disk, waiting to be submitted to the mempool. */
+struct LoadedTx {
+    CTransactionRef tx;
+    int64_t time;
+    int64_t fee_delta;
+
+    SERIALIZE_METHODS(LoadedTx, obj) { READWRITE(TX_WITH_WITNESS(obj.tx), obj.time, obj.fee_delta); }
+};
+} // namespace
+
+/**
+ * Check the scripts of a batch of loaded transactions on the script check threads, storing
+ * the valid signatures in the signature cache. AcceptToMemoryPool finds them there, which
+ * leaves it little more than the policy checks to do serially under cs_main. This decides
+ * nothing: transactions whose inputs cannot be found, or not after min_time (which are not
+ * going to be submitted), are skipped, and a failing check only ends the warm-up early.
+ *
+ * Like block validation and mempool acceptance, this only controls the script check queue
+ * while holding cs_main, so none of them ever waits for another to release the queue. It
+ * does so for PREVALIDATE_SLICE_TXS transactions at a time, so as not to hold up blocks.
+ *
+ * Coins this pulls into the coins cache are added to coins_to_uncache, by transaction, as
+ * AcceptToMemoryPool would otherwise find them cached and keep them even if it rejects it.
+ */
+static void PrevalidateScripts(const std::vector<LoadedTx>& batch, int64_t min_time, const CTxMemPool& pool, Chainstate& active_chainstate,
+                               std::vector<std::vector<COutPoint>>& coins_to_uncache)
+{
+    coins_to_uncache.assign(batch.size(), {});
+    CCheckQueue<CScriptCheck>& queue{active_chainstate.m_chainman.GetCheckQueue()};
+    if (!queue.HasThreads()) return;
+
+    std::map<COutPoint, CTxOut> batch_outputs;
+    std::vector<PrecomputedTransactionData> txdata(batch.size());
+    for (size_t slice_begin = 0; slice_begin < batch.size(); slice_begin += PREVALIDATE_SLICE_TXS) {
+        const size_t slice_end{std::min(batch.size(), slice_begin + PREVALIDATE_SLICE_TXS)};
+        LOCK(cs_main);
+        const CCoinsViewCache& coins{active_chainstate.CoinsTip()};
+        std::vector<CScriptCheck> checks;
+        for (size_t i = slice_begin; i < slice_end; ++i) {
+            if (batch[i].time <= min_time) continue;
+            const CTransaction& tx{*batch[i].tx};
+            std::vector<CTxOut> spent_outputs;
+            spent_outputs.reserve(tx.vin.size());
+            for (const CTxIn& txin : tx.vin) {
+                if (auto it{batch_outputs.find(txin.prevout)}; it != batch_outputs.end()) {
+                    spent_outputs.push_back(it->second);
+                } else if (const CTransactionRef parent{pool.get(txin.prevout.hash)}) {
+                    if (txin.prevout.n >= parent->vout.size()) break;
+                    spent_outputs.push_back(parent->vout[txin.prevout.n]);
+                } else {
+                    if (!coins.HaveCoinInCache(txin.prevout)) coins_to_uncache[i].push_back(txin.prevout);
+                    const Coin& coin{coins.AccessCoin(txin.prevout)};
+                    if (coin.IsSpent()) break;
+                    spent_outputs.push_back(coin.out);
+                }
+            }
+            for (uint32_t n = 0; n < tx.vout.size(); ++n) {
+                batch_outputs.emplace(COutPoint{tx.GetHash(), n}, tx.vout[n]);
+            }
+            if (spent_outputs.size() != tx.vin.size()) continue;
+
+            txdata[i].Init(tx, std::vector<CTxOut>{spent_outputs});
+            for (unsigned int n = 0; n < tx.vin.size(); ++n) {
+                checks.emplace_back(spent_outputs[n], tx, n, STANDARD_SCRIPT_VERIFY_FLAGS, /*cacheIn=*/true, &txdata[i]);
+            }
+        }
+
+        CCheckQueueControl<CScriptCheck> control(&queue);
+        control.Add(std::move(checks));
+        if (!control.Wait()) return;
+    }
+}
 
 bool LoadMempool(CTxMemPool& pool, const fs::path& load_path, Chainstate& active_chainstate, ImportMempoolOptions&& opts)
 {
@@ -61,7 +148,7 @@ bool LoadMempool(CTxMemPool& pool, const fs::path& load_path, Chainstate& active
         std::vector<std::byte> xor_key;
         if (version == MEMPOOL_DUMP_VERSION_NO_XOR_KEY) {
             // Leave XOR-key empty
-        } else if (version == MEMPOOL_DUMP_VERSION) {
+        } else if (version == MEMPOOL_DUMP_VERSION_UNCHUNKED || version == MEMPOOL_DUMP_VERSION) {
             file >> xor_key;
         } else {
             return false;
@@ -72,6 +159,10 @@ bool LoadMempool(CTxMemPool& pool, const fs::path& load_path, Chainstate& active
         uint64_t txns_tried = 0;
         LogInfo("Loading %u mempool transactions from disk...\n", total_txns_to_load);
         int next_tenth_to_report = 0;
+        std::vector<LoadedTx> batch;
+        // Transactions not after this time are expired, and not submitted.
+        const int64_t min_time{opts.use_current_time ? std::numeric_limits<int64_t>::min() :
+                                                       TicksSinceEpoch<std::chrono::seconds>(now - pool.m_expiry)};
         while (txns_tried < total_txns_to_load) {
             const int percentage_done(100.0 * txns_tried / total_txns_to_load);
             if (next_tenth_to_report < percentage_done / 10) {
@@ -79,44 +170,75 @@ bool LoadMempool(CTxMemPool& pool, const fs::path& load_path, Chainstate& active
                         percentage_done, txns_tried, total_txns_to_load - txns_tried);
                 next_tenth_to_report = percentage_done / 10;
             }
-            ++txns_tried;
 
-            CTransactionRef tx;
-            int64_t nTime;
-            int64_t nFeeDelta;
-            file >> TX_WITH_WITNESS(tx);
-            file >> nTime;
-            file >> nFeeDelta;
-
-            if (opts.use_current_time) {
-                nTime = TicksSinceEpoch<std::chrono::seconds>(now);
+            // Read the next batch: a whole chunk, or the same number of transactions from an
+            // older, unchunked file.
+            batch.clear();
+            if (version == MEMPOOL_DUMP_VERSION) {
+                uint32_t chunk_txs;
+                std::vector<std::byte> chunk;
+                uint256 checksum;
+                file >> chunk_txs >> chunk >> checksum;
+                if (chunk_txs == 0 || chunk_txs > total_txns_to_load - txns_tried) {
+                    throw std::ios_base::failure("invalid chunk size");
+                }
+                txns_tried += chunk_txs;
+                if (Hash(chunk) != checksum) {
+                    // The framing is intact, so only this chunk is lost.
+                    LogPrintf("Skipping %u mempool transactions from disk with a bad checksum\n", chunk_txs);
+                    failed += chunk_txs;
+                    continue;
+                }
+                DataStream chunk_stream{chunk};
+                batch.resize(chunk_txs);
+                for (LoadedTx& loaded : batch) chunk_stream >> loaded;
+            } else {
+                while (txns_tried < total_txns_to_load && batch.size() < MEMPOOL_DUMP_CHUNK_TXS) {
+                    ++txns_tried;
+                    file >> batch.emplace_back();
+                }
             }
 
-            CAmount amountdelta = nFeeDelta;
-            if (amountdelta && opts.apply_fee_delta_priority) {
-                pool.PrioritiseTransaction(tx->GetHash(), amountdelta);
-            }
-            if (nTime > TicksSinceEpoch<std::chrono::seconds>(now - pool.m_expiry)) {
-                LOCK(cs_main);
-                const auto& accepted = AcceptToMemoryPool(active_chainstate, tx, nTime, /*bypass_limits=*/false, /*test_accept=*/false);
-                if (accepted.m_result_type == MempoolAcceptResult::ResultType::VALID) {
-                    ++count;
-                } else {
-                    // mempool may contain the transaction already, e.g. from
-                    // wallet(s) having loaded it while we were processing
-                    // mempool transactions; consider these as valid, instead of
-                    // failed, but mark them as 'already there'
-                    if (pool.exists(GenTxid::Txid(tx->GetHash()))) {
-                        ++already_there;
+            std::vector<std::vector<COutPoint>> coins_to_uncache;
+            PrevalidateScripts(batch, min_time, pool, active_chainstate, coins_to_uncache);
+
+            for (size_t i = 0; i < batch.size(); ++i) {
+                LoadedTx& loaded{batch[i]};
+                const CTransactionRef& tx{loaded.tx};
+                int64_t nTime{loaded.time};
+                if (opts.use_current_time) {
+                    nTime = TicksSinceEpoch<std::chrono::seconds>(now);
+                }
+
+                CAmount amountdelta = loaded.fee_delta;
+                if (amountdelta && opts.apply_fee_delta_priority) {
+                    pool.PrioritiseTransaction(tx->GetHash(), amountdelta);
+                }
+                if (nTime > TicksSinceEpoch<std::chrono::seconds>(now - pool.m_expiry)) {
+                    LOCK(cs_main);
+                    const auto& accepted = AcceptToMemoryPool(active_chainstate, tx, nTime, /*bypass_limits=*/false, /*test_accept=*/false);
+                    if (accepted.m_result_type == MempoolAcceptResult::ResultType::VALID) {
+                        ++count;
                     } else {
-                        ++failed;
+                        for (const COutPoint& outpoint : coins_to_uncache[i]) {
+                            active_chainstate.CoinsTip().Uncache(outpoint);
+                        }
+                        // mempool may contain the transaction already, e.g. from
+                        // wallet(s) having loaded it while we were processing
+                        // mempool transactions; consider these as valid, instead of
+                        // failed, but mark them as 'already there'
+                        if (pool.exists(GenTxid::Txid(tx->GetHash()))) {
+                            ++already_there;
+                        } else {
+                            ++failed;
+                        }
                     }
+                } else {
+                    ++expired;
                 }
-            } else {
-                ++expired;
+                if (active_chainstate.m_chainman.m_interrupt)
+                    return false;
             }
-            if (active_chainstate.m_chainman.m_interrupt)
-                return false;
         }
         std::map<uint256, CAmount> mapDeltas;
         file >> mapDeltas;
@@ -185,11 +307,32 @@ bool DumpMempool(const CTxMemPool& pool, const fs::path& dump_path, FopenFn mock
         file.SetXor(xor_key);
 
         file << (uint64_t)vinfo.size();
-        for (const auto& i : vinfo) {
-            file << TX_WITH_WITNESS(*(i.tx));
-            file << int64_t{count_seconds(i.m_time)};
-            file << int64_t{i.nFeeDelta};
-            mapDeltas.erase(i.tx->GetHash());
+        if (pool.m_persist_v1_dat) {
+            for (const auto& i : vinfo) {
+                file << TX_WITH_WITNESS(*(i.tx));
+                file << int64_t{count_seconds(i.m_time)};
+                file << int64_t{i.nFeeDelta};
+                mapDeltas.erase(i.tx->GetHash());
+            }
+        } else {
+            // Stream the transactions in checksummed chunks, so that a reader can
+            // validate one chunk while reading the next, and a corrupted chunk does
+            // not take the rest of the file down with it.
+            DataStream chunk;
+            uint32_t chunk_txs{0};
+            const auto write_chunk{[&] {
+                file << chunk_txs;
+                WriteCompactSize(file, chunk.size());
+                file << Span{chunk} << Hash(chunk);
+                chunk.clear();
+                chunk_txs = 0;
+            }};
+            for (const auto& i : vinfo) {
+                chunk << LoadedTx{i.tx, int64_t{count_seconds(i.m_time)}, int64_t{i.nFeeDelta}};
+                mapDeltas.erase(i.tx->GetHash());
+                if (++chunk_txs == MEMPOOL_DUMP_CHUNK_TXS || chunk.size() >= MEMPOOL_DUMP_CHUNK_BYTES) write_chunk();
+            }
+            if (chunk_txs > 0) write_chunk();
         }
 
         file << mapDeltas;
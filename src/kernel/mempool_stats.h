@@ -0,0 +1,133 @@
+// Copyright (c) 2024 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_KERNEL_MEMPOOL_STATS_H
+#define BITCOIN_KERNEL_MEMPOOL_STATS_H
+
+#include <util/time.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace kernel {
+
+/** Mempool operations whose latency is tracked. */
+enum class MempoolPhase {
+    ACCEPT_TRANSACTION, //!< AcceptToMemoryPool, or one transaction of a batch, as a whole
+    ACCEPT_PACKAGE,     //!< ProcessNewPackage as a whole
+    PRE_CHECKS,
+    POLICY_SCRIPTS,
+    CONSENSUS_SCRIPTS,
+    FINALIZE,
+    REMOVE_FOR_BLOCK,
+    TRIM_TO_SIZE,       //!< Must stay last, MEMPOOL_PHASE_COUNT is derived from it
+};
+
+static constexpr size_t MEMPOOL_PHASE_COUNT{static_cast<size_t>(MempoolPhase::TRIM_TO_SIZE) + 1};
+
+constexpr std::string_view MempoolPhaseToString(MempoolPhase phase)
+{
+    switch (phase) {
+    case MempoolPhase::ACCEPT_TRANSACTION: return "accept_transaction";
+    case MempoolPhase::ACCEPT_PACKAGE: return "accept_package";
+    case MempoolPhase::PRE_CHECKS: return "prechecks";
+    case MempoolPhase::POLICY_SCRIPTS: return "policy_scripts";
+    case MempoolPhase::CONSENSUS_SCRIPTS: return "consensus_scripts";
+    case MempoolPhase::FINALIZE: return "finalize";
+    case MempoolPhase::REMOVE_FOR_BLOCK: return "remove_for_block";
+    case MempoolPhase::TRIM_TO_SIZE: return "trim_to_size";
+    } // no default case, so the compiler can warn about missing cases
+    return "";
+}
+
+static_assert([] {
+    for (size_t i = 0; i < MEMPOOL_PHASE_COUNT; ++i) {
+        if (MempoolPhaseToString(static_cast<MempoolPhase>(i)).empty()) return false;
+    }
+    return true;
+}(), "every MempoolPhase below MEMPOOL_PHASE_COUNT must have a name");
+
+/**
+ * Histogram of durations with power-of-two buckets: bucket i counts durations of at
+ * least 2^i microseconds and less than twice that, except that the first bucket also
+ * counts shorter durations and the last one longer durations.
+ *
+ * Updates are relaxed atomic increments, so it can be fed from any thread without
+ * locking. A reader may observe a sample in one counter but not yet in another.
+ */
+class LatencyHistogram
+{
+public:
+    static constexpr size_t NUM_BUCKETS{24};
+
+    void Add(std::chrono::microseconds duration)
+    {
+        const uint64_t us{duration.count() > 0 ? uint64_t(duration.count()) : 0};
+        m_buckets[Bucket(us)].fetch_add(1, std::memory_order_relaxed);
+        m_total_us.fetch_add(us, std::memory_order_relaxed);
+        uint64_t max_us{m_max_us.load(std::memory_order_relaxed)};
+        while (us > max_us && !m_max_us.compare_exchange_weak(max_us, us, std::memory_order_relaxed)) {}
+    }
+
+    static constexpr size_t Bucket(uint64_t us)
+    {
+        return us == 0 ? 0 : std::min<size_t>(std::bit_width(us) - 1, NUM_BUCKETS - 1);
+    }
+
+    /** Smallest duration counted in a bucket, in microseconds. */
+    static constexpr uint64_t BucketMin(size_t bucket) { return bucket == 0 ? 0 : uint64_t{1} << bucket; }
+
+    uint64_t BucketCount(size_t bucket) const { return m_buckets[bucket].load(std::memory_order_relaxed); }
+
+    uint64_t Count() const
+    {
+        uint64_t count{0};
+        for (const auto& bucket : m_buckets) count += bucket.load(std::memory_order_relaxed);
+        return count;
+    }
+
+    uint64_t TotalMicros() const { return m_total_us.load(std::memory_order_relaxed); }
+    uint64_t MaxMicros() const { return m_max_us.load(std::memory_order_relaxed); }
+
+private:
+    std::array<std::atomic<uint64_t>, NUM_BUCKETS> m_buckets{};
+    std::atomic<uint64_t> m_total_us{0};
+    std::atomic<uint64_t> m_max_us{0};
+};
+
+/** One latency histogram per MempoolPhase. */
+class MempoolLatencyStats
+{
+public:
+    LatencyHistogram& operator[](MempoolPhase phase) { return m_histograms[size_t(phase)]; }
+    const LatencyHistogram& operator[](MempoolPhase phase) const { return m_histograms[size_t(phase)]; }
+
+private:
+    std::array<LatencyHistogram, MEMPOOL_PHASE_COUNT> m_histograms;
+};
+
+/** Adds the time between its construction and destruction to a histogram. */
+class ScopedLatencyTimer
+{
+public:
+    explicit ScopedLatencyTimer(LatencyHistogram& histogram) : m_histogram{histogram} {}
+    ~ScopedLatencyTimer() { m_histogram.Add(std::chrono::duration_cast<std::chrono::microseconds>(SteadyClock::now() - m_start)); }
+
+    ScopedLatencyTimer(const ScopedLatencyTimer&) = delete;
+    ScopedLatencyTimer& operator=(const ScopedLatencyTimer&) = delete;
+
+private:
+    LatencyHistogram& m_histogram;
+    const SteadyClock::time_point m_start{SteadyClock::now()};
+};
+
+} // namespace kernel
+
+#endif // BITCOIN_KERNEL_MEMPOOL_STATS_H
@@ -36,6 +36,7 @@
 
 using namespace std;
 using node::BlockAssembler;
+using node::BlockTemplateCache;
 using node::CBlockTemplate;
 using node::UpdateTime;
 
@@ -105,10 +106,22 @@ static CBlock CreateGenesisBlock(uint32_t nTime, uint32_t nNonce, uint32_t nBits
 std::atomic<bool> shouldMine{};
 std::atomic<uint64_t> total_hashes{0};
 
-bool static ScanHash(CBlockHeader *pblock, uint32_t& nNonce, uint256 *phash, ChainstateManager& chainman) {
+uint32_t NonceRangeStart(size_t thread_index, size_t num_threads)
+{
+    return static_cast<uint32_t>((uint64_t{thread_index} << 32) / num_threads);
+}
+
+uint32_t NextNonce(uint32_t nonce, uint32_t nonce_begin, uint32_t nonce_end)
+{
+    ++nonce;
+    return nonce == nonce_end ? nonce_begin : nonce;
+}
+
+/** Try the nonces after nNonce within [nonce_begin, nonce_end), wrapping around at its end. */
+bool static ScanHash(CBlockHeader *pblock, uint32_t& nNonce, uint32_t nonce_begin, uint32_t nonce_end, uint256 *phash, ChainstateManager& chainman) {
     int64_t nStart = GetTime();
     while (shouldMine) {
-        nNonce++;
+        nNonce = NextNonce(nNonce, nonce_begin, nonce_end);
         pblock->nNonce = nNonce;
         //
         //  Need to do the following POW
@@ -182,9 +195,23 @@ void static ShaicoinMiner(const CChainParams& chainparams,
                           const CScript& minerAddress,
                           ChainstateManager& chainman,
                           const CConnman& conman,
-                          const CTxMemPool& mempool) {
+                          BlockTemplateCache& template_cache,
+                          size_t thread_index,
+                          size_t num_threads) {
 
     util::ThreadRename("shaicoin-miner");
+
+    // All threads work on the same template, so give each its own part of the nonce space, and keep
+    // going through it across templates so that a template served again is not scanned twice. Start
+    // at a random point of the part, so that other miners paying to the same address do not overlap.
+    const uint32_t nonce_begin{NonceRangeStart(thread_index, num_threads)};
+    const uint32_t nonce_end{NonceRangeStart(thread_index + 1, num_threads)};
+    uint32_t nNonce = [&]() {
+        std::random_device rd;
+        std::mt19937 gen(rd());
+        std::uniform_int_distribution<uint32_t> dis(0, nonce_end - nonce_begin - 1);
+        return nonce_begin + dis(gen);
+    }();
     try {
         // Throw an error if no script was provided.  This can happen
         // due to some internal error but also if the keypool is empty.
@@ -223,7 +250,8 @@ void static ShaicoinMiner(const CChainParams& chainparams,
                 break;
             }
 
-            std::unique_ptr<CBlockTemplate> pblocktemplate(BlockAssembler{chainman.ActiveChainstate(), &mempool}.CreateNewBlock(minerAddress));
+            // All mining threads share the template, which is only assembled again once the tip or the mempool changed.
+            std::unique_ptr<CBlockTemplate> pblocktemplate(template_cache.GetTemplate(minerAddress));
             if (!pblocktemplate.get()) {
                 shouldMine = false;
                 std::cout << "Error in ShaicoinMiner: Keypool ran out, please call keypoolrefill before restarting the mining thread" << std::endl;
@@ -233,22 +261,15 @@ void static ShaicoinMiner(const CChainParams& chainparams,
             //auto genesis = CreateGenesisBlock(1723206420, 42, 0x1f7fffff, 1, 11 * COIN);
             //CBlock* pblock = &genesis;
             CBlock* pblock = &pblocktemplate->block;
-            pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
             //
             // Search
             //
             arith_uint256 hashTarget = arith_uint256().SetCompact(pblock->nBits);
             uint256 hash;
-            
-            uint32_t nNonce = []() {
-                std::random_device rd;
-                std::mt19937 gen(rd());
-                std::uniform_int_distribution<uint32_t> dis(0, UINT32_MAX);
-                return dis(gen);
-            }();
 
             // Check if something found
-            if (ScanHash(pblock, nNonce, &hash, chainman)) {
+            const bool found{ScanHash(pblock, nNonce, nonce_begin, nonce_end, &hash, chainman)};
+            if (found) {
                 bool needs_to_add = true;
                 // Found a solution
                 {
@@ -334,6 +355,7 @@ void GenerateShaicoins(std::optional<CScript> minerAddress,
                        const CTxMemPool& mempool)
 {
     static std::vector<std::thread> minerThreads;
+    static std::unique_ptr<BlockTemplateCache> template_cache;
 
     bool use_all_cores = true;
 
@@ -347,12 +369,14 @@ void GenerateShaicoins(std::optional<CScript> minerAddress,
             thread.join();
     }
     minerThreads.clear();
+    template_cache.reset();
 
     if(minerAddress.has_value() == false) {
         return;
     }
 
     shouldMine = true;
+    template_cache = std::make_unique<BlockTemplateCache>(chainman.ActiveChainstate(), &mempool);
 
     minerThreads.resize(nThreads + 1);
     for (size_t i = 0; i < nThreads; i++) {
@@ -361,7 +385,9 @@ void GenerateShaicoins(std::optional<CScript> minerAddress,
                                       std::cref(*minerAddress),
                                       std::ref(chainman),
                                       std::cref(conman),
-                                      std::cref(mempool));
+                                      std::ref(*template_cache),
+                                      i,
+                                      nThreads);
     }
 
     minerThreads.emplace_back(DisplayHashRate);
@@ -250,6 +250,14 @@ class HCGraphUtil {
     }
 };
 
+/** Start of the part of the nonce space mined by thread thread_index out of num_threads. Each part
+ *  ends where the next one starts, the last one at 2^32 (which wraps to 0). */
+uint32_t NonceRangeStart(size_t thread_index, size_t num_threads);
+
+/** The nonce after nonce within the part [nonce_begin, nonce_end) of the nonce space, wrapping around
+ *  to nonce_begin at its end. */
+uint32_t NextNonce(uint32_t nonce, uint32_t nonce_begin, uint32_t nonce_end);
+
 /** Run the miner threads */
 void GenerateShaicoins(std::optional<CScript> minerAddress,
                        const CChainParams& chainparams,
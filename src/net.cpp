@@ -123,7 +123,9 @@ size_t CSerializedNetMsg::GetMemoryUsage() const noexcept
     // Don't count the dynamic memory used for the m_type string, by assuming it fits in the
     // "small string" optimization area (which stores data inside the object itself, up to some
     // size; 15 bytes in modern libstdc++).
-    return sizeof(*this) + memusage::DynamicUsage(data);
+    // A shared payload is counted in full for every message referencing it, as this is used
+    // to limit how much is queued for a single peer.
+    return sizeof(*this) + memusage::DynamicUsage(data) + (m_shared_data ? memusage::DynamicUsage(*m_shared_data) : 0);
 }
 
 void CConnman::AddAddrFetch(const std::string& strDest)
@@ -808,13 +810,13 @@ bool V1Transport::SetMessageToSend(CSerializedNetMsg& msg) noexcept
     AssertLockNotHeld(m_send_mutex);
     // Determine whether a new message can be set.
     LOCK(m_send_mutex);
-    if (m_sending_header || m_bytes_sent < m_message_to_send.data.size()) return false;
+    if (m_sending_header || m_bytes_sent < m_message_to_send.Payload().size()) return false;
 
     // create dbl-sha256 checksum
-    uint256 hash = Hash(msg.data);
+    uint256 hash = Hash(msg.Payload());
 
     // create header
-    CMessageHeader hdr(m_magic_bytes, msg.m_type.c_str(), msg.data.size());
+    CMessageHeader hdr(m_magic_bytes, msg.m_type.c_str(), msg.Payload().size());
     memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
 
     // serialize header
@@ -836,11 +838,11 @@ Transport::BytesToSend V1Transport::GetBytesToSend(bool have_next_message) const
         return {Span{m_header_to_send}.subspan(m_bytes_sent),
                 // We have more to send after the header if the message has payload, or if there
                 // is a next message after that.
-                have_next_message || !m_message_to_send.data.empty(),
+                have_next_message || !m_message_to_send.Payload().empty(),
                 m_message_to_send.m_type
                };
     } else {
-        return {Span{m_message_to_send.data}.subspan(m_bytes_sent),
+        return {m_message_to_send.Payload().subspan(m_bytes_sent),
                 // We only have more to send after this message's payload if there is another
                 // message.
                 have_next_message,
@@ -849,18 +851,38 @@ Transport::BytesToSend V1Transport::GetBytesToSend(bool have_next_message) const
     }
 }
 
+Span<const uint8_t> V1Transport::GetFollowingBytesToSend(bool have_next_message, bool& more) const noexcept
+{
+    AssertLockNotHeld(m_send_mutex);
+    LOCK(m_send_mutex);
+    more = have_next_message;
+    // The payload follows the header.
+    if (m_sending_header) return m_message_to_send.Payload();
+    return {};
+}
+
 void V1Transport::MarkBytesSent(size_t bytes_sent) noexcept
 {
     AssertLockNotHeld(m_send_mutex);
     LOCK(m_send_mutex);
-    m_bytes_sent += bytes_sent;
-    if (m_sending_header && m_bytes_sent == m_header_to_send.size()) {
+    if (m_sending_header) {
+        // The header may have been sent together with (part of) the payload.
+        const size_t header_left{m_header_to_send.size() - m_bytes_sent};
+        if (bytes_sent < header_left) {
+            m_bytes_sent += bytes_sent;
+            return;
+        }
         // We're done sending a message's header. Switch to sending its data bytes.
         m_sending_header = false;
         m_bytes_sent = 0;
-    } else if (!m_sending_header && m_bytes_sent == m_message_to_send.data.size()) {
+        bytes_sent -= header_left;
+        if (bytes_sent == 0) return;
+    }
+    m_bytes_sent += bytes_sent;
+    if (m_bytes_sent == m_message_to_send.Payload().size()) {
         // We're done sending a message's data. Wipe the data vector to reduce memory consumption.
         ClearShrink(m_message_to_send.data);
+        m_message_to_send.m_shared_data.reset();
         m_bytes_sent = 0;
     }
 }
@@ -1454,17 +1476,18 @@ bool V2Transport::SetMessageToSend(CSerializedNetMsg& msg) noexcept
     if (!(m_send_state == SendState::READY && m_send_buffer.empty())) return false;
     // Construct contents (encoding message type + payload).
     std::vector<uint8_t> contents;
+    const auto payload{msg.Payload()};
     auto short_message_id = V2_MESSAGE_MAP(msg.m_type);
     if (short_message_id) {
-        contents.resize(1 + msg.data.size());
+        contents.resize(1 + payload.size());
         contents[0] = *short_message_id;
-        std::copy(msg.data.begin(), msg.data.end(), contents.begin() + 1);
+        std::copy(payload.begin(), payload.end(), contents.begin() + 1);
     } else {
         // Initialize with zeroes, and then write the message type string starting at offset 1.
         // This means contents[0] and the unused positions in contents[1..13] remain 0x00.
-        contents.resize(1 + CMessageHeader::COMMAND_SIZE + msg.data.size(), 0);
+        contents.resize(1 + CMessageHeader::COMMAND_SIZE + payload.size(), 0);
         std::copy(msg.m_type.begin(), msg.m_type.end(), contents.data() + 1);
-        std::copy(msg.data.begin(), msg.data.end(), contents.begin() + 1 + CMessageHeader::COMMAND_SIZE);
+        std::copy(payload.begin(), payload.end(), contents.begin() + 1 + CMessageHeader::COMMAND_SIZE);
     }
     // Construct ciphertext in send buffer.
     m_send_buffer.resize(contents.size() + BIP324Cipher::EXPANSION);
@@ -1472,9 +1495,20 @@ bool V2Transport::SetMessageToSend(CSerializedNetMsg& msg) noexcept
     m_send_type = msg.m_type;
     // Release memory
     ClearShrink(msg.data);
+    msg.m_shared_data.reset();
     return true;
 }
 
+Span<const uint8_t> V2Transport::GetFollowingBytesToSend(bool have_next_message, bool& more) const noexcept
+{
+    AssertLockNotHeld(m_send_mutex);
+    LOCK(m_send_mutex);
+    if (m_send_state == SendState::V1) return m_v1_fallback.GetFollowingBytesToSend(have_next_message, more);
+    // Each message is encrypted into the contiguous send buffer.
+    more = have_next_message;
+    return {};
+}
+
 Transport::BytesToSend V2Transport::GetBytesToSend(bool have_next_message) const noexcept
 {
     AssertLockNotHeld(m_send_mutex);
@@ -1580,11 +1614,19 @@ std::pair<size_t, bool> CConnman::SocketSendData(CNode& node) const
                 ++it;
             }
         }
-        const auto& [data, more, msg_type] = node.m_transport->GetBytesToSend(it != node.vSendMsg.end());
+        const bool have_next_message{it != node.vSendMsg.end()};
+        const auto& [data, data_more, msg_type] = node.m_transport->GetBytesToSend(have_next_message);
         // We rely on the 'more' value returned by GetBytesToSend to correctly predict whether more
         // bytes are still to be sent, to correctly set the MSG_MORE flag. As a sanity check,
         // verify that the previously returned 'more' was correct.
         if (expected_more.has_value()) Assume(!data.empty() == *expected_more);
+        // Send the rest of the message along with data in one gathering write, if the transport
+        // has it ready (e.g. a payload after its header), instead of a send call for each.
+        bool more{data_more};
+        Span<const uint8_t> following;
+        if (!data.empty()) following = node.m_transport->GetFollowingBytesToSend(have_next_message, more);
+        if (following.empty()) more = data_more;
+        const size_t total_size{data.size() + following.size()};
         expected_more = more;
         data_left = !data.empty(); // will be overwritten on next loop if all of data gets sent
         int nBytes = 0;
@@ -1602,7 +1644,12 @@ std::pair<size_t, bool> CConnman::SocketSendData(CNode& node) const
                 flags |= MSG_MORE;
             }
 #endif
-            nBytes = node.m_sock->Send(reinterpret_cast<const char*>(data.data()), data.size(), flags);
+            if (following.empty()) {
+                nBytes = node.m_sock->Send(reinterpret_cast<const char*>(data.data()), data.size(), flags);
+            } else {
+                const std::array<Span<const unsigned char>, 2> buffers{data, following};
+                nBytes = node.m_sock->SendMany(buffers, flags);
+            }
         }
         if (nBytes > 0) {
             node.m_last_send = GetTime<std::chrono::seconds>();
@@ -1614,7 +1661,7 @@ std::pair<size_t, bool> CConnman::SocketSendData(CNode& node) const
                 node.AccountForSentBytes(msg_type, nBytes);
             }
             nSentSize += nBytes;
-            if ((size_t)nBytes != data.size()) {
+            if ((size_t)nBytes != total_size) {
                 // could not send full message; stop sending more
                 break;
             }
@@ -1821,6 +1868,7 @@ void CConnman::CreateNodeFromAcceptedSocket(std::unique_ptr<Sock>&& sock,
     {
         LOCK(m_nodes_mutex);
         m_nodes.push_back(pnode);
+        if (m_sock_epoll) m_sock_epoll_new_nodes.push_back(pnode);
     }
 
     // We received a new connection, harvest entropy from the time (and our peer count)
@@ -1894,6 +1942,10 @@ void CConnman::DisconnectNodes()
             {
                 // remove from m_nodes
                 m_nodes.erase(remove(m_nodes.begin(), m_nodes.end(), pnode), m_nodes.end());
+                // Closing the socket below removes it from m_sock_epoll.
+                m_sock_epoll_nodes.erase(pnode->GetId());
+                m_sock_epoll_ready.erase(pnode);
+                m_sock_epoll_new_nodes.erase(std::remove(m_sock_epoll_new_nodes.begin(), m_sock_epoll_new_nodes.end(), pnode), m_sock_epoll_new_nodes.end());
 
                 // Add to reconnection list if appropriate. We don't reconnect right here, because
                 // the creation of a connection is a blocking operation (up to several seconds),
@@ -2030,6 +2082,11 @@ void CConnman::SocketHandler()
 {
     AssertLockNotHeld(m_total_bytes_sent_mutex);
 
+    if (m_sock_epoll) {
+        SocketHandlerEpoll();
+        return;
+    }
+
     Sock::EventsPerSock events_per_sock;
 
     {
@@ -2063,9 +2120,6 @@ void CConnman::SocketHandlerConnected(const std::vector<CNode*>& nodes,
         if (interruptNet)
             return;
 
-        //
-        // Receive
-        //
         bool recvSet = false;
         bool sendSet = false;
         bool errorSet = false;
@@ -2082,71 +2136,94 @@ void CConnman::SocketHandlerConnected(const std::vector<CNode*>& nodes,
             }
         }
 
-        if (sendSet) {
-            // Send data
-            auto [bytes_sent, data_left] = WITH_LOCK(pnode->cs_vSend, return SocketSendData(*pnode));
-            if (bytes_sent) {
-                RecordBytesSent(bytes_sent);
-
-                // If both receiving and (non-optimistic) sending were possible, we first attempt
-                // sending. If that succeeds, but does not fully drain the send queue, do not
-                // attempt to receive. This avoids needlessly queueing data if the remote peer
-                // is slow at receiving data, by means of TCP flow control. We only do this when
-                // sending actually succeeded to make sure progress is always made; otherwise a
-                // deadlock would be possible when both sides have data to send, but neither is
-                // receiving.
-                if (data_left) recvSet = false;
+        SocketHandlerNode(*pnode, recvSet, sendSet, errorSet);
+
+        if (InactivityCheck(*pnode)) pnode->fDisconnect = true;
+    }
+}
+
+bool CConnman::SocketHandlerNode(CNode& node, bool recv_set, bool send_set, bool error_set)
+{
+    AssertLockNotHeld(m_total_bytes_sent_mutex);
+
+    CNode* pnode = &node;
+    bool recv_skipped{false};
+    if (send_set) {
+        // Send data
+        auto [bytes_sent, data_left] = WITH_LOCK(pnode->cs_vSend, return SocketSendData(*pnode));
+        if (bytes_sent) {
+            RecordBytesSent(bytes_sent);
+
+            // If both receiving and (non-optimistic) sending were possible, we first attempt
+            // sending. If that succeeds, but does not fully drain the send queue, do not
+            // attempt to receive. This avoids needlessly queueing data if the remote peer
+            // is slow at receiving data, by means of TCP flow control. We only do this when
+            // sending actually succeeded to make sure progress is always made; otherwise a
+            // deadlock would be possible when both sides have data to send, but neither is
+            // receiving.
+            if (data_left && recv_set) {
+                recv_set = false;
+                recv_skipped = true;
             }
         }
+    }
 
-        if (recvSet || errorSet)
+    //
+    // Receive
+    //
+    if (recv_set || error_set)
+    {
+        // typical socket buffer is 8K-64K
+        uint8_t pchBuf[0x10000];
+        int nBytes = 0;
         {
-            // typical socket buffer is 8K-64K
-            uint8_t pchBuf[0x10000];
-            int nBytes = 0;
-            {
-                LOCK(pnode->m_sock_mutex);
-                if (!pnode->m_sock) {
-                    continue;
-                }
-                nBytes = pnode->m_sock->Recv(pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+            LOCK(pnode->m_sock_mutex);
+            if (!pnode->m_sock) {
+                return false;
             }
-            if (nBytes > 0)
-            {
-                bool notify = false;
-                if (!pnode->ReceiveMsgBytes({pchBuf, (size_t)nBytes}, notify)) {
-                    pnode->CloseSocketDisconnect();
-                }
-                RecordBytesRecv(nBytes);
-                if (notify) {
+            nBytes = pnode->m_sock->Recv(pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+        }
+        if (nBytes > 0)
+        {
+            bool notify = false;
+            if (!pnode->ReceiveMsgBytes({pchBuf, (size_t)nBytes}, notify)) {
+                pnode->CloseSocketDisconnect();
+            }
+            RecordBytesRecv(nBytes);
+            if (notify) {
+                if (m_msg_preprocessors.empty()) {
                     pnode->MarkReceivedMsgsForProcessing();
                     WakeMessageHandler();
+                } else if (pnode->MarkReceivedMsgsForPreProcessing()) {
+                    QueueForPreProcessing(*pnode);
                 }
             }
-            else if (nBytes == 0)
+            return recv_skipped || nBytes == sizeof(pchBuf);
+        }
+        else if (nBytes == 0)
+        {
+            // socket closed gracefully
+            if (!pnode->fDisconnect) {
+                LogPrint(BCLog::NET, "socket closed for peer=%d\n", pnode->GetId());
+            }
+            pnode->CloseSocketDisconnect();
+        }
+        else if (nBytes < 0)
+        {
+            // error
+            int nErr = WSAGetLastError();
+            if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
             {
-                // socket closed gracefully
                 if (!pnode->fDisconnect) {
-                    LogPrint(BCLog::NET, "socket closed for peer=%d\n", pnode->GetId());
+                    LogPrint(BCLog::NET, "socket recv error for peer=%d: %s\n", pnode->GetId(), NetworkErrorString(nErr));
                 }
                 pnode->CloseSocketDisconnect();
             }
-            else if (nBytes < 0)
-            {
-                // error
-                int nErr = WSAGetLastError();
-                if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
-                {
-                    if (!pnode->fDisconnect) {
-                        LogPrint(BCLog::NET, "socket recv error for peer=%d: %s\n", pnode->GetId(), NetworkErrorString(nErr));
-                    }
-                    pnode->CloseSocketDisconnect();
-                }
-            }
+            // An interrupted receive may have left data behind.
+            return recv_skipped || nErr == WSAEINTR;
         }
-
-        if (InactivityCheck(*pnode)) pnode->fDisconnect = true;
     }
+    return recv_skipped;
 }
 
 void CConnman::SocketHandlerListening(const Sock::EventsPerSock& events_per_sock)
@@ -2162,6 +2239,120 @@ void CConnman::SocketHandlerListening(const Sock::EventsPerSock& events_per_sock
     }
 }
 
+/** Flag in the SockEpoll id of listening sockets, which is otherwise the index into vhListenSocket. */
+static constexpr uint64_t EPOLL_LISTEN_SOCKET_FLAG{uint64_t{1} << 63};
+/** How often SocketHandlerEpoll() checks all peers for inactivity. */
+static constexpr auto INACTIVITY_CHECK_INTERVAL{1s};
+
+void CConnman::EpollAddNode(CNode& node)
+{
+    LOCK(node.cs_vSend);
+    LOCK(node.m_sock_mutex);
+    if (!node.m_sock) return;
+    const auto& [to_send, more, _msg_type] = node.m_transport->GetBytesToSend(!node.vSendMsg.empty());
+    const bool want_send{!to_send.empty() || more};
+    if (!m_sock_epoll->Add(*node.m_sock, node.GetId(), Sock::RECV | (want_send ? Sock::SEND : 0), /*edge_triggered=*/true)) {
+        LogPrint(BCLog::NET, "failed to register socket for peer=%d: %s\n", node.GetId(), NetworkErrorString(WSAGetLastError()));
+        node.CloseSocketDisconnect();
+        return;
+    }
+    node.m_sock_epoll_send = want_send;
+    // Data may have arrived before the registration; the first receive will tell.
+    node.m_sock_recv_ready = true;
+    m_sock_epoll_nodes.emplace(node.GetId(), &node);
+    m_sock_epoll_ready.insert(&node);
+}
+
+void CConnman::EpollUpdateSendInterest(CNode& node)
+{
+    AssertLockHeld(node.cs_vSend);
+    const auto& [to_send, more, _msg_type] = node.m_transport->GetBytesToSend(!node.vSendMsg.empty());
+    const bool want_send{!to_send.empty() || more};
+    if (want_send == node.m_sock_epoll_send) return;
+
+    LOCK(node.m_sock_mutex);
+    // The socket may not be registered yet, in which case EpollAddNode() takes care of it.
+    if (node.m_sock && m_sock_epoll->Modify(*node.m_sock, node.GetId(), Sock::RECV | (want_send ? Sock::SEND : 0), /*edge_triggered=*/true)) {
+        node.m_sock_epoll_send = want_send;
+    }
+}
+
+void CConnman::SocketHandlerEpoll()
+{
+    AssertLockNotHeld(m_total_bytes_sent_mutex);
+
+    // Register new connections. Sockets that are already ready at the time of the
+    // registration are reported by the next wait.
+    std::vector<CNode*> new_nodes;
+    WITH_LOCK(m_nodes_mutex, new_nodes.swap(m_sock_epoll_new_nodes));
+    for (CNode* pnode : new_nodes) {
+        EpollAddNode(*pnode);
+    }
+
+    // Don't sleep if some socket still holds data from an earlier readiness report.
+    const bool pending{std::any_of(m_sock_epoll_ready.begin(), m_sock_epoll_ready.end(), [](const CNode* pnode) {
+        return (pnode->m_sock_recv_ready && !pnode->fPauseRecv) || pnode->m_sock_error;
+    })};
+    const auto timeout{pending ? 0ms : std::chrono::milliseconds{SELECT_TIMEOUT_MILLISECONDS}};
+    if (!m_sock_epoll->Wait(timeout, m_sock_epoll_events)) {
+        interruptNet.sleep_for(timeout);
+    }
+
+    std::vector<const ListenSocket*> listen_ready;
+    for (const auto& [id, occurred] : m_sock_epoll_events) {
+        if (id & EPOLL_LISTEN_SOCKET_FLAG) {
+            const size_t index = id & ~EPOLL_LISTEN_SOCKET_FLAG;
+            if (index < vhListenSocket.size() && occurred & Sock::RECV) listen_ready.push_back(&vhListenSocket[index]);
+            continue;
+        }
+        const auto it{m_sock_epoll_nodes.find(static_cast<NodeId>(id))};
+        if (it == m_sock_epoll_nodes.end()) continue;
+        CNode* pnode{it->second};
+        if (occurred & Sock::RECV) pnode->m_sock_recv_ready = true;
+        if (occurred & Sock::SEND) pnode->m_sock_send_ready = true;
+        if (occurred & Sock::ERR) pnode->m_sock_error = true;
+        m_sock_epoll_ready.insert(pnode);
+    }
+
+    // Service the nodes that have pending readiness. Nodes are only deleted by
+    // DisconnectNodes() on this thread, which also drops them from m_sock_epoll_ready.
+    for (auto it{m_sock_epoll_ready.begin()}; it != m_sock_epoll_ready.end();) {
+        if (interruptNet) return;
+
+        CNode* pnode{*it};
+        const bool recv{pnode->m_sock_recv_ready && !pnode->fPauseRecv};
+        const bool send{pnode->m_sock_send_ready};
+        // An error or hangup is noticed by receiving, even while receiving is paused.
+        const bool error{pnode->m_sock_error};
+        if (recv || send || error) {
+            // A send either drains the queue or fills the socket buffer; in both cases
+            // wait for the next SEND event.
+            pnode->m_sock_send_ready = false;
+            const bool recv_left{SocketHandlerNode(*pnode, recv, send, error)};
+            if (recv) pnode->m_sock_recv_ready = recv_left;
+            WITH_LOCK(pnode->cs_vSend, EpollUpdateSendInterest(*pnode));
+        }
+        // Nodes with paused receiving keep their readiness until they are resumed.
+        it = pnode->m_sock_recv_ready || pnode->m_sock_error ? std::next(it) : m_sock_epoll_ready.erase(it);
+    }
+
+    // Sweep for inactive peers on a timer rather than on every wakeup.
+    const auto now{SteadyClock::now()};
+    if (now >= m_next_inactivity_check) {
+        m_next_inactivity_check = now + INACTIVITY_CHECK_INTERVAL;
+        const NodesSnapshot snap{*this, /*shuffle=*/false};
+        for (CNode* pnode : snap.Nodes()) {
+            if (InactivityCheck(*pnode)) pnode->fDisconnect = true;
+        }
+    }
+
+    // Accept new connections from listening sockets.
+    for (const ListenSocket* listen_socket : listen_ready) {
+        if (interruptNet) return;
+        AcceptConnection(*listen_socket);
+    }
+}
+
 void CConnman::ThreadSocketHandler()
 {
     AssertLockNotHeld(m_total_bytes_sent_mutex);
@@ -2888,6 +3079,7 @@ void CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
     {
         LOCK(m_nodes_mutex);
         m_nodes.push_back(pnode);
+        if (m_sock_epoll) m_sock_epoll_new_nodes.push_back(pnode);
 
         // update connection count by network
         if (pnode->IsManualOrFullOutboundConn()) ++m_network_conn_counts[pnode->addr.GetNetwork()];
@@ -2935,6 +3127,44 @@ void CConnman::ThreadMessageHandler()
     }
 }
 
+void CConnman::QueueForPreProcessing(CNode& node)
+{
+    MessagePreProcessor& preprocessor{*m_msg_preprocessors[node.GetId() % m_msg_preprocessors.size()]};
+    {
+        LOCK(preprocessor.m_mutex);
+        preprocessor.m_nodes.push_back(node.AddRef());
+    }
+    preprocessor.m_cond.notify_one();
+}
+
+void CConnman::ThreadMessagePreProcessor(size_t index)
+{
+    MessagePreProcessor& preprocessor{*m_msg_preprocessors[index]};
+    while (!flagInterruptMsgProc) {
+        CNode* pnode;
+        {
+            WAIT_LOCK(preprocessor.m_mutex, lock);
+            preprocessor.m_cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(preprocessor.m_mutex) {
+                return flagInterruptMsgProc || !preprocessor.m_nodes.empty();
+            });
+            if (flagInterruptMsgProc) return;
+            pnode = preprocessor.m_nodes.front();
+            preprocessor.m_nodes.pop_front();
+        }
+
+        // Messages that arrive in the meantime queue the node again, and are
+        // taken by this same thread afterwards, so the order is preserved.
+        std::list<CNetMessage> msgs{pnode->TakeMsgsForPreProcessing()};
+        for (const CNetMessage& msg : msgs) {
+            if (flagInterruptMsgProc) break;
+            m_msgproc->PreProcessMessage(*pnode, msg);
+        }
+        pnode->QueuePreProcessedMsgs(std::move(msgs));
+        pnode->Release();
+        WakeMessageHandler();
+    }
+}
+
 void CConnman::ThreadI2PAcceptIncoming()
 {
     static constexpr auto err_wait_begin = 1s;
@@ -3231,6 +3461,19 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         semAddnode = std::make_unique<CSemaphore>(m_max_addnode);
     }
 
+    // Keep the sockets registered with epoll(7) across socket handler iterations,
+    // where available.
+    m_sock_epoll = std::make_unique<SockEpoll>();
+    for (size_t i = 0; m_sock_epoll->IsValid() && i < vhListenSocket.size(); ++i) {
+        // Level-triggered, as AcceptConnection() only accepts one connection at a time.
+        if (!m_sock_epoll->Add(*vhListenSocket[i].sock, EPOLL_LISTEN_SOCKET_FLAG | i, Sock::RECV, /*edge_triggered=*/false)) {
+            LogPrintf("Unable to register listening socket with epoll, falling back to poll: %s\n", NetworkErrorString(WSAGetLastError()));
+            m_sock_epoll.reset();
+            break;
+        }
+    }
+    if (m_sock_epoll && !m_sock_epoll->IsValid()) m_sock_epoll.reset();
+
     //
     // Start threads
     //
@@ -3243,6 +3486,14 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         fMsgProcWake = false;
     }
 
+    // Pre-process received messages, set up before the socket handler hands any to them
+    for (int i = 0; i < m_num_msg_preprocess_threads; ++i) {
+        m_msg_preprocessors.push_back(std::make_unique<MessagePreProcessor>());
+    }
+    for (size_t i = 0; i < m_msg_preprocessors.size(); ++i) {
+        m_msg_preprocessors[i]->m_thread = std::thread(&util::TraceThread, strprintf("msgpre.%i", i), [this, i] { ThreadMessagePreProcessor(i); });
+    }
+
     // Send and receive from sockets, accept connections
     threadSocketHandler = std::thread(&util::TraceThread, "net", [this] { ThreadSocketHandler(); });
 
@@ -3310,6 +3561,11 @@ void CConnman::Interrupt()
         flagInterruptMsgProc = true;
     }
     condMsgProc.notify_all();
+    for (const auto& preprocessor : m_msg_preprocessors) {
+        // Take the lock so a thread can't miss the flag between checking it and waiting.
+        { LOCK(preprocessor->m_mutex); }
+        preprocessor->m_cond.notify_all();
+    }
 
     interruptNet();
     g_socks5_interrupt();
@@ -3342,6 +3598,16 @@ void CConnman::StopThreads()
         threadDNSAddressSeed.join();
     if (threadSocketHandler.joinable())
         threadSocketHandler.join();
+    // The socket handler hands nodes to the pre-processing threads, so clean them up after it.
+    for (const auto& preprocessor : m_msg_preprocessors) {
+        if (preprocessor->m_thread.joinable()) preprocessor->m_thread.join();
+        LOCK(preprocessor->m_mutex);
+        for (CNode* pnode : preprocessor->m_nodes) {
+            pnode->Release();
+        }
+        preprocessor->m_nodes.clear();
+    }
+    m_msg_preprocessors.clear();
 }
 
 void CConnman::StopNodes()
@@ -3372,6 +3638,10 @@ void CConnman::StopNodes()
         DeleteNode(pnode);
     }
     m_nodes_disconnected.clear();
+    m_sock_epoll_nodes.clear();
+    m_sock_epoll_ready.clear();
+    WITH_LOCK(m_nodes_mutex, m_sock_epoll_new_nodes.clear());
+    m_sock_epoll.reset();
     vhListenSocket.clear();
     semOutbound.reset();
     semAddnode.reset();
@@ -3729,10 +3999,42 @@ void CNode::MarkReceivedMsgsForProcessing()
     fPauseRecv = m_msg_process_queue_size > m_recv_flood_size;
 }
 
-std::optional<std::pair<CNetMessage, bool>> CNode::PollMessage()
+bool CNode::MarkReceivedMsgsForPreProcessing()
+{
+    AssertLockNotHeld(m_msg_process_queue_mutex);
+
+    size_t nSizeAdded = 0;
+    for (const auto& msg : vRecvMsg) {
+        nSizeAdded += msg.m_raw_message_size;
+    }
+
+    LOCK(m_msg_process_queue_mutex);
+    const bool was_empty{m_msg_preprocess_queue.empty()};
+    m_msg_preprocess_queue.splice(m_msg_preprocess_queue.end(), vRecvMsg);
+    m_msg_process_queue_size += nSizeAdded;
+    fPauseRecv = m_msg_process_queue_size > m_recv_flood_size;
+    return was_empty;
+}
+
+std::list<CNetMessage> CNode::TakeMsgsForPreProcessing()
+{
+    std::list<CNetMessage> msgs;
+    LOCK(m_msg_process_queue_mutex);
+    msgs.swap(m_msg_preprocess_queue);
+    return msgs;
+}
+
+void CNode::QueuePreProcessedMsgs(std::list<CNetMessage>&& msgs)
+{
+    LOCK(m_msg_process_queue_mutex);
+    m_msg_process_queue.splice(m_msg_process_queue.end(), msgs);
+}
+
+std::optional<std::pair<CNetMessage, bool>> CNode::PollMessage(std::optional<std::string_view> msg_type)
 {
     LOCK(m_msg_process_queue_mutex);
     if (m_msg_process_queue.empty()) return std::nullopt;
+    if (msg_type && m_msg_process_queue.front().m_type != *msg_type) return std::nullopt;
 
     std::list<CNetMessage> msgs;
     // Just take one message
@@ -3751,10 +4053,10 @@ bool CConnman::NodeFullyConnected(const CNode* pnode)
 void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 {
     AssertLockNotHeld(m_total_bytes_sent_mutex);
-    size_t nMessageSize = msg.data.size();
+    size_t nMessageSize = msg.Payload().size();
     LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n", msg.m_type, nMessageSize, pnode->GetId());
     if (gArgs.GetBoolArg("-capturemessages", false)) {
-        CaptureMessage(pnode->addr, msg.m_type, msg.data, /*is_incoming=*/false);
+        CaptureMessage(pnode->addr, msg.m_type, msg.Payload(), /*is_incoming=*/false);
     }
 
     TRACE6(net, outbound_message,
@@ -3762,8 +4064,8 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
         pnode->m_addr_name.c_str(),
         pnode->ConnectionTypeAsString().c_str(),
         msg.m_type.c_str(),
-        msg.data.size(),
-        msg.data.data()
+        msg.Payload().size(),
+        msg.Payload().data()
     );
 
     size_t nBytesSent = 0;
@@ -3791,6 +4093,8 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
         if (queue_was_empty && more) {
             std::tie(nBytesSent, std::ignore) = SocketSendData(*pnode);
         }
+        // Whatever the optimistic write left over is sent once the socket becomes writable.
+        if (m_sock_epoll) EpollUpdateSendInterest(*pnode);
     }
     if (nBytesSent) RecordBytesSent(nBytesSent);
 }
@@ -32,6 +32,7 @@
 #include <util/sock.h>
 #include <util/threadinterrupt.h>
 
+#include <algorithm>
 #include <atomic>
 #include <condition_variable>
 #include <cstdint>
@@ -42,7 +43,9 @@
 #include <memory>
 #include <optional>
 #include <queue>
+#include <string_view>
 #include <thread>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
@@ -95,6 +98,10 @@ static constexpr bool DEFAULT_FORCEDNSSEED{false};
 static constexpr bool DEFAULT_DNSSEED{true};
 static constexpr bool DEFAULT_FIXEDSEEDS{true};
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
+/** Default number of threads pre-processing received messages (0 disables pre-processing) */
+static constexpr int DEFAULT_MSG_PREPROCESS_THREADS{2};
+/** Maximum number of threads pre-processing received messages */
+static constexpr int MAX_MSG_PREPROCESS_THREADS{16};
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
 
 static constexpr bool DEFAULT_V2_TRANSPORT{true};
@@ -128,11 +135,23 @@ struct CSerializedNetMsg {
     {
         CSerializedNetMsg copy;
         copy.data = data;
+        copy.m_shared_data = m_shared_data;
         copy.m_type = m_type;
         return copy;
     }
 
+    /** The payload, from m_shared_data if set, or from data otherwise. */
+    Span<const unsigned char> Payload() const noexcept
+    {
+        return m_shared_data ? Span<const unsigned char>{*m_shared_data} : Span<const unsigned char>{data};
+    }
+
     std::vector<unsigned char> data;
+    /**
+     * Immutable payload shared by all copies of the message, used instead of data if set.
+     * This avoids copying a large payload (e.g. a block) for each peer it is sent to.
+     */
+    std::shared_ptr<const std::vector<unsigned char>> m_shared_data;
     std::string m_type;
 
     /** Compute total memory usage of this object (own memory + any dynamic memory). */
@@ -351,6 +370,22 @@ public:
      */
     virtual BytesToSend GetBytesToSend(bool have_next_message) const noexcept = 0;
 
+    /** Get the bytes that follow the ones returned by GetBytesToSend() within the same message.
+     *
+     * This allows handing both to the socket in a single gathering write (e.g. a message's
+     * header and its payload), instead of one at a time. MarkBytesSent() accepts up to the
+     * combined size of both.
+     *
+     * @param[in] have_next_message Same as for GetBytesToSend().
+     * @param[out] more Whether there will be more bytes to send after the returned ones.
+     * @return the following bytes, or an empty span if there are none.
+     */
+    virtual Span<const uint8_t> GetFollowingBytesToSend(bool have_next_message, bool& more) const noexcept
+    {
+        more = have_next_message;
+        return {};
+    }
+
     /** Report how many bytes returned by the last GetBytesToSend() have been sent.
      *
      * bytes_sent cannot exceed to_send.size() of the last GetBytesToSend() result.
@@ -445,6 +480,7 @@ public:
 
     bool SetMessageToSend(CSerializedNetMsg& msg) noexcept override EXCLUSIVE_LOCKS_REQUIRED(!m_send_mutex);
     BytesToSend GetBytesToSend(bool have_next_message) const noexcept override EXCLUSIVE_LOCKS_REQUIRED(!m_send_mutex);
+    Span<const uint8_t> GetFollowingBytesToSend(bool have_next_message, bool& more) const noexcept override EXCLUSIVE_LOCKS_REQUIRED(!m_send_mutex);
     void MarkBytesSent(size_t bytes_sent) noexcept override EXCLUSIVE_LOCKS_REQUIRED(!m_send_mutex);
     size_t GetSendMemoryUsage() const noexcept override EXCLUSIVE_LOCKS_REQUIRED(!m_send_mutex);
     bool ShouldReconnectV1() const noexcept override { return false; }
@@ -655,6 +691,7 @@ public:
     // Send side functions.
     bool SetMessageToSend(CSerializedNetMsg& msg) noexcept override EXCLUSIVE_LOCKS_REQUIRED(!m_send_mutex);
     BytesToSend GetBytesToSend(bool have_next_message) const noexcept override EXCLUSIVE_LOCKS_REQUIRED(!m_send_mutex);
+    Span<const uint8_t> GetFollowingBytesToSend(bool have_next_message, bool& more) const noexcept override EXCLUSIVE_LOCKS_REQUIRED(!m_send_mutex);
     void MarkBytesSent(size_t bytes_sent) noexcept override EXCLUSIVE_LOCKS_REQUIRED(!m_send_mutex);
     size_t GetSendMemoryUsage() const noexcept override EXCLUSIVE_LOCKS_REQUIRED(!m_send_mutex);
 
@@ -741,18 +778,47 @@ public:
     std::atomic_bool fPauseRecv{false};
     std::atomic_bool fPauseSend{false};
 
+    /**
+     * Socket readiness reported by CConnman's edge-triggered SockEpoll, remembered until the
+     * socket has been read or written until it would block. Only accessed by the socket
+     * handler thread.
+     */
+    bool m_sock_recv_ready{false};
+    bool m_sock_send_ready{false};
+    /** Whether SockEpoll reported an error or hangup on the socket. Only accessed by the socket handler thread. */
+    bool m_sock_error{false};
+    /** Whether SEND events are currently requested for the socket from CConnman's SockEpoll. */
+    bool m_sock_epoll_send GUARDED_BY(cs_vSend){false};
+
     const ConnectionType m_conn_type;
 
     /** Move all messages from the received queue to the processing queue. */
     void MarkReceivedMsgsForProcessing()
         EXCLUSIVE_LOCKS_REQUIRED(!m_msg_process_queue_mutex);
 
+    /**
+     * Move all messages from the received queue to the pre-processing queue.
+     * Returns whether the pre-processing queue was empty, in which case the node
+     * has to be handed to a pre-processing thread.
+     */
+    bool MarkReceivedMsgsForPreProcessing()
+        EXCLUSIVE_LOCKS_REQUIRED(!m_msg_process_queue_mutex);
+
+    /** Take all messages from the pre-processing queue. */
+    std::list<CNetMessage> TakeMsgsForPreProcessing()
+        EXCLUSIVE_LOCKS_REQUIRED(!m_msg_process_queue_mutex);
+
+    /** Append pre-processed messages to the processing queue. */
+    void QueuePreProcessedMsgs(std::list<CNetMessage>&& msgs)
+        EXCLUSIVE_LOCKS_REQUIRED(!m_msg_process_queue_mutex);
+
     /** Poll the next message from the processing queue of this connection.
      *
-     * Returns std::nullopt if the processing queue is empty, or a pair
+     * Returns std::nullopt if the processing queue is empty (or, if msg_type
+     * is given, if the next message has a different type), or a pair
      * consisting of the message and a bool that indicates if the processing
      * queue has more entries. */
-    std::optional<std::pair<CNetMessage, bool>> PollMessage()
+    std::optional<std::pair<CNetMessage, bool>> PollMessage(std::optional<std::string_view> msg_type = std::nullopt)
         EXCLUSIVE_LOCKS_REQUIRED(!m_msg_process_queue_mutex);
 
     /** Account for the total size of a sent message in the per msg type connection stats. */
@@ -968,6 +1034,9 @@ private:
 
     Mutex m_msg_process_queue_mutex;
     std::list<CNetMessage> m_msg_process_queue GUARDED_BY(m_msg_process_queue_mutex);
+    /** Received messages waiting for NetEventsInterface::PreProcessMessage(), ahead of m_msg_process_queue. */
+    std::list<CNetMessage> m_msg_preprocess_queue GUARDED_BY(m_msg_process_queue_mutex);
+    /** Total size of the messages in m_msg_preprocess_queue and m_msg_process_queue. */
     size_t m_msg_process_queue_size GUARDED_BY(m_msg_process_queue_mutex){0};
 
     // Our address, as reported by the peer
@@ -1020,6 +1089,16 @@ public:
     */
     virtual bool ProcessMessages(CNode* pnode, std::atomic<bool>& interrupt) EXCLUSIVE_LOCKS_REQUIRED(g_msgproc_mutex) = 0;
 
+    /**
+    * Do the expensive checks on a received message that don't depend on any node or peer
+    * state ahead of ProcessMessages(), whose checks can then use the cached results. Called
+    * concurrently for messages from different nodes, without g_msgproc_mutex held.
+    *
+    * @param[in]   node            The node the message was received from.
+    * @param[in]   msg             The message received from the node.
+    */
+    virtual void PreProcessMessage(CNode& node, const CNetMessage& msg) = 0;
+
     /**
     * Send queued protocol messages to a given node.
     *
@@ -1064,6 +1143,7 @@ public:
         std::vector<std::string> m_specified_outgoing;
         std::vector<std::string> m_added_nodes;
         bool m_i2p_accept_incoming;
+        int m_msg_preprocess_threads = 0;
     };
 
     void Init(const Options& connOptions) EXCLUSIVE_LOCKS_REQUIRED(!m_added_nodes_mutex, !m_total_bytes_sent_mutex)
@@ -1098,6 +1178,7 @@ public:
             }
         }
         m_onion_binds = connOptions.onion_binds;
+        m_num_msg_preprocess_threads = std::clamp(connOptions.m_msg_preprocess_threads, 0, MAX_MSG_PREPROCESS_THREADS);
     }
 
     CConnman(uint64_t seed0, uint64_t seed1, AddrMan& addrman, const NetGroupManager& netgroupman,
@@ -1322,6 +1403,36 @@ private:
      */
     void SocketHandlerListening(const Sock::EventsPerSock& events_per_sock);
 
+    /**
+     * Send to and/or receive from a connected node's socket.
+     * @param[in] node Node to service.
+     * @param[in] recv_set Whether the socket is ready for receiving.
+     * @param[in] send_set Whether the socket is ready for sending.
+     * @param[in] error_set Whether an error occurred on the socket.
+     * @return whether the socket may still have data to receive, because receiving was
+     * skipped or filled the whole buffer
+     */
+    bool SocketHandlerNode(CNode& node, bool recv_set, bool send_set, bool error_set)
+        EXCLUSIVE_LOCKS_REQUIRED(!m_total_bytes_sent_mutex, !mutexMsgProc);
+
+    /**
+     * Same as SocketHandler(), but only wait for and service the sockets that became ready
+     * according to m_sock_epoll, which keeps the sockets registered between iterations.
+     */
+    void SocketHandlerEpoll() EXCLUSIVE_LOCKS_REQUIRED(!m_total_bytes_sent_mutex, !mutexMsgProc);
+
+    /** Register a node's socket with m_sock_epoll. */
+    void EpollAddNode(CNode& node) EXCLUSIVE_LOCKS_REQUIRED(!node.cs_vSend);
+
+    /**
+     * Request SEND events for the node's socket from m_sock_epoll only while there is
+     * something to send, so that idle writable sockets don't wake up the socket handler.
+     */
+    void EpollUpdateSendInterest(CNode& node) EXCLUSIVE_LOCKS_REQUIRED(node.cs_vSend);
+
+    /** Hand a node with received messages to the pre-processing thread it is assigned to. */
+    void QueueForPreProcessing(CNode& node);
+    void ThreadMessagePreProcessor(size_t index) EXCLUSIVE_LOCKS_REQUIRED(!mutexMsgProc);
     void ThreadSocketHandler() EXCLUSIVE_LOCKS_REQUIRED(!m_total_bytes_sent_mutex, !mutexMsgProc, !m_nodes_mutex, !m_reconnections_mutex);
     void ThreadDNSAddressSeed() EXCLUSIVE_LOCKS_REQUIRED(!m_addr_fetches_mutex, !m_nodes_mutex);
 
@@ -1417,6 +1528,27 @@ private:
     mutable Mutex m_added_nodes_mutex;
     std::vector<CNode*> m_nodes GUARDED_BY(m_nodes_mutex);
     std::list<CNode*> m_nodes_disconnected;
+
+    /**
+     * Persistent, edge-triggered registration of the listening and connected sockets, used
+     * by the socket handler instead of Sock::WaitMany() where epoll(7) is available. Set up
+     * in Start() and reset in Stop(). Besides the socket handler thread, PushMessage() may
+     * change the requested events of a registered socket.
+     */
+    std::unique_ptr<SockEpoll> m_sock_epoll;
+    /** Nodes whose sockets are registered with m_sock_epoll. Only accessed by the socket handler thread. */
+    std::unordered_map<NodeId, CNode*> m_sock_epoll_nodes;
+    /** Nodes added to m_nodes whose sockets still have to be registered with m_sock_epoll. */
+    std::vector<CNode*> m_sock_epoll_new_nodes GUARDED_BY(m_nodes_mutex);
+    /**
+     * Registered nodes with pending readiness (see CNode::m_sock_recv_ready), so that a wakeup
+     * only visits the nodes it concerns. Only accessed by the socket handler thread.
+     */
+    std::unordered_set<CNode*> m_sock_epoll_ready;
+    /** When SocketHandlerEpoll() next checks all peers for inactivity. Only accessed by the socket handler thread. */
+    SteadyClock::time_point m_next_inactivity_check;
+    /** Events retrieved from m_sock_epoll, kept to reuse the allocation. Only accessed by the socket handler thread. */
+    std::vector<SockEpoll::Occurred> m_sock_epoll_events;
     mutable RecursiveMutex m_nodes_mutex;
     std::atomic<NodeId> nLastNodeId{0};
     unsigned int nPrevNodeCount{0};
@@ -1512,6 +1644,22 @@ private:
     Mutex mutexMsgProc;
     std::atomic<bool> flagInterruptMsgProc{false};
 
+    /**
+     * Threads running NetEventsInterface::PreProcessMessage() on received messages before
+     * they are queued for ThreadMessageHandler(). Each node is assigned to one of them, so
+     * its messages keep their order, while expensive checks (e.g. graph proof of work) of
+     * one peer's messages run concurrently with the processing of other peers' messages.
+     */
+    struct MessagePreProcessor {
+        Mutex m_mutex;
+        std::condition_variable m_cond;
+        /** Nodes with messages to pre-process, each holding a reference. */
+        std::deque<CNode*> m_nodes GUARDED_BY(m_mutex);
+        std::thread m_thread;
+    };
+    int m_num_msg_preprocess_threads{0};
+    std::vector<std::unique_ptr<MessagePreProcessor>> m_msg_preprocessors;
+
     /**
      * This is signaled when network activity should cease.
      * A pointer to it is saved in `m_i2p_sam_session`, so make sure that
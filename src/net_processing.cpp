@@ -47,7 +47,7 @@
 
 #include <algorithm>
 #include <atomic>
-#include <future>
+#include <deque>
 #include <memory>
 #include <optional>
 #include <typeinfo>
@@ -103,8 +103,20 @@ static constexpr auto OVERLOADED_PEER_TX_DELAY{2s};
 static constexpr auto GETDATA_TX_INTERVAL{60s};
 /** Limit to avoid sending big packets. Not used in processing incoming GETDATA for compatibility */
 static const unsigned int MAX_GETDATA_SZ = 10;
-/** Number of blocks that can be requested at any given time from a single peer. */
-static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 8;
+/** Number of blocks that can be requested at any given time from a peer whose download speed we haven't measured yet. */
+static const int DEFAULT_BLOCKS_IN_TRANSIT_PER_PEER = 8;
+/** Bounds on the number of blocks that can be requested at any given time from a single peer. Within these,
+ *  the limit is adapted to the peer's measured download speed (see CNodeState::BlockInFlightLimit). */
+static const int MIN_BLOCKS_IN_TRANSIT_PER_PEER = 2;
+static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 32;
+/** Amount of download time we try to keep queued with each peer when sizing its in-flight limit. */
+static constexpr auto BLOCK_DOWNLOAD_TARGET_TIME{5s};
+/** Weight (out of 8) given to the previous value when updating a peer's block download estimates. */
+static constexpr int BLOCK_DOWNLOAD_EWMA_WEIGHT{6};
+/** A block stalling the download window is requested from another peer instead if that peer is at least
+ *  this many times faster than the staller, and the block has been outstanding for this many times the
+ *  other peer's per-block download time. */
+static constexpr int BLOCK_REREQUEST_SPEEDUP{2};
 /** Default time during which a peer must stall block download progress before being disconnected.
  * the actual timeout is increased temporarily if peers are disconnected for hitting the timeout */
 static constexpr auto BLOCK_STALLING_TIMEOUT_DEFAULT{2s};
@@ -116,6 +128,20 @@ static const unsigned int MAX_HEADERS_RESULTS = 40;
 /** Maximum depth of blocks we're willing to serve as compact blocks to peers
  *  when requested. For older blocks, a regular BLOCK response will be sent. */
 static const int MAX_CMPCTBLOCK_DEPTH = 5;
+/** Number of pre-processed compact block announcements whose mempool transactions are kept
+ *  until the announcement is processed. */
+static constexpr size_t MAX_CMPCTBLOCK_MEMPOOL_TXS{16};
+/** Number of those kept per announcing peer. A peer's further announcements only displace its own. */
+static constexpr size_t MAX_CMPCTBLOCK_MEMPOOL_TXS_PER_PEER{2};
+/** Maximum number of consecutive tx messages from one peer that are submitted to the mempool together */
+static constexpr size_t MAX_TX_BATCH_SIZE{16};
+/** No more tx messages are added to a batch once its transactions spend this many inputs. Script
+ *  checks dominate validation cost, so this bounds what a batch costs the peer's turn in the
+ *  message handler to about what a single transaction with this many inputs (plus the last one
+ *  added) costs, which any peer could already take up with one tx message. */
+static constexpr size_t MAX_TX_BATCH_INPUTS{32};
+/** Compact blocks with older headers are not looked up in the mempool ahead of processing. */
+static constexpr auto CMPCTBLOCK_PREPROCESS_MAX_AGE{2h};
 /** Maximum depth of blocks we're willing to respond to GETBLOCKTXN requests for. */
 static const int MAX_BLOCKTXN_DEPTH = 10;
 /** Size of the "block download window": how far ahead of our current height do we fetch?
@@ -187,6 +213,8 @@ struct QueuedBlock {
     const CBlockIndex* pindex;
     /** Optional, used for CMPCTBLOCK downloads */
     std::unique_ptr<PartiallyDownloadedBlock> partialBlock;
+    /** When the block was requested, used to measure the peer's download speed. */
+    std::chrono::microseconds m_requested_time{0us};
 };
 
 /**
@@ -426,6 +454,15 @@ struct CNodeState {
     std::list<QueuedBlock> vBlocksInFlight;
     //! When the first entry in vBlocksInFlight started downloading. Don't care when vBlocksInFlight is empty.
     std::chrono::microseconds m_downloading_since{0us};
+    //! When we last received a block we requested from this peer, or 0.
+    std::chrono::microseconds m_last_block_received{0us};
+    //! Moving average of the time between a block request and its receipt, or 0 if not measured yet.
+    std::chrono::microseconds m_block_latency{0us};
+    //! Moving average of the time this peer spends sending us each block, not counting time it was idle
+    //! waiting for our requests. 0 if not measured yet.
+    std::chrono::microseconds m_block_service_time{0us};
+    //! Moving average of the rate (bytes per second) at which this peer sends us blocks, or 0 if not measured yet.
+    double m_block_download_rate{0};
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload{false};
     /** Whether this peer wants invs or cmpctblocks (when possible) for block announcements. */
@@ -477,6 +514,14 @@ struct CNodeState {
     const bool m_is_inbound;
 
     CNodeState(bool is_inbound) : m_is_inbound(is_inbound) {}
+
+    //! Number of blocks to keep in flight with this peer: enough to keep it busy for
+    //! BLOCK_DOWNLOAD_TARGET_TIME at its measured speed.
+    int BlockInFlightLimit() const
+    {
+        if (m_block_service_time == 0us) return DEFAULT_BLOCKS_IN_TRANSIT_PER_PEER;
+        return std::clamp<int64_t>(BLOCK_DOWNLOAD_TARGET_TIME / m_block_service_time, MIN_BLOCKS_IN_TRANSIT_PER_PEER, MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+    }
 };
 
 class PeerManagerImpl final : public PeerManager
@@ -503,7 +548,8 @@ public:
     void FinalizeNode(const CNode& node) override EXCLUSIVE_LOCKS_REQUIRED(!m_peer_mutex, !m_headers_presync_mutex);
     bool HasAllDesirableServiceFlags(ServiceFlags services) const override;
     bool ProcessMessages(CNode* pfrom, std::atomic<bool>& interrupt) override
-        EXCLUSIVE_LOCKS_REQUIRED(!m_peer_mutex, !m_recent_confirmed_transactions_mutex, !m_most_recent_block_mutex, !m_headers_presync_mutex, g_msgproc_mutex);
+        EXCLUSIVE_LOCKS_REQUIRED(!m_peer_mutex, !m_recent_confirmed_transactions_mutex, !m_most_recent_block_mutex, !m_headers_presync_mutex, !m_cmpctblock_mempool_txs_mutex, g_msgproc_mutex);
+    void PreProcessMessage(CNode& node, const CNetMessage& msg) override EXCLUSIVE_LOCKS_REQUIRED(!m_peer_mutex, !m_cmpctblock_mempool_txs_mutex);
     bool SendMessages(CNode* pto) override
         EXCLUSIVE_LOCKS_REQUIRED(!m_peer_mutex, !m_recent_confirmed_transactions_mutex, !m_most_recent_block_mutex, g_msgproc_mutex);
 
@@ -524,7 +570,7 @@ public:
     void UnitTestMisbehaving(NodeId peer_id, int howmuch) override EXCLUSIVE_LOCKS_REQUIRED(!m_peer_mutex) { Misbehaving(*Assert(GetPeerRef(peer_id)), howmuch, ""); };
     void ProcessMessage(CNode& pfrom, const std::string& msg_type, DataStream& vRecv,
                         const std::chrono::microseconds time_received, const std::atomic<bool>& interruptMsgProc) override
-        EXCLUSIVE_LOCKS_REQUIRED(!m_peer_mutex, !m_recent_confirmed_transactions_mutex, !m_most_recent_block_mutex, !m_headers_presync_mutex, g_msgproc_mutex);
+        EXCLUSIVE_LOCKS_REQUIRED(!m_peer_mutex, !m_recent_confirmed_transactions_mutex, !m_most_recent_block_mutex, !m_headers_presync_mutex, !m_cmpctblock_mempool_txs_mutex, g_msgproc_mutex);
     void UpdateLastBlockAnnounceTime(NodeId node, int64_t time_in_seconds) override;
     ServiceFlags GetDesirableServiceFlags(ServiceFlags services) const override;
 
@@ -596,6 +642,16 @@ private:
     bool ProcessOrphanTx(Peer& peer)
         EXCLUSIVE_LOCKS_REQUIRED(!m_peer_mutex, g_msgproc_mutex);
 
+    /** Account for a transaction received from a peer (e.g. as the response to our request).
+     *  Returns false if it should not be submitted to the mempool, e.g. because we already have it. */
+    bool PrepareReceivedTx(CNode& pfrom, const CTransaction& tx)
+        EXCLUSIVE_LOCKS_REQUIRED(cs_main, !m_peer_mutex, !m_recent_confirmed_transactions_mutex);
+
+    /** Act on the mempool's verdict on a transaction received from a peer: relay it, keep it
+     *  as an orphan, or remember the rejection. */
+    void ProcessReceivedTxResult(CNode& pfrom, Peer& peer, const CTransactionRef& ptx, const MempoolAcceptResult& result)
+        EXCLUSIVE_LOCKS_REQUIRED(cs_main, !m_peer_mutex, !m_recent_confirmed_transactions_mutex, g_msgproc_mutex);
+
     /** Process a single headers message from a peer.
      *
      * @param[in]   pfrom     CNode of the peer
@@ -866,6 +922,30 @@ private:
     std::shared_ptr<const CBlockHeaderAndShortTxIDs> m_most_recent_compact_block GUARDED_BY(m_most_recent_block_mutex);
     uint256 m_most_recent_block_hash GUARDED_BY(m_most_recent_block_mutex);
     std::unique_ptr<const std::map<uint256, CTransactionRef>> m_most_recent_block_txs GUARDED_BY(m_most_recent_block_mutex);
+    /** BLOCK message for m_most_recent_block with witness data, built on first request and shared by all peers requesting it. */
+    std::optional<CSerializedNetMsg> m_most_recent_block_msg GUARDED_BY(m_most_recent_block_mutex);
+    /** CMPCTBLOCK message for m_most_recent_compact_block, shared by all peers it is sent to. */
+    CSerializedNetMsg m_most_recent_compact_block_msg GUARDED_BY(m_most_recent_block_mutex);
+
+    /** Mempool transactions in pre-processed compact block announcements, by announcing peer and
+     *  block hash, oldest first. Entries are never shared between peers, as each is only as good
+     *  as the short IDs its announcer sent. */
+    Mutex m_cmpctblock_mempool_txs_mutex;
+    std::deque<std::pair<std::pair<NodeId, uint256>, std::shared_ptr<const CompactBlockMempoolTxs>>> m_cmpctblock_mempool_txs GUARDED_BY(m_cmpctblock_mempool_txs_mutex);
+
+    /** Whether a compact block announcement is worth pre-processing: it is from a high-bandwidth
+     *  peer or for a block requested from this peer, and its block extends our tip and isn't
+     *  stored yet. Anything else ProcessMessage() won't reconstruct, or not from the mempool. */
+    bool ShouldPreProcessCompactBlock(const CNode& node, const CBlockHeader& header, const uint256& blockhash)
+        EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    /** Scan the mempool for the transactions in the block announced by cmpctblock, ahead of
+     *  processing the announcement, unless that was already done for this peer and block. */
+    void PreProcessCompactBlock(NodeId peer_id, const CBlockHeaderAndShortTxIDs& cmpctblock, const uint256& blockhash)
+        EXCLUSIVE_LOCKS_REQUIRED(!m_cmpctblock_mempool_txs_mutex);
+    /** Take the result of PreProcessCompactBlock for this announcement, or nullptr (in which case
+     *  the whole mempool needs to be scanned) if there is none. */
+    std::shared_ptr<const CompactBlockMempoolTxs> TakeCompactBlockMempoolTxs(NodeId peer_id, const uint256& blockhash)
+        EXCLUSIVE_LOCKS_REQUIRED(!m_cmpctblock_mempool_txs_mutex);
 
     // Data about the low-work headers synchronization, aggregated from all peers' HeadersSyncStates.
     /** Mutex guarding the other m_headers_presync_* variables. */
@@ -909,6 +989,13 @@ private:
      */
     bool BlockRequested(NodeId nodeid, const CBlockIndex& block, std::list<QueuedBlock>::iterator** pit = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+    /** Update the download speed estimates of a peer that sent us a block (of size bytes) we requested from it. */
+    void BlockReceived(NodeId nodeid, const uint256& hash, size_t size) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+    /** Return the block in flight from staller that holds back the download window, if peer is fast enough
+     *  and has waited long enough to request it as well. */
+    const CBlockIndex* FindStalledBlockToRerequest(const Peer& peer, NodeId staller, std::chrono::microseconds now) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
     bool TipMayBeStale() EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     /** Update pindexLastCommonBlock and add not-in-flight missing successors to vBlocks, until it has
@@ -1138,6 +1225,20 @@ static void AddKnownTx(Peer& peer, const uint256& hash)
     tx_relay->m_tx_inventory_known_filter.insert(hash);
 }
 
+/** Queue transactions the peer is missing according to a reconciliation for announcement. */
+static void AnnounceReconciledTxs(Peer& peer, const std::vector<uint256>& wtxids)
+{
+    auto tx_relay = peer.GetTxRelay();
+    if (!tx_relay) return;
+
+    LOCK(tx_relay->m_tx_inventory_mutex);
+    for (const uint256& wtxid : wtxids) {
+        if (!tx_relay->m_tx_inventory_known_filter.contains(wtxid)) {
+            tx_relay->m_tx_inventory_to_send.insert(wtxid);
+        }
+    }
+}
+
 /** Whether this peer can serve us blocks. */
 static bool CanServeBlocks(const Peer& peer)
 {
@@ -1245,11 +1346,12 @@ bool PeerManagerImpl::BlockRequested(NodeId nodeid, const CBlockIndex& block, st
     // Make sure it's not being fetched already from same peer.
     RemoveBlockRequest(hash, nodeid);
 
+    const auto now{GetTime<std::chrono::microseconds>()};
     std::list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(),
-            {&block, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&m_mempool) : nullptr)});
+            {&block, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&m_mempool) : nullptr), now});
     if (state->vBlocksInFlight.size() == 1) {
         // We're starting a block download (batch) from this peer.
-        state->m_downloading_since = GetTime<std::chrono::microseconds>();
+        state->m_downloading_since = now;
         m_peers_downloading_from++;
     }
     auto itInFlight = mapBlocksInFlight.insert(std::make_pair(hash, std::make_pair(nodeid, it)));
@@ -1259,6 +1361,54 @@ bool PeerManagerImpl::BlockRequested(NodeId nodeid, const CBlockIndex& block, st
     return true;
 }
 
+void PeerManagerImpl::BlockReceived(NodeId nodeid, const uint256& hash, size_t size)
+{
+    for (auto range = mapBlocksInFlight.equal_range(hash); range.first != range.second; range.first++) {
+        const auto& [node_id, list_it] = range.first->second;
+        if (node_id != nodeid) continue;
+
+        CNodeState& state = *Assert(State(nodeid));
+        const auto now{GetTime<std::chrono::microseconds>()};
+        const auto latency{std::max(now - list_it->m_requested_time, 1us)};
+        // Blocks are sent in the order they were requested, so the peer only started on this
+        // one after it was requested and the previous one was delivered.
+        const auto service_time{std::max(now - std::max(list_it->m_requested_time, state.m_last_block_received), 1us)};
+        const auto update = [](auto average, auto sample) {
+            if (average == decltype(average){}) return sample;
+            return (average * BLOCK_DOWNLOAD_EWMA_WEIGHT + sample * (8 - BLOCK_DOWNLOAD_EWMA_WEIGHT)) / 8;
+        };
+        state.m_block_latency = update(state.m_block_latency, latency);
+        state.m_block_service_time = update(state.m_block_service_time, service_time);
+        state.m_block_download_rate = update(state.m_block_download_rate, size / Ticks<SecondsDouble>(service_time));
+        state.m_last_block_received = now;
+        return;
+    }
+}
+
+const CBlockIndex* PeerManagerImpl::FindStalledBlockToRerequest(const Peer& peer, NodeId staller, std::chrono::microseconds now)
+{
+    const CNodeState& state = *Assert(State(peer.m_id));
+    const CNodeState* staller_state = State(staller);
+    if (staller_state == nullptr || state.pindexBestKnownBlock == nullptr || state.m_block_service_time == 0us) return nullptr;
+    // Only take over from peers known (or, for peers that never delivered, assumed) to be much slower.
+    if (staller_state->m_block_service_time != 0us && staller_state->m_block_service_time < state.m_block_service_time * BLOCK_REREQUEST_SPEEDUP) return nullptr;
+
+    // The lowest block in flight from the staller is the one holding back the window.
+    const QueuedBlock* stalled{nullptr};
+    for (const QueuedBlock& queued : staller_state->vBlocksInFlight) {
+        if (stalled == nullptr || queued.pindex->nHeight < stalled->pindex->nHeight) stalled = &queued;
+    }
+    if (stalled == nullptr || stalled->partialBlock) return nullptr;
+    if (now - stalled->m_requested_time < state.m_block_service_time * BLOCK_REREQUEST_SPEEDUP) return nullptr;
+
+    const CBlockIndex* pindex{stalled->pindex};
+    // Leave blocks that are also in flight from another peer (e.g. as compact block) alone.
+    if (mapBlocksInFlight.count(pindex->GetBlockHash()) != 1) return nullptr;
+    if (state.pindexBestKnownBlock->GetAncestor(pindex->nHeight) != pindex) return nullptr;
+    if (!CanServeWitnesses(peer) && DeploymentActiveAt(*pindex, m_chainman, Consensus::DEPLOYMENT_SEGWIT)) return nullptr;
+    return pindex;
+}
+
 void PeerManagerImpl::MaybeSetPeerAsAnnouncingHeaderAndIDs(NodeId nodeid)
 {
     AssertLockHeld(cs_main);
@@ -1717,6 +1867,9 @@ bool PeerManagerImpl::GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats) c
             return false;
         stats.nSyncHeight = state->pindexBestKnownBlock ? state->pindexBestKnownBlock->nHeight : -1;
         stats.nCommonHeight = state->pindexLastCommonBlock ? state->pindexLastCommonBlock->nHeight : -1;
+        stats.m_block_latency = state->m_block_latency;
+        stats.m_block_download_rate = state->m_block_download_rate;
+        stats.m_block_inflight_limit = state->BlockInFlightLimit();
         for (const QueuedBlock& queue : state->vBlocksInFlight) {
             if (queue.pindex)
                 stats.vHeightInFlight.push_back(queue.pindex->nHeight);
@@ -2031,6 +2184,8 @@ void PeerManagerImpl::BlockDisconnected(const std::shared_ptr<const CBlock> &blo
 void PeerManagerImpl::NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock)
 {
     auto pcmpctblock = std::make_shared<const CBlockHeaderAndShortTxIDs>(*pblock);
+    // Serialized once, and shared by all peers it is announced to or requested by.
+    CSerializedNetMsg cmpctblock_msg{NetMsg::MakeShared(NetMsgType::CMPCTBLOCK, *pcmpctblock)};
 
     LOCK(cs_main);
 
@@ -2041,8 +2196,6 @@ void PeerManagerImpl::NewPoWValidBlock(const CBlockIndex *pindex, const std::sha
     if (!DeploymentActiveAt(*pindex, m_chainman, Consensus::DEPLOYMENT_SEGWIT)) return;
 
     uint256 hashBlock(pblock->GetHash());
-    const std::shared_future<CSerializedNetMsg> lazy_ser{
-        std::async(std::launch::deferred, [&] { return NetMsg::Make(NetMsgType::CMPCTBLOCK, *pcmpctblock); })};
 
     {
         auto most_recent_block_txs = std::make_unique<std::map<uint256, CTransactionRef>>();
@@ -2055,10 +2208,12 @@ void PeerManagerImpl::NewPoWValidBlock(const CBlockIndex *pindex, const std::sha
         m_most_recent_block_hash = hashBlock;
         m_most_recent_block = pblock;
         m_most_recent_compact_block = pcmpctblock;
+        m_most_recent_compact_block_msg = cmpctblock_msg.Copy();
         m_most_recent_block_txs = std::move(most_recent_block_txs);
+        m_most_recent_block_msg.reset();
     }
 
-    m_connman.ForEachNode([this, pindex, &lazy_ser, &hashBlock](CNode* pnode) EXCLUSIVE_LOCKS_REQUIRED(::cs_main) {
+    m_connman.ForEachNode([this, pindex, &cmpctblock_msg, &hashBlock](CNode* pnode) EXCLUSIVE_LOCKS_REQUIRED(::cs_main) {
         AssertLockHeld(::cs_main);
 
         if (pnode->GetCommonVersion() < INVALID_CB_NO_BAN_VERSION || pnode->fDisconnect)
@@ -2072,8 +2227,7 @@ void PeerManagerImpl::NewPoWValidBlock(const CBlockIndex *pindex, const std::sha
             LogPrint(BCLog::NET, "%s sending header-and-ids %s to peer=%d\n", "PeerManager::NewPoWValidBlock",
                     hashBlock.ToString(), pnode->GetId());
 
-            const CSerializedNetMsg& ser_cmpctblock{lazy_ser.get()};
-            PushMessage(*pnode, ser_cmpctblock.Copy());
+            PushMessage(*pnode, cmpctblock_msg.Copy());
             state.pindexBestHeaderSent = pindex;
         }
     });
@@ -2210,6 +2364,13 @@ void PeerManagerImpl::RelayTransaction(const uint256& txid, const uint256& wtxid
 
         const uint256& hash{peer.m_wtxid_relay ? wtxid : txid};
         if (!tx_relay->m_tx_inventory_known_filter.contains(hash)) {
+            // For reconciling peers, defer the announcement to the next
+            // reconciliation round, unless the peer was picked for flooding.
+            if (m_txreconciliation && m_txreconciliation->IsPeerRegistered(peer.m_id) &&
+                !m_txreconciliation->ShouldFloodTo(peer.m_id, wtxid) &&
+                m_txreconciliation->AddToSet(peer.m_id, wtxid)) {
+                continue;
+            }
             tx_relay->m_tx_inventory_to_send.insert(hash);
         }
     };
@@ -2268,10 +2429,12 @@ void PeerManagerImpl::ProcessGetBlockData(CNode& pfrom, Peer& peer, const CInv&
 {
     std::shared_ptr<const CBlock> a_recent_block;
     std::shared_ptr<const CBlockHeaderAndShortTxIDs> a_recent_compact_block;
+    CSerializedNetMsg a_recent_compact_block_msg;
     {
         LOCK(m_most_recent_block_mutex);
         a_recent_block = m_most_recent_block;
         a_recent_compact_block = m_most_recent_compact_block;
+        if (inv.IsMsgCmpctBlk()) a_recent_compact_block_msg = m_most_recent_compact_block_msg.Copy();
     }
 
     bool need_activate_chain = false;
@@ -2331,15 +2494,31 @@ void PeerManagerImpl::ProcessGetBlockData(CNode& pfrom, Peer& peer, const CInv&
     }
     std::shared_ptr<const CBlock> pblock;
     if (a_recent_block && a_recent_block->GetHash() == pindex->GetBlockHash()) {
-        pblock = a_recent_block;
+        if (inv.IsMsgWitnessBlk()) {
+            // Many peers request the most recent block at about the same time. Serialize it
+            // once, and share the payload between all of them.
+            std::optional<CSerializedNetMsg> msg{WITH_LOCK(m_most_recent_block_mutex,
+                return m_most_recent_block == a_recent_block && m_most_recent_block_msg ? std::make_optional(m_most_recent_block_msg->Copy()) : std::nullopt)};
+            if (!msg) {
+                msg = NetMsg::MakeShared(NetMsgType::BLOCK, TX_WITH_WITNESS(*a_recent_block));
+                LOCK(m_most_recent_block_mutex);
+                if (m_most_recent_block == a_recent_block) m_most_recent_block_msg = msg->Copy();
+            }
+            m_connman.PushMessage(&pfrom, std::move(*msg));
+            // Don't set pblock as we've sent the block
+        } else {
+            pblock = a_recent_block;
+        }
     } else if (inv.IsMsgWitnessBlk()) {
         // Fast-path: in this case it is possible to serve the block directly from disk,
-        // as the network format matches the format on disk
-        std::vector<uint8_t> block_data;
-        if (!m_chainman.m_blockman.ReadRawBlockFromDisk(block_data, pindex->GetBlockPos())) {
+        // as the network format matches the format on disk. Move the bytes into the message
+        // rather than copying them.
+        CSerializedNetMsg msg;
+        msg.m_type = NetMsgType::BLOCK;
+        if (!m_chainman.m_blockman.ReadRawBlockFromDisk(msg.data, pindex->GetBlockPos())) {
             assert(!"cannot load block from disk");
         }
-        MakeAndPushMessage(pfrom, NetMsgType::BLOCK, Span{block_data});
+        m_connman.PushMessage(&pfrom, std::move(msg));
         // Don't set pblock as we've sent the block
     } else {
         // Send block from disk
@@ -2385,7 +2564,7 @@ void PeerManagerImpl::ProcessGetBlockData(CNode& pfrom, Peer& peer, const CInv&
             // instead we respond with the full, non-compact block.
             if (CanDirectFetch() && pindex->nHeight >= m_chainman.ActiveChain().Height() - MAX_CMPCTBLOCK_DEPTH) {
                 if (a_recent_compact_block && a_recent_compact_block->header.GetHash() == pindex->GetBlockHash()) {
-                    MakeAndPushMessage(pfrom, NetMsgType::CMPCTBLOCK, *a_recent_compact_block);
+                    m_connman.PushMessage(&pfrom, std::move(a_recent_compact_block_msg));
                 } else {
                     CBlockHeaderAndShortTxIDs cmpctblock{*pblock};
                     MakeAndPushMessage(pfrom, NetMsgType::CMPCTBLOCK, cmpctblock);
@@ -2774,7 +2953,7 @@ void PeerManagerImpl::HeadersDirectFetchBlocks(CNode& pfrom, const Peer& peer, c
         std::vector<const CBlockIndex*> vToFetch;
         const CBlockIndex* pindexWalk{&last_header};
         // Calculate all the blocks we'd need to switch to last_header, up to a limit.
-        while (pindexWalk && !m_chainman.ActiveChain().Contains(pindexWalk) && vToFetch.size() <= MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        while (pindexWalk && !m_chainman.ActiveChain().Contains(pindexWalk) && vToFetch.size() <= static_cast<size_t>(nodestate->BlockInFlightLimit())) {
             if (!(pindexWalk->nStatus & BLOCK_HAVE_DATA) &&
                     !IsBlockRequested(pindexWalk->GetBlockHash()) &&
                     (!DeploymentActiveAt(*pindexWalk, m_chainman, Consensus::DEPLOYMENT_SEGWIT) || CanServeWitnesses(peer))) {
@@ -2795,7 +2974,7 @@ void PeerManagerImpl::HeadersDirectFetchBlocks(CNode& pfrom, const Peer& peer, c
             std::vector<CInv> vGetData;
             // Download as much as possible, from earliest to latest.
             for (const CBlockIndex *pindex : reverse_iterate(vToFetch)) {
-                if (nodestate->vBlocksInFlight.size() >= MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+                if (nodestate->vBlocksInFlight.size() >= static_cast<size_t>(nodestate->BlockInFlightLimit())) {
                     // Can't download any more from this peer
                     break;
                 }
@@ -3032,6 +3211,192 @@ void PeerManagerImpl::ProcessHeadersMessage(CNode& pfrom, Peer& peer,
     return;
 }
 
+bool PeerManagerImpl::PrepareReceivedTx(CNode& pfrom, const CTransaction& tx)
+{
+    AssertLockHeld(cs_main);
+    const uint256& txid = tx.GetHash();
+    const uint256& wtxid = tx.GetWitnessHash();
+
+    m_txrequest.ReceivedResponse(pfrom.GetId(), txid);
+    if (tx.HasWitness()) m_txrequest.ReceivedResponse(pfrom.GetId(), wtxid);
+
+    // We do the AlreadyHaveTx() check using wtxid, rather than txid - in the
+    // absence of witness malleation, this is strictly better, because the
+    // recent rejects filter may contain the wtxid but rarely contains
+    // the txid of a segwit transaction that has been rejected.
+    // In the presence of witness malleation, it's possible that by only
+    // doing the check with wtxid, we could overlook a transaction which
+    // was confirmed with a different witness, or exists in our mempool
+    // with a different witness, but this has limited downside:
+    // mempool validation does its own lookup of whether we have the txid
+    // already; and an adversary can already relay us old transactions
+    // (older than our recency filter) if trying to DoS us, without any need
+    // for witness malleation.
+    if (AlreadyHaveTx(GenTxid::Wtxid(wtxid))) {
+        if (pfrom.HasPermission(NetPermissionFlags::ForceRelay)) {
+            // Always relay transactions received from peers with forcerelay
+            // permission, even if they were already in the mempool, allowing
+            // the node to function as a gateway for nodes hidden behind it.
+            if (!m_mempool.exists(GenTxid::Txid(tx.GetHash()))) {
+                LogPrintf("Not relaying non-mempool transaction %s (wtxid=%s) from forcerelay peer=%d\n",
+                          tx.GetHash().ToString(), tx.GetWitnessHash().ToString(), pfrom.GetId());
+            } else {
+                LogPrintf("Force relaying tx %s (wtxid=%s) from peer=%d\n",
+                          tx.GetHash().ToString(), tx.GetWitnessHash().ToString(), pfrom.GetId());
+                RelayTransaction(tx.GetHash(), tx.GetWitnessHash());
+            }
+        }
+        // If a tx is detected by m_recent_rejects it is ignored. Because we haven't
+        // submitted the tx to our mempool, we won't have computed a DoS
+        // score for it or determined exactly why we consider it invalid.
+        //
+        // This means we won't penalize any peer subsequently relaying a DoSy
+        // tx (even if we penalized the first peer who gave it to us) because
+        // we have to account for m_recent_rejects showing false positives. In
+        // other words, we shouldn't penalize a peer if we aren't *sure* they
+        // submitted a DoSy tx.
+        //
+        // Note that m_recent_rejects doesn't just record DoSy or invalid
+        // transactions, but any tx not accepted by the mempool, which may be
+        // due to node policy (vs. consensus). So we can't blanket penalize a
+        // peer simply for relaying a tx that our m_recent_rejects has caught,
+        // regardless of false positives.
+        return false;
+    }
+
+    return true;
+}
+
+void PeerManagerImpl::ProcessReceivedTxResult(CNode& pfrom, Peer& peer, const CTransactionRef& ptx, const MempoolAcceptResult& result)
+{
+    AssertLockHeld(cs_main);
+    const CTransaction& tx = *ptx;
+    const TxValidationState& state = result.m_state;
+
+    if (result.m_result_type == MempoolAcceptResult::ResultType::VALID) {
+        // As this version of the transaction was acceptable, we can forget about any
+        // requests for it.
+        m_txrequest.ForgetTxHash(tx.GetHash());
+        m_txrequest.ForgetTxHash(tx.GetWitnessHash());
+        RelayTransaction(tx.GetHash(), tx.GetWitnessHash());
+        m_orphanage.AddChildrenToWorkSet(tx);
+
+        pfrom.m_last_tx_time = GetTime<std::chrono::seconds>();
+
+        LogPrint(BCLog::MEMPOOL, "AcceptToMemoryPool: peer=%d: accepted %s (wtxid=%s) (poolsz %u txn, %u kB)\n",
+            pfrom.GetId(),
+            tx.GetHash().ToString(),
+            tx.GetWitnessHash().ToString(),
+            m_mempool.size(), m_mempool.DynamicMemoryUsage() / 1000);
+
+        for (const CTransactionRef& removedTx : result.m_replaced_transactions.value()) {
+            AddToCompactExtraTransactions(removedTx);
+        }
+    }
+    else if (state.GetResult() == TxValidationResult::TX_MISSING_INPUTS)
+    {
+        bool fRejectedParents = false; // It may be the case that the orphans parents have all been rejected
+
+        // Deduplicate parent txids, so that we don't have to loop over
+        // the same parent txid more than once down below.
+        std::vector<uint256> unique_parents;
+        unique_parents.reserve(tx.vin.size());
+        for (const CTxIn& txin : tx.vin) {
+            // We start with all parents, and then remove duplicates below.
+            unique_parents.push_back(txin.prevout.hash);
+        }
+        std::sort(unique_parents.begin(), unique_parents.end());
+        unique_parents.erase(std::unique(unique_parents.begin(), unique_parents.end()), unique_parents.end());
+        for (const uint256& parent_txid : unique_parents) {
+            if (m_recent_rejects.contains(parent_txid)) {
+                fRejectedParents = true;
+                break;
+            }
+        }
+        if (!fRejectedParents) {
+            const auto current_time{GetTime<std::chrono::microseconds>()};
+
+            for (const uint256& parent_txid : unique_parents) {
+                // Here, we only have the txid (and not wtxid) of the
+                // inputs, so we only request in txid mode, even for
+                // wtxidrelay peers.
+                // Eventually we should replace this with an improved
+                // protocol for getting all unconfirmed parents.
+                const auto gtxid{GenTxid::Txid(parent_txid)};
+                AddKnownTx(peer, parent_txid);
+                if (!AlreadyHaveTx(gtxid)) AddTxAnnouncement(pfrom, gtxid, current_time);
+            }
+
+            if (m_orphanage.AddTx(ptx, pfrom.GetId())) {
+                AddToCompactExtraTransactions(ptx);
+            }
+
+            // Once added to the orphan pool, a tx is considered AlreadyHave, and we shouldn't request it anymore.
+            m_txrequest.ForgetTxHash(tx.GetHash());
+            m_txrequest.ForgetTxHash(tx.GetWitnessHash());
+
+            // DoS prevention: do not allow m_orphanage to grow unbounded (see CVE-2012-3789)
+            m_orphanage.LimitOrphans(m_opts.max_orphan_txs, m_rng);
+        } else {
+            LogPrint(BCLog::MEMPOOL, "not keeping orphan with rejected parents %s (wtxid=%s)\n",
+                     tx.GetHash().ToString(),
+                     tx.GetWitnessHash().ToString());
+            // We will continue to reject this tx since it has rejected
+            // parents so avoid re-requesting it from other peers.
+            // Here we add both the txid and the wtxid, as we know that
+            // regardless of what witness is provided, we will not accept
+            // this, so we don't need to allow for redownload of this txid
+            // from any of our non-wtxidrelay peers.
+            m_recent_rejects.insert(tx.GetHash().ToUint256());
+            m_recent_rejects.insert(tx.GetWitnessHash().ToUint256());
+            m_txrequest.ForgetTxHash(tx.GetHash());
+            m_txrequest.ForgetTxHash(tx.GetWitnessHash());
+        }
+    } else {
+        if (state.GetResult() != TxValidationResult::TX_WITNESS_STRIPPED) {
+            // We can add the wtxid of this transaction to our reject filter.
+            // Do not add txids of witness transactions or witness-stripped
+            // transactions to the filter, as they can have been malleated;
+            // adding such txids to the reject filter would potentially
+            // interfere with relay of valid transactions from peers that
+            // do not support wtxid-based relay. See
+            // https://github.com/bitcoin/bitcoin/issues/8279 for details.
+            // We can remove this restriction (and always add wtxids to
+            // the filter even for witness stripped transactions) once
+            // wtxid-based relay is broadly deployed.
+            // See also comments in https://github.com/bitcoin/bitcoin/pull/18044#discussion_r443419034
+            // for concerns around weakening security of unupgraded nodes
+            // if we start doing this too early.
+            m_recent_rejects.insert(tx.GetWitnessHash().ToUint256());
+            m_txrequest.ForgetTxHash(tx.GetWitnessHash());
+            // If the transaction failed for TX_INPUTS_NOT_STANDARD,
+            // then we know that the witness was irrelevant to the policy
+            // failure, since this check depends only on the txid
+            // (the scriptPubKey being spent is covered by the txid).
+            // Add the txid to the reject filter to prevent repeated
+            // processing of this transaction in the event that child
+            // transactions are later received (resulting in
+            // parent-fetching by txid via the orphan-handling logic).
+            if (state.GetResult() == TxValidationResult::TX_INPUTS_NOT_STANDARD && tx.HasWitness()) {
+                m_recent_rejects.insert(tx.GetHash().ToUint256());
+                m_txrequest.ForgetTxHash(tx.GetHash());
+            }
+            if (RecursiveDynamicUsage(*ptx) < 100000) {
+                AddToCompactExtraTransactions(ptx);
+            }
+        }
+    }
+
+    if (state.IsInvalid()) {
+        LogPrint(BCLog::MEMPOOLREJ, "%s (wtxid=%s) from peer=%d was not accepted: %s\n",
+            tx.GetHash().ToString(),
+            tx.GetWitnessHash().ToString(),
+            pfrom.GetId(),
+            state.ToString());
+        MaybePunishNodeForTx(pfrom.GetId(), state);
+    }
+}
+
 bool PeerManagerImpl::ProcessOrphanTx(Peer& peer)
 {
     AssertLockHeld(g_msgproc_mutex);
@@ -3886,6 +4251,81 @@ void PeerManagerImpl::ProcessMessage(CNode& pfrom, const std::string& msg_type,
         return;
     }
 
+    if (msg_type == NetMsgType::REQRECON) {
+        if (!m_txreconciliation) return;
+
+        uint16_t peer_recon_set_size, peer_q;
+        vRecv >> peer_recon_set_size >> peer_q;
+
+        std::vector<uint8_t> sketch;
+        switch (m_txreconciliation->HandleReconciliationRequest(pfrom.GetId(), peer_recon_set_size, peer_q, sketch, GetTime<std::chrono::microseconds>())) {
+        case ReconciliationResult::NOT_FOUND:
+            LogPrintLevel(BCLog::NET, BCLog::Level::Debug, "reqrecon from peer=%d ignored, as the peer is not registered for txreconciliation\n", pfrom.GetId());
+            return;
+        case ReconciliationResult::PROTOCOL_VIOLATION:
+            LogPrintLevel(BCLog::NET, BCLog::Level::Debug, "txreconciliation protocol violation from peer=%d (unexpected reqrecon); disconnecting\n", pfrom.GetId());
+            pfrom.fDisconnect = true;
+            return;
+        case ReconciliationResult::SUCCESS:
+            MakeAndPushMessage(pfrom, NetMsgType::SKETCH, sketch);
+            return;
+        }
+        return;
+    }
+
+    if (msg_type == NetMsgType::SKETCH) {
+        if (!m_txreconciliation) return;
+
+        std::vector<uint8_t> skdata;
+        vRecv >> skdata;
+
+        bool success;
+        std::vector<uint32_t> txs_to_request;
+        std::vector<uint256> txs_to_announce;
+        switch (m_txreconciliation->HandleSketch(pfrom.GetId(), skdata, success, txs_to_request, txs_to_announce)) {
+        case ReconciliationResult::NOT_FOUND:
+            LogPrintLevel(BCLog::NET, BCLog::Level::Debug, "sketch from peer=%d ignored, as the peer is not registered for txreconciliation\n", pfrom.GetId());
+            return;
+        case ReconciliationResult::PROTOCOL_VIOLATION:
+            LogPrintLevel(BCLog::NET, BCLog::Level::Debug, "txreconciliation protocol violation from peer=%d (unexpected or oversized sketch); disconnecting\n", pfrom.GetId());
+            pfrom.fDisconnect = true;
+            return;
+        case ReconciliationResult::SUCCESS:
+            AnnounceReconciledTxs(*peer, txs_to_announce);
+            MakeAndPushMessage(pfrom, NetMsgType::RECONCILDIFF, success, txs_to_request);
+            return;
+        }
+        return;
+    }
+
+    if (msg_type == NetMsgType::RECONCILDIFF) {
+        if (!m_txreconciliation) return;
+
+        bool success;
+        std::vector<uint32_t> ask_shortids;
+        vRecv >> success >> ask_shortids;
+        if (ask_shortids.size() > MAX_SKETCH_CAPACITY) {
+            LogPrintLevel(BCLog::NET, BCLog::Level::Debug, "txreconciliation protocol violation from peer=%d (oversized reconcildiff); disconnecting\n", pfrom.GetId());
+            pfrom.fDisconnect = true;
+            return;
+        }
+
+        std::vector<uint256> txs_to_announce;
+        switch (m_txreconciliation->HandleReconciliationDifference(pfrom.GetId(), success, ask_shortids, txs_to_announce)) {
+        case ReconciliationResult::NOT_FOUND:
+            LogPrintLevel(BCLog::NET, BCLog::Level::Debug, "reconcildiff from peer=%d ignored, as the peer is not registered for txreconciliation\n", pfrom.GetId());
+            return;
+        case ReconciliationResult::PROTOCOL_VIOLATION:
+            LogPrintLevel(BCLog::NET, BCLog::Level::Debug, "txreconciliation protocol violation from peer=%d (unexpected reconcildiff); disconnecting\n", pfrom.GetId());
+            pfrom.fDisconnect = true;
+            return;
+        case ReconciliationResult::SUCCESS:
+            AnnounceReconciledTxs(*peer, txs_to_announce);
+            return;
+        }
+        return;
+    }
+
     if (msg_type == NetMsgType::INV) {
         std::vector<CInv> vInv;
         vRecv >> vInv;
@@ -3939,6 +4379,8 @@ void PeerManagerImpl::ProcessMessage(CNode& pfrom, const std::string& msg_type,
                 LogPrint(BCLog::NET, "got inv: %s  %s peer=%d\n", inv.ToString(), fAlreadyHave ? "have" : "new", pfrom.GetId());
 
                 AddKnownTx(*peer, inv.hash);
+                // The peer has the transaction, so there is no need to reconcile it.
+                if (m_txreconciliation && gtxid.IsWtxid()) m_txreconciliation->TryRemovingFromSet(pfrom.GetId(), inv.hash);
                 if (!fAlreadyHave && !m_chainman.IsInitialBlockDownload()) {
                     AddTxAnnouncement(pfrom, gtxid, current_time);
                 }
@@ -4213,189 +4655,55 @@ void PeerManagerImpl::ProcessMessage(CNode& pfrom, const std::string& msg_type,
         // is not considered a protocol violation, so don't punish the peer.
         if (m_chainman.IsInitialBlockDownload()) return;
 
+        // Transactions this peer sent right after this one are submitted together with it, so
+        // that the mempool is trimmed and the coins cache flushed once for all of them.
+        std::vector<CTransactionRef> txs;
         CTransactionRef ptx;
         vRecv >> TX_WITH_WITNESS(ptx);
-        const CTransaction& tx = *ptx;
-
-        const uint256& txid = ptx->GetHash();
-        const uint256& wtxid = ptx->GetWitnessHash();
-
-        const uint256& hash = peer->m_wtxid_relay ? wtxid : txid;
-        AddKnownTx(*peer, hash);
-
-        LOCK(cs_main);
-
-        m_txrequest.ReceivedResponse(pfrom.GetId(), txid);
-        if (tx.HasWitness()) m_txrequest.ReceivedResponse(pfrom.GetId(), wtxid);
-
-        // We do the AlreadyHaveTx() check using wtxid, rather than txid - in the
-        // absence of witness malleation, this is strictly better, because the
-        // recent rejects filter may contain the wtxid but rarely contains
-        // the txid of a segwit transaction that has been rejected.
-        // In the presence of witness malleation, it's possible that by only
-        // doing the check with wtxid, we could overlook a transaction which
-        // was confirmed with a different witness, or exists in our mempool
-        // with a different witness, but this has limited downside:
-        // mempool validation does its own lookup of whether we have the txid
-        // already; and an adversary can already relay us old transactions
-        // (older than our recency filter) if trying to DoS us, without any need
-        // for witness malleation.
-        if (AlreadyHaveTx(GenTxid::Wtxid(wtxid))) {
-            if (pfrom.HasPermission(NetPermissionFlags::ForceRelay)) {
-                // Always relay transactions received from peers with forcerelay
-                // permission, even if they were already in the mempool, allowing
-                // the node to function as a gateway for nodes hidden behind it.
-                if (!m_mempool.exists(GenTxid::Txid(tx.GetHash()))) {
-                    LogPrintf("Not relaying non-mempool transaction %s (wtxid=%s) from forcerelay peer=%d\n",
-                              tx.GetHash().ToString(), tx.GetWitnessHash().ToString(), pfrom.GetId());
-                } else {
-                    LogPrintf("Force relaying tx %s (wtxid=%s) from peer=%d\n",
-                              tx.GetHash().ToString(), tx.GetWitnessHash().ToString(), pfrom.GetId());
-                    RelayTransaction(tx.GetHash(), tx.GetWitnessHash());
-                }
-            }
-            // If a tx is detected by m_recent_rejects it is ignored. Because we haven't
-            // submitted the tx to our mempool, we won't have computed a DoS
-            // score for it or determined exactly why we consider it invalid.
-            //
-            // This means we won't penalize any peer subsequently relaying a DoSy
-            // tx (even if we penalized the first peer who gave it to us) because
-            // we have to account for m_recent_rejects showing false positives. In
-            // other words, we shouldn't penalize a peer if we aren't *sure* they
-            // submitted a DoSy tx.
-            //
-            // Note that m_recent_rejects doesn't just record DoSy or invalid
-            // transactions, but any tx not accepted by the mempool, which may be
-            // due to node policy (vs. consensus). So we can't blanket penalize a
-            // peer simply for relaying a tx that our m_recent_rejects has caught,
-            // regardless of false positives.
-            return;
-        }
-
-        const MempoolAcceptResult result = m_chainman.ProcessTransaction(ptx);
-        const TxValidationState& state = result.m_state;
-
-        if (result.m_result_type == MempoolAcceptResult::ResultType::VALID) {
-            // As this version of the transaction was acceptable, we can forget about any
-            // requests for it.
-            m_txrequest.ForgetTxHash(tx.GetHash());
-            m_txrequest.ForgetTxHash(tx.GetWitnessHash());
-            RelayTransaction(tx.GetHash(), tx.GetWitnessHash());
-            m_orphanage.AddChildrenToWorkSet(tx);
-
-            pfrom.m_last_tx_time = GetTime<std::chrono::seconds>();
-
-            LogPrint(BCLog::MEMPOOL, "AcceptToMemoryPool: peer=%d: accepted %s (wtxid=%s) (poolsz %u txn, %u kB)\n",
+        txs.push_back(ptx);
+        size_t batch_inputs{ptx->vin.size()};
+        const size_t max_batch_size{m_opts.capture_messages ? 1 : MAX_TX_BATCH_SIZE};
+        while (txs.size() < max_batch_size && batch_inputs < MAX_TX_BATCH_INPUTS) {
+            auto next{pfrom.PollMessage(NetMsgType::TX)};
+            if (!next) break;
+            CNetMessage& msg{next->first};
+            // Report the message as ProcessMessages() and ProcessMessage() do for all others.
+            TRACE6(net, inbound_message,
                 pfrom.GetId(),
-                tx.GetHash().ToString(),
-                tx.GetWitnessHash().ToString(),
-                m_mempool.size(), m_mempool.DynamicMemoryUsage() / 1000);
-
-            for (const CTransactionRef& removedTx : result.m_replaced_transactions.value()) {
-                AddToCompactExtraTransactions(removedTx);
+                pfrom.m_addr_name.c_str(),
+                pfrom.ConnectionTypeAsString().c_str(),
+                msg.m_type.c_str(),
+                msg.m_recv.size(),
+                msg.m_recv.data()
+            );
+            LogPrint(BCLog::NET, "received: %s (%u bytes) peer=%d\n", SanitizeString(msg.m_type), msg.m_recv.size(), pfrom.GetId());
+            try {
+                msg.m_recv >> TX_WITH_WITNESS(ptx);
+                txs.push_back(ptx);
+                batch_inputs += ptx->vin.size();
+            } catch (const std::exception& e) {
+                LogPrint(BCLog::NET, "%s(%s, %u bytes): Exception '%s' (%s) caught\n", __func__, msg_type, msg.m_message_size, e.what(), typeid(e).name());
             }
         }
-        else if (state.GetResult() == TxValidationResult::TX_MISSING_INPUTS)
-        {
-            bool fRejectedParents = false; // It may be the case that the orphans parents have all been rejected
-
-            // Deduplicate parent txids, so that we don't have to loop over
-            // the same parent txid more than once down below.
-            std::vector<uint256> unique_parents;
-            unique_parents.reserve(tx.vin.size());
-            for (const CTxIn& txin : tx.vin) {
-                // We start with all parents, and then remove duplicates below.
-                unique_parents.push_back(txin.prevout.hash);
-            }
-            std::sort(unique_parents.begin(), unique_parents.end());
-            unique_parents.erase(std::unique(unique_parents.begin(), unique_parents.end()), unique_parents.end());
-            for (const uint256& parent_txid : unique_parents) {
-                if (m_recent_rejects.contains(parent_txid)) {
-                    fRejectedParents = true;
-                    break;
-                }
-            }
-            if (!fRejectedParents) {
-                const auto current_time{GetTime<std::chrono::microseconds>()};
-
-                for (const uint256& parent_txid : unique_parents) {
-                    // Here, we only have the txid (and not wtxid) of the
-                    // inputs, so we only request in txid mode, even for
-                    // wtxidrelay peers.
-                    // Eventually we should replace this with an improved
-                    // protocol for getting all unconfirmed parents.
-                    const auto gtxid{GenTxid::Txid(parent_txid)};
-                    AddKnownTx(*peer, parent_txid);
-                    if (!AlreadyHaveTx(gtxid)) AddTxAnnouncement(pfrom, gtxid, current_time);
-                }
 
-                if (m_orphanage.AddTx(ptx, pfrom.GetId())) {
-                    AddToCompactExtraTransactions(ptx);
-                }
+        for (const CTransactionRef& tx : txs) {
+            const uint256& hash = peer->m_wtxid_relay ? tx->GetWitnessHash().ToUint256() : tx->GetHash().ToUint256();
+            AddKnownTx(*peer, hash);
+            if (m_txreconciliation) m_txreconciliation->TryRemovingFromSet(pfrom.GetId(), tx->GetWitnessHash());
+        }
 
-                // Once added to the orphan pool, a tx is considered AlreadyHave, and we shouldn't request it anymore.
-                m_txrequest.ForgetTxHash(tx.GetHash());
-                m_txrequest.ForgetTxHash(tx.GetWitnessHash());
+        LOCK(cs_main);
 
-                // DoS prevention: do not allow m_orphanage to grow unbounded (see CVE-2012-3789)
-                m_orphanage.LimitOrphans(m_opts.max_orphan_txs, m_rng);
-            } else {
-                LogPrint(BCLog::MEMPOOL, "not keeping orphan with rejected parents %s (wtxid=%s)\n",
-                         tx.GetHash().ToString(),
-                         tx.GetWitnessHash().ToString());
-                // We will continue to reject this tx since it has rejected
-                // parents so avoid re-requesting it from other peers.
-                // Here we add both the txid and the wtxid, as we know that
-                // regardless of what witness is provided, we will not accept
-                // this, so we don't need to allow for redownload of this txid
-                // from any of our non-wtxidrelay peers.
-                m_recent_rejects.insert(tx.GetHash().ToUint256());
-                m_recent_rejects.insert(tx.GetWitnessHash().ToUint256());
-                m_txrequest.ForgetTxHash(tx.GetHash());
-                m_txrequest.ForgetTxHash(tx.GetWitnessHash());
-            }
-        } else {
-            if (state.GetResult() != TxValidationResult::TX_WITNESS_STRIPPED) {
-                // We can add the wtxid of this transaction to our reject filter.
-                // Do not add txids of witness transactions or witness-stripped
-                // transactions to the filter, as they can have been malleated;
-                // adding such txids to the reject filter would potentially
-                // interfere with relay of valid transactions from peers that
-                // do not support wtxid-based relay. See
-                // https://github.com/bitcoin/bitcoin/issues/8279 for details.
-                // We can remove this restriction (and always add wtxids to
-                // the filter even for witness stripped transactions) once
-                // wtxid-based relay is broadly deployed.
-                // See also comments in https://github.com/bitcoin/bitcoin/pull/18044#discussion_r443419034
-                // for concerns around weakening security of unupgraded nodes
-                // if we start doing this too early.
-                m_recent_rejects.insert(tx.GetWitnessHash().ToUint256());
-                m_txrequest.ForgetTxHash(tx.GetWitnessHash());
-                // If the transaction failed for TX_INPUTS_NOT_STANDARD,
-                // then we know that the witness was irrelevant to the policy
-                // failure, since this check depends only on the txid
-                // (the scriptPubKey being spent is covered by the txid).
-                // Add the txid to the reject filter to prevent repeated
-                // processing of this transaction in the event that child
-                // transactions are later received (resulting in
-                // parent-fetching by txid via the orphan-handling logic).
-                if (state.GetResult() == TxValidationResult::TX_INPUTS_NOT_STANDARD && tx.HasWitness()) {
-                    m_recent_rejects.insert(tx.GetHash().ToUint256());
-                    m_txrequest.ForgetTxHash(tx.GetHash());
-                }
-                if (RecursiveDynamicUsage(*ptx) < 100000) {
-                    AddToCompactExtraTransactions(ptx);
-                }
-            }
+        std::vector<CTransactionRef> batch;
+        for (const CTransactionRef& tx : txs) {
+            const bool duplicate{std::any_of(batch.begin(), batch.end(), [&](const auto& other) { return other->GetWitnessHash() == tx->GetWitnessHash(); })};
+            if (PrepareReceivedTx(pfrom, *tx) && !duplicate) batch.push_back(tx);
         }
+        if (batch.empty()) return;
 
-        if (state.IsInvalid()) {
-            LogPrint(BCLog::MEMPOOLREJ, "%s (wtxid=%s) from peer=%d was not accepted: %s\n",
-                tx.GetHash().ToString(),
-                tx.GetWitnessHash().ToString(),
-                pfrom.GetId(),
-                state.ToString());
-            MaybePunishNodeForTx(pfrom.GetId(), state);
+        const std::vector<MempoolAcceptResult> results{m_chainman.ProcessTransactions(batch)};
+        for (size_t i = 0; i < batch.size(); ++i) {
+            ProcessReceivedTxResult(pfrom, *peer, batch[i], results[i]);
         }
         return;
     }
@@ -4512,7 +4820,7 @@ void PeerManagerImpl::ProcessMessage(CNode& pfrom, const std::string& msg_type,
         // We want to be a bit conservative just to be extra careful about DoS
         // possibilities in compact block processing...
         if (pindex->nHeight <= m_chainman.ActiveChain().Height() + 2) {
-            if ((already_in_flight < MAX_CMPCTBLOCKS_INFLIGHT_PER_BLOCK && nodestate->vBlocksInFlight.size() < MAX_BLOCKS_IN_TRANSIT_PER_PEER) ||
+            if ((already_in_flight < MAX_CMPCTBLOCKS_INFLIGHT_PER_BLOCK && nodestate->vBlocksInFlight.size() < static_cast<size_t>(nodestate->BlockInFlightLimit())) ||
                  requested_block_from_this_peer) {
                 std::list<QueuedBlock>::iterator* queuedBlockIt = nullptr;
                 if (!BlockRequested(pfrom.GetId(), *pindex, &queuedBlockIt)) {
@@ -4526,7 +4834,7 @@ void PeerManagerImpl::ProcessMessage(CNode& pfrom, const std::string& msg_type,
                 }
 
                 PartiallyDownloadedBlock& partialBlock = *(*queuedBlockIt)->partialBlock;
-                ReadStatus status = partialBlock.InitData(cmpctblock, vExtraTxnForCompact);
+                ReadStatus status = partialBlock.InitData(cmpctblock, vExtraTxnForCompact, TakeCompactBlockMempoolTxs(pfrom.GetId(), blockhash).get());
                 if (status == READ_STATUS_INVALID) {
                     RemoveBlockRequest(pindex->GetBlockHash(), pfrom.GetId()); // Reset in-flight state in case Misbehaving does not result in a disconnect
                     Misbehaving(*peer, 100, "invalid compact block");
@@ -4577,7 +4885,7 @@ void PeerManagerImpl::ProcessMessage(CNode& pfrom, const std::string& msg_type,
                 // Optimistically try to reconstruct anyway since we might be
                 // able to without any round trips.
                 PartiallyDownloadedBlock tempBlock(&m_mempool);
-                ReadStatus status = tempBlock.InitData(cmpctblock, vExtraTxnForCompact);
+                ReadStatus status = tempBlock.InitData(cmpctblock, vExtraTxnForCompact, TakeCompactBlockMempoolTxs(pfrom.GetId(), blockhash).get());
                 if (status != READ_STATUS_OK) {
                     // TODO: don't ignore failures
                     return;
@@ -4714,6 +5022,7 @@ void PeerManagerImpl::ProcessMessage(CNode& pfrom, const std::string& msg_type,
             return;
         }
 
+        const size_t block_size{vRecv.size()};
         std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
         vRecv >> TX_WITH_WITNESS(*pblock);
 
@@ -4738,6 +5047,7 @@ void PeerManagerImpl::ProcessMessage(CNode& pfrom, const std::string& msg_type,
             // Always process the block if we requested it, since we may
             // need it even when it's not a candidate for a new best tip.
             forceProcessing = IsBlockRequested(hash);
+            BlockReceived(pfrom.GetId(), hash, block_size);
             RemoveBlockRequest(hash, pfrom.GetId());
             // mapBlockSource is only used for punishing peers and setting
             // which peers send us compact blocks, so the race between here and
@@ -5053,6 +5363,100 @@ bool PeerManagerImpl::MaybeDiscourageAndDisconnect(CNode& pnode, Peer& peer)
     return true;
 }
 
+bool PeerManagerImpl::ShouldPreProcessCompactBlock(const CNode& node, const CBlockHeader& header, const uint256& blockhash)
+{
+    AssertLockHeld(cs_main);
+    const CBlockIndex* pindex{m_chainman.m_blockman.LookupBlockIndex(blockhash)};
+    if (pindex && (pindex->nStatus & BLOCK_HAVE_DATA)) return false;
+    const CBlockIndex* tip{m_chainman.ActiveChain().Tip()};
+    if (!tip || header.hashPrevBlock != tip->GetBlockHash()) return false;
+    if (node.m_bip152_highbandwidth_from) return true;
+    for (auto range = mapBlocksInFlight.equal_range(blockhash); range.first != range.second; range.first++) {
+        if (range.first->second.first == node.GetId()) return true;
+    }
+    return false;
+}
+
+void PeerManagerImpl::PreProcessCompactBlock(NodeId peer_id, const CBlockHeaderAndShortTxIDs& cmpctblock, const uint256& blockhash)
+{
+    const auto key{std::make_pair(peer_id, blockhash)};
+    const auto is_peer{[&](const auto& entry) { return entry.first.first == peer_id; }};
+    {
+        LOCK(m_cmpctblock_mempool_txs_mutex);
+        if (std::any_of(m_cmpctblock_mempool_txs.begin(), m_cmpctblock_mempool_txs.end(),
+                        [&](const auto& entry) { return entry.first == key; })) return;
+    }
+
+    auto mempool_txs{std::make_shared<const CompactBlockMempoolTxs>(PartiallyDownloadedBlock::FindMempoolTxs(cmpctblock, m_mempool))};
+
+    LOCK(m_cmpctblock_mempool_txs_mutex);
+    if (static_cast<size_t>(std::count_if(m_cmpctblock_mempool_txs.begin(), m_cmpctblock_mempool_txs.end(), is_peer)) >= MAX_CMPCTBLOCK_MEMPOOL_TXS_PER_PEER) {
+        m_cmpctblock_mempool_txs.erase(std::find_if(m_cmpctblock_mempool_txs.begin(), m_cmpctblock_mempool_txs.end(), is_peer));
+    }
+    m_cmpctblock_mempool_txs.emplace_back(key, std::move(mempool_txs));
+    if (m_cmpctblock_mempool_txs.size() > MAX_CMPCTBLOCK_MEMPOOL_TXS) m_cmpctblock_mempool_txs.pop_front();
+}
+
+std::shared_ptr<const CompactBlockMempoolTxs> PeerManagerImpl::TakeCompactBlockMempoolTxs(NodeId peer_id, const uint256& blockhash)
+{
+    LOCK(m_cmpctblock_mempool_txs_mutex);
+    const auto it{std::find_if(m_cmpctblock_mempool_txs.begin(), m_cmpctblock_mempool_txs.end(),
+                               [&](const auto& entry) { return entry.first == std::make_pair(peer_id, blockhash); })};
+    if (it == m_cmpctblock_mempool_txs.end()) return nullptr;
+    auto mempool_txs{std::move(it->second)};
+    m_cmpctblock_mempool_txs.erase(it);
+    return mempool_txs;
+}
+
+void PeerManagerImpl::PreProcessMessage(CNode& node, const CNetMessage& msg)
+{
+    // Verify the proof of work of the headers in the message, which is expensive, without
+    // holding up the processing of other peers' messages. The results are cached, so the
+    // checks in ProcessMessage() and under cs_main don't verify the graph solutions again.
+    // Malformed messages are left to ProcessMessage().
+    //
+    // Only do this work for peers that completed the handshake and aren't about to be
+    // disconnected; anything else is verified in ProcessMessage() as usual.
+    if (!node.fSuccessfullyConnected || node.fDisconnect) return;
+    const PeerRef peer{GetPeerRef(node.GetId())};
+    if (!peer || WITH_LOCK(peer->m_misbehavior_mutex, return peer->m_should_discourage)) return;
+
+    const auto& consensus_params{m_chainparams.GetConsensus()};
+    try {
+        SpanReader stream{MakeUCharSpan(msg.m_recv)};
+        if (msg.m_type == NetMsgType::HEADERS) {
+            const unsigned int count = ReadCompactSize(stream);
+            if (count > MAX_HEADERS_RESULTS) return;
+            std::vector<CBlockHeader> headers(count);
+            for (CBlockHeader& header : headers) {
+                stream >> header;
+                ReadCompactSize(stream); // ignore tx count
+            }
+            // Same cheap check as ProcessHeadersMessage(), ahead of the expensive one.
+            if (!CheckHeadersAreContinuous(headers)) return;
+            for (const CBlockHeader& header : headers) {
+                if (!CheckHeaderProofOfWork(header, consensus_params)) return;
+            }
+        } else if (msg.m_type == NetMsgType::CMPCTBLOCK) {
+            CBlockHeaderAndShortTxIDs cmpctblock;
+            stream >> cmpctblock;
+            if (!CheckHeaderProofOfWork(cmpctblock.header, consensus_params)) return;
+            // Also look the block's transactions up in the mempool now, concurrently with other
+            // peers' announcements, instead of in ProcessMessage() while holding cs_main. The
+            // scan takes the mempool lock, so only announcements we will reconstruct get one.
+            if (cmpctblock.header.Time() < Now<NodeSeconds>() - CMPCTBLOCK_PREPROCESS_MAX_AGE) return;
+            const uint256 blockhash{cmpctblock.header.GetHash()};
+            if (!WITH_LOCK(cs_main, return ShouldPreProcessCompactBlock(node, cmpctblock.header, blockhash))) return;
+            PreProcessCompactBlock(node.GetId(), cmpctblock, blockhash);
+        } else if (msg.m_type == NetMsgType::BLOCK) {
+            CBlockHeader header;
+            stream >> header;
+            CheckHeaderProofOfWork(header, consensus_params);
+        }
+    } catch (const std::exception&) {
+    }
+}
+
 bool PeerManagerImpl::ProcessMessages(CNode* pfrom, std::atomic<bool>& interruptMsgProc)
 {
     AssertLockHeld(g_msgproc_mutex);
@@ -5706,7 +6110,7 @@ bool PeerManagerImpl::SendMessages(CNode* pto)
                     {
                         LOCK(m_most_recent_block_mutex);
                         if (m_most_recent_block_hash == pBestIndex->GetBlockHash()) {
-                            cached_cmpctblock_msg = NetMsg::Make(NetMsgType::CMPCTBLOCK, *m_most_recent_compact_block);
+                            cached_cmpctblock_msg = m_most_recent_compact_block_msg.Copy();
                         }
                     }
                     if (cached_cmpctblock_msg.has_value()) {
@@ -5893,6 +6297,18 @@ bool PeerManagerImpl::SendMessages(CNode* pto)
         if (!vInv.empty())
             MakeAndPushMessage(*pto, NetMsgType::INV, vInv);
 
+        //
+        // Message: reqrecon
+        //
+        if (m_txreconciliation) {
+            // Flood the transactions of a round the peer left unfinished, so they aren't stuck.
+            AnnounceReconciledTxs(*peer, m_txreconciliation->TimeoutReconciliation(pto->GetId(), current_time));
+            if (const auto request{m_txreconciliation->InitiateReconciliationRequest(pto->GetId(), current_time)}) {
+                const auto [local_set_size, q] = *request;
+                MakeAndPushMessage(*pto, NetMsgType::REQRECON, local_set_size, q);
+            }
+        }
+
         // Detect whether we're stalling
         auto stalling_timeout = m_block_stalling_timeout.load();
         if (state.m_stalling_since.count() && state.m_stalling_since < current_time - stalling_timeout) {
@@ -5964,11 +6380,11 @@ bool PeerManagerImpl::SendMessages(CNode* pto)
         // Message: getdata (blocks)
         //
         std::vector<CInv> vGetData;
-        if (CanServeBlocks(*peer) && ((sync_blocks_and_headers_from_peer && !IsLimitedPeer(*peer)) || !m_chainman.IsInitialBlockDownload()) && state.vBlocksInFlight.size() < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        if (CanServeBlocks(*peer) && ((sync_blocks_and_headers_from_peer && !IsLimitedPeer(*peer)) || !m_chainman.IsInitialBlockDownload()) && state.vBlocksInFlight.size() < static_cast<size_t>(state.BlockInFlightLimit())) {
             std::vector<const CBlockIndex*> vToDownload;
             NodeId staller = -1;
             auto get_inflight_budget = [&state]() {
-                return std::max(0, MAX_BLOCKS_IN_TRANSIT_PER_PEER - static_cast<int>(state.vBlocksInFlight.size()));
+                return std::max(0, state.BlockInFlightLimit() - static_cast<int>(state.vBlocksInFlight.size()));
             };
 
             // If a snapshot chainstate is in use, we want to find its next blocks
@@ -5994,6 +6410,19 @@ bool PeerManagerImpl::SendMessages(CNode* pto)
                     LogPrint(BCLog::NET, "Stall started peer=%d\n", staller);
                 }
             }
+            // Rather than waiting for a slow peer to deliver the block holding back the window (or to be
+            // disconnected for stalling), ask this faster peer for it instead. Dropping the staller's
+            // request also ends its stall, so it isn't disconnected for a block it no longer holds back.
+            if (vToDownload.empty() && staller != -1) {
+                if (const CBlockIndex* pindex{FindStalledBlockToRerequest(*peer, staller, current_time)}) {
+                    if (BlockRequested(pto->GetId(), *pindex)) {
+                        RemoveBlockRequest(pindex->GetBlockHash(), staller);
+                        vGetData.emplace_back(MSG_BLOCK | GetFetchFlags(*peer), pindex->GetBlockHash());
+                        LogPrint(BCLog::NET, "Requesting block %s (%d) stalled by peer=%d from faster peer=%d\n",
+                            pindex->GetBlockHash().ToString(), pindex->nHeight, staller, pto->GetId());
+                    }
+                }
+            }
         }
 
         //
@@ -34,6 +34,9 @@ struct CNodeStateStats {
     int m_starting_height = -1;
     std::chrono::microseconds m_ping_wait;
     std::vector<int> vHeightInFlight;
+    std::chrono::microseconds m_block_latency{};
+    double m_block_download_rate{0};
+    int m_block_inflight_limit{0};
     bool m_relay_txs;
     CAmount m_fee_filter_received;
     uint64_t m_addr_processed = 0;
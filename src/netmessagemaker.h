@@ -18,6 +18,18 @@ namespace NetMsg {
         VectorWriter{msg.data, 0, std::forward<Args>(args)...};
         return msg;
     }
+
+    /** Same as Make(), but the payload is shared by all copies of the message (see CSerializedNetMsg::Copy()). */
+    template <typename... Args>
+    CSerializedNetMsg MakeShared(std::string msg_type, Args&&... args)
+    {
+        auto data{std::make_shared<std::vector<unsigned char>>()};
+        VectorWriter{*data, 0, std::forward<Args>(args)...};
+        CSerializedNetMsg msg;
+        msg.m_type = std::move(msg_type);
+        msg.m_shared_data = std::move(data);
+        return msg;
+    }
 } // namespace NetMsg
 
 #endif // BITCOIN_NETMESSAGEMAKER_H
@@ -33,10 +33,15 @@
 #include <util/fs.h>
 #include <util/signalinterrupt.h>
 #include <util/strencodings.h>
+#include <util/thread.h>
 #include <util/translation.h>
 #include <validation.h>
 
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
 #include <map>
+#include <thread>
 #include <unordered_map>
 
 namespace kernel {
@@ -45,6 +50,12 @@ static constexpr uint8_t DB_BLOCK_INDEX{'b'};
 static constexpr uint8_t DB_FLAG{'F'};
 static constexpr uint8_t DB_REINDEX_FLAG{'R'};
 static constexpr uint8_t DB_LAST_BLOCK{'l'};
+//! Maximum number of threads reading the block index from disk on startup
+static constexpr unsigned int MAX_BLOCK_INDEX_LOAD_THREADS{8};
+//! Number of block index entries a loading thread hands over at once
+static constexpr size_t BLOCK_INDEX_LOAD_BATCH_SIZE{256};
+//! Maximum number of loaded batches waiting to be inserted
+static constexpr size_t MAX_BLOCK_INDEX_LOAD_BATCHES{16};
 // Keys used in previous version that might still be found in the DB:
 // BlockTreeDB::DB_TXINDEX_BLOCK{'T'};
 // BlockTreeDB::DB_TXINDEX{'t'}
@@ -102,60 +113,154 @@ bool BlockTreeDB::ReadFlag(const std::string& name, bool& fValue)
     return true;
 }
 
+/**
+ * A CDiskBlockIndex record, in the same format, deserialized without taking
+ * cs_main (which CDiskBlockIndex does for nStatus). That lets threads other
+ * than the one holding cs_main read block index entries.
+ */
+struct DiskBlockIndexRecord {
+    int nHeight{0};
+    uint32_t nStatus{0};
+    unsigned int nTx{0};
+    int nFile{0};
+    unsigned int nDataPos{0};
+    unsigned int nUndoPos{0};
+    CBlockHeader header;
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        int _nVersion;
+        s >> VARINT_MODE(_nVersion, VarIntMode::NONNEGATIVE_SIGNED);
+        s >> VARINT_MODE(nHeight, VarIntMode::NONNEGATIVE_SIGNED);
+        s >> VARINT(nStatus);
+        s >> VARINT(nTx);
+        if (nStatus & (BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO)) s >> VARINT_MODE(nFile, VarIntMode::NONNEGATIVE_SIGNED);
+        if (nStatus & BLOCK_HAVE_DATA) s >> VARINT(nDataPos);
+        if (nStatus & BLOCK_HAVE_UNDO) s >> VARINT(nUndoPos);
+        // The header fields follow in CBlockHeader's own order.
+        s >> header;
+    }
+};
+
 bool BlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex, const util::SignalInterrupt& interrupt)
 {
     AssertLockHeld(::cs_main);
-    std::unique_ptr<CDBIterator> pcursor(NewIterator());
-    pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, uint256()));
 
-    // Load m_block_index
-    while (pcursor->Valid()) {
-        if (interrupt) return false;
-        std::pair<uint8_t, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew = insertBlockIndex(diskindex.ConstructBlockHash());
-                pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight        = diskindex.nHeight;
-                pindexNew->nFile          = diskindex.nFile;
-                pindexNew->nDataPos       = diskindex.nDataPos;
-                pindexNew->nUndoPos       = diskindex.nUndoPos;
-                pindexNew->nVersion       = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime          = diskindex.nTime;
-                pindexNew->nBits          = diskindex.nBits;
-                pindexNew->nNonce         = diskindex.nNonce;
-                pindexNew->nStatus        = diskindex.nStatus;
-                pindexNew->nTx            = diskindex.nTx;
-                pindexNew->vdfSolution    = diskindex.vdfSolution;
-
-
-                //
-                //  After talking to a XMR dev. XMR is not validating blocks from disk
-                //  I looked through and tried to trace LoadBlockIndexGuts as best I could
-                //  and I believe that we are validating the headers on communication and
-                //  I can only seem to come to the conclusion that this is validating what
-                //  is already there which was previously once validated.
-                //  if Im wrong make a PR telling me! <3
-                //
-                // if (!CheckProofOfWork(pindexNew->nTime, 
-                //                       pindexNew->GetBlockHeader().GetSHA256(),
-                //                       pindexNew->GetBlockHeader().GetHash(),
-                //                       pindexNew->nBits,
-                //                       pindexNew->vdfSolution,
-                //                       consensusParams)) {
-                //     return error("%s: CheckProofOfWork failed: %s", __func__, pindexNew->ToString());
-                // }
-
-                pcursor->Next();
-            } else {
-                return error("%s: failed to read value", __func__);
+    // Entries are keyed by block hash, which is uniformly distributed. Split
+    // the key space into ranges by the first byte of the hash, and read,
+    // deserialize and hash the (4 KB) entries of each range on its own
+    // thread. Insertion into the block index isn't thread-safe, so the
+    // workers hand over bounded batches to this thread, which links them.
+    struct LoadedEntry {
+        uint256 hash;
+        DiskBlockIndexRecord record;
+    };
+    using Batch = std::vector<LoadedEntry>;
+
+    const unsigned int num_threads{std::clamp(std::thread::hardware_concurrency(), 1U, MAX_BLOCK_INDEX_LOAD_THREADS)};
+    Mutex batches_mutex;
+    std::condition_variable batches_cv;
+    std::deque<Batch> batches;
+    unsigned int running{num_threads};
+    bool failed{false};
+
+    const auto load_range = [&](unsigned int range) {
+        const unsigned int begin_byte{range * 256 / num_threads};
+        const unsigned int end_byte{(range + 1) * 256 / num_threads};
+        const auto hand_over = [&](Batch&& batch) {
+            WAIT_LOCK(batches_mutex, lock);
+            batches_cv.wait(lock, [&] { return batches.size() < MAX_BLOCK_INDEX_LOAD_BATCHES || failed; });
+            batches.push_back(std::move(batch));
+            batches_cv.notify_all();
+        };
+
+        uint256 start;
+        start.begin()[0] = begin_byte;
+        std::unique_ptr<CDBIterator> pcursor(NewIterator());
+        pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, start));
+        Batch batch;
+        while (pcursor->Valid() && !interrupt) {
+            std::pair<uint8_t, uint256> key;
+            if (!pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX || key.second.begin()[0] >= end_byte) break;
+            LoadedEntry& entry{batch.emplace_back()};
+            if (!pcursor->GetValue(entry.record)) {
+                WITH_LOCK(batches_mutex, failed = true);
+                break;
             }
-        } else {
-            break;
+            entry.hash = entry.record.header.GetHash();
+            if (batch.size() == BLOCK_INDEX_LOAD_BATCH_SIZE) {
+                hand_over(std::move(batch));
+                batch.clear();
+            }
+            pcursor->Next();
         }
+        if (!batch.empty()) hand_over(std::move(batch));
+        LOCK(batches_mutex);
+        --running;
+        batches_cv.notify_all();
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads);
+    for (unsigned int range = 0; range < num_threads; ++range) {
+        threads.emplace_back(&util::TraceThread, strprintf("loadblkidx.%u", range), [&load_range, range] { load_range(range); });
+    }
+
+    // Load m_block_index
+    while (true) {
+        Batch batch;
+        {
+            WAIT_LOCK(batches_mutex, lock);
+            batches_cv.wait(lock, [&] { return !batches.empty() || running == 0; });
+            if (batches.empty()) break;
+            batch = std::move(batches.front());
+            batches.pop_front();
+            batches_cv.notify_all();
+        }
+        for (const auto& [hash, record] : batch) {
+            // Construct block index object
+            CBlockIndex* pindexNew = insertBlockIndex(hash);
+            pindexNew->pprev          = insertBlockIndex(record.header.hashPrevBlock);
+            pindexNew->nHeight        = record.nHeight;
+            pindexNew->nFile          = record.nFile;
+            pindexNew->nDataPos       = record.nDataPos;
+            pindexNew->nUndoPos       = record.nUndoPos;
+            pindexNew->nVersion       = record.header.nVersion;
+            pindexNew->hashMerkleRoot = record.header.hashMerkleRoot;
+            pindexNew->nTime          = record.header.nTime;
+            pindexNew->nBits          = record.header.nBits;
+            pindexNew->nNonce         = record.header.nNonce;
+            pindexNew->nStatus        = record.nStatus;
+            pindexNew->nTx            = record.nTx;
+            pindexNew->vdfSolution    = record.header.vdfSolution;
+
+
+            //
+            //  After talking to a XMR dev. XMR is not validating blocks from disk
+            //  I looked through and tried to trace LoadBlockIndexGuts as best I could
+            //  and I believe that we are validating the headers on communication and
+            //  I can only seem to come to the conclusion that this is validating what
+            //  is already there which was previously once validated.
+            //  if Im wrong make a PR telling me! <3
+            //
+            // if (!CheckProofOfWork(pindexNew->nTime, 
+            //                       pindexNew->GetBlockHeader().GetSHA256(),
+            //                       pindexNew->GetBlockHeader().GetHash(),
+            //                       pindexNew->nBits,
+            //                       pindexNew->vdfSolution,
+            //                       consensusParams)) {
+            //     return error("%s: CheckProofOfWork failed: %s", __func__, pindexNew->ToString());
+            // }
+        }
+    }
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    if (interrupt) return false;
+    if (WITH_LOCK(batches_mutex, return failed)) {
+        return error("%s: failed to read value", __func__);
     }
 
     return true;
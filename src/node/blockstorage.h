@@ -15,6 +15,7 @@
 #include <kernel/messagestartchars.h>
 #include <primitives/block.h>
 #include <streams.h>
+#include <support/allocators/pool.h>
 #include <sync.h>
 #include <uint256.h>
 #include <util/fs.h>
@@ -82,7 +83,22 @@ extern std::atomic_bool fReindex;
 // we ever switch to another associative container, we need to either use a
 // container that has stable addressing (true of all std associative
 // containers), or make the key a `std::unique_ptr<CBlockIndex>`
-using BlockMap = std::unordered_map<uint256, CBlockIndex, BlockHasher>;
+//
+// Entries are large (the header includes a 4 KB vdfSolution) and are never
+// freed individually during normal operation, so nodes are carved out of
+// pooled chunks instead of being allocated one by one. See CCoinsMap for the
+// reasoning behind the MAX_BLOCK_SIZE_BYTES value.
+using BlockMap = std::unordered_map<uint256,
+                                    CBlockIndex,
+                                    BlockHasher,
+                                    std::equal_to<uint256>,
+                                    PoolAllocator<std::pair<const uint256, CBlockIndex>,
+                                                  sizeof(std::pair<const uint256, CBlockIndex>) + sizeof(void*) * 4>>;
+
+using BlockMapMemoryResource = BlockMap::allocator_type::ResourceType;
+
+//! Size of the chunks block index entries are allocated from
+static constexpr size_t BLOCK_MAP_CHUNK_SIZE_BYTES{1 << 20};
 
 struct CBlockIndexWorkComparator {
     bool operator()(const CBlockIndex* pa, const CBlockIndex* pb) const;
@@ -259,7 +275,9 @@ public:
     const util::SignalInterrupt& m_interrupt;
     std::atomic<bool> m_importing{false};
 
-    BlockMap m_block_index GUARDED_BY(cs_main);
+    //! Backing memory for m_block_index entries; must outlive the map.
+    BlockMapMemoryResource m_block_index_memory_resource{BLOCK_MAP_CHUNK_SIZE_BYTES};
+    BlockMap m_block_index GUARDED_BY(cs_main){0, BlockHasher{}, BlockMap::key_equal{}, &m_block_index_memory_resource};
 
     /**
      * The height of the base block of an assumeutxo snapshot, if one is in use.
@@ -90,6 +90,45 @@ static BlockAssembler::Options ConfiguredOptions()
 BlockAssembler::BlockAssembler(Chainstate& chainstate, const CTxMemPool* mempool)
     : BlockAssembler(chainstate, mempool, ConfiguredOptions()) {}
 
+BlockTemplateCache::BlockTemplateCache(Chainstate& chainstate, const CTxMemPool* mempool)
+    : m_chainstate{chainstate}, m_mempool{mempool} {}
+
+BlockTemplateCache::BlockTemplateCache(Chainstate& chainstate, const CTxMemPool* mempool, const BlockAssembler::Options& options)
+    : m_chainstate{chainstate}, m_mempool{mempool}, m_options{options} {}
+
+std::unique_ptr<CBlockTemplate> BlockTemplateCache::GetTemplate(const CScript& scriptPubKeyIn)
+{
+    LOCK(m_mutex);
+    const uint256 tip_hash{WITH_LOCK(::cs_main, return m_chainstate.m_chain.Tip()->GetBlockHash())};
+    // Read the counter before assembling, so that transactions arriving meanwhile cause another assembly.
+    const unsigned int transactions_updated{m_mempool ? m_mempool->GetTransactionsUpdated() : 0};
+    if (!m_template || m_template->block.hashPrevBlock != tip_hash ||
+        m_transactions_updated != transactions_updated || m_script != scriptPubKeyIn) {
+        auto assembler{m_options ? BlockAssembler{m_chainstate, m_mempool, *m_options} : BlockAssembler{m_chainstate, m_mempool}};
+        auto block_template{assembler.CreateNewBlock(scriptPubKeyIn)};
+        if (!block_template) return nullptr;
+        // Compute the merkle root once here, rather than in every consumer of the template.
+        block_template->block.hashMerkleRoot = BlockMerkleRoot(block_template->block);
+        m_template = std::move(block_template);
+        m_transactions_updated = transactions_updated;
+        m_script = scriptPubKeyIn;
+        ++m_num_assembled;
+        return std::make_unique<CBlockTemplate>(*m_template);
+    }
+
+    auto block_template{std::make_unique<CBlockTemplate>(*m_template)};
+    LOCK(::cs_main);
+    const CBlockIndex* pindexPrev{m_chainstate.m_blockman.LookupBlockIndex(block_template->block.hashPrevBlock)};
+    if (pindexPrev) UpdateTime(&block_template->block, m_chainstate.m_chainman.GetConsensus(), pindexPrev);
+    return block_template;
+}
+
+uint64_t BlockTemplateCache::GetNumAssembled() const
+{
+    LOCK(m_mutex);
+    return m_num_assembled;
+}
+
 void BlockAssembler::resetBlock()
 {
     inBlock.clear();
@@ -8,6 +8,8 @@
 
 #include <policy/policy.h>
 #include <primitives/block.h>
+#include <script/script.h>
+#include <sync.h>
 #include <txmempool.h>
 
 #include <memory>
@@ -199,6 +201,39 @@ private:
     void SortForBlock(const CTxMemPool::setEntries& package, std::vector<CTxMemPool::txiter>& sortedEntries);
 };
 
+/**
+ * Serves block templates to several consumers, such as mining threads, assembling
+ * a new one only when the chain tip, the mempool (as tracked by
+ * CTxMemPool::GetTransactionsUpdated) or the coinbase script has changed since the
+ * previous one. Concurrent callers wait for a single assembly rather than each
+ * scanning the mempool.
+ */
+class BlockTemplateCache
+{
+public:
+    explicit BlockTemplateCache(Chainstate& chainstate, const CTxMemPool* mempool);
+    explicit BlockTemplateCache(Chainstate& chainstate, const CTxMemPool* mempool, const BlockAssembler::Options& options);
+
+    /** Return a copy of the current template with coinbase to scriptPubKeyIn, its merkle
+     *  root and an up to date block time, or nullptr if no template could be created. */
+    std::unique_ptr<CBlockTemplate> GetTemplate(const CScript& scriptPubKeyIn) EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+
+    /** Number of templates assembled so far */
+    uint64_t GetNumAssembled() const EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+
+private:
+    Chainstate& m_chainstate;
+    const CTxMemPool* const m_mempool;
+    const std::optional<BlockAssembler::Options> m_options;
+
+    mutable Mutex m_mutex;
+    std::unique_ptr<CBlockTemplate> m_template GUARDED_BY(m_mutex);
+    /** GetTransactionsUpdated() of the mempool before m_template was assembled */
+    unsigned int m_transactions_updated GUARDED_BY(m_mutex){0};
+    CScript m_script GUARDED_BY(m_mutex);
+    uint64_t m_num_assembled GUARDED_BY(m_mutex){0};
+};
+
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
 
 /** Update an old GenerateCoinbaseCommitment from CreateNewBlock after the block txs have changed */
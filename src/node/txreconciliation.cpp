@@ -5,10 +5,16 @@
 #include <node/txreconciliation.h>
 
 #include <common/system.h>
+#include <crypto/siphash.h>
 #include <logging.h>
+#include <node/minisketchwrapper.h>
 #include <util/check.h>
+#include <util/hasher.h>
 
+#include <algorithm>
+#include <cmath>
 #include <unordered_map>
+#include <unordered_set>
 #include <variant>
 
 
@@ -29,6 +35,30 @@ uint256 ComputeSalt(uint64_t salt1, uint64_t salt2)
     return (HashWriter(RECON_SALT_HASHER) << std::min(salt1, salt2) << std::max(salt1, salt2)).GetSHA256();
 }
 
+/**
+ * Estimate the capacity of a sketch sufficient to find the difference between two sets, see
+ * BIP-330: the difference in set sizes, plus a q-weighted share of the smaller set. One more
+ * element is added that is never decoded into, and serves as a checksum (see HandleSketch).
+ */
+uint32_t EstimateSketchCapacity(size_t local_set_size, size_t remote_set_size, double q)
+{
+    const size_t set_size_diff{local_set_size > remote_set_size ? local_set_size - remote_set_size : remote_set_size - local_set_size};
+    const size_t min_size{std::min(local_set_size, remote_set_size)};
+    // q travels as a fixed-point fraction that rounds slightly down, so round the product to nearest
+    // rather than truncating it.
+    const size_t capacity{set_size_diff + static_cast<size_t>(std::lround(q * min_size)) + 1 + 1};
+    return static_cast<uint32_t>(std::min<size_t>(capacity, MAX_SKETCH_CAPACITY));
+}
+
+/** Number of bytes a sketch element takes in serialized form. */
+constexpr size_t SKETCH_ELEMENT_BYTES{4};
+
+/** Phase of a reconciliation we initiated. */
+enum class ReconciliationPhase {
+    NONE,
+    INIT_REQUESTED,
+};
+
 /**
  * Keeps track of txreconciliation-related per-peer state.
  */
@@ -36,9 +66,6 @@ class TxReconciliationState
 {
 public:
     /**
-     * TODO: This field is public to ignore -Wunused-private-field. Make private once used in
-     * the following commits.
-     *
      * Reconciliation protocol assumes using one role consistently: either a reconciliation
      * initiator (requesting sketches), or responder (sending sketches). This defines our role,
      * based on the direction of the p2p connection.
@@ -47,14 +74,49 @@ public:
     bool m_we_initiate;
 
     /**
-     * TODO: These fields are public to ignore -Wunused-private-field. Make private once used in
-     * the following commits.
-     *
      * These values are used to salt short IDs, which is necessary for transaction reconciliations.
      */
     uint64_t m_k0, m_k1;
 
+    /** Transactions we want to announce to the peer via the next reconciliation. */
+    std::unordered_set<uint256, SaltedTxidHasher> m_local_set;
+
+    /**
+     * As a responder, the set we sent a sketch of, keyed by short ID. Kept until the peer
+     * tells us the outcome, so we can announce what it asks for.
+     */
+    std::unordered_map<uint32_t, uint256> m_local_set_snapshot;
+
+    /** As a responder, whether we sent a sketch and are waiting for a RECONCILDIFF. */
+    bool m_sketch_sent{false};
+
+    /** As an initiator, whether we are waiting for a SKETCH. */
+    ReconciliationPhase m_phase{ReconciliationPhase::NONE};
+
+    /** As an initiator, when we should request the next reconciliation. */
+    std::chrono::microseconds m_next_request{0};
+
+    /** When we give up on the ongoing round, as an initiator or a responder. */
+    std::chrono::microseconds m_round_timeout{0};
+
     TxReconciliationState(bool we_initiate, uint64_t k0, uint64_t k1) : m_we_initiate(we_initiate), m_k0(k0), m_k1(k1) {}
+
+    /** Compute the BIP-330 short ID of a transaction: never zero, as sketches can't hold 0. */
+    uint32_t ComputeShortID(const uint256& wtxid) const
+    {
+        const uint64_t s{SipHashUint256(m_k0, m_k1, wtxid)};
+        return 1 + static_cast<uint32_t>(s % 0xFFFFFFFF);
+    }
+
+    /** Build a sketch of the given capacity containing the short IDs of our set. */
+    Minisketch ComputeSketch(uint32_t capacity) const
+    {
+        Minisketch sketch{node::MakeMinisketch32(capacity)};
+        for (const uint256& wtxid : m_local_set) {
+            sketch.Add(ComputeShortID(wtxid));
+        }
+        return sketch;
+    }
 };
 
 } // namespace
@@ -76,6 +138,23 @@ private:
      */
     std::unordered_map<NodeId, std::variant<uint64_t, TxReconciliationState>> m_states GUARDED_BY(m_txreconciliation_mutex);
 
+    /** Number of registered peers we initiate reconciliations with (outbound) and respond to (inbound). */
+    size_t m_outbound_registered GUARDED_BY(m_txreconciliation_mutex){0};
+    size_t m_inbound_registered GUARDED_BY(m_txreconciliation_mutex){0};
+
+    TxReconciliationState* GetRegisteredPeerState(NodeId peer_id) EXCLUSIVE_LOCKS_REQUIRED(m_txreconciliation_mutex)
+    {
+        AssertLockHeld(m_txreconciliation_mutex);
+        auto recon_state = m_states.find(peer_id);
+        if (recon_state == m_states.end()) return nullptr;
+        return std::get_if<TxReconciliationState>(&recon_state->second);
+    }
+
+    const TxReconciliationState* GetRegisteredPeerState(NodeId peer_id) const EXCLUSIVE_LOCKS_REQUIRED(m_txreconciliation_mutex)
+    {
+        return const_cast<Impl*>(this)->GetRegisteredPeerState(peer_id);
+    }
+
 public:
     explicit Impl(uint32_t recon_version) : m_recon_version(recon_version) {}
 
@@ -121,7 +200,8 @@ public:
                       peer_id, is_peer_inbound);
 
         const uint256 full_salt{ComputeSalt(local_salt, remote_salt)};
-        recon_state->second = TxReconciliationState(!is_peer_inbound, full_salt.GetUint64(0), full_salt.GetUint64(1));
+        recon_state->second.emplace<TxReconciliationState>(!is_peer_inbound, full_salt.GetUint64(0), full_salt.GetUint64(1));
+        ++(is_peer_inbound ? m_inbound_registered : m_outbound_registered);
         return ReconciliationRegisterResult::SUCCESS;
     }
 
@@ -129,6 +209,9 @@ public:
     {
         AssertLockNotHeld(m_txreconciliation_mutex);
         LOCK(m_txreconciliation_mutex);
+        if (const auto* peer_state{GetRegisteredPeerState(peer_id)}) {
+            --(peer_state->m_we_initiate ? m_outbound_registered : m_inbound_registered);
+        }
         if (m_states.erase(peer_id)) {
             LogPrintLevel(BCLog::TXRECONCILIATION, BCLog::Level::Debug, "Forget txreconciliation state of peer=%d\n", peer_id);
         }
@@ -142,6 +225,198 @@ public:
         return (recon_state != m_states.end() &&
                 std::holds_alternative<TxReconciliationState>(recon_state->second));
     }
+
+    bool ShouldFloodTo(NodeId peer_id, const uint256& wtxid) const EXCLUSIVE_LOCKS_REQUIRED(!m_txreconciliation_mutex)
+    {
+        AssertLockNotHeld(m_txreconciliation_mutex);
+        LOCK(m_txreconciliation_mutex);
+        const auto* peer_state{GetRegisteredPeerState(peer_id)};
+        if (!peer_state) return true;
+
+        // The salt is unique per peer, so this picks an independent pseudorandom
+        // subset of peers for every transaction.
+        const uint64_t hash{SipHashUint256(peer_state->m_k0, peer_state->m_k1, wtxid)};
+        if (peer_state->m_we_initiate) {
+            return hash % m_outbound_registered < OUTBOUND_FANOUT_DESTINATIONS;
+        }
+        return hash % 1000 < static_cast<uint64_t>(INBOUND_FANOUT_DESTINATIONS_FRACTION * 1000);
+    }
+
+    bool AddToSet(NodeId peer_id, const uint256& wtxid) EXCLUSIVE_LOCKS_REQUIRED(!m_txreconciliation_mutex)
+    {
+        AssertLockNotHeld(m_txreconciliation_mutex);
+        LOCK(m_txreconciliation_mutex);
+        auto* peer_state{GetRegisteredPeerState(peer_id)};
+        if (!peer_state || peer_state->m_local_set.size() >= MAX_RECONSET_SIZE) return false;
+        peer_state->m_local_set.insert(wtxid);
+        return true;
+    }
+
+    bool TryRemovingFromSet(NodeId peer_id, const uint256& wtxid) EXCLUSIVE_LOCKS_REQUIRED(!m_txreconciliation_mutex)
+    {
+        AssertLockNotHeld(m_txreconciliation_mutex);
+        LOCK(m_txreconciliation_mutex);
+        auto* peer_state{GetRegisteredPeerState(peer_id)};
+        return peer_state && peer_state->m_local_set.erase(wtxid) > 0;
+    }
+
+    std::optional<std::pair<uint16_t, uint16_t>> InitiateReconciliationRequest(NodeId peer_id, std::chrono::microseconds now)
+        EXCLUSIVE_LOCKS_REQUIRED(!m_txreconciliation_mutex)
+    {
+        AssertLockNotHeld(m_txreconciliation_mutex);
+        LOCK(m_txreconciliation_mutex);
+        auto* peer_state{GetRegisteredPeerState(peer_id)};
+        if (!peer_state || !peer_state->m_we_initiate) return std::nullopt;
+        if (peer_state->m_phase != ReconciliationPhase::NONE || now < peer_state->m_next_request) return std::nullopt;
+
+        peer_state->m_phase = ReconciliationPhase::INIT_REQUESTED;
+        peer_state->m_next_request = now + RECON_REQUEST_INTERVAL;
+        peer_state->m_round_timeout = now + RECON_RESPONSE_TIMEOUT;
+        const uint16_t set_size{static_cast<uint16_t>(peer_state->m_local_set.size())};
+        LogPrintLevel(BCLog::TXRECONCILIATION, BCLog::Level::Debug, "Initiate reconciliation with peer=%d with the following params: local_set_size=%i\n",
+                      peer_id, set_size);
+        return std::make_pair(set_size, static_cast<uint16_t>(RECON_Q * Q_PRECISION));
+    }
+
+    ReconciliationResult HandleReconciliationRequest(NodeId peer_id, uint16_t peer_set_size, uint16_t peer_q,
+                                                     std::vector<uint8_t>& sketch_out, std::chrono::microseconds now)
+        EXCLUSIVE_LOCKS_REQUIRED(!m_txreconciliation_mutex)
+    {
+        AssertLockNotHeld(m_txreconciliation_mutex);
+        LOCK(m_txreconciliation_mutex);
+        auto* peer_state{GetRegisteredPeerState(peer_id)};
+        if (!peer_state) return ReconciliationResult::NOT_FOUND;
+        // The initiator must not request again before finishing the previous round.
+        if (peer_state->m_we_initiate || peer_state->m_sketch_sent) return ReconciliationResult::PROTOCOL_VIOLATION;
+
+        sketch_out.clear();
+        if (!peer_state->m_local_set.empty()) {
+            const double q{double(peer_q) / Q_PRECISION};
+            const uint32_t capacity{EstimateSketchCapacity(peer_state->m_local_set.size(), peer_set_size, q)};
+            sketch_out = peer_state->ComputeSketch(capacity).Serialize();
+        }
+
+        peer_state->m_local_set_snapshot.clear();
+        for (const uint256& wtxid : peer_state->m_local_set) {
+            peer_state->m_local_set_snapshot.emplace(peer_state->ComputeShortID(wtxid), wtxid);
+        }
+        peer_state->m_local_set.clear();
+        peer_state->m_sketch_sent = true;
+        peer_state->m_round_timeout = now + RECON_RESPONSE_TIMEOUT;
+        LogPrintLevel(BCLog::TXRECONCILIATION, BCLog::Level::Debug, "Respond to reconciliation request from peer=%d with a sketch of %i bytes\n",
+                      peer_id, sketch_out.size());
+        return ReconciliationResult::SUCCESS;
+    }
+
+    std::vector<uint256> TimeoutReconciliation(NodeId peer_id, std::chrono::microseconds now) EXCLUSIVE_LOCKS_REQUIRED(!m_txreconciliation_mutex)
+    {
+        AssertLockNotHeld(m_txreconciliation_mutex);
+        LOCK(m_txreconciliation_mutex);
+        auto* peer_state{GetRegisteredPeerState(peer_id)};
+        std::vector<uint256> txs_to_announce;
+        if (!peer_state || now < peer_state->m_round_timeout) return txs_to_announce;
+
+        if (peer_state->m_phase == ReconciliationPhase::INIT_REQUESTED) {
+            txs_to_announce.assign(peer_state->m_local_set.begin(), peer_state->m_local_set.end());
+            peer_state->m_local_set.clear();
+            peer_state->m_phase = ReconciliationPhase::NONE;
+        } else if (peer_state->m_sketch_sent) {
+            for (const auto& [_, wtxid] : peer_state->m_local_set_snapshot) {
+                txs_to_announce.push_back(wtxid);
+            }
+            peer_state->m_local_set_snapshot.clear();
+            peer_state->m_sketch_sent = false;
+        } else {
+            return txs_to_announce;
+        }
+        LogPrintLevel(BCLog::TXRECONCILIATION, BCLog::Level::Debug, "Reconciliation with peer=%d timed out: announcing %i\n",
+                      peer_id, txs_to_announce.size());
+        return txs_to_announce;
+    }
+
+    ReconciliationResult HandleSketch(NodeId peer_id, Span<const uint8_t> skdata, bool& success,
+                                      std::vector<uint32_t>& txs_to_request, std::vector<uint256>& txs_to_announce)
+        EXCLUSIVE_LOCKS_REQUIRED(!m_txreconciliation_mutex)
+    {
+        AssertLockNotHeld(m_txreconciliation_mutex);
+        LOCK(m_txreconciliation_mutex);
+        auto* peer_state{GetRegisteredPeerState(peer_id)};
+        if (!peer_state) return ReconciliationResult::NOT_FOUND;
+        if (!peer_state->m_we_initiate || peer_state->m_phase != ReconciliationPhase::INIT_REQUESTED) {
+            return ReconciliationResult::PROTOCOL_VIOLATION;
+        }
+        if (skdata.size() % SKETCH_ELEMENT_BYTES != 0 || skdata.size() / SKETCH_ELEMENT_BYTES > MAX_SKETCH_CAPACITY) {
+            return ReconciliationResult::PROTOCOL_VIOLATION;
+        }
+
+        txs_to_request.clear();
+        txs_to_announce.clear();
+        success = true;
+        const uint32_t capacity{static_cast<uint32_t>(skdata.size() / SKETCH_ELEMENT_BYTES)};
+        if (capacity > 0) {
+            Minisketch remote_sketch{node::MakeMinisketch32(capacity)};
+            remote_sketch.Deserialize(skdata);
+            Minisketch local_sketch{peer_state->ComputeSketch(capacity)};
+            local_sketch.Merge(remote_sketch);
+            // Decode at most capacity - 1 differences, keeping the last element as a checksum:
+            // a sketch holding more differences than its capacity otherwise sometimes decodes to
+            // bogus ones, and the real ones would never be announced.
+            if (const auto differences{local_sketch.Decode(capacity - 1)}) {
+                std::unordered_map<uint32_t, uint256> local_short_ids;
+                for (const uint256& wtxid : peer_state->m_local_set) {
+                    local_short_ids.emplace(peer_state->ComputeShortID(wtxid), wtxid);
+                }
+                for (const uint64_t diff : *differences) {
+                    const uint32_t short_id{static_cast<uint32_t>(diff)};
+                    if (const auto it{local_short_ids.find(short_id)}; it != local_short_ids.end()) {
+                        txs_to_announce.push_back(it->second);
+                    } else {
+                        txs_to_request.push_back(short_id);
+                    }
+                }
+            } else {
+                success = false;
+            }
+        }
+        // With an empty sketch the peer has nothing for us, and with a failed decoding we
+        // fall back to announcing everything; both mean announcing our whole set.
+        if (capacity == 0 || !success) {
+            txs_to_announce.assign(peer_state->m_local_set.begin(), peer_state->m_local_set.end());
+        }
+        LogPrintLevel(BCLog::TXRECONCILIATION, BCLog::Level::Debug, "Reconciliation with peer=%d %s: announcing %i, requesting %i\n",
+                      peer_id, success ? "succeeded" : "failed", txs_to_announce.size(), txs_to_request.size());
+
+        peer_state->m_local_set.clear();
+        peer_state->m_phase = ReconciliationPhase::NONE;
+        return ReconciliationResult::SUCCESS;
+    }
+
+    ReconciliationResult HandleReconciliationDifference(NodeId peer_id, bool success,
+                                                        const std::vector<uint32_t>& ask_shortids,
+                                                        std::vector<uint256>& txs_to_announce) EXCLUSIVE_LOCKS_REQUIRED(!m_txreconciliation_mutex)
+    {
+        AssertLockNotHeld(m_txreconciliation_mutex);
+        LOCK(m_txreconciliation_mutex);
+        auto* peer_state{GetRegisteredPeerState(peer_id)};
+        if (!peer_state) return ReconciliationResult::NOT_FOUND;
+        if (peer_state->m_we_initiate || !peer_state->m_sketch_sent) return ReconciliationResult::PROTOCOL_VIOLATION;
+
+        txs_to_announce.clear();
+        if (success) {
+            for (const uint32_t short_id : ask_shortids) {
+                if (const auto it{peer_state->m_local_set_snapshot.find(short_id)}; it != peer_state->m_local_set_snapshot.end()) {
+                    txs_to_announce.push_back(it->second);
+                }
+            }
+        } else {
+            for (const auto& [_, wtxid] : peer_state->m_local_set_snapshot) {
+                txs_to_announce.push_back(wtxid);
+            }
+        }
+        peer_state->m_local_set_snapshot.clear();
+        peer_state->m_sketch_sent = false;
+        return ReconciliationResult::SUCCESS;
+    }
 };
 
 TxReconciliationTracker::TxReconciliationTracker(uint32_t recon_version) : m_impl{std::make_unique<TxReconciliationTracker::Impl>(recon_version)} {}
@@ -168,3 +443,47 @@ bool TxReconciliationTracker::IsPeerRegistered(NodeId peer_id) const
 {
     return m_impl->IsPeerRegistered(peer_id);
 }
+
+bool TxReconciliationTracker::ShouldFloodTo(NodeId peer_id, const uint256& wtxid) const
+{
+    return m_impl->ShouldFloodTo(peer_id, wtxid);
+}
+
+bool TxReconciliationTracker::AddToSet(NodeId peer_id, const uint256& wtxid)
+{
+    return m_impl->AddToSet(peer_id, wtxid);
+}
+
+bool TxReconciliationTracker::TryRemovingFromSet(NodeId peer_id, const uint256& wtxid)
+{
+    return m_impl->TryRemovingFromSet(peer_id, wtxid);
+}
+
+std::optional<std::pair<uint16_t, uint16_t>> TxReconciliationTracker::InitiateReconciliationRequest(NodeId peer_id, std::chrono::microseconds now)
+{
+    return m_impl->InitiateReconciliationRequest(peer_id, now);
+}
+
+ReconciliationResult TxReconciliationTracker::HandleReconciliationRequest(NodeId peer_id, uint16_t peer_set_size, uint16_t peer_q,
+                                                                          std::vector<uint8_t>& sketch_out, std::chrono::microseconds now)
+{
+    return m_impl->HandleReconciliationRequest(peer_id, peer_set_size, peer_q, sketch_out, now);
+}
+
+std::vector<uint256> TxReconciliationTracker::TimeoutReconciliation(NodeId peer_id, std::chrono::microseconds now)
+{
+    return m_impl->TimeoutReconciliation(peer_id, now);
+}
+
+ReconciliationResult TxReconciliationTracker::HandleSketch(NodeId peer_id, Span<const uint8_t> skdata, bool& success,
+                                                           std::vector<uint32_t>& txs_to_request, std::vector<uint256>& txs_to_announce)
+{
+    return m_impl->HandleSketch(peer_id, skdata, success, txs_to_request, txs_to_announce);
+}
+
+ReconciliationResult TxReconciliationTracker::HandleReconciliationDifference(NodeId peer_id, bool success,
+                                                                             const std::vector<uint32_t>& ask_shortids,
+                                                                             std::vector<uint256>& txs_to_announce)
+{
+    return m_impl->HandleReconciliationDifference(peer_id, success, ask_shortids, txs_to_announce);
+}
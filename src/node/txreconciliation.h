@@ -6,13 +6,45 @@
 #define BITCOIN_NODE_TXRECONCILIATION_H
 
 #include <net.h>
+#include <span.h>
 #include <sync.h>
+#include <uint256.h>
 
+#include <chrono>
+#include <cstdint>
 #include <memory>
+#include <optional>
 #include <tuple>
+#include <vector>
 
 /** Supported transaction reconciliation protocol version */
 static constexpr uint32_t TXRECONCILIATION_VERSION{1};
+/** How often we request a reconciliation from each peer we initiate reconciliations with. */
+static constexpr std::chrono::microseconds RECON_REQUEST_INTERVAL{8s};
+/**
+ * Maximum number of transactions waiting to be reconciled with a single peer. Once the set is
+ * full, further transactions are flooded to the peer instead.
+ */
+static constexpr size_t MAX_RECONSET_SIZE{3000};
+/**
+ * How long we wait for the peer to complete a reconciliation round, i.e. to answer our REQRECON
+ * with a SKETCH or our SKETCH with a RECONCILDIFF, before giving up on the round and flooding
+ * its transactions instead.
+ */
+static constexpr std::chrono::microseconds RECON_RESPONSE_TIMEOUT{30s};
+/** Maximum capacity (in elements) of a sketch we send or accept. */
+static constexpr uint32_t MAX_SKETCH_CAPACITY{2 << 11};
+/** Coefficient used to estimate the set difference from the smaller set's size, see BIP-330. */
+static constexpr double RECON_Q{0.25};
+/** The q coefficient is transmitted as a fixed-point integer with this precision. */
+static constexpr uint16_t Q_PRECISION{(2 << 14) - 1};
+/**
+ * Number of outbound reconciling peers we still flood a given transaction to (on average), so
+ * that transactions keep propagating quickly through the network core.
+ */
+static constexpr size_t OUTBOUND_FANOUT_DESTINATIONS{1};
+/** Fraction of inbound reconciling peers we still flood a given transaction to. */
+static constexpr double INBOUND_FANOUT_DESTINATIONS_FRACTION{0.1};
 
 enum class ReconciliationRegisterResult {
     NOT_FOUND,
@@ -21,6 +53,16 @@ enum class ReconciliationRegisterResult {
     PROTOCOL_VIOLATION,
 };
 
+/** Outcome of handling a reconciliation message from a peer. */
+enum class ReconciliationResult {
+    //! The message was handled; the out parameters describe what to send.
+    SUCCESS,
+    //! We don't reconcile with this peer; the message should be ignored.
+    NOT_FOUND,
+    //! The message was not expected in the current state; the peer should be disconnected.
+    PROTOCOL_VIOLATION,
+};
+
 /**
  * Transaction reconciliation is a way for nodes to efficiently announce transactions.
  * This object keeps track of all txreconciliation-related communications with the peers.
@@ -84,6 +126,64 @@ public:
      * Check if a peer is registered to reconcile transactions with us.
      */
     bool IsPeerRegistered(NodeId peer_id) const;
+
+    /**
+     * Step 1. Decide whether a transaction should still be flooded to this registered peer
+     * instead of being reconciled. A deterministic, per-peer salted selection floods each
+     * transaction to OUTBOUND_FANOUT_DESTINATIONS outbound peers and to
+     * INBOUND_FANOUT_DESTINATIONS_FRACTION of inbound peers on average.
+     */
+    bool ShouldFloodTo(NodeId peer_id, const uint256& wtxid) const;
+
+    /**
+     * Step 1. Add a transaction to the set of transactions to reconcile with the peer.
+     * Returns false if the peer is not registered or its set is full, in which case the
+     * caller should announce the transaction to the peer by flooding.
+     */
+    bool AddToSet(NodeId peer_id, const uint256& wtxid);
+
+    /**
+     * Step 1. Remove a transaction from the peer's set, e.g. because the peer announced
+     * it to us. Returns whether the transaction was in the set.
+     */
+    bool TryRemovingFromSet(NodeId peer_id, const uint256& wtxid);
+
+    /**
+     * Step 2. If we initiate reconciliations with the peer, no reconciliation is ongoing and
+     * the peer's turn has come, return the (local set size, q) to send in a REQRECON message.
+     */
+    std::optional<std::pair<uint16_t, uint16_t>> InitiateReconciliationRequest(NodeId peer_id, std::chrono::microseconds now);
+
+    /**
+     * Step 2. Respond to the peer's REQRECON: move our set for the peer into a snapshot and
+     * compute the sketch of it to send back. An empty sketch means our set is empty.
+     */
+    ReconciliationResult HandleReconciliationRequest(NodeId peer_id, uint16_t peer_set_size, uint16_t peer_q,
+                                                     std::vector<uint8_t>& sketch_out, std::chrono::microseconds now);
+
+    /**
+     * Step 2. Give up on a round the peer has not completed within RECON_RESPONSE_TIMEOUT, so that
+     * the next one can start. Returns the transactions of the abandoned round (our set as an
+     * initiator, our snapshot as a responder), which should be announced to the peer by flooding.
+     */
+    std::vector<uint256> TimeoutReconciliation(NodeId peer_id, std::chrono::microseconds now);
+
+    /**
+     * Steps 3-4. Handle the peer's SKETCH by finding the set difference against our own set.
+     * On success, txs_to_request holds the short IDs to ask for in RECONCILDIFF, and
+     * txs_to_announce the transactions the peer is missing. On failure, all our transactions
+     * are returned in txs_to_announce. Our set is cleared either way.
+     */
+    ReconciliationResult HandleSketch(NodeId peer_id, Span<const uint8_t> skdata, bool& success,
+                                      std::vector<uint32_t>& txs_to_request, std::vector<uint256>& txs_to_announce);
+
+    /**
+     * Step 4. Handle the peer's RECONCILDIFF: return the transactions from our snapshot that
+     * the peer asked for, or all of them if the reconciliation failed.
+     */
+    ReconciliationResult HandleReconciliationDifference(NodeId peer_id, bool success,
+                                                        const std::vector<uint32_t>& ask_shortids,
+                                                        std::vector<uint256>& txs_to_announce);
 };
 
 #endif // BITCOIN_NODE_TXRECONCILIATION_H
@@ -19,6 +19,7 @@
 #include <tinyformat.h>
 #include <uint256.h>
 #include <util/fs.h>
+#include <util/fs_helpers.h>
 #include <util/serfloat.h>
 #include <util/time.h>
 
@@ -34,6 +35,11 @@
 
 static constexpr double INF_FEERATE = 1e99;
 
+/** Version of the fee_estimates.dat format, which is written as the version required to read
+ *  it. It is numbered after the 0.14.99 release that introduced it, which is above this client's
+ *  own version, so files are checked against it rather than against CLIENT_VERSION. */
+static constexpr int FEE_ESTIMATES_FILE_VERSION{149900};
+
 std::string StringForFeeEstimateHorizon(FeeEstimateHorizon horizon)
 {
     switch (horizon) {
@@ -83,13 +89,14 @@ private:
     // Track the historical moving average of this total over blocks
     std::vector<double> txCtAvg;
 
-    // Count the total # of txs confirmed within Y blocks in each bucket
-    // Track the historical moving average of these totals over blocks
-    std::vector<std::vector<double>> confAvg; // confAvg[Y][X]
+    // Count the # of txs confirmed in period Y (and not earlier) in each bucket
+    // Track the historical moving average of these counts over blocks
+    // The totals confirmed within Y periods are summed from these when estimating
+    std::vector<std::vector<double>> confPeriodAvg; // confPeriodAvg[Y][X]
 
     // Track moving avg of txs which have been evicted from the mempool
-    // after failing to be confirmed within Y blocks
-    std::vector<std::vector<double>> failAvg; // failAvg[Y][X]
+    // after failing to be confirmed for Y periods (and not more, except in the last period)
+    std::vector<std::vector<double>> failPeriodAvg; // failPeriodAvg[Y][X]
 
     // Sum the total feerate of all tx's in each bucket
     // Track the historical moving average of this total over blocks
@@ -100,6 +107,11 @@ private:
 
     double decay;
 
+    // All the averages above are stored multiplied by this weight, which is also
+    // the weight given to a new data point. Dividing it by decay every block decays
+    // every average at once, instead of walking all buckets and periods.
+    double m_decay_weight{1};
+
     // Resolution (# of blocks) with which confirmations are tracked
     unsigned int scale;
 
@@ -112,6 +124,15 @@ private:
 
     void resizeInMemoryCounters(size_t newbuckets);
 
+    /** Fold m_decay_weight back into the stored averages before it overflows */
+    void NormalizeMovingAverages();
+
+    /** Moving average of txs confirmed within period + 1 periods in a bucket */
+    double ConfirmedWithin(unsigned int period, unsigned int bucket) const;
+
+    /** Moving average of txs that left the mempool unconfirmed after more than period periods in a bucket */
+    double FailedAfter(unsigned int period, unsigned int bucket) const;
+
 public:
     /**
      * Create new TxConfirmStats. This is called by BlockPolicyEstimator's
@@ -159,10 +180,11 @@ public:
                              EstimationResult *result = nullptr) const;
 
     /** Return the max number of confirms we're tracking */
-    unsigned int GetMaxConfirms() const { return scale * confAvg.size(); }
+    unsigned int GetMaxConfirms() const { return scale * confPeriodAvg.size(); }
 
     /** Write state of estimation data to a file*/
-    void Write(AutoFile& fileout) const;
+    template <typename Stream>
+    void Write(Stream& fileout) const;
 
     /**
      * Read saved state of estimation data from a file and replace all internal data structures and
@@ -178,11 +200,11 @@ TxConfirmStats::TxConfirmStats(const std::vector<double>& defaultBuckets,
     : buckets(defaultBuckets), bucketMap(defaultBucketMap), decay(_decay), scale(_scale)
 {
     assert(_scale != 0 && "_scale must be non-zero");
-    confAvg.resize(maxPeriods);
-    failAvg.resize(maxPeriods);
+    confPeriodAvg.resize(maxPeriods);
+    failPeriodAvg.resize(maxPeriods);
     for (unsigned int i = 0; i < maxPeriods; i++) {
-        confAvg[i].resize(buckets.size());
-        failAvg[i].resize(buckets.size());
+        confPeriodAvg[i].resize(buckets.size());
+        failPeriodAvg[i].resize(buckets.size());
     }
 
     txCtAvg.resize(buckets.size());
@@ -215,26 +237,53 @@ void TxConfirmStats::Record(int blocksToConfirm, double feerate)
     // blocksToConfirm is 1-based
     if (blocksToConfirm < 1)
         return;
-    int periodsToConfirm = (blocksToConfirm + scale - 1) / scale;
+    unsigned int periodsToConfirm = (blocksToConfirm + scale - 1) / scale;
     unsigned int bucketindex = bucketMap.lower_bound(feerate)->second;
-    for (size_t i = periodsToConfirm; i <= confAvg.size(); i++) {
-        confAvg[i - 1][bucketindex]++;
+    if (periodsToConfirm <= confPeriodAvg.size()) {
+        confPeriodAvg[periodsToConfirm - 1][bucketindex] += m_decay_weight;
     }
-    txCtAvg[bucketindex]++;
-    m_feerate_avg[bucketindex] += feerate;
+    txCtAvg[bucketindex] += m_decay_weight;
+    m_feerate_avg[bucketindex] += feerate * m_decay_weight;
 }
 
 void TxConfirmStats::UpdateMovingAverages()
 {
-    assert(confAvg.size() == failAvg.size());
-    for (unsigned int j = 0; j < buckets.size(); j++) {
-        for (unsigned int i = 0; i < confAvg.size(); i++) {
-            confAvg[i][j] *= decay;
-            failAvg[i][j] *= decay;
+    m_decay_weight /= decay;
+    // Leave plenty of headroom for the sums of the weighted data points
+    if (m_decay_weight > 1e100) NormalizeMovingAverages();
+}
+
+void TxConfirmStats::NormalizeMovingAverages()
+{
+    assert(confPeriodAvg.size() == failPeriodAvg.size());
+    const double factor = 1 / m_decay_weight;
+    for (unsigned int j = 0; j < txCtAvg.size(); j++) {
+        for (unsigned int i = 0; i < confPeriodAvg.size(); i++) {
+            confPeriodAvg[i][j] *= factor;
+            failPeriodAvg[i][j] *= factor;
         }
-        m_feerate_avg[j] *= decay;
-        txCtAvg[j] *= decay;
+        m_feerate_avg[j] *= factor;
+        txCtAvg[j] *= factor;
     }
+    m_decay_weight = 1;
+}
+
+double TxConfirmStats::ConfirmedWithin(unsigned int period, unsigned int bucket) const
+{
+    double total = 0;
+    for (unsigned int i = 0; i <= period; i++) {
+        total += confPeriodAvg[i][bucket];
+    }
+    return total / m_decay_weight;
+}
+
+double TxConfirmStats::FailedAfter(unsigned int period, unsigned int bucket) const
+{
+    double total = 0;
+    for (unsigned int i = period; i < failPeriodAvg.size(); i++) {
+        total += failPeriodAvg[i][bucket];
+    }
+    return total / m_decay_weight;
 }
 
 // returns -1 on error conditions
@@ -279,10 +328,10 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
             newBucketRange = false;
         }
         curFarBucket = bucket;
-        nConf += confAvg[periodTarget - 1][bucket];
-        partialNum += txCtAvg[bucket];
-        totalNum += txCtAvg[bucket];
-        failNum += failAvg[periodTarget - 1][bucket];
+        nConf += ConfirmedWithin(periodTarget - 1, bucket);
+        partialNum += txCtAvg[bucket] / m_decay_weight;
+        totalNum += txCtAvg[bucket] / m_decay_weight;
+        failNum += FailedAfter(periodTarget - 1, bucket);
         for (unsigned int confct = confTarget; confct < GetMaxConfirms(); confct++)
             extraNum += unconfTxs[(nBlockHeight - confct) % bins][bucket];
         extraNum += oldUnconfTxs[bucket];
@@ -346,6 +395,7 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
     // and reporting the average which is less accurate
     unsigned int minBucket = std::min(bestNearBucket, bestFarBucket);
     unsigned int maxBucket = std::max(bestNearBucket, bestFarBucket);
+    // (The weight cancels out here, so the stored values are compared directly.)
     for (unsigned int j = minBucket; j <= maxBucket; j++) {
         txSum += txCtAvg[j];
     }
@@ -404,14 +454,30 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
     return median;
 }
 
-void TxConfirmStats::Write(AutoFile& fileout) const
+template <typename Stream>
+void TxConfirmStats::Write(Stream& fileout) const
 {
+    // The file stores the decayed totals within/after Y periods, as computed
+    // before the averages were kept per period and lazily decayed.
+    const unsigned int maxPeriods = confPeriodAvg.size();
+    std::vector<double> feerate_avg(txCtAvg.size()), tx_ct_avg(txCtAvg.size());
+    std::vector<std::vector<double>> conf_avg(maxPeriods, std::vector<double>(txCtAvg.size()));
+    std::vector<std::vector<double>> fail_avg(maxPeriods, std::vector<double>(txCtAvg.size()));
+    for (unsigned int j = 0; j < txCtAvg.size(); j++) {
+        feerate_avg[j] = m_feerate_avg[j] / m_decay_weight;
+        tx_ct_avg[j] = txCtAvg[j] / m_decay_weight;
+        for (unsigned int i = 0; i < maxPeriods; i++) {
+            conf_avg[i][j] = ConfirmedWithin(i, j);
+            fail_avg[i][j] = FailedAfter(i, j);
+        }
+    }
+
     fileout << Using<EncodedDoubleFormatter>(decay);
     fileout << scale;
-    fileout << Using<VectorFormatter<EncodedDoubleFormatter>>(m_feerate_avg);
-    fileout << Using<VectorFormatter<EncodedDoubleFormatter>>(txCtAvg);
-    fileout << Using<VectorFormatter<VectorFormatter<EncodedDoubleFormatter>>>(confAvg);
-    fileout << Using<VectorFormatter<VectorFormatter<EncodedDoubleFormatter>>>(failAvg);
+    fileout << Using<VectorFormatter<EncodedDoubleFormatter>>(feerate_avg);
+    fileout << Using<VectorFormatter<EncodedDoubleFormatter>>(tx_ct_avg);
+    fileout << Using<VectorFormatter<VectorFormatter<EncodedDoubleFormatter>>>(conf_avg);
+    fileout << Using<VectorFormatter<VectorFormatter<EncodedDoubleFormatter>>>(fail_avg);
 }
 
 void TxConfirmStats::Read(AutoFile& filein, int nFileVersion, size_t numBuckets)
@@ -439,29 +505,38 @@ void TxConfirmStats::Read(AutoFile& filein, int nFileVersion, size_t numBuckets)
     if (txCtAvg.size() != numBuckets) {
         throw std::runtime_error("Corrupt estimates file. Mismatch in tx count bucket count");
     }
-    filein >> Using<VectorFormatter<VectorFormatter<EncodedDoubleFormatter>>>(confAvg);
-    maxPeriods = confAvg.size();
+    filein >> Using<VectorFormatter<VectorFormatter<EncodedDoubleFormatter>>>(confPeriodAvg);
+    maxPeriods = confPeriodAvg.size();
     maxConfirms = scale * maxPeriods;
 
     if (maxConfirms <= 0 || maxConfirms > 6 * 24 * 7) { // one week
         throw std::runtime_error("Corrupt estimates file.  Must maintain estimates for between 1 and 1008 (one week) confirms");
     }
     for (unsigned int i = 0; i < maxPeriods; i++) {
-        if (confAvg[i].size() != numBuckets) {
+        if (confPeriodAvg[i].size() != numBuckets) {
             throw std::runtime_error("Corrupt estimates file. Mismatch in feerate conf average bucket count");
         }
     }
 
-    filein >> Using<VectorFormatter<VectorFormatter<EncodedDoubleFormatter>>>(failAvg);
-    if (maxPeriods != failAvg.size()) {
+    filein >> Using<VectorFormatter<VectorFormatter<EncodedDoubleFormatter>>>(failPeriodAvg);
+    if (maxPeriods != failPeriodAvg.size()) {
         throw std::runtime_error("Corrupt estimates file. Mismatch in confirms tracked for failures");
     }
     for (unsigned int i = 0; i < maxPeriods; i++) {
-        if (failAvg[i].size() != numBuckets) {
+        if (failPeriodAvg[i].size() != numBuckets) {
             throw std::runtime_error("Corrupt estimates file. Mismatch in one of failure average bucket counts");
         }
     }
 
+    // Turn the stored totals within/after Y periods into per-period averages
+    for (unsigned int j = 0; j < numBuckets; j++) {
+        for (unsigned int i = maxPeriods - 1; i > 0; i--) {
+            confPeriodAvg[i][j] -= confPeriodAvg[i - 1][j];
+            failPeriodAvg[maxPeriods - 1 - i][j] -= failPeriodAvg[maxPeriods - i][j];
+        }
+    }
+    m_decay_weight = 1;
+
     // Resize the current block variables which aren't stored in the data file
     // to match the number of confirms and buckets
     resizeInMemoryCounters(numBuckets);
@@ -508,10 +583,8 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
     }
     if (!inBlock && (unsigned int)blocksAgo >= scale) { // Only counts as a failure if not confirmed for entire period
         assert(scale != 0);
-        unsigned int periodsAgo = blocksAgo / scale;
-        for (size_t i = 0; i < periodsAgo && i < failAvg.size(); i++) {
-            failAvg[i][bucketindex]++;
-        }
+        unsigned int periodsAgo = std::min<unsigned int>(blocksAgo / scale, failPeriodAvg.size());
+        failPeriodAvg[periodsAgo - 1][bucketindex] += m_decay_weight;
     }
 }
 
@@ -530,6 +603,7 @@ bool CBlockPolicyEstimator::_removeTx(const uint256& hash, bool inBlock)
         shortStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
         longStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
         mapMemPoolTxs.erase(hash);
+        m_smart_fee_cache.clear();
         return true;
     } else {
         return false;
@@ -679,6 +753,7 @@ void CBlockPolicyEstimator::processBlock(const std::vector<RemovedMempoolTransac
     // calls to removeTx (via processBlockTx) correctly calculate age
     // of unconfirmed txs to remove from tracking.
     nBestSeenHeight = nBlockHeight;
+    m_smart_fee_cache.clear();
 
     // Update unconfirmed circular buffer
     feeStats->ClearCurrent(nBlockHeight);
@@ -868,6 +943,20 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation
 {
     LOCK(m_cs_fee_estimator);
 
+    auto it = m_smart_fee_cache.find({confTarget, conservative});
+    if (it == m_smart_fee_cache.end()) {
+        FeeCalculation calc;
+        const CFeeRate feerate{estimateSmartFeeUncached(confTarget, &calc, conservative)};
+        it = m_smart_fee_cache.emplace(std::make_pair(confTarget, conservative), std::make_pair(feerate, calc)).first;
+    }
+    if (feeCalc) *feeCalc = it->second.second;
+    return it->second.first;
+}
+
+CFeeRate CBlockPolicyEstimator::estimateSmartFeeUncached(int confTarget, FeeCalculation* feeCalc, bool conservative) const
+{
+    AssertLockHeld(m_cs_fee_estimator);
+
     if (feeCalc) {
         feeCalc->desiredTarget = confTarget;
         feeCalc->returnedTarget = confTarget;
@@ -949,8 +1038,23 @@ void CBlockPolicyEstimator::Flush() {
 
 void CBlockPolicyEstimator::FlushFeeEstimates()
 {
-    AutoFile est_file{fsbridge::fopen(m_estimation_filepath, "wb")};
-    if (est_file.IsNull() || !Write(est_file)) {
+    // Serialize under the lock, then write the file without holding it, so
+    // block and mempool processing don't wait on the disk.
+    DataStream stream;
+    bool ok{SerializeEstimates(stream)};
+    if (ok) {
+        const fs::path tmp_path{m_estimation_filepath + ".new"};
+        AutoFile est_file{fsbridge::fopen(tmp_path, "wb")};
+        try {
+            if (est_file.IsNull()) throw std::runtime_error("open failed");
+            est_file << Span{stream};
+            if (est_file.fclose() != 0) throw std::runtime_error("close failed");
+            if (!RenameOver(tmp_path, m_estimation_filepath)) throw std::runtime_error("rename failed");
+        } catch (const std::exception&) {
+            ok = false;
+        }
+    }
+    if (!ok) {
         LogPrintf("Failed to write fee estimates to %s. Continue anyway.\n", fs::PathToString(m_estimation_filepath));
     } else {
         LogPrintf("Flushed fee estimates to %s.\n", fs::PathToString(m_estimation_filepath.filename()));
@@ -958,10 +1062,24 @@ void CBlockPolicyEstimator::FlushFeeEstimates()
 }
 
 bool CBlockPolicyEstimator::Write(AutoFile& fileout) const
+{
+    DataStream stream;
+    if (!SerializeEstimates(stream)) return false;
+    try {
+        fileout << Span{stream};
+    }
+    catch (const std::exception&) {
+        LogPrintf("CBlockPolicyEstimator::Write(): unable to write policy estimator data (non-fatal)\n");
+        return false;
+    }
+    return true;
+}
+
+bool CBlockPolicyEstimator::SerializeEstimates(DataStream& fileout) const
 {
     try {
         LOCK(m_cs_fee_estimator);
-        fileout << 149900; // version required to read: 0.14.99 or later
+        fileout << FEE_ESTIMATES_FILE_VERSION; // version required to read
         fileout << CLIENT_VERSION; // version that wrote the file
         fileout << nBestSeenHeight;
         if (BlockSpan() > HistoricalBlockSpan()/2) {
@@ -988,7 +1106,7 @@ bool CBlockPolicyEstimator::Read(AutoFile& filein)
         LOCK(m_cs_fee_estimator);
         int nVersionRequired, nVersionThatWrote;
         filein >> nVersionRequired >> nVersionThatWrote;
-        if (nVersionRequired > CLIENT_VERSION) {
+        if (nVersionRequired > FEE_ESTIMATES_FILE_VERSION) {
             throw std::runtime_error(strprintf("up-version (%d) fee estimate file", nVersionRequired));
         }
 
@@ -1035,6 +1153,7 @@ bool CBlockPolicyEstimator::Read(AutoFile& filein)
             nBestSeenHeight = nFileBestSeenHeight;
             historicalFirst = nFileHistoricalFirst;
             historicalBest = nFileHistoricalBest;
+            m_smart_fee_cache.clear();
         }
     }
     catch (const std::exception& e) {
@@ -265,6 +265,23 @@ extern const char* WTXIDRELAY;
  * txreconciliation, as described by BIP 330.
  */
 extern const char* SENDTXRCNCL;
+/**
+ * Requests a sketch of the peer's reconciliation set. Contains the size of
+ * the requester's set and the q coefficient used for estimating the set
+ * difference, as described by BIP 330.
+ */
+extern const char* REQRECON;
+/**
+ * Contains a sketch of the sender's reconciliation set, in response to a
+ * reqrecon message, as described by BIP 330.
+ */
+extern const char* SKETCH;
+/**
+ * Finalizes a reconciliation round: contains whether the set difference
+ * could be found, and the short IDs of transactions the sender is missing,
+ * as described by BIP 330.
+ */
+extern const char* RECONCILDIFF;
 }; // namespace NetMsgType
 
 /* Get a vector of all valid message types (see above) */
@@ -710,6 +710,63 @@ static RPCHelpMan getmempoolinfo()
     };
 }
 
+static RPCHelpMan getmempoolstats()
+{
+    return RPCHelpMan{"getmempoolstats",
+        "Returns latency histograms of mempool operations since startup.\n"
+        "Durations are counted in power-of-two buckets of microseconds; only non-empty buckets are listed.",
+        {},
+        RPCResult{
+            RPCResult::Type::OBJ_DYN, "", "",
+            {
+                {RPCResult::Type::OBJ, "operation", "The operation: accept_transaction, accept_package, prechecks, policy_scripts, consensus_scripts, finalize, remove_for_block or trim_to_size",
+                {
+                    {RPCResult::Type::NUM, "count", "Number of times the operation ran"},
+                    {RPCResult::Type::NUM, "total_us", "Total time spent in the operation, in microseconds"},
+                    {RPCResult::Type::NUM, "max_us", "Longest single run, in microseconds"},
+                    {RPCResult::Type::ARR, "histogram", "",
+                    {
+                        {RPCResult::Type::OBJ, "", "",
+                        {
+                            {RPCResult::Type::NUM, "min_us", "Lower bound of the bucket, in microseconds. The bucket ends at twice this, except for the last one"},
+                            {RPCResult::Type::NUM, "count", "Number of runs in the bucket"},
+                        }},
+                    }},
+                }},
+            }},
+        RPCExamples{
+            HelpExampleCli("getmempoolstats", "")
+            + HelpExampleRpc("getmempoolstats", "")
+        },
+        [&](const RPCHelpMan& self, const JSONRPCRequest& request) -> UniValue
+{
+    const CTxMemPool& mempool = EnsureAnyMemPool(request.context);
+
+    UniValue ret(UniValue::VOBJ);
+    for (size_t i = 0; i < kernel::MEMPOOL_PHASE_COUNT; ++i) {
+        const auto phase{static_cast<kernel::MempoolPhase>(i)};
+        const kernel::LatencyHistogram& histogram{mempool.m_latency_stats[phase]};
+        UniValue buckets(UniValue::VARR);
+        for (size_t bucket = 0; bucket < kernel::LatencyHistogram::NUM_BUCKETS; ++bucket) {
+            const uint64_t count{histogram.BucketCount(bucket)};
+            if (count == 0) continue;
+            UniValue entry(UniValue::VOBJ);
+            entry.pushKV("min_us", kernel::LatencyHistogram::BucketMin(bucket));
+            entry.pushKV("count", count);
+            buckets.push_back(std::move(entry));
+        }
+        UniValue stats(UniValue::VOBJ);
+        stats.pushKV("count", histogram.Count());
+        stats.pushKV("total_us", histogram.TotalMicros());
+        stats.pushKV("max_us", histogram.MaxMicros());
+        stats.pushKV("histogram", std::move(buckets));
+        ret.pushKV(std::string{kernel::MempoolPhaseToString(phase)}, std::move(stats));
+    }
+    return ret;
+},
+    };
+}
+
 static RPCHelpMan importmempool()
 {
     return RPCHelpMan{
@@ -995,6 +1052,7 @@ void RegisterMempoolRPCCommands(CRPCTable& t)
         {"blockchain", &getmempoolentry},
         {"blockchain", &gettxspendingprevout},
         {"blockchain", &getmempoolinfo},
+        {"blockchain", &getmempoolstats},
         {"blockchain", &getrawmempool},
         {"blockchain", &importmempool},
         {"blockchain", &savemempool},
@@ -160,6 +160,9 @@ static RPCHelpMan getpeerinfo()
                     {
                         {RPCResult::Type::NUM, "n", "The heights of blocks we're currently asking from this peer"},
                     }},
+                    {RPCResult::Type::NUM, "inflight_limit", "The number of blocks we're willing to have in flight from this peer, based on its measured download speed"},
+                    {RPCResult::Type::NUM, "blocklatency", /*optional=*/true, "The average time in seconds between requesting a block from this peer and receiving it, if measured"},
+                    {RPCResult::Type::NUM, "blockdownloadrate", /*optional=*/true, "The average rate in bytes per second at which this peer sends us blocks, if measured"},
                     {RPCResult::Type::BOOL, "addr_relay_enabled", "Whether we participate in address relay with this peer"},
                     {RPCResult::Type::NUM, "addr_processed", "The total number of addresses processed, excluding those dropped due to rate limiting"},
                     {RPCResult::Type::NUM, "addr_rate_limited", "The total number of addresses dropped due to rate limiting"},
@@ -266,6 +269,11 @@ static RPCHelpMan getpeerinfo()
             heights.push_back(height);
         }
         obj.pushKV("inflight", heights);
+        obj.pushKV("inflight_limit", statestats.m_block_inflight_limit);
+        if (statestats.m_block_latency > 0us) {
+            obj.pushKV("blocklatency", Ticks<SecondsDouble>(statestats.m_block_latency));
+            obj.pushKV("blockdownloadrate", statestats.m_block_download_rate);
+        }
         obj.pushKV("addr_relay_enabled", statestats.m_addr_relay_enabled);
         obj.pushKV("addr_processed", statestats.m_addr_processed);
         obj.pushKV("addr_rate_limited", statestats.m_addr_rate_limited);
@@ -11,14 +11,24 @@
 #include <random.h>
 #include <uint256.h>
 
-#include <cuckoocache.h>
-
 #include <algorithm>
-#include <mutex>
 #include <optional>
-#include <shared_mutex>
 #include <vector>
 
+std::optional<std::pair<uint32_t, size_t>> ShardedCuckooCache::setup_bytes(size_t bytes)
+{
+    uint32_t num_elems{0};
+    size_t approx_size_bytes{0};
+    for (Shard& shard : m_shards) {
+        std::unique_lock<std::shared_mutex> lock(shard.m_mutex);
+        auto setup_results = shard.m_set.setup_bytes(bytes / NUM_SHARDS);
+        if (!setup_results) return std::nullopt;
+        num_elems += setup_results->first;
+        approx_size_bytes += setup_results->second;
+    }
+    return std::make_pair(num_elems, approx_size_bytes);
+}
+
 namespace {
 /**
  * Valid signature cache, to avoid doing expensive ECDSA signature checking
@@ -31,9 +41,7 @@ private:
      //! Entries are SHA256(nonce || 'E' or 'S' || 31 zero bytes || signature hash || public key || signature):
     CSHA256 m_salted_hasher_ecdsa;
     CSHA256 m_salted_hasher_schnorr;
-    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
-    map_type setValid;
-    std::shared_mutex cs_sigcache;
+    ShardedCuckooCache setValid;
 
 public:
     CSignatureCache()
@@ -68,13 +76,11 @@ public:
     bool
     Get(const uint256& entry, const bool erase)
     {
-        std::shared_lock<std::shared_mutex> lock(cs_sigcache);
         return setValid.contains(entry, erase);
     }
 
     void Set(const uint256& entry)
     {
-        std::unique_lock<std::shared_mutex> lock(cs_sigcache);
         setValid.insert(entry);
     }
     std::optional<std::pair<uint32_t, size_t>> setup_bytes(size_t n)
@@ -6,11 +6,19 @@
 #ifndef BITCOIN_SCRIPT_SIGCACHE_H
 #define BITCOIN_SCRIPT_SIGCACHE_H
 
+#include <crypto/common.h>
+#include <cuckoocache.h>
 #include <script/interpreter.h>
 #include <span.h>
+#include <uint256.h>
 #include <util/hasher.h>
 
+#include <array>
+#include <cstdint>
+#include <mutex>
 #include <optional>
+#include <shared_mutex>
+#include <utility>
 #include <vector>
 
 // DoS prevention: limit cache size to 32MiB (over 1000000 entries on 64-bit
@@ -20,6 +28,57 @@ static constexpr size_t DEFAULT_MAX_SIG_CACHE_BYTES{32 << 20};
 
 class CPubKey;
 
+/**
+ * A cache of uint256 entries (salted hashes) split into independent
+ * CuckooCache tables. The table an entry lives in is selected by its hash
+ * bits, and each table has its own shared mutex, so that lookups and
+ * insertions from different threads only contend when they hit the same
+ * shard. Used for both the signature cache and the script execution cache.
+ */
+class ShardedCuckooCache
+{
+public:
+    static constexpr size_t NUM_SHARDS{16};
+
+    bool contains(const uint256& entry, bool erase)
+    {
+        Shard& shard{GetShard(entry)};
+        std::shared_lock<std::shared_mutex> lock(shard.m_mutex);
+        return shard.m_set.contains(entry, erase);
+    }
+
+    void insert(const uint256& entry)
+    {
+        Shard& shard{GetShard(entry)};
+        std::unique_lock<std::shared_mutex> lock(shard.m_mutex);
+        shard.m_set.insert(entry);
+    }
+
+    /**
+     * Split the given memory budget evenly between the shards.
+     * Returns the total number of storable elements and the bytes used, or
+     * std::nullopt on failure.
+     */
+    std::optional<std::pair<uint32_t, size_t>> setup_bytes(size_t bytes);
+
+private:
+    struct Shard {
+        std::shared_mutex m_mutex;
+        CuckooCache::cache<uint256, SignatureCacheHasher> m_set;
+    };
+    std::array<Shard, NUM_SHARDS> m_shards;
+
+    Shard& GetShard(const uint256& entry)
+    {
+        // All 32 bytes of an entry feed the cuckoo hash functions within a
+        // shard. Mix 8 of them instead of selecting on raw bits, so the
+        // shard index is not correlated with any single in-shard hash.
+        const uint64_t mixed{ReadLE64(entry.begin() + 8) * 0x9E3779B97F4A7C15ULL};
+        return m_shards[mixed >> 60];
+    }
+};
+static_assert(ShardedCuckooCache::NUM_SHARDS == 16, "GetShard() selects a shard from 4 bits");
+
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker
 {
 private:
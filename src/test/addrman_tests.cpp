@@ -770,6 +770,95 @@ BOOST_AUTO_TEST_CASE(addrman_serialization)
     BOOST_CHECK(addr_pos7.position != addr_pos8.position);
 }
 
+BOOST_AUTO_TEST_CASE(addrman_write_changes)
+{
+    const auto ratio = GetCheckRatio(m_node);
+    AddrMan addrman{EMPTY_NETGROUPMAN, DETERMINISTIC, ratio};
+
+    const CNetAddr source{ResolveIP("252.2.2.2")};
+    const CAddress addr1{ResolveService("250.1.1.1", 8333), NODE_NONE};
+    const CAddress addr2{ResolveService("250.1.2.1", 8333), NODE_NONE};
+    const CAddress addr3{ResolveService("250.1.3.1", 8333), NODE_NONE};
+    const CAddress addr4{ResolveService("250.1.4.1", 8333), NODE_NONE};
+    BOOST_CHECK(addrman.Add({addr1, addr2, addr3}, source));
+
+    // The serialized state covers everything so far.
+    DataStream base{};
+    base << addrman;
+    DataStream discarded{};
+    BOOST_CHECK_EQUAL(addrman.WriteChanges(discarded), 3U);
+
+    BOOST_CHECK(addrman.Good(addr1));
+    addrman.Attempt(addr2, /*fCountFailure=*/true);
+    BOOST_CHECK(addrman.Add({addr4}, source));
+    DataStream changes{};
+    BOOST_CHECK_EQUAL(addrman.WriteChanges(changes), 3U);
+    DataStream no_changes{};
+    BOOST_CHECK_EQUAL(addrman.WriteChanges(no_changes), 0U);
+    BOOST_CHECK(no_changes.empty());
+
+    // Changes whose records could not be persisted are written again next time.
+    DataStream unwritten{changes};
+    addrman.RestoreChanges(unwritten);
+    DataStream rewritten{};
+    BOOST_CHECK_EQUAL(addrman.WriteChanges(rewritten), 3U);
+    BOOST_CHECK_EQUAL(rewritten.size(), changes.size());
+
+    AddrMan replayed{EMPTY_NETGROUPMAN, DETERMINISTIC, ratio};
+    base >> replayed;
+    replayed.ApplyChanges(changes);
+    BOOST_CHECK_EQUAL(replayed.Size(), 4U);
+    BOOST_CHECK_EQUAL(replayed.Size(std::nullopt, /*in_new=*/false), 1U);
+    for (const auto& addr : {addr1, addr2, addr3, addr4}) {
+        BOOST_CHECK(replayed.FindAddressEntry(addr).value() == addrman.FindAddressEntry(addr).value());
+    }
+    const auto entries{replayed.GetEntries(/*from_tried=*/false)};
+    const auto it{std::find_if(entries.begin(), entries.end(), [&](const auto& entry) { return CService{entry.first} == addr2; })};
+    BOOST_REQUIRE(it != entries.end());
+    BOOST_CHECK_EQUAL(it->first.nAttempts, 1);
+}
+
+BOOST_AUTO_TEST_CASE(addrman_journal)
+{
+    const fs::path path_addr{m_args.GetDataDirNet() / "peers.dat"};
+    const fs::path path_journal{m_args.GetDataDirNet() / "peers.journal"};
+
+    // Loading without peers.dat creates it along with an empty journal.
+    auto loaded{LoadAddrman(EMPTY_NETGROUPMAN, m_args)};
+    BOOST_REQUIRE(loaded);
+    AddrMan& addrman{**loaded};
+    BOOST_REQUIRE(fs::exists(path_addr) && fs::exists(path_journal));
+    const auto addr_size{fs::file_size(path_addr)};
+    const auto journal_size{fs::file_size(path_journal)};
+
+    const CNetAddr source{ResolveIP("252.2.2.2")};
+    const CAddress addr1{ResolveService("250.1.1.1", 8333), NODE_NONE};
+    const CAddress addr2{ResolveService("250.1.2.1", 8333), NODE_NONE};
+    // addrman isn't deterministic here, so only add addr2 once addr1 has left the new table and
+    // can't collide with it.
+    BOOST_CHECK(addrman.Add({addr1}, source));
+    BOOST_CHECK(addrman.Good(addr1));
+    BOOST_CHECK(addrman.Add({addr2}, source));
+
+    // Small changes are appended to the journal rather than rewriting peers.dat.
+    BOOST_CHECK(DumpPeerAddresses(m_args, addrman));
+    BOOST_CHECK_EQUAL(fs::file_size(path_addr), addr_size);
+    BOOST_CHECK_GT(fs::file_size(path_journal), journal_size);
+
+    auto reloaded{LoadAddrman(EMPTY_NETGROUPMAN, m_args)};
+    BOOST_REQUIRE(reloaded);
+    BOOST_CHECK_EQUAL((*reloaded)->Size(), 2U);
+    BOOST_CHECK((*reloaded)->FindAddressEntry(addr1).value().tried);
+    BOOST_CHECK(!(*reloaded)->FindAddressEntry(addr2).value().tried);
+
+    // The journal is only applied on top of the peers.dat it was written for.
+    fs::remove(path_addr);
+    auto recreated{LoadAddrman(EMPTY_NETGROUPMAN, m_args)};
+    BOOST_REQUIRE(recreated);
+    BOOST_CHECK_EQUAL((*recreated)->Size(), 0U);
+    BOOST_CHECK_EQUAL(fs::file_size(path_journal), journal_size);
+}
+
 BOOST_AUTO_TEST_CASE(remove_invalid)
 {
     // Confirm that invalid addresses are ignored in unserialization.
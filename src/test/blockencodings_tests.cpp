@@ -9,6 +9,7 @@
 #include <streams.h>
 #include <test/util/random.h>
 #include <test/util/txmempool.h>
+#include <validation.h>
 
 #include <test/util/setup_common.h>
 
@@ -302,6 +303,46 @@ BOOST_AUTO_TEST_CASE(EmptyBlockRoundTripTest)
     }
 }
 
+BOOST_FIXTURE_TEST_CASE(SharedMempoolTxsTest, TestingSetup)
+{
+    CTxMemPool& pool = *Assert(m_node.mempool);
+    TestMemPoolEntryHelper entry;
+    CBlock block(BuildBlockTestCase());
+
+    LOCK2(cs_main, pool.cs);
+    pool.addUnchecked(entry.Time(NodeSeconds{1s}).FromTx(block.vtx[1]));
+
+    // The first announcement scans the mempool.
+    CBlockHeaderAndShortTxIDs first{block};
+    const CompactBlockMempoolTxs mempool_txs{PartiallyDownloadedBlock::FindMempoolTxs(first, pool)};
+    BOOST_REQUIRE_EQUAL(mempool_txs.txs.size(), 1U);
+    BOOST_CHECK(mempool_txs.txs[0] == block.vtx[1]);
+
+    // A transaction arriving after the scan is found as well.
+    pool.addUnchecked(entry.Time(NodeSeconds{2s}).Sequence(pool.GetAndIncrementSequence()).FromTx(block.vtx[2]));
+
+    // Another announcement of the same block, using different short ID keys, reuses the scan.
+    CBlockHeaderAndShortTxIDs second{block};
+    DataStream stream{};
+    stream << second;
+    CBlockHeaderAndShortTxIDs second_received;
+    stream >> second_received;
+
+    PartiallyDownloadedBlock partialBlock(&pool);
+    // The test block has no valid proof of work.
+    partialBlock.m_check_block_mock = [](const CBlock& block, BlockValidationState& state, const Consensus::Params& params, bool, bool check_merkle_root) {
+        return CheckBlock(block, state, params, /*fCheckPOW=*/false, check_merkle_root);
+    };
+    BOOST_CHECK(partialBlock.InitData(second_received, extra_txn, &mempool_txs) == READ_STATUS_OK);
+    BOOST_CHECK(partialBlock.IsTxAvailable(0));
+    BOOST_CHECK(partialBlock.IsTxAvailable(1));
+    BOOST_CHECK(partialBlock.IsTxAvailable(2));
+
+    CBlock block2;
+    BOOST_CHECK(partialBlock.FillBlock(block2, {}) == READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(block.GetHash().ToString(), block2.GetHash().ToString());
+}
+
 BOOST_AUTO_TEST_CASE(TransactionsRequestSerializationTest) {
     BlockTransactionsRequest req1;
     req1.blockhash = InsecureRand256();
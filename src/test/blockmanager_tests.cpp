@@ -10,6 +10,7 @@
 #include <script/solver.h>
 #include <primitives/block.h>
 #include <util/chaintype.h>
+#include <util/signalinterrupt.h>
 #include <validation.h>
 
 #include <boost/test/unit_test.hpp>
@@ -132,6 +133,74 @@ BOOST_FIXTURE_TEST_CASE(blockmanager_block_data_availability, TestChain100Setup)
     BOOST_CHECK(!blockman.CheckBlockDataAvailability(tip, *last_pruned_block));
 }
 
+BOOST_AUTO_TEST_CASE(blockmanager_load_block_index_guts)
+{
+    // Held by callers, as when loading the block index on startup.
+    LOCK(::cs_main);
+
+    // Write a chain of synthetic headers directly to a block tree database. Their
+    // hashes spread them over all the ranges that are loaded in parallel.
+    std::unordered_map<uint256, CBlockIndex, BlockHasher> written;
+    std::vector<const CBlockIndex*> blockinfo;
+    uint256 prev_hash;
+    for (int height = 0; height < 2000; ++height) {
+        CBlockHeader header;
+        header.nVersion = 1;
+        header.hashPrevBlock = prev_hash;
+        // Late enough for the hash to commit to the whole header.
+        header.nTime = 1726799421 + height;
+        header.nNonce = height;
+        const uint256 hash{header.GetHash()};
+        const auto [it, inserted]{written.try_emplace(hash, header)};
+        BOOST_REQUIRE(inserted);
+        CBlockIndex& index{it->second};
+        index.phashBlock = &it->first;
+        index.pprev = prev_hash.IsNull() ? nullptr : &written.at(prev_hash);
+        index.nHeight = height;
+        index.nTx = 1 + height % 7;
+        if (height % 3 == 0) {
+            index.nStatus = BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO;
+            index.nFile = height / 100;
+            index.nDataPos = 8 + height;
+            index.nUndoPos = 8 + 2 * height;
+        }
+        blockinfo.push_back(&index);
+        prev_hash = hash;
+    }
+    kernel::BlockTreeDB block_tree_db{DBParams{.path = m_args.GetDataDirNet() / "blocks" / "index", .cache_bytes = 1 << 20, .memory_only = true}};
+    BOOST_REQUIRE(block_tree_db.WriteBatchSync({}, 0, blockinfo));
+
+    std::unordered_map<uint256, CBlockIndex, BlockHasher> loaded;
+    const auto insert{[&](const uint256& hash) -> CBlockIndex* {
+        if (hash.IsNull()) return nullptr;
+        const auto [it, inserted]{loaded.try_emplace(hash)};
+        if (inserted) it->second.phashBlock = &it->first;
+        return &it->second;
+    }};
+    util::SignalInterrupt interrupt;
+    BOOST_REQUIRE(block_tree_db.LoadBlockIndexGuts(Params().GetConsensus(), insert, interrupt));
+
+    BOOST_CHECK_EQUAL(loaded.size(), written.size());
+    for (const auto& [hash, index] : written) {
+        const auto it{loaded.find(hash)};
+        BOOST_REQUIRE(it != loaded.end());
+        BOOST_CHECK_EQUAL(it->second.nHeight, index.nHeight);
+        BOOST_CHECK_EQUAL(it->second.nTx, index.nTx);
+        BOOST_CHECK_EQUAL(it->second.nStatus, index.nStatus);
+        BOOST_CHECK_EQUAL(it->second.nFile, index.nFile);
+        BOOST_CHECK_EQUAL(it->second.nDataPos, index.nDataPos);
+        BOOST_CHECK_EQUAL(it->second.nUndoPos, index.nUndoPos);
+        BOOST_CHECK_EQUAL(it->second.nNonce, index.nNonce);
+        BOOST_CHECK_EQUAL(it->second.GetBlockHash(), hash);
+        BOOST_CHECK_EQUAL(it->second.pprev ? it->second.pprev->GetBlockHash() : uint256{}, index.pprev ? index.pprev->GetBlockHash() : uint256{});
+    }
+
+    // An interrupted load fails.
+    BOOST_REQUIRE(interrupt());
+    loaded.clear();
+    BOOST_CHECK(!block_tree_db.LoadBlockIndexGuts(Params().GetConsensus(), insert, interrupt));
+}
+
 BOOST_AUTO_TEST_CASE(blockmanager_flush_block_file)
 {
     KernelNotifications notifications{*Assert(m_node.shutdown), m_node.exit_status};
@@ -838,6 +838,63 @@ BOOST_AUTO_TEST_CASE(chacha20_midblock)
     BOOST_CHECK(Span{block}.last(52) == Span{b3});
 }
 
+BOOST_AUTO_TEST_CASE(chacha20_implementations)
+{
+    // All multi-block implementations must match the standard one, including across the
+    // 32-bit block counter overflow into the nonce.
+    const auto key{g_insecure_rand_ctx.randbytes<std::byte>(32)};
+    const auto plain{g_insecure_rand_ctx.randbytes<std::byte>(37 * 64 + 5)};
+    const ChaCha20::Nonce96 nonce{0xfffffffe, 0x123456789abcdef0};
+    std::vector<std::vector<std::byte>> results;
+    for (const auto use_implementation : {chacha20_implementation::STANDARD, chacha20_implementation::USE_SSE2, chacha20_implementation::USE_ALL}) {
+        BOOST_TEST_MESSAGE("Using the '" << ChaCha20AutoDetect(use_implementation) << "' ChaCha20 implementation");
+        for (const uint32_t seek : {0U, 3U, 0xffffffedU}) {
+            ChaCha20 c20{key};
+            c20.Seek(nonce, seek);
+            std::vector<std::byte> keystream(plain.size()), cipher(plain.size());
+            c20.Keystream(keystream);
+            c20.Seek(nonce, seek);
+            c20.Crypt(plain, cipher);
+            for (size_t i = 0; i < plain.size(); ++i) {
+                BOOST_CHECK(cipher[i] == (plain[i] ^ keystream[i]));
+            }
+            results.push_back(std::move(cipher));
+        }
+    }
+    ChaCha20AutoDetect();
+    for (size_t i = 3; i < results.size(); ++i) {
+        BOOST_CHECK(results[i] == results[i % 3]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(poly1305_multiblock)
+{
+    // Messages processed in one go (4 blocks at a time) must give the same tag as when fed one
+    // block at a time.
+    for (size_t len : {0, 16, 63, 64, 65, 128, 200, 1000, 4096}) {
+        const auto key{g_insecure_rand_ctx.randbytes<std::byte>(Poly1305::KEYLEN)};
+        const auto m{g_insecure_rand_ctx.randbytes<std::byte>(len)};
+        std::byte tag[Poly1305::TAGLEN], tag_single[Poly1305::TAGLEN];
+        Poly1305{key}.Update(m).Finalize(tag);
+        Poly1305 poly1305{key};
+        for (size_t pos = 0; pos < len; pos += POLY1305_BLOCK_SIZE) {
+            poly1305.Update(Span{m}.subspan(pos, std::min<size_t>(POLY1305_BLOCK_SIZE, len - pos)));
+        }
+        poly1305.Finalize(tag_single);
+        BOOST_CHECK(Span{tag} == Span{tag_single});
+    }
+    // Maximal limbs: all-ones key and message.
+    const std::vector<std::byte> ones(1024, std::byte{0xff});
+    std::byte tag[Poly1305::TAGLEN], tag_single[Poly1305::TAGLEN];
+    Poly1305{Span{ones}.first(Poly1305::KEYLEN)}.Update(ones).Finalize(tag);
+    Poly1305 poly1305{Span{ones}.first(Poly1305::KEYLEN)};
+    for (size_t pos = 0; pos < ones.size(); pos += POLY1305_BLOCK_SIZE) {
+        poly1305.Update(Span{ones}.subspan(pos, POLY1305_BLOCK_SIZE));
+    }
+    poly1305.Finalize(tag_single);
+    BOOST_CHECK(Span{tag} == Span{tag_single});
+}
+
 BOOST_AUTO_TEST_CASE(poly1305_testvector)
 {
     // RFC 7539, section 2.5.2.
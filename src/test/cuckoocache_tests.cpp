@@ -10,6 +10,7 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include <atomic>
 #include <deque>
 #include <mutex>
 #include <shared_mutex>
@@ -119,6 +120,43 @@ BOOST_AUTO_TEST_CASE(cuckoocache_hit_rate_ok)
     }
 }
 
+/** Check that sharding does not hurt the hit rate on the same loads */
+BOOST_AUTO_TEST_CASE(cuckoocache_sharded_hit_rate_ok)
+{
+    double HitRateThresh = 0.98;
+    size_t megabytes = 4;
+    for (double load = 0.1; load < 2; load *= 2) {
+        double hits = test_cache<ShardedCuckooCache>(megabytes, load);
+        BOOST_CHECK(normalize_hit_rate(hits, load) > HitRateThresh);
+    }
+}
+
+/** Check that the sharded cache can be used from several threads without
+ * external locking */
+BOOST_AUTO_TEST_CASE(cuckoocache_sharded_parallel)
+{
+    SeedInsecureRand(SeedRand::ZEROS);
+    ShardedCuckooCache set{};
+    set.setup_bytes(4 << 20);
+    const size_t n_threads{4};
+    const size_t n_per_thread{10000};
+    std::vector<std::vector<uint256>> hashes(n_threads);
+    for (auto& thread_hashes : hashes) {
+        for (size_t i = 0; i < n_per_thread; ++i) thread_hashes.push_back(InsecureRand256());
+    }
+
+    std::vector<std::thread> threads;
+    std::atomic<size_t> misses{0};
+    for (size_t t = 0; t < n_threads; ++t) {
+        threads.emplace_back([&, t] {
+            for (const uint256& h : hashes[t]) set.insert(h);
+            for (const uint256& h : hashes[t]) misses += !set.contains(h, /*erase=*/false);
+        });
+    }
+    for (std::thread& t : threads) t.join();
+    // The cache is far from full, so nothing should have been evicted.
+    BOOST_CHECK_EQUAL(misses, 0U);
+}
 
 /** This helper checks that erased elements are preferentially inserted onto and
  * that the hit rate of "fresher" keys is reasonable*/
@@ -135,6 +135,7 @@ FUZZ_TARGET(txorphan, .init = initialize_orphanage)
                     auto limit = fuzzed_data_provider.ConsumeIntegral<unsigned int>();
                     orphanage.LimitOrphans(limit, limit_orphans_rng);
                     Assert(orphanage.Size() <= limit);
+                    Assert(orphanage.TotalOrphanWeight() <= DEFAULT_MAX_ORPHAN_WEIGHT);
                 });
         }
     }
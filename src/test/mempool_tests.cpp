@@ -3,14 +3,18 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <common/system.h>
+#include <kernel/mempool_persist.h>
 #include <policy/policy.h>
+#include <test/util/transaction_utils.h>
 #include <test/util/txmempool.h>
 #include <txmempool.h>
 #include <util/time.h>
+#include <validation.h>
 
 #include <test/util/setup_common.h>
 
 #include <boost/test/unit_test.hpp>
+#include <limits>
 #include <vector>
 
 BOOST_FIXTURE_TEST_SUITE(mempool_tests, TestingSetup)
@@ -533,20 +537,20 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     pool.addUnchecked(entry.Fee(1100LL).FromTx(tx6));
     pool.addUnchecked(entry.Fee(9000LL).FromTx(tx7));
 
-    // we only require this to remove, at max, 2 txn, because it's not clear what we're really optimizing for aside from that
+    // The cluster linearizes as {tx4}, {tx5, tx6, tx7}: tx7 only pays for tx5 and tx6
+    // together, so the three of them are what mining would include last and are evicted.
     pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
     BOOST_CHECK(pool.exists(GenTxid::Txid(tx4.GetHash())));
-    BOOST_CHECK(pool.exists(GenTxid::Txid(tx6.GetHash())));
+    BOOST_CHECK(!pool.exists(GenTxid::Txid(tx5.GetHash())));
+    BOOST_CHECK(!pool.exists(GenTxid::Txid(tx6.GetHash())));
     BOOST_CHECK(!pool.exists(GenTxid::Txid(tx7.GetHash())));
 
-    if (!pool.exists(GenTxid::Txid(tx5.GetHash())))
-        pool.addUnchecked(entry.Fee(1000LL).FromTx(tx5));
+    pool.addUnchecked(entry.Fee(1000LL).FromTx(tx5));
     pool.addUnchecked(entry.Fee(9000LL).FromTx(tx7));
 
-    pool.TrimToSize(pool.DynamicMemoryUsage() / 2); // should maximize mempool size by only removing 5/7
+    pool.TrimToSize(pool.DynamicMemoryUsage() / 2); // {tx5, tx7} is again the last chunk
     BOOST_CHECK(pool.exists(GenTxid::Txid(tx4.GetHash())));
     BOOST_CHECK(!pool.exists(GenTxid::Txid(tx5.GetHash())));
-    BOOST_CHECK(pool.exists(GenTxid::Txid(tx6.GetHash())));
     BOOST_CHECK(!pool.exists(GenTxid::Txid(tx7.GetHash())));
 
     pool.addUnchecked(entry.Fee(1000LL).FromTx(tx5));
@@ -800,4 +804,261 @@ BOOST_AUTO_TEST_CASE(MempoolAncestryTestsDiamond)
     BOOST_CHECK_EQUAL(descendants, 4ULL);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolLinearizeClusterTest)
+{
+    CTxMemPool& pool = *Assert(m_node.mempool);
+    LOCK2(::cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+
+    // [ta] <- [tb] (high fee)
+    //   ^---- [tc] (low fee)
+    CTransactionRef ta = make_tx(/*output_values=*/{5 * COIN, 5 * COIN});
+    CTransactionRef tb = make_tx(/*output_values=*/{5 * COIN}, /*inputs=*/{ta}, /*input_indices=*/{0});
+    CTransactionRef tc = make_tx(/*output_values=*/{5 * COIN}, /*inputs=*/{ta}, /*input_indices=*/{1});
+    pool.addUnchecked(entry.Fee(0).FromTx(ta));
+    pool.addUnchecked(entry.Fee(30000LL).FromTx(tb));
+    pool.addUnchecked(entry.Fee(1000LL).FromTx(tc));
+
+    // tb pays for its parent and is mined with it; tc comes last.
+    auto chunks = pool.LinearizeCluster(*pool.GetIter(tc->GetHash()));
+    BOOST_REQUIRE_EQUAL(chunks.size(), 2U);
+    BOOST_REQUIRE_EQUAL(chunks[0].txs.size(), 2U);
+    BOOST_CHECK(chunks[0].txs[0]->GetSharedTx() == ta);
+    BOOST_CHECK(chunks[0].txs[1]->GetSharedTx() == tb);
+    BOOST_CHECK_EQUAL(chunks[0].fee, 30000);
+    BOOST_CHECK_EQUAL(chunks[0].vsize, pool.GetIter(ta->GetHash()).value()->GetTxSize() + pool.GetIter(tb->GetHash()).value()->GetTxSize());
+    BOOST_REQUIRE_EQUAL(chunks[1].txs.size(), 1U);
+    BOOST_CHECK(chunks[1].txs[0]->GetSharedTx() == tc);
+    BOOST_CHECK(CFeeRate(chunks[0].fee, chunks[0].vsize) >= CFeeRate(chunks[1].fee, chunks[1].vsize));
+
+    // A high fee child of tc makes {ta, tc, td} the best ancestor set, after which tb
+    // alone has a higher feerate and is merged into the same chunk.
+    CTransactionRef td = make_tx(/*output_values=*/{5 * COIN}, /*inputs=*/{tc});
+    pool.addUnchecked(entry.Fee(50000LL).FromTx(td));
+    chunks = pool.LinearizeCluster(*pool.GetIter(tb->GetHash()));
+    BOOST_REQUIRE_EQUAL(chunks.size(), 1U);
+    BOOST_REQUIRE_EQUAL(chunks[0].txs.size(), 4U);
+    BOOST_CHECK(chunks[0].txs[0]->GetSharedTx() == ta);
+    BOOST_CHECK(chunks[0].txs[1]->GetSharedTx() == tc);
+    BOOST_CHECK(chunks[0].txs[2]->GetSharedTx() == td);
+    BOOST_CHECK(chunks[0].txs[3]->GetSharedTx() == tb);
+    BOOST_CHECK_EQUAL(chunks[0].fee, 81000);
+
+    // Trimming evicts the last chunk of the worst cluster, i.e. the whole cluster here.
+    pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
+    BOOST_CHECK_EQUAL(pool.size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolEntryLinksTest)
+{
+    CTxMemPool& pool = *Assert(m_node.mempool);
+    LOCK2(::cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+
+    // A parent with more children than its links store inline
+    CTransactionRef parent = make_tx(/*output_values=*/{COIN, COIN, COIN, COIN, COIN});
+    std::vector<CTransactionRef> children;
+    for (uint32_t i = 0; i < 5; ++i) {
+        children.push_back(make_tx(/*output_values=*/{COIN / 2}, /*inputs=*/{parent}, /*input_indices=*/{i}));
+    }
+    const auto add_all{[&] {
+        pool.addUnchecked(entry.FromTx(parent));
+        for (const auto& child : children) pool.addUnchecked(entry.FromTx(child));
+    }};
+
+    add_all();
+    const CTxMemPoolEntry& parent_entry = **pool.GetIter(parent->GetHash());
+    const CTxMemPoolEntry::Children& links = parent_entry.GetMemPoolChildrenConst();
+    BOOST_CHECK_EQUAL(links.size(), 5U);
+    BOOST_CHECK(std::is_sorted(links.begin(), links.end(), CompareIteratorByHash{}));
+    for (const auto& child : children) {
+        const CTxMemPoolEntry& child_entry = **pool.GetIter(child->GetHash());
+        BOOST_CHECK_EQUAL(links.count(child_entry), 1U);
+        BOOST_REQUIRE_EQUAL(child_entry.GetMemPoolParentsConst().size(), 1U);
+        BOOST_CHECK(&child_entry.GetMemPoolParentsConst().begin()->get() == &parent_entry);
+    }
+
+    pool.removeRecursive(*children[2], REMOVAL_REASON_DUMMY);
+    BOOST_CHECK_EQUAL(links.size(), 4U);
+    BOOST_CHECK(std::is_sorted(links.begin(), links.end(), CompareIteratorByHash{}));
+    pool.removeRecursive(*parent, REMOVAL_REASON_DUMMY);
+    BOOST_CHECK_EQUAL(pool.size(), 0U);
+
+    // The link storage is accounted for exactly, so the usage of an emptied mempool
+    // doesn't drift as the same transactions come and go.
+    const size_t usage{pool.DynamicMemoryUsage()};
+    add_all();
+    BOOST_CHECK(pool.DynamicMemoryUsage() > usage);
+    pool.removeRecursive(*parent, REMOVAL_REASON_DUMMY);
+    BOOST_CHECK_EQUAL(pool.DynamicMemoryUsage(), usage);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolRemoveForBlockTest)
+{
+    CTxMemPool& pool = *Assert(m_node.mempool);
+    LOCK2(::cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+
+    // [ta] <- [tb] <- [tc] <- [te]
+    //   ^----------- [td] <----'
+    CTransactionRef ta = make_tx(/*output_values=*/{5 * COIN, 5 * COIN});
+    CTransactionRef tb = make_tx(/*output_values=*/{5 * COIN}, /*inputs=*/{ta}, /*input_indices=*/{0});
+    CTransactionRef tc = make_tx(/*output_values=*/{5 * COIN}, /*inputs=*/{tb});
+    CTransactionRef td = make_tx(/*output_values=*/{5 * COIN}, /*inputs=*/{ta}, /*input_indices=*/{1});
+    CTransactionRef te = make_tx(/*output_values=*/{5 * COIN}, /*inputs=*/{tc, td});
+    pool.addUnchecked(entry.Fee(1000LL).FromTx(ta));
+    pool.addUnchecked(entry.Fee(2000LL).FromTx(tb));
+    pool.addUnchecked(entry.Fee(3000LL).FromTx(tc));
+    pool.addUnchecked(entry.Fee(4000LL).FromTx(td));
+    pool.addUnchecked(entry.Fee(5000LL).FromTx(te));
+    const auto get{[&](const CTransactionRef& tx) -> const CTxMemPoolEntry& { return **pool.GetIter(tx->GetHash()); }};
+    const int64_t size_a{get(ta).GetTxSize()}, size_b{get(tb).GetTxSize()}, size_c{get(tc).GetTxSize()}, size_d{get(td).GetTxSize()}, size_e{get(te).GetTxSize()};
+
+    // ta and tb confirm together: everything that stays loses both as ancestors.
+    pool.removeForBlock({ta, tb}, /*nBlockHeight=*/1);
+    BOOST_CHECK_EQUAL(pool.size(), 3U);
+    BOOST_CHECK_EQUAL(get(tc).GetCountWithAncestors(), 1U);
+    BOOST_CHECK_EQUAL(get(tc).GetSizeWithAncestors(), size_c);
+    BOOST_CHECK_EQUAL(get(tc).GetModFeesWithAncestors(), 3000);
+    BOOST_CHECK_EQUAL(get(tc).GetCountWithDescendants(), 2U);
+    BOOST_CHECK_EQUAL(get(td).GetCountWithAncestors(), 1U);
+    BOOST_CHECK_EQUAL(get(td).GetModFeesWithAncestors(), 4000);
+    BOOST_CHECK_EQUAL(get(te).GetCountWithAncestors(), 3U);
+    BOOST_CHECK_EQUAL(get(te).GetSizeWithAncestors(), size_c + size_d + size_e);
+    BOOST_CHECK_EQUAL(get(te).GetModFeesWithAncestors(), 12000);
+    BOOST_CHECK_EQUAL(get(te).GetSigOpCostWithAncestors(), get(tc).GetSigOpCost() + get(td).GetSigOpCost() + get(te).GetSigOpCost());
+
+    // Disconnecting the block adds them back before their descendants are linked.
+    pool.addUnchecked(entry.Fee(1000LL).FromTx(ta));
+    pool.addUnchecked(entry.Fee(2000LL).FromTx(tb));
+    pool.UpdateTransactionsFromBlock({ta->GetHash(), tb->GetHash()});
+    BOOST_CHECK_EQUAL(get(ta).GetCountWithDescendants(), 5U);
+    BOOST_CHECK_EQUAL(get(ta).GetSizeWithDescendants(), size_a + size_b + size_c + size_d + size_e);
+    BOOST_CHECK_EQUAL(get(ta).GetModFeesWithDescendants(), 15000);
+    BOOST_CHECK_EQUAL(get(tb).GetCountWithDescendants(), 3U);
+    BOOST_CHECK_EQUAL(get(tc).GetCountWithAncestors(), 3U);
+    BOOST_CHECK_EQUAL(get(td).GetCountWithAncestors(), 2U);
+    BOOST_CHECK_EQUAL(get(te).GetCountWithAncestors(), 5U);
+    BOOST_CHECK_EQUAL(get(te).GetModFeesWithAncestors(), 15000);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolPersistChunksTest)
+{
+    CTxMemPool& pool = *Assert(m_node.mempool);
+    Chainstate& chainstate{m_node.chainman->ActiveChainstate()};
+    const fs::path dump_path{m_args.GetDataDirNet() / "mempool_chunks.dat"};
+    TestMemPoolEntryHelper entry;
+
+    // Spend the outputs of a transaction that is not in the mempool
+    const CTransactionRef parent{make_tx(/*output_values=*/{COIN, COIN, COIN})};
+    std::vector<CTransactionRef> txs;
+    for (uint32_t i = 0; i < 3; ++i) {
+        txs.push_back(make_tx(/*output_values=*/{COIN / 2}, /*inputs=*/{parent}, /*input_indices=*/{i}));
+        WITH_LOCK(pool.cs, pool.addUnchecked(entry.Fee(1000LL).FromTx(txs.back())));
+    }
+    pool.PrioritiseTransaction(txs[0]->GetHash(), 500);
+    BOOST_REQUIRE(kernel::DumpMempool(pool, dump_path));
+
+    const auto clear_pool{[&] {
+        LOCK2(::cs_main, pool.cs);
+        for (const auto& tx : txs) {
+            pool.removeRecursive(*tx, REMOVAL_REASON_DUMMY);
+            pool.ClearPrioritisation(tx->GetHash());
+        }
+    }};
+    const auto delta{[&] {
+        CAmount delta{0};
+        WITH_LOCK(pool.cs, pool.ApplyDelta(txs[0]->GetHash(), delta));
+        return delta;
+    }};
+
+    // The transactions are missing their inputs and are rejected again, but their records (including
+    // the fee delta) are read back from the chunk.
+    clear_pool();
+    BOOST_CHECK(kernel::LoadMempool(pool, dump_path, chainstate, {}));
+    BOOST_CHECK_EQUAL(delta(), 500);
+
+    // A corrupted chunk is skipped and the rest of the file is still read.
+    clear_pool();
+    std::vector<std::byte> contents;
+    {
+        AutoFile file{fsbridge::fopen(dump_path, "rb")};
+        contents.resize(fs::file_size(dump_path));
+        file >> Span{contents};
+    }
+    // version, xor key, transaction count, chunk size and payload length precede the payload
+    contents.at(8 + 9 + 8 + 4 + 1 + 10) ^= std::byte{1};
+    {
+        AutoFile file{fsbridge::fopen(dump_path, "wb")};
+        file << Span{contents};
+    }
+    BOOST_CHECK(kernel::LoadMempool(pool, dump_path, chainstate, {}));
+    BOOST_CHECK_EQUAL(delta(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolPersistUncacheTest)
+{
+    CTxMemPool& pool = *Assert(m_node.mempool);
+    Chainstate& chainstate{m_node.chainman->ActiveChainstate()};
+    const fs::path dump_path{m_args.GetDataDirNet() / "mempool_uncache.dat"};
+    TestMemPoolEntryHelper entry;
+
+    // A coin on disk but not in the coins cache
+    COutPoint outpoint;
+    {
+        LOCK(::cs_main);
+        CCoinsViewCache& coins_tip{chainstate.CoinsTip()};
+        outpoint = AddOpTrueCoins(coins_tip, 1, COIN)[0];
+        BOOST_REQUIRE(coins_tip.Flush());
+        BOOST_REQUIRE(!coins_tip.HaveCoinInCache(outpoint));
+    }
+
+    // Spent by a transaction that is rejected when loaded, for its non-standard version
+    const CTransactionRef tx{SpendOpTrue({outpoint}, COIN / 2, /*version=*/0)};
+    WITH_LOCK(pool.cs, pool.addUnchecked(entry.Fee(COIN / 2).Time(Now<NodeSeconds>()).FromTx(tx)));
+    BOOST_REQUIRE(kernel::DumpMempool(pool, dump_path));
+    WITH_LOCK(pool.cs, pool.removeRecursive(*tx, REMOVAL_REASON_DUMMY));
+
+    // Script prevalidation reads the coin, but doesn't leave it cached.
+    BOOST_CHECK(kernel::LoadMempool(pool, dump_path, chainstate, {}));
+    BOOST_CHECK(!pool.exists(GenTxid::Txid(tx->GetHash())));
+    BOOST_CHECK(!WITH_LOCK(::cs_main, return chainstate.CoinsTip().HaveCoinInCache(outpoint)));
+}
+
+BOOST_AUTO_TEST_CASE(MempoolLatencyHistogramTest)
+{
+    using kernel::LatencyHistogram;
+    BOOST_CHECK_EQUAL(LatencyHistogram::Bucket(0), 0U);
+    BOOST_CHECK_EQUAL(LatencyHistogram::Bucket(1), 0U);
+    BOOST_CHECK_EQUAL(LatencyHistogram::Bucket(2), 1U);
+    BOOST_CHECK_EQUAL(LatencyHistogram::Bucket(3), 1U);
+    BOOST_CHECK_EQUAL(LatencyHistogram::Bucket(1000), 9U);
+    BOOST_CHECK_EQUAL(LatencyHistogram::Bucket(std::numeric_limits<uint64_t>::max()), LatencyHistogram::NUM_BUCKETS - 1);
+    for (size_t bucket = 1; bucket < LatencyHistogram::NUM_BUCKETS; ++bucket) {
+        BOOST_CHECK_EQUAL(LatencyHistogram::Bucket(LatencyHistogram::BucketMin(bucket)), bucket);
+        BOOST_CHECK_EQUAL(LatencyHistogram::Bucket(LatencyHistogram::BucketMin(bucket) - 1), bucket - 1);
+    }
+
+    LatencyHistogram histogram;
+    histogram.Add(std::chrono::microseconds{-5});
+    histogram.Add(std::chrono::microseconds{0});
+    histogram.Add(std::chrono::microseconds{1000});
+    histogram.Add(std::chrono::microseconds{1023});
+    histogram.Add(std::chrono::hours{1});
+    BOOST_CHECK_EQUAL(histogram.Count(), 5U);
+    BOOST_CHECK_EQUAL(histogram.BucketCount(0), 2U);
+    BOOST_CHECK_EQUAL(histogram.BucketCount(9), 2U);
+    BOOST_CHECK_EQUAL(histogram.BucketCount(LatencyHistogram::NUM_BUCKETS - 1), 1U);
+    BOOST_CHECK_EQUAL(histogram.MaxMicros(), 3'600'000'000U);
+    BOOST_CHECK_EQUAL(histogram.TotalMicros(), 3'600'002'023U);
+
+    // The stats of a mempool are fed by validation, through a scoped timer.
+    CTxMemPool& pool = *Assert(m_node.mempool);
+    const uint64_t before{pool.m_latency_stats[kernel::MempoolPhase::TRIM_TO_SIZE].Count()};
+    {
+        const kernel::ScopedLatencyTimer timer{pool.m_latency_stats[kernel::MempoolPhase::TRIM_TO_SIZE]};
+    }
+    BOOST_CHECK_EQUAL(pool.m_latency_stats[kernel::MempoolPhase::TRIM_TO_SIZE].Count(), before + 1);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
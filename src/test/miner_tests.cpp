@@ -8,6 +8,7 @@
 #include <consensus/consensus.h>
 #include <consensus/merkle.h>
 #include <consensus/tx_verify.h>
+#include <miner.h>
 #include <node/miner.h>
 #include <policy/policy.h>
 #include <test/util/random.h>
@@ -21,11 +22,13 @@
 
 #include <test/util/setup_common.h>
 
+#include <limits>
 #include <memory>
 
 #include <boost/test/unit_test.hpp>
 
 using node::BlockAssembler;
+using node::BlockTemplateCache;
 using node::CBlockTemplate;
 
 namespace miner_tests {
@@ -654,4 +657,63 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     TestPrioritisedMining(scriptPubKey, txFirst);
 }
 
+BOOST_AUTO_TEST_CASE(BlockTemplateCache_reuse)
+{
+    CTxMemPool& tx_mempool{*m_node.mempool};
+    BlockAssembler::Options options;
+    options.test_block_validity = false;
+    BlockTemplateCache template_cache{m_node.chainman->ActiveChainstate(), &tx_mempool, options};
+    const CScript script_a{CScript() << OP_TRUE};
+    const CScript script_b{CScript() << OP_FALSE};
+
+    // As long as nothing changes, the same template is served again.
+    const auto first{template_cache.GetTemplate(script_a)};
+    BOOST_REQUIRE(first);
+    const auto second{template_cache.GetTemplate(script_a)};
+    BOOST_REQUIRE(second);
+    BOOST_CHECK_EQUAL(template_cache.GetNumAssembled(), 1U);
+    BOOST_CHECK_EQUAL(second->block.vtx[0]->GetHash(), first->block.vtx[0]->GetHash());
+    BOOST_CHECK_EQUAL(second->block.hashPrevBlock, first->block.hashPrevBlock);
+    BOOST_CHECK_EQUAL(second->block.hashMerkleRoot, BlockMerkleRoot(second->block));
+
+    // The copies are independent.
+    second->block.nNonce = first->block.nNonce + 1;
+    BOOST_CHECK_EQUAL(template_cache.GetTemplate(script_a)->block.nNonce, first->block.nNonce);
+
+    // A change to the mempool or another coinbase script requires a new template.
+    tx_mempool.AddTransactionsUpdated(1);
+    BOOST_REQUIRE(template_cache.GetTemplate(script_a));
+    BOOST_CHECK_EQUAL(template_cache.GetNumAssembled(), 2U);
+    const auto other{template_cache.GetTemplate(script_b)};
+    BOOST_REQUIRE(other);
+    BOOST_CHECK_EQUAL(template_cache.GetNumAssembled(), 3U);
+    BOOST_CHECK(other->block.vtx[0]->vout[0].scriptPubKey == script_b);
+}
+
+BOOST_FIXTURE_TEST_CASE(nonce_partitioning, BasicTestingSetup)
+{
+    // A single thread gets the whole nonce space, and wraps around at 2^32.
+    BOOST_CHECK_EQUAL(NonceRangeStart(0, 1), 0U);
+    BOOST_CHECK_EQUAL(NonceRangeStart(1, 1), 0U);
+    BOOST_CHECK_EQUAL(NextNonce(0, 0, 0), 1U);
+    BOOST_CHECK_EQUAL(NextNonce(std::numeric_limits<uint32_t>::max(), 0, 0), 0U);
+
+    for (const size_t num_threads : {2, 3, 7, 64}) {
+        uint64_t covered{0};
+        for (size_t i = 0; i < num_threads; ++i) {
+            const uint32_t begin{NonceRangeStart(i, num_threads)};
+            const uint32_t end{NonceRangeStart(i + 1, num_threads)};
+            // Parts are adjacent and of (almost) equal size; only the last one ends at 2^32.
+            BOOST_CHECK_EQUAL(i == num_threads - 1, end == 0);
+            const uint32_t size{end - begin};
+            BOOST_CHECK(size == (uint64_t{1} << 32) / num_threads || size == (uint64_t{1} << 32) / num_threads + 1);
+            covered += size;
+            // The last nonce of a part is followed by its first one, never by the next part's.
+            BOOST_CHECK_EQUAL(NextNonce(begin, begin, end), begin + 1);
+            BOOST_CHECK_EQUAL(NextNonce(end - 1, begin, end), begin);
+        }
+        BOOST_CHECK_EQUAL(covered, uint64_t{1} << 32);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -1345,6 +1345,41 @@ public:
 
 } // namespace
 
+BOOST_FIXTURE_TEST_CASE(v1transport_gather_send, BasicTestingSetup)
+{
+    V1Transport transport{0};
+    const std::vector<unsigned char> payload{1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+
+    CSerializedNetMsg msg{NetMsg::MakeShared(NetMsgType::PING, Span{payload})};
+    BOOST_CHECK(msg.data.empty());
+    CSerializedNetMsg copy{msg.Copy()};
+    BOOST_CHECK(copy.m_shared_data == msg.m_shared_data);
+    BOOST_CHECK(std::ranges::equal(copy.Payload(), msg.Payload()));
+    BOOST_REQUIRE(transport.SetMessageToSend(msg));
+
+    // The header is returned first, followed by the payload.
+    const auto& [header, header_more, type] = transport.GetBytesToSend(/*have_next_message=*/false);
+    BOOST_CHECK_EQUAL(header.size(), CMessageHeader::HEADER_SIZE);
+    BOOST_CHECK(header_more);
+    BOOST_CHECK_EQUAL(type, NetMsgType::PING);
+    bool more{true};
+    const auto following{transport.GetFollowingBytesToSend(/*have_next_message=*/false, more)};
+    BOOST_CHECK(!more);
+    BOOST_CHECK(std::ranges::equal(following, copy.Payload()));
+
+    // A partial send crossing from the header into the payload leaves the rest of the payload.
+    const size_t total{header.size() + following.size()};
+    transport.MarkBytesSent(CMessageHeader::HEADER_SIZE + 3);
+    const auto& [rest, rest_more, rest_type] = transport.GetBytesToSend(/*have_next_message=*/false);
+    BOOST_CHECK(std::ranges::equal(rest, Span{copy.Payload()}.subspan(3)));
+    BOOST_CHECK(transport.GetFollowingBytesToSend(/*have_next_message=*/false, more).empty());
+    transport.MarkBytesSent(total - CMessageHeader::HEADER_SIZE - 3);
+    BOOST_CHECK(std::get<0>(transport.GetBytesToSend(/*have_next_message=*/false)).empty());
+
+    // The shared payload survives in the copy after the transport released its reference.
+    BOOST_CHECK(std::ranges::equal(copy.Payload(), payload));
+}
+
 BOOST_AUTO_TEST_CASE(v2transport_test)
 {
     // A mostly normal scenario, testing a transport in initiator mode.
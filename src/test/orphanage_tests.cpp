@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <arith_uint256.h>
+#include <consensus/validation.h>
 #include <primitives/transaction.h>
 #include <pubkey.h>
 #include <script/sign.h>
@@ -138,4 +139,72 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
     BOOST_CHECK(orphanage.CountOrphans() == 0);
 }
 
+static CTransactionRef MakeOrphan(const COutPoint& prevout, size_t data_size)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = prevout;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 1 * CENT;
+    tx.vout[0].scriptPubKey = CScript() << OP_RETURN << std::vector<unsigned char>(data_size);
+    return MakeTransactionRef(tx);
+}
+
+BOOST_FIXTURE_TEST_CASE(orphanage_weight_limit, BasicTestingSetup)
+{
+    TxOrphanageTest orphanage;
+    FastRandomContext rng{/*fDeterministic=*/true};
+
+    // Peer 0 floods us with large orphans, peer 1 only sends a few small ones.
+    for (int i = 0; i < 10; ++i) {
+        BOOST_CHECK(orphanage.AddTx(MakeOrphan(COutPoint{Txid::FromUint256(InsecureRand256()), 0}, 10'000), 0));
+    }
+    int64_t small_weight{0};
+    for (int i = 0; i < 3; ++i) {
+        const auto tx{MakeOrphan(COutPoint{Txid::FromUint256(InsecureRand256()), 0}, 100)};
+        BOOST_CHECK(orphanage.AddTx(tx, 1));
+        small_weight += GetTransactionWeight(*tx);
+    }
+    BOOST_CHECK_EQUAL(orphanage.CountForPeer(0), 10U);
+    BOOST_CHECK_EQUAL(orphanage.CountForPeer(1), 3U);
+    const int64_t total_weight{orphanage.TotalOrphanWeight()};
+
+    // Halving the weight budget only evicts orphans of the peer using most of it.
+    orphanage.LimitOrphans(/*max_orphans=*/100, rng, /*max_weight=*/total_weight / 2);
+    BOOST_CHECK(orphanage.TotalOrphanWeight() <= total_weight / 2);
+    BOOST_CHECK(orphanage.CountForPeer(0) < 10);
+    BOOST_CHECK_EQUAL(orphanage.CountForPeer(1), 3U);
+
+    orphanage.EraseForPeer(0);
+    BOOST_CHECK_EQUAL(orphanage.CountForPeer(0), 0U);
+    BOOST_CHECK_EQUAL(orphanage.TotalOrphanWeight(), small_weight);
+    orphanage.LimitOrphans(/*max_orphans=*/0, rng);
+    BOOST_CHECK_EQUAL(orphanage.CountOrphans(), 0U);
+    BOOST_CHECK_EQUAL(orphanage.TotalOrphanWeight(), 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(orphanage_erase_for_block, BasicTestingSetup)
+{
+    TxOrphanageTest orphanage;
+
+    const COutPoint funding{Txid::FromUint256(InsecureRand256()), 0};
+    const auto parent{MakeOrphan(funding, 10)};
+    // An orphan double spending the parent, and one spending its output.
+    const auto conflict{MakeOrphan(funding, 20)};
+    const auto child{MakeOrphan(COutPoint{parent->GetHash(), 0}, 10)};
+    BOOST_CHECK(orphanage.AddTx(conflict, 0));
+    BOOST_CHECK(orphanage.AddTx(child, 1));
+    BOOST_CHECK(!orphanage.HaveTxToReconsider(1));
+
+    // Mining the parent removes the conflict, and queues the child for reconsideration.
+    CBlock block;
+    block.vtx.push_back(parent);
+    orphanage.EraseForBlock(block);
+    BOOST_CHECK(!orphanage.HaveTx(GenTxid::Txid(conflict->GetHash())));
+    BOOST_CHECK_EQUAL(orphanage.CountForPeer(0), 0U);
+    BOOST_CHECK(orphanage.HaveTxToReconsider(1));
+    BOOST_CHECK_EQUAL(orphanage.GetTxToReconsider(1), child);
+    BOOST_CHECK(!orphanage.HaveTxToReconsider(1));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
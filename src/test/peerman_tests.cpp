@@ -3,12 +3,28 @@
 // file COPYING or https://www.opensource.org/licenses/mit-license.php.
 
 #include <chainparams.h>
+#include <consensus/amount.h>
+#include <consensus/merkle.h>
 #include <node/miner.h>
+#include <net.h>
 #include <net_processing.h>
+#include <netmessagemaker.h>
 #include <pow.h>
+#include <primitives/transaction.h>
+#include <protocol.h>
+#include <script/script.h>
+#include <test/util/net.h>
 #include <test/util/setup_common.h>
+#include <test/util/transaction_utils.h>
+#include <test/util/validation.h>
+#include <txmempool.h>
 #include <validation.h>
 
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
 #include <boost/test/unit_test.hpp>
 
 BOOST_FIXTURE_TEST_SUITE(peerman_tests, RegTestingSetup)
@@ -72,4 +88,252 @@ BOOST_AUTO_TEST_CASE(connections_desirable_service_flags)
     BOOST_CHECK(peerman->GetDesirableServiceFlags(peer_flags) == ServiceFlags(NODE_NETWORK | NODE_WITNESS));
 }
 
+/** Take everything queued for sending to node, as the bytes sent for each message type. */
+static std::map<std::string, std::vector<unsigned char>> TakeSentBytes(CNode& node)
+{
+    std::map<std::string, std::vector<unsigned char>> sent;
+    LOCK(node.cs_vSend);
+    while (true) {
+        const auto& [to_send, _more, msg_type] = node.m_transport->GetBytesToSend(false);
+        if (to_send.empty()) {
+            if (node.vSendMsg.empty()) break;
+            BOOST_REQUIRE(node.m_transport->SetMessageToSend(node.vSendMsg.front()));
+            node.vSendMsg.pop_front();
+            continue;
+        }
+        sent[msg_type].insert(sent[msg_type].end(), to_send.begin(), to_send.end());
+        node.m_transport->MarkBytesSent(to_send.size());
+    }
+    node.m_send_memusage = 0;
+    return sent;
+}
+
+// Consecutive tx messages from a peer are validated together, with the same outcome as one by one.
+BOOST_FIXTURE_TEST_CASE(tx_batch_processing, TestingSetup)
+{
+    LOCK(NetEventsInterface::g_msgproc_mutex);
+    auto& connman{static_cast<ConnmanTestMsg&>(*m_node.connman)};
+    PeerManager& peerman{*m_node.peerman};
+    CTxMemPool& pool{*m_node.mempool};
+    static_cast<TestChainstateManager&>(*m_node.chainman).JumpOutOfIbd();
+
+    const auto outpoints{WITH_LOCK(cs_main, return AddOpTrueCoins(m_node.chainman->ActiveChainstate().CoinsTip(), 24, 10 * COIN))};
+
+    NodeId id{0};
+    CNode sender{id++, /*sock=*/nullptr, CAddress{}, /*nKeyedNetGroupIn=*/0, /*nLocalHostNonceIn=*/0, CAddress{}, /*addrNameIn=*/"", ConnectionType::INBOUND, /*inbound_onion=*/false};
+    CNode other{id++, /*sock=*/nullptr, CAddress{}, /*nKeyedNetGroupIn=*/1, /*nLocalHostNonceIn=*/0, CAddress{}, /*addrNameIn=*/"", ConnectionType::INBOUND, /*inbound_onion=*/false};
+    for (CNode* node : {&sender, &other}) {
+        connman.Handshake(*node, /*successfully_connected=*/true, ServiceFlags(NODE_NETWORK | NODE_WITNESS),
+                          ServiceFlags(NODE_NETWORK | NODE_WITNESS), PROTOCOL_VERSION, /*relay_txs=*/true);
+        connman.FlushSendBuffer(*node);
+    }
+
+    const auto send{[&](const CTransactionRef& tx) {
+        connman.FlushSendBuffer(sender);
+        BOOST_REQUIRE(connman.ReceiveMsgFrom(sender, NetMsg::Make(NetMsgType::TX, TX_WITH_WITNESS(*tx))));
+    }};
+    const auto process{[&] {
+        sender.fPauseSend = false;
+        return connman.ProcessMessagesOnce(sender);
+    }};
+    const auto validated{[&] { return pool.m_latency_stats[kernel::MempoolPhase::ACCEPT_TRANSACTION].Count(); }};
+    const auto in_pool{[&](const CTransactionRef& tx) { return pool.exists(GenTxid::Txid(tx->GetHash())); }};
+
+    const auto parent{SpendOpTrue({outpoints[0]}, 10 * COIN - 10000)};
+    const auto child{SpendOpTrue({COutPoint{parent->GetHash(), 0}}, 10 * COIN - 20000)};
+    const auto nonstandard{SpendOpTrue({outpoints[1]}, 10 * COIN - 10000, /*version=*/0)};
+    const auto orphan_parent{SpendOpTrue({outpoints[2]}, 10 * COIN - 10000)};
+    const auto orphan{SpendOpTrue({COutPoint{orphan_parent->GetHash(), 0}}, 10 * COIN - 20000)};
+
+    // All four are validated in a single turn of the peer, the child after its parent.
+    for (const auto& tx : {parent, child, nonstandard, orphan}) send(tx);
+    process();
+    BOOST_CHECK_EQUAL(validated(), 4U);
+    BOOST_CHECK(in_pool(parent));
+    BOOST_CHECK(in_pool(child));
+    BOOST_CHECK(!in_pool(nonstandard));
+    BOOST_CHECK(!in_pool(orphan));
+
+    // The rejected transaction and the orphan are not validated again when resent.
+    send(nonstandard);
+    send(orphan);
+    while (process()) {}
+    BOOST_CHECK_EQUAL(validated(), 4U);
+
+    // Once its parent arrives, the orphan is accepted too.
+    send(orphan_parent);
+    while (process()) {}
+    BOOST_CHECK(in_pool(orphan_parent));
+    BOOST_CHECK(in_pool(orphan));
+
+    // Accepted transactions are announced to the other peer, the rejected one is not.
+    SetMockTime(GetTime<std::chrono::seconds>() + 10min);
+    peerman.SendMessages(&other);
+    const auto inv{TakeSentBytes(other)[NetMsgType::INV]};
+    const auto announced{[&](const CTransactionRef& tx) {
+        return std::search(inv.begin(), inv.end(), tx->GetHash().ToUint256().begin(), tx->GetHash().ToUint256().end()) != inv.end();
+    }};
+    BOOST_CHECK(announced(parent));
+    BOOST_CHECK(announced(child));
+    BOOST_CHECK(announced(orphan_parent));
+    BOOST_CHECK(announced(orphan));
+    BOOST_CHECK(!announced(nonstandard));
+
+    // A long run of tx messages is split over several turns.
+    std::vector<CTransactionRef> many;
+    for (size_t i = 3; i < outpoints.size(); ++i) many.push_back(SpendOpTrue({outpoints[i]}, 10 * COIN - 10000));
+    for (const auto& tx : many) send(tx);
+    const auto before{validated()};
+    BOOST_CHECK(process());
+    BOOST_CHECK(validated() - before > 1);
+    BOOST_CHECK(validated() - before < many.size());
+    while (process()) {}
+    BOOST_CHECK(std::all_of(many.begin(), many.end(), in_pool));
+
+    peerman.FinalizeNode(sender);
+    peerman.FinalizeNode(other);
+}
+
+/** Add count headers on top of the active tip to the block index, without their blocks. Their proof of work
+ *  is not checked, and their difficulty is high enough to beat the minimum chain work of the main chain. */
+static std::vector<CBlock> AddBlockHeaders(ChainstateManager& chainman, int count)
+{
+    LOCK(cs_main);
+    std::vector<CBlock> blocks;
+    const CBlockIndex* prev{chainman.ActiveChain().Tip()};
+    for (int i = 0; i < count; ++i) {
+        CMutableTransaction coinbase;
+        coinbase.vin.resize(1);
+        coinbase.vin[0].scriptSig = CScript() << (prev->nHeight + 1) << OP_0;
+        coinbase.vout.emplace_back(1 * COIN, CScript() << OP_TRUE);
+        CBlock block;
+        block.nVersion = 4;
+        block.hashPrevBlock = prev->GetBlockHash();
+        block.nTime = 1726799421 + prev->nHeight; // late enough for the hash to cover the whole header
+        block.nBits = 0x1b00ffff;
+        block.vtx.push_back(MakeTransactionRef(std::move(coinbase)));
+        block.hashMerkleRoot = BlockMerkleRoot(block);
+        prev = chainman.m_blockman.AddToBlockIndex(block, chainman.m_best_header);
+        blocks.push_back(block);
+    }
+    return blocks;
+}
+
+/** Have node send us msg, and process it. */
+static void ReceiveFrom(ConnmanTestMsg& connman, CNode& node, CSerializedNetMsg&& msg)
+{
+    connman.FlushSendBuffer(node);
+    BOOST_REQUIRE(connman.ReceiveMsgFrom(node, std::move(msg)));
+    node.fPauseSend = false;
+    connman.ProcessMessagesOnce(node);
+}
+
+static CNodeStateStats GetStats(const PeerManager& peerman, const CNode& node)
+{
+    CNodeStateStats stats;
+    BOOST_REQUIRE(peerman.GetNodeStateStats(node.GetId(), stats));
+    return stats;
+}
+
+// The number of blocks kept in flight with a peer follows how fast it delivers them.
+BOOST_FIXTURE_TEST_CASE(block_inflight_limit, TestingSetup)
+{
+    LOCK(NetEventsInterface::g_msgproc_mutex);
+    auto& connman{static_cast<ConnmanTestMsg&>(*m_node.connman)};
+    PeerManager& peerman{*m_node.peerman};
+    static_cast<TestChainstateManager&>(*m_node.chainman).JumpOutOfIbd();
+    SetMockTime(GetTime<std::chrono::seconds>());
+
+    const auto blocks{AddBlockHeaders(*m_node.chainman, 100)};
+    // The blocks fail their proof of work check when delivered; don't disconnect the peer for it.
+    CNode peer{/*id=*/0, /*sock=*/nullptr, CAddress{}, /*nKeyedNetGroupIn=*/0, /*nLocalHostNonceIn=*/0, CAddress{}, /*addrNameIn=*/"", ConnectionType::INBOUND, /*inbound_onion=*/false, CNodeOptions{.permission_flags = NetPermissionFlags::NoBan}};
+    connman.Handshake(peer, /*successfully_connected=*/true, ServiceFlags(NODE_NETWORK | NODE_WITNESS),
+                      ServiceFlags(NODE_NETWORK | NODE_WITNESS), PROTOCOL_VERSION, /*relay_txs=*/true);
+    const auto deliver{[&](int height) {
+        ReceiveFrom(connman, peer, NetMsg::Make(NetMsgType::BLOCK, TX_WITH_WITNESS(blocks[height - 1])));
+    }};
+
+    // Before the peer has delivered anything, it gets the default number of requests.
+    ReceiveFrom(connman, peer, NetMsg::Make(NetMsgType::INV, std::vector<CInv>{CInv{MSG_BLOCK, blocks.back().GetHash()}}));
+    peerman.SendMessages(&peer);
+    const int default_limit{GetStats(peerman, peer).m_block_inflight_limit};
+    BOOST_CHECK_EQUAL(GetStats(peerman, peer).vHeightInFlight.size(), static_cast<size_t>(default_limit));
+
+    // Blocks delivered right away raise the limit, and more blocks are requested at once.
+    for (int height : GetStats(peerman, peer).vHeightInFlight) deliver(height);
+    const int fast_limit{GetStats(peerman, peer).m_block_inflight_limit};
+    BOOST_CHECK_GT(fast_limit, default_limit);
+    peerman.SendMessages(&peer);
+    BOOST_CHECK_EQUAL(GetStats(peerman, peer).vHeightInFlight.size(), static_cast<size_t>(fast_limit));
+
+    // Once blocks take several seconds each, the limit drops below the default, and no more blocks
+    // are requested while more than that are still outstanding.
+    const auto in_flight{GetStats(peerman, peer).vHeightInFlight};
+    SetMockTime(GetTime<std::chrono::seconds>() + 5s);
+    deliver(in_flight.front());
+    SetMockTime(GetTime<std::chrono::seconds>() + 5s);
+    deliver(in_flight[1]);
+    BOOST_CHECK_LT(GetStats(peerman, peer).m_block_inflight_limit, default_limit);
+    peerman.SendMessages(&peer);
+    BOOST_CHECK_EQUAL(GetStats(peerman, peer).vHeightInFlight.size(), in_flight.size() - 2);
+
+    peerman.FinalizeNode(peer);
+}
+
+// A block holding back the download window is requested from a faster peer instead of the staller.
+BOOST_FIXTURE_TEST_CASE(stalled_block_rerequest, TestingSetup)
+{
+    LOCK(NetEventsInterface::g_msgproc_mutex);
+    auto& connman{static_cast<ConnmanTestMsg&>(*m_node.connman)};
+    PeerManager& peerman{*m_node.peerman};
+    static_cast<TestChainstateManager&>(*m_node.chainman).JumpOutOfIbd();
+    SetMockTime(GetTime<std::chrono::seconds>());
+
+    // One block beyond the download window, so that the window being full shows up as a stall.
+    const auto blocks{AddBlockHeaders(*m_node.chainman, 1025)};
+    CNode staller{/*id=*/0, /*sock=*/nullptr, CAddress{}, /*nKeyedNetGroupIn=*/0, /*nLocalHostNonceIn=*/0, CAddress{}, /*addrNameIn=*/"", ConnectionType::INBOUND, /*inbound_onion=*/false, CNodeOptions{.permission_flags = NetPermissionFlags::NoBan}};
+    CNode fast{/*id=*/1, /*sock=*/nullptr, CAddress{}, /*nKeyedNetGroupIn=*/1, /*nLocalHostNonceIn=*/0, CAddress{}, /*addrNameIn=*/"", ConnectionType::INBOUND, /*inbound_onion=*/false, CNodeOptions{.permission_flags = NetPermissionFlags::NoBan}};
+    for (CNode* node : {&staller, &fast}) {
+        connman.Handshake(*node, /*successfully_connected=*/true, ServiceFlags(NODE_NETWORK | NODE_WITNESS),
+                          ServiceFlags(NODE_NETWORK | NODE_WITNESS), PROTOCOL_VERSION, /*relay_txs=*/true);
+        ReceiveFrom(connman, *node, NetMsg::Make(NetMsgType::INV, std::vector<CInv>{CInv{MSG_BLOCK, blocks.back().GetHash()}}));
+        peerman.SendMessages(node);
+    }
+    const auto staller_blocks{GetStats(peerman, staller).vHeightInFlight};
+    BOOST_REQUIRE(!staller_blocks.empty());
+    BOOST_REQUIRE_EQUAL(staller_blocks.front(), 1);
+
+    // The fast peer delivers its blocks right away. Then everything else in the window is downloaded
+    // (which can't happen for real, as these blocks don't pass their proof of work check).
+    for (int height : GetStats(peerman, fast).vHeightInFlight) {
+        ReceiveFrom(connman, fast, NetMsg::Make(NetMsgType::BLOCK, TX_WITH_WITNESS(blocks[height - 1])));
+    }
+    {
+        LOCK(cs_main);
+        for (int height = staller_blocks.back() + 1; height < 1025; ++height) {
+            m_node.chainman->m_blockman.LookupBlockIndex(blocks[height - 1].GetHash())->nStatus |= BLOCK_HAVE_DATA;
+        }
+    }
+
+    // The first block the staller hasn't delivered is now requested from the fast peer, and no longer
+    // from the staller.
+    SetMockTime(GetTime<std::chrono::seconds>() + 1s);
+    connman.FlushSendBuffer(fast);
+    peerman.SendMessages(&fast);
+    BOOST_CHECK(GetStats(peerman, fast).vHeightInFlight == std::vector<int>{1});
+    const auto staller_left{GetStats(peerman, staller).vHeightInFlight};
+    BOOST_CHECK(std::equal(staller_left.begin(), staller_left.end(), staller_blocks.begin() + 1, staller_blocks.end()));
+    const auto getdata{TakeSentBytes(fast)[NetMsgType::GETDATA]};
+    const uint256 hash{blocks.front().GetHash()};
+    BOOST_CHECK(std::search(getdata.begin(), getdata.end(), hash.begin(), hash.end()) != getdata.end());
+
+    // The staller no longer holds back the window, so it isn't disconnected for stalling.
+    SetMockTime(GetTime<std::chrono::seconds>() + 10s);
+    peerman.SendMessages(&staller);
+    BOOST_CHECK(!staller.fDisconnect);
+
+    peerman.FinalizeNode(staller);
+    peerman.FinalizeNode(fast);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <policy/fees.h>
+#include <policy/fees_args.h>
 #include <policy/policy.h>
 #include <test/util/txmempool.h>
 #include <txmempool.h>
@@ -262,6 +263,23 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
     for (int i = 2; i < 9; i++) { // At 9, the original estimate was already at the bottom (b/c scale = 2)
         BOOST_CHECK(feeEst.estimateFee(i).GetFeePerK() < origFeeEst[i-1] - deltaFee);
     }
+
+    // Estimates survive a flush and reload of the lazily decayed averages
+    feeEst.FlushUnconfirmed();
+    feeEst.FlushFeeEstimates();
+    CBlockPolicyEstimator reloaded{FeeestPath(*m_node.args), /*read_stale_estimates=*/true};
+    for (int i = 1; i <= 48; i++) {
+        for (bool conservative : {false, true}) {
+            FeeCalculation calc, calc_reloaded;
+            const CAmount fee{feeEst.estimateSmartFee(i, &calc, conservative).GetFeePerK()};
+            BOOST_CHECK_LE(std::abs(fee - reloaded.estimateSmartFee(i, &calc_reloaded, conservative).GetFeePerK()), 1);
+            BOOST_CHECK_EQUAL(calc.returnedTarget, calc_reloaded.returnedTarget);
+            // A cached answer matches the computed one
+            FeeCalculation calc_cached;
+            BOOST_CHECK_EQUAL(feeEst.estimateSmartFee(i, &calc_cached, conservative).GetFeePerK(), fee);
+            BOOST_CHECK(calc_cached.reason == calc.reason);
+        }
+    }
 }
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -140,6 +140,50 @@ BOOST_AUTO_TEST_CASE(wait)
     waiter.join();
 }
 
+BOOST_AUTO_TEST_CASE(epoll_wait)
+{
+    SockEpoll epoll;
+#ifdef USE_EPOLL
+    BOOST_REQUIRE(epoll.IsValid());
+#else
+    BOOST_REQUIRE(!epoll.IsValid());
+    return;
+#endif
+
+    int s[2];
+    CreateSocketPair(s);
+
+    Sock sock0(s[0]);
+    Sock sock1(s[1]);
+
+    std::vector<SockEpoll::Occurred> occurred;
+    BOOST_REQUIRE(epoll.Add(sock0, 42, Sock::RECV, /*edge_triggered=*/true));
+    BOOST_REQUIRE(epoll.Wait(0ms, occurred));
+    BOOST_CHECK(occurred.empty());
+
+    BOOST_REQUIRE_EQUAL(sock1.Send("a", 1, 0), 1);
+    BOOST_REQUIRE(epoll.Wait(24h, occurred));
+    BOOST_REQUIRE_EQUAL(occurred.size(), 1U);
+    BOOST_CHECK_EQUAL(occurred[0].id, 42U);
+    BOOST_CHECK_EQUAL(occurred[0].occurred, Sock::RECV);
+
+    // Edge-triggered: the unread byte is not reported again.
+    BOOST_REQUIRE(epoll.Wait(0ms, occurred));
+    BOOST_CHECK(occurred.empty());
+
+    // Requesting SEND on the writable socket reports it, together with the still unread byte.
+    BOOST_REQUIRE(epoll.Modify(sock0, 43, Sock::RECV | Sock::SEND, /*edge_triggered=*/true));
+    BOOST_REQUIRE(epoll.Wait(0ms, occurred));
+    BOOST_REQUIRE_EQUAL(occurred.size(), 1U);
+    BOOST_CHECK_EQUAL(occurred[0].id, 43U);
+    BOOST_CHECK_EQUAL(occurred[0].occurred, Sock::RECV | Sock::SEND);
+
+    BOOST_REQUIRE(epoll.Remove(sock0));
+    BOOST_REQUIRE_EQUAL(sock1.Send("b", 1, 0), 1);
+    BOOST_REQUIRE(epoll.Wait(0ms, occurred));
+    BOOST_CHECK(occurred.empty());
+}
+
 BOOST_AUTO_TEST_CASE(recv_until_terminator_limit)
 {
     constexpr auto timeout = 1min; // High enough so that it is never hit.
@@ -4,7 +4,11 @@
 
 #include <node/txreconciliation.h>
 
+#include <test/util/random.h>
 #include <test/util/setup_common.h>
+#include <uint256.h>
+
+#include <algorithm>
 
 #include <boost/test/unit_test.hpp>
 
@@ -81,4 +85,192 @@ BOOST_AUTO_TEST_CASE(IsPeerRegisteredTest)
     BOOST_CHECK(!tracker.IsPeerRegistered(peer_id0));
 }
 
+BOOST_AUTO_TEST_CASE(AddToSetTest)
+{
+    TxReconciliationTracker tracker(TXRECONCILIATION_VERSION);
+    NodeId peer_id0 = 0;
+    const uint256 wtxid{InsecureRand256()};
+
+    // Transactions can't be added for an unregistered peer.
+    BOOST_CHECK(!tracker.AddToSet(peer_id0, wtxid));
+    BOOST_CHECK(tracker.ShouldFloodTo(peer_id0, wtxid));
+
+    tracker.PreRegisterPeer(peer_id0);
+    BOOST_REQUIRE_EQUAL(tracker.RegisterPeer(peer_id0, true, 1, 1), ReconciliationRegisterResult::SUCCESS);
+    BOOST_CHECK(tracker.AddToSet(peer_id0, wtxid));
+    BOOST_CHECK(tracker.TryRemovingFromSet(peer_id0, wtxid));
+    BOOST_CHECK(!tracker.TryRemovingFromSet(peer_id0, wtxid));
+
+    // The set is bounded.
+    for (size_t i = 0; i < MAX_RECONSET_SIZE; ++i) {
+        BOOST_CHECK(tracker.AddToSet(peer_id0, InsecureRand256()));
+    }
+    BOOST_CHECK(!tracker.AddToSet(peer_id0, wtxid));
+}
+
+BOOST_AUTO_TEST_CASE(ShouldFloodToTest)
+{
+    TxReconciliationTracker tracker(TXRECONCILIATION_VERSION);
+
+    // With a single outbound reconciling peer, every transaction is flooded to it.
+    tracker.PreRegisterPeer(0);
+    BOOST_REQUIRE_EQUAL(tracker.RegisterPeer(0, false, 1, 1), ReconciliationRegisterResult::SUCCESS);
+    for (int i = 0; i < 100; ++i) {
+        BOOST_CHECK(tracker.ShouldFloodTo(0, InsecureRand256()));
+    }
+
+    // Inbound reconciling peers only get a small fraction of transactions flooded.
+    tracker.PreRegisterPeer(1);
+    BOOST_REQUIRE_EQUAL(tracker.RegisterPeer(1, true, 1, 1), ReconciliationRegisterResult::SUCCESS);
+    int flooded{0};
+    for (int i = 0; i < 1000; ++i) {
+        if (tracker.ShouldFloodTo(1, InsecureRand256())) ++flooded;
+    }
+    BOOST_CHECK(flooded > 0 && flooded < 300);
+}
+
+/** Register two trackers with each other: tracker_a initiates reconciliations with peer 0, which is tracker_b. */
+static void RegisterPair(TxReconciliationTracker& tracker_a, TxReconciliationTracker& tracker_b)
+{
+    const uint64_t salt_a{tracker_a.PreRegisterPeer(0)};
+    const uint64_t salt_b{tracker_b.PreRegisterPeer(0)};
+    BOOST_REQUIRE_EQUAL(tracker_a.RegisterPeer(0, /*is_peer_inbound=*/false, 1, salt_b), ReconciliationRegisterResult::SUCCESS);
+    BOOST_REQUIRE_EQUAL(tracker_b.RegisterPeer(0, /*is_peer_inbound=*/true, 1, salt_a), ReconciliationRegisterResult::SUCCESS);
+}
+
+BOOST_AUTO_TEST_CASE(ReconciliationRoundTest)
+{
+    // Fix the salts and transactions, so that sketch decoding behaves the same on every run.
+    SeedInsecureRand(SeedRand::ZEROS);
+    g_mock_deterministic_tests = true;
+    TxReconciliationTracker tracker_a(TXRECONCILIATION_VERSION);
+    TxReconciliationTracker tracker_b(TXRECONCILIATION_VERSION);
+    RegisterPair(tracker_a, tracker_b);
+
+    std::vector<uint256> only_a, only_b;
+    for (int i = 0; i < 10; ++i) {
+        const uint256 shared{InsecureRand256()};
+        BOOST_CHECK(tracker_a.AddToSet(0, shared));
+        BOOST_CHECK(tracker_b.AddToSet(0, shared));
+    }
+    for (int i = 0; i < 2; ++i) {
+        only_a.push_back(InsecureRand256());
+        only_b.push_back(InsecureRand256());
+        BOOST_CHECK(tracker_a.AddToSet(0, only_a.back()));
+        BOOST_CHECK(tracker_b.AddToSet(0, only_b.back()));
+    }
+
+    // Only the initiator sends requests, and not again before the round is over.
+    const auto now{GetTime<std::chrono::microseconds>()};
+    BOOST_CHECK(!tracker_b.InitiateReconciliationRequest(0, now));
+    const auto request{tracker_a.InitiateReconciliationRequest(0, now)};
+    BOOST_REQUIRE(request);
+    BOOST_CHECK_EQUAL(request->first, 12);
+    BOOST_CHECK(!tracker_a.InitiateReconciliationRequest(0, now + RECON_REQUEST_INTERVAL));
+
+    std::vector<uint8_t> sketch;
+    BOOST_REQUIRE(tracker_b.HandleReconciliationRequest(0, request->first, request->second, sketch, now) == ReconciliationResult::SUCCESS);
+    BOOST_CHECK(!sketch.empty());
+    // A second request before the round is finished is a protocol violation.
+    std::vector<uint8_t> sketch2;
+    BOOST_CHECK(tracker_b.HandleReconciliationRequest(0, request->first, request->second, sketch2, now) == ReconciliationResult::PROTOCOL_VIOLATION);
+
+    bool success;
+    std::vector<uint32_t> to_request;
+    std::vector<uint256> a_announces;
+    BOOST_REQUIRE(tracker_a.HandleSketch(0, sketch, success, to_request, a_announces) == ReconciliationResult::SUCCESS);
+    BOOST_CHECK(success);
+    BOOST_CHECK_EQUAL(to_request.size(), only_b.size());
+    std::sort(a_announces.begin(), a_announces.end());
+    std::sort(only_a.begin(), only_a.end());
+    BOOST_CHECK(a_announces == only_a);
+
+    std::vector<uint256> b_announces;
+    BOOST_REQUIRE(tracker_b.HandleReconciliationDifference(0, success, to_request, b_announces) == ReconciliationResult::SUCCESS);
+    std::sort(b_announces.begin(), b_announces.end());
+    std::sort(only_b.begin(), only_b.end());
+    BOOST_CHECK(b_announces == only_b);
+
+    // The next round can start once the interval has passed.
+    BOOST_CHECK(!tracker_a.InitiateReconciliationRequest(0, now + RECON_REQUEST_INTERVAL - 1us));
+    const auto next_request{tracker_a.InitiateReconciliationRequest(0, now + RECON_REQUEST_INTERVAL)};
+    BOOST_REQUIRE(next_request);
+    BOOST_CHECK_EQUAL(next_request->first, 0);
+}
+
+BOOST_AUTO_TEST_CASE(ReconciliationFailureTest)
+{
+    // Fix the salts and transactions, so that sketch decoding behaves the same on every run.
+    SeedInsecureRand(SeedRand::ZEROS);
+    g_mock_deterministic_tests = true;
+    TxReconciliationTracker tracker_a(TXRECONCILIATION_VERSION);
+    TxReconciliationTracker tracker_b(TXRECONCILIATION_VERSION);
+    RegisterPair(tracker_a, tracker_b);
+
+    // Disjoint sets exceed the estimated sketch capacity, so everything is announced.
+    for (int i = 0; i < 10; ++i) {
+        BOOST_CHECK(tracker_a.AddToSet(0, InsecureRand256()));
+        BOOST_CHECK(tracker_b.AddToSet(0, InsecureRand256()));
+    }
+
+    const auto now{GetTime<std::chrono::microseconds>()};
+    const auto request{tracker_a.InitiateReconciliationRequest(0, now)};
+    BOOST_REQUIRE(request);
+    std::vector<uint8_t> sketch;
+    BOOST_REQUIRE(tracker_b.HandleReconciliationRequest(0, request->first, request->second, sketch, now) == ReconciliationResult::SUCCESS);
+
+    bool success;
+    std::vector<uint32_t> to_request;
+    std::vector<uint256> a_announces;
+    BOOST_REQUIRE(tracker_a.HandleSketch(0, sketch, success, to_request, a_announces) == ReconciliationResult::SUCCESS);
+    BOOST_CHECK(!success);
+    BOOST_CHECK(to_request.empty());
+    BOOST_CHECK_EQUAL(a_announces.size(), 10U);
+
+    std::vector<uint256> b_announces;
+    BOOST_REQUIRE(tracker_b.HandleReconciliationDifference(0, success, to_request, b_announces) == ReconciliationResult::SUCCESS);
+    BOOST_CHECK_EQUAL(b_announces.size(), 10U);
+
+    // Messages out of order are protocol violations.
+    BOOST_CHECK(tracker_a.HandleSketch(0, sketch, success, to_request, a_announces) == ReconciliationResult::PROTOCOL_VIOLATION);
+    BOOST_CHECK(tracker_b.HandleReconciliationDifference(0, true, {}, b_announces) == ReconciliationResult::PROTOCOL_VIOLATION);
+}
+
+BOOST_AUTO_TEST_CASE(ReconciliationTimeoutTest)
+{
+    TxReconciliationTracker tracker_a(TXRECONCILIATION_VERSION);
+    TxReconciliationTracker tracker_b(TXRECONCILIATION_VERSION);
+    RegisterPair(tracker_a, tracker_b);
+    for (int i = 0; i < 10; ++i) {
+        BOOST_CHECK(tracker_a.AddToSet(0, InsecureRand256()));
+        BOOST_CHECK(tracker_b.AddToSet(0, InsecureRand256()));
+    }
+
+    // Nothing times out without an ongoing round.
+    const auto now{GetTime<std::chrono::microseconds>()};
+    BOOST_CHECK(tracker_a.TimeoutReconciliation(0, now + RECON_RESPONSE_TIMEOUT).empty());
+    BOOST_CHECK(tracker_b.TimeoutReconciliation(0, now + RECON_RESPONSE_TIMEOUT).empty());
+
+    const auto request{tracker_a.InitiateReconciliationRequest(0, now)};
+    BOOST_REQUIRE(request);
+    std::vector<uint8_t> sketch;
+    BOOST_REQUIRE(tracker_b.HandleReconciliationRequest(0, request->first, request->second, sketch, now) == ReconciliationResult::SUCCESS);
+
+    // The sketch never arrives, and the diff never comes back. Once the timeout has passed, both
+    // sides give up and flood the transactions of the round.
+    BOOST_CHECK(tracker_a.TimeoutReconciliation(0, now + RECON_RESPONSE_TIMEOUT - 1us).empty());
+    BOOST_CHECK(tracker_b.TimeoutReconciliation(0, now + RECON_RESPONSE_TIMEOUT - 1us).empty());
+    BOOST_CHECK_EQUAL(tracker_a.TimeoutReconciliation(0, now + RECON_RESPONSE_TIMEOUT).size(), 10U);
+    BOOST_CHECK_EQUAL(tracker_b.TimeoutReconciliation(0, now + RECON_RESPONSE_TIMEOUT).size(), 10U);
+    BOOST_CHECK(tracker_a.TimeoutReconciliation(0, now + RECON_RESPONSE_TIMEOUT).empty());
+    BOOST_CHECK(tracker_b.TimeoutReconciliation(0, now + RECON_RESPONSE_TIMEOUT).empty());
+
+    // A new round can start on both sides.
+    const auto next_request{tracker_a.InitiateReconciliationRequest(0, now + RECON_RESPONSE_TIMEOUT)};
+    BOOST_REQUIRE(next_request);
+    BOOST_CHECK_EQUAL(next_request->first, 0);
+    BOOST_CHECK(tracker_b.HandleReconciliationRequest(0, next_request->first, next_request->second, sketch, now + RECON_RESPONSE_TIMEOUT) == ReconciliationResult::SUCCESS);
+    BOOST_CHECK(sketch.empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -11,6 +11,7 @@
 
 #include <algorithm>
 #include <functional>
+#include <thread>
 #include <vector>
 
 #include <boost/test/unit_test.hpp>
@@ -737,4 +738,50 @@ BOOST_AUTO_TEST_CASE(TxRequestTest)
     }
 }
 
+BOOST_AUTO_TEST_CASE(TxRequestShardedTest)
+{
+    // Announcements from many peers, processed by several threads at once, give the same results as processing
+    // them one by one in a tracker with a single shard.
+    constexpr int NUM_PEERS{16}, NUM_TXS{64}, NUM_THREADS{4};
+    std::vector<GenTxid> txs;
+    for (int i = 0; i < NUM_TXS; ++i) txs.push_back(GenTxid::Wtxid(InsecureRand256()));
+    const auto now{RandomTime1y()};
+
+    TxRequestTracker single{/*deterministic=*/true, /*num_shards=*/1};
+    TxRequestTracker sharded{/*deterministic=*/true};
+    for (NodeId peer = 0; peer < NUM_PEERS; ++peer) {
+        for (const GenTxid& gtxid : txs) single.ReceivedInv(peer, gtxid, peer % 4 == 0, now);
+    }
+    std::vector<std::thread> threads;
+    for (int t = 0; t < NUM_THREADS; ++t) {
+        threads.emplace_back([&, t] {
+            for (NodeId peer = t; peer < NUM_PEERS; peer += NUM_THREADS) {
+                for (const GenTxid& gtxid : txs) sharded.ReceivedInv(peer, gtxid, peer % 4 == 0, now);
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    sharded.SanityCheck();
+    BOOST_CHECK_EQUAL(sharded.Size(), single.Size());
+
+    for (NodeId peer = 0; peer < NUM_PEERS; ++peer) {
+        BOOST_CHECK_EQUAL(sharded.Count(peer), single.Count(peer));
+        const auto requestable{single.GetRequestable(peer, now)};
+        auto requestable_sharded{sharded.GetRequestable(peer, now)};
+        // The order of announcements made by concurrent threads is arbitrary.
+        BOOST_CHECK_EQUAL(requestable.size(), requestable_sharded.size());
+        for (const GenTxid& gtxid : requestable) {
+            BOOST_CHECK(std::find(requestable_sharded.begin(), requestable_sharded.end(), gtxid) != requestable_sharded.end());
+            sharded.RequestedTx(peer, gtxid.GetHash(), now + MICROSECOND);
+        }
+        sharded.PostGetRequestableSanityCheck(now);
+        BOOST_CHECK_EQUAL(sharded.CountInFlight(peer), requestable.size());
+    }
+    BOOST_CHECK_EQUAL(sharded.CountInFlight(0) + sharded.CountCandidates(0), sharded.Count(0));
+
+    for (NodeId peer = 0; peer < NUM_PEERS; ++peer) sharded.DisconnectedPeer(peer);
+    sharded.SanityCheck();
+    BOOST_CHECK_EQUAL(sharded.Size(), 0U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -10,7 +10,9 @@
 #include <primitives/transaction.h>
 #include <random.h>
 #include <script/script.h>
+#include <test/util/random.h>
 #include <test/util/setup_common.h>
+#include <test/util/transaction_utils.h>
 #include <test/util/txmempool.h>
 #include <validation.h>
 
@@ -341,4 +343,51 @@ BOOST_FIXTURE_TEST_CASE(version3_tests, RegTestingSetup)
     // equivalent to the tx with multiple generations of ancestors.
 }
 
+BOOST_FIXTURE_TEST_CASE(tx_batch_accept, TestingSetup)
+{
+    CTxMemPool& pool = *Assert(m_node.mempool);
+    LOCK(cs_main);
+    const auto outpoints{AddOpTrueCoins(m_node.chainman->ActiveChainstate().CoinsTip(), 3, 10 * COIN)};
+
+    const auto parent{SpendOpTrue({outpoints[0]}, 10 * COIN - 10000)};
+    // Spends a transaction earlier in the same batch.
+    const auto child{SpendOpTrue({COutPoint{parent->GetHash(), 0}}, 10 * COIN - 20000)};
+    // Policy-invalid: non-standard version.
+    const auto nonstandard{SpendOpTrue({outpoints[1]}, 10 * COIN - 10000, /*version=*/0)};
+    // Its parent is unknown.
+    const auto orphan{SpendOpTrue({COutPoint{Txid::FromUint256(InsecureRand256()), 0}}, COIN)};
+    // Conflicts with parent, without paying enough to replace it.
+    const auto conflict{SpendOpTrue({outpoints[0]}, 10 * COIN - 10000 - 1)};
+    const auto independent{SpendOpTrue({outpoints[2]}, 10 * COIN - 10000)};
+
+    const std::vector<CTransactionRef> batch{parent, child, nonstandard, orphan, conflict, independent};
+    const auto results{m_node.chainman->ProcessTransactions(batch)};
+    BOOST_REQUIRE_EQUAL(results.size(), batch.size());
+
+    // Every transaction gets its own result, as if it had been submitted on its own after
+    // the ones before it.
+    for (const auto& tx : {parent, child, independent}) {
+        const size_t i = std::find(batch.begin(), batch.end(), tx) - batch.begin();
+        BOOST_CHECK(results[i].m_result_type == MempoolAcceptResult::ResultType::VALID);
+        BOOST_CHECK(pool.exists(GenTxid::Wtxid(tx->GetWitnessHash())));
+    }
+    BOOST_CHECK(results[2].m_result_type == MempoolAcceptResult::ResultType::INVALID);
+    BOOST_CHECK(results[2].m_state.GetResult() == TxValidationResult::TX_NOT_STANDARD);
+    BOOST_CHECK_EQUAL(results[2].m_state.GetRejectReason(), "version");
+    BOOST_CHECK(results[3].m_result_type == MempoolAcceptResult::ResultType::INVALID);
+    BOOST_CHECK(results[3].m_state.GetResult() == TxValidationResult::TX_MISSING_INPUTS);
+    BOOST_CHECK(results[4].m_result_type == MempoolAcceptResult::ResultType::INVALID);
+    BOOST_CHECK(results[4].m_state.GetResult() == TxValidationResult::TX_MEMPOOL_POLICY);
+    BOOST_CHECK_EQUAL(pool.size(), 3U);
+
+    // Resubmitting the batch rejects the accepted transactions as duplicates, as AcceptToMemoryPool would.
+    const auto resubmitted{m_node.chainman->ProcessTransactions(batch)};
+    for (const auto& tx : {parent, child, independent}) {
+        const size_t i = std::find(batch.begin(), batch.end(), tx) - batch.begin();
+        BOOST_CHECK(resubmitted[i].m_result_type == MempoolAcceptResult::ResultType::INVALID);
+        BOOST_CHECK_EQUAL(resubmitted[i].m_state.GetRejectReason(), "txn-already-in-mempool");
+    }
+    BOOST_CHECK_EQUAL(pool.size(), 3U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,8 @@
 
 #include <coins.h>
 #include <script/signingprovider.h>
+#include <test/util/random.h>
+#include <test/util/script.h>
 #include <test/util/transaction_utils.h>
 
 CMutableTransaction BuildCreditingTransaction(const CScript& scriptPubKey, int nValue)
@@ -69,3 +71,25 @@ std::vector<CMutableTransaction> SetupDummyInputs(FillableSigningProvider& keyst
 
     return dummyTransactions;
 }
+
+std::vector<COutPoint> AddOpTrueCoins(CCoinsViewCache& coins_view, size_t num_coins, CAmount value)
+{
+    std::vector<COutPoint> outpoints;
+    for (size_t i = 0; i < num_coins; ++i) {
+        outpoints.emplace_back(Txid::FromUint256(InsecureRand256()), 0);
+        coins_view.AddCoin(outpoints.back(), Coin{CTxOut{value, P2WSH_OP_TRUE}, /*nHeightIn=*/1, /*fCoinBaseIn=*/false}, /*possible_overwrite=*/false);
+    }
+    return outpoints;
+}
+
+CTransactionRef SpendOpTrue(const std::vector<COutPoint>& outpoints, CAmount value, int32_t version)
+{
+    CMutableTransaction mtx;
+    mtx.nVersion = version;
+    for (const COutPoint& outpoint : outpoints) {
+        mtx.vin.emplace_back(outpoint);
+        mtx.vin.back().scriptWitness.stack.push_back(WITNESS_STACK_ELEM_OP_TRUE);
+    }
+    mtx.vout.emplace_back(value, P2WSH_OP_TRUE);
+    return MakeTransactionRef(mtx);
+}
@@ -5,9 +5,11 @@
 #ifndef BITCOIN_TEST_UTIL_TRANSACTION_UTILS_H
 #define BITCOIN_TEST_UTIL_TRANSACTION_UTILS_H
 
+#include <consensus/amount.h>
 #include <primitives/transaction.h>
 
 #include <array>
+#include <vector>
 
 class FillableSigningProvider;
 class CCoinsViewCache;
@@ -26,4 +28,12 @@ CMutableTransaction BuildSpendingTransaction(const CScript& scriptSig, const CSc
 // the second nValues[2] and nValues[3] outputs paid to a TxoutType::PUBKEYHASH.
 std::vector<CMutableTransaction> SetupDummyInputs(FillableSigningProvider& keystoreRet, CCoinsViewCache& coinsRet, const std::array<CAmount,4>& nValues);
 
+// Helper: add num_coins coins of the given value, paid to P2WSH(OP_TRUE) at random
+// outpoints, to the view, and return their outpoints.
+std::vector<COutPoint> AddOpTrueCoins(CCoinsViewCache& coins_view, size_t num_coins, CAmount value);
+
+// create transaction spending P2WSH(OP_TRUE) outpoints
+// [inputs with the OP_TRUE witness => 1 P2WSH(OP_TRUE) output with the given value]
+CTransactionRef SpendOpTrue(const std::vector<COutPoint>& outpoints, CAmount value, int32_t version = 2);
+
 #endif // BITCOIN_TEST_UTIL_TRANSACTION_UTILS_H
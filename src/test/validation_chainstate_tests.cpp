@@ -140,4 +140,60 @@ BOOST_FIXTURE_TEST_CASE(chainstate_update_tip, TestChain100Setup)
     BOOST_CHECK_EQUAL(curr_tip, ::g_best_block);
 }
 
+//! Test that PrefetchInputs() warms the coins tip cache with a block's inputs.
+BOOST_FIXTURE_TEST_CASE(chainstate_prefetch_inputs, TestingSetup)
+{
+    Chainstate& chainstate = Assert(m_node.chainman)->ActiveChainstate();
+    LOCK(::cs_main);
+    CCoinsViewCache& tip{chainstate.CoinsTip()};
+
+    // Synthetic coins, flushed to the coins database so that they leave the cache.
+    std::vector<std::pair<COutPoint, CAmount>> coins;
+    for (int i = 0; i < 100; ++i) {
+        const COutPoint outpoint{AddTestCoin(tip)};
+        coins.emplace_back(outpoint, tip.AccessCoin(outpoint).out.nValue);
+    }
+    BOOST_REQUIRE(tip.Flush());
+    for (const auto& [outpoint, value] : coins) BOOST_CHECK(!tip.HaveCoinInCache(outpoint));
+
+    // Ten transactions spending the coins, one spending an output created within
+    // the block, and one spending a coin that does not exist.
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.resize(1);
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    for (size_t i = 0; i < coins.size(); i += 10) {
+        CMutableTransaction tx;
+        for (size_t j = i; j < i + 10; ++j) tx.vin.emplace_back(coins[j].first);
+        tx.vout.resize(1);
+        block.vtx.push_back(MakeTransactionRef(tx));
+    }
+    const COutPoint in_block_outpoint{block.vtx.back()->GetHash(), 0};
+    const COutPoint missing_outpoint{Txid::FromUint256(InsecureRand256()), 0};
+    CMutableTransaction child;
+    child.vin.emplace_back(in_block_outpoint);
+    child.vin.emplace_back(missing_outpoint);
+    child.vout.resize(1);
+    block.vtx.push_back(MakeTransactionRef(child));
+
+    const size_t usage_before{tip.DynamicMemoryUsage()};
+    chainstate.PrefetchInputs(block);
+
+    // The cached coins are the ones that were read from the database.
+    for (const auto& [outpoint, value] : coins) {
+        BOOST_CHECK(tip.HaveCoinInCache(outpoint));
+        BOOST_CHECK_EQUAL(tip.AccessCoin(outpoint).out.nValue, value);
+    }
+    BOOST_CHECK(!tip.HaveCoinInCache(in_block_outpoint));
+    BOOST_CHECK(!tip.HaveCoinInCache(missing_outpoint));
+    BOOST_CHECK_GT(tip.DynamicMemoryUsage(), usage_before);
+
+    // Prefetched coins are clean, so they can be uncached again.
+    for (const auto& [outpoint, value] : coins) {
+        tip.Uncache(outpoint);
+        BOOST_CHECK(!tip.HaveCoinInCache(outpoint));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
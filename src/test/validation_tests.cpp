@@ -34,6 +34,23 @@ BOOST_AUTO_TEST_CASE(subsidy_limit_test)
     BOOST_CHECK_EQUAL(nSum, CAmount{2099999997690000});
 }
 
+BOOST_AUTO_TEST_CASE(header_pow_cache)
+{
+    const auto chainparams = CreateChainParams(*m_node.args, ChainType::MAIN);
+    const auto& consensus = chainparams->GetConsensus();
+    CBlockHeader header = chainparams->GenesisBlock();
+
+    // The result doesn't depend on whether the header was already verified before.
+    BOOST_CHECK(CheckHeaderProofOfWork(header, consensus));
+    BOOST_CHECK(CheckHeaderProofOfWork(header, consensus));
+    BOOST_CHECK(HasValidProofOfWork({header, header}, consensus));
+
+    // A modified solution is not mistaken for the cached header.
+    std::swap(header.vdfSolution[0], header.vdfSolution[1]);
+    BOOST_CHECK(!CheckHeaderProofOfWork(header, consensus));
+    BOOST_CHECK(!HasValidProofOfWork({chainparams->GenesisBlock(), header}, consensus));
+}
+
 BOOST_AUTO_TEST_CASE(signet_parse_tests)
 {
     ArgsManager signet_argsman;
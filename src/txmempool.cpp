@@ -25,6 +25,7 @@
 #include <util/translation.h>
 #include <validationinterface.h>
 
+#include <bitset>
 #include <cmath>
 #include <numeric>
 #include <optional>
@@ -48,8 +49,38 @@ bool TestLockPointValidity(CChain& active_chain, const LockPoints& lp)
     return true;
 }
 
+size_t CTxMemPool::StagedStateUpdates::Slot(txiter entry)
+{
+    const auto [it, inserted] = slots.try_emplace(&*entry, entries.size());
+    if (inserted) {
+        entries.push_back(entry);
+        ancestor_count.push_back(0);
+        ancestor_size.push_back(0);
+        ancestor_fee.push_back(0);
+        ancestor_sigops.push_back(0);
+        descendant_count.push_back(0);
+        descendant_size.push_back(0);
+        descendant_fee.push_back(0);
+    }
+    return it->second;
+}
+
+void CTxMemPool::ApplyStateUpdates(const StagedStateUpdates& staged)
+{
+    for (size_t i = 0; i < staged.entries.size(); ++i) {
+        mapTx.modify(staged.entries[i], [&staged, i](CTxMemPoolEntry& e) {
+            if (staged.descendant_count[i] != 0) {
+                e.UpdateDescendantState(staged.descendant_size[i], staged.descendant_fee[i], staged.descendant_count[i]);
+            }
+            if (staged.ancestor_count[i] != 0) {
+                e.UpdateAncestorState(staged.ancestor_size[i], staged.ancestor_fee[i], staged.ancestor_count[i], staged.ancestor_sigops[i]);
+            }
+        });
+    }
+}
+
 void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap& cachedDescendants,
-                                      const std::set<uint256>& setExclude, std::set<uint256>& descendants_to_remove)
+                                      const std::set<uint256>& setExclude, StagedStateUpdates& staged)
 {
     CTxMemPoolEntry::Children stageEntries, descendants;
     stageEntries = updateIt->GetMemPoolChildrenConst();
@@ -84,19 +115,20 @@ void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap& cachedDescendan
             modifyFee += descendant.GetModifiedFee();
             modifyCount++;
             cachedDescendants[updateIt].insert(mapTx.iterator_to(descendant));
-            // Update ancestor state for each descendant
-            mapTx.modify(mapTx.iterator_to(descendant), [=](CTxMemPoolEntry& e) {
-              e.UpdateAncestorState(updateIt->GetTxSize(), updateIt->GetModifiedFee(), 1, updateIt->GetSigOpCost());
-            });
-            // Don't directly remove the transaction here -- doing so would
-            // invalidate iterators in cachedDescendants. Mark it for removal
-            // by inserting into descendants_to_remove.
-            if (descendant.GetCountWithAncestors() > uint64_t(m_limits.ancestor_count) || descendant.GetSizeWithAncestors() > m_limits.ancestor_size_vbytes) {
-                descendants_to_remove.insert(descendant.GetTx().GetHash());
-            }
+            // Stage the ancestor state update for each descendant
+            const size_t slot{staged.Slot(mapTx.iterator_to(descendant))};
+            staged.ancestor_count[slot] += 1;
+            staged.ancestor_size[slot] += updateIt->GetTxSize();
+            staged.ancestor_fee[slot] += updateIt->GetModifiedFee();
+            staged.ancestor_sigops[slot] += updateIt->GetSigOpCost();
         }
     }
-    mapTx.modify(updateIt, [=](CTxMemPoolEntry& e) { e.UpdateDescendantState(modifySize, modifyFee, modifyCount); });
+    if (modifyCount > 0) {
+        const size_t slot{staged.Slot(updateIt)};
+        staged.descendant_count[slot] += modifyCount;
+        staged.descendant_size[slot] += modifySize;
+        staged.descendant_fee[slot] += modifyFee;
+    }
 }
 
 void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256>& vHashesToUpdate)
@@ -111,7 +143,7 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256>& vHashes
     // accounted for in the state of their ancestors)
     std::set<uint256> setAlreadyIncluded(vHashesToUpdate.begin(), vHashesToUpdate.end());
 
-    std::set<uint256> descendants_to_remove;
+    StagedStateUpdates staged;
 
     // Iterate in reverse, so that whenever we are looking at a transaction
     // we are sure that all in-mempool descendants have already been processed.
@@ -142,7 +174,19 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256>& vHashes
                 }
             }
         } // release epoch guard for UpdateForDescendants
-        UpdateForDescendants(it, mapMemPoolDescendantsToUpdate, setAlreadyIncluded, descendants_to_remove);
+        UpdateForDescendants(it, mapMemPoolDescendantsToUpdate, setAlreadyIncluded, staged);
+    }
+    ApplyStateUpdates(staged);
+
+    // Adding ancestors only grows the ancestor state, so checking the limits once
+    // all of it is applied finds every descendant that exceeded them on the way.
+    std::set<uint256> descendants_to_remove;
+    for (size_t i = 0; i < staged.entries.size(); ++i) {
+        const CTxMemPoolEntry& entry = *staged.entries[i];
+        if (staged.ancestor_count[i] != 0 &&
+            (entry.GetCountWithAncestors() > uint64_t(m_limits.ancestor_count) || entry.GetSizeWithAncestors() > m_limits.ancestor_size_vbytes)) {
+            descendants_to_remove.insert(entry.GetTx().GetHash());
+        }
     }
 
     for (const auto& txid : descendants_to_remove) {
@@ -319,6 +363,9 @@ void CTxMemPool::UpdateChildrenForRemoval(txiter it)
 
 void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, bool updateDescendants)
 {
+    // The state changes of the entries that stay in the mempool are summed up
+    // first, so that each is modified once for all of its removed relatives.
+    StagedStateUpdates staged;
     // For each entry, walk back all ancestors and decrement size associated with this
     // transaction
     if (updateDescendants) {
@@ -331,12 +378,14 @@ void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, b
         for (txiter removeIt : entriesToRemove) {
             setEntries setDescendants;
             CalculateDescendants(removeIt, setDescendants);
-            setDescendants.erase(removeIt); // don't update state for self
-            int32_t modifySize = -removeIt->GetTxSize();
-            CAmount modifyFee = -removeIt->GetModifiedFee();
-            int modifySigOps = -removeIt->GetSigOpCost();
             for (txiter dit : setDescendants) {
-                mapTx.modify(dit, [=](CTxMemPoolEntry& e){ e.UpdateAncestorState(modifySize, modifyFee, -1, modifySigOps); });
+                // don't update state for self, or for others that are removed too
+                if (entriesToRemove.count(dit)) continue;
+                const size_t slot{staged.Slot(dit)};
+                staged.ancestor_count[slot] -= 1;
+                staged.ancestor_size[slot] -= removeIt->GetTxSize();
+                staged.ancestor_fee[slot] -= removeIt->GetModifiedFee();
+                staged.ancestor_sigops[slot] -= removeIt->GetSigOpCost();
             }
         }
     }
@@ -362,10 +411,20 @@ void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, b
         // we use the cached notion of ancestor transactions as the set of
         // things to update for removal.
         auto ancestors{AssumeCalculateMemPoolAncestors(__func__, entry, Limits::NoLimits(), /*fSearchForParents=*/false)};
-        // Note that UpdateAncestorsOf severs the child links that point to
-        // removeIt in the entries for the parents of removeIt.
-        UpdateAncestorsOf(false, removeIt, ancestors);
+        // Sever the child links that point to removeIt in the entries for the
+        // parents of removeIt.
+        for (const CTxMemPoolEntry& parent : entry.GetMemPoolParentsConst()) {
+            UpdateChild(mapTx.iterator_to(parent), removeIt, false);
+        }
+        for (txiter ancestorIt : ancestors) {
+            if (entriesToRemove.count(ancestorIt)) continue;
+            const size_t slot{staged.Slot(ancestorIt)};
+            staged.descendant_count[slot] -= 1;
+            staged.descendant_size[slot] -= removeIt->GetTxSize();
+            staged.descendant_fee[slot] -= removeIt->GetModifiedFee();
+        }
     }
+    ApplyStateUpdates(staged);
     // After updating all the ancestor sizes, we can now sever the link between each
     // transaction being removed and any mempool children (ie, update CTxMemPoolEntry::m_parents
     // for each direct child of a transaction being removed).
@@ -472,6 +531,7 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, setEntries &setAnces
     m_total_fee += entry.GetFee();
 
     txns_randomized.emplace_back(newit->GetSharedTx());
+    wtxids_randomized.emplace_back(newit->GetTx().GetWitnessHash());
     newit->idx_randomized = txns_randomized.size() - 1;
 
     TRACE3(mempool, added,
@@ -513,15 +573,21 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
         // Remove entry from txns_randomized by replacing it with the back and deleting the back.
         txns_randomized[it->idx_randomized] = std::move(txns_randomized.back());
         txns_randomized.pop_back();
-        if (txns_randomized.size() * 2 < txns_randomized.capacity())
+        wtxids_randomized[it->idx_randomized] = wtxids_randomized.back();
+        wtxids_randomized.pop_back();
+        if (txns_randomized.size() * 2 < txns_randomized.capacity()) {
             txns_randomized.shrink_to_fit();
-    } else
+            wtxids_randomized.shrink_to_fit();
+        }
+    } else {
         txns_randomized.clear();
+        wtxids_randomized.clear();
+    }
 
     totalTxSize -= it->GetTxSize();
     m_total_fee -= it->GetFee();
     cachedInnerUsage -= it->DynamicMemoryUsage();
-    cachedInnerUsage -= memusage::DynamicUsage(it->GetMemPoolParentsConst()) + memusage::DynamicUsage(it->GetMemPoolChildrenConst());
+    cachedInnerUsage -= it->GetMemPoolParentsConst().DynamicMemoryUsage() + it->GetMemPoolChildrenConst().DynamicMemoryUsage();
     mapTx.erase(it);
     nTransactionsUpdated++;
 }
@@ -631,15 +697,20 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigne
     AssertLockHeld(cs);
     std::vector<RemovedMempoolTransactionInfo> txs_removed_for_block;
     txs_removed_for_block.reserve(vtx.size());
-    for (const auto& tx : vtx)
-    {
+    // Remove all the block's transactions at once, so that the state of their
+    // in-mempool relatives is updated once rather than once per transaction.
+    // (Any in-mempool ancestor of a block transaction is in the block too.)
+    setEntries stage;
+    for (const auto& tx : vtx) {
         txiter it = mapTx.find(tx->GetHash());
         if (it != mapTx.end()) {
-            setEntries stage;
             stage.insert(it);
             txs_removed_for_block.emplace_back(*it);
-            RemoveStaged(stage, true, MemPoolRemovalReason::BLOCK);
         }
+    }
+    RemoveStaged(stage, true, MemPoolRemovalReason::BLOCK);
+    for (const auto& tx : vtx)
+    {
         removeConflicts(*tx);
         ClearPrioritisation(tx->GetHash());
     }
@@ -670,7 +741,7 @@ void CTxMemPool::check(const CCoinsViewCache& active_coins_tip, int64_t spendhei
         check_total_fee += it->GetFee();
         innerUsage += it->DynamicMemoryUsage();
         const CTransaction& tx = it->GetTx();
-        innerUsage += memusage::DynamicUsage(it->GetMemPoolParentsConst()) + memusage::DynamicUsage(it->GetMemPoolChildrenConst());
+        innerUsage += it->GetMemPoolParentsConst().DynamicMemoryUsage() + it->GetMemPoolChildrenConst().DynamicMemoryUsage();
         CTxMemPoolEntry::Parents setParentCheck;
         for (const CTxIn &txin : tx.vin) {
             // Check that every mempool transaction's inputs refer to available coins, or other mempool tx's.
@@ -833,6 +904,17 @@ std::vector<TxMempoolInfo> CTxMemPool::infoAll() const
     return ret;
 }
 
+std::vector<CTransactionRef> CTxMemPool::GetTxsAddedSince(uint64_t sequence) const
+{
+    AssertLockHeld(cs);
+    std::vector<CTransactionRef> ret;
+    const auto& by_time{mapTx.get<entry_time>()};
+    for (auto it = by_time.rbegin(); it != by_time.rend() && it->GetSequence() >= sequence; ++it) {
+        ret.push_back(it->GetSharedTx());
+    }
+    return ret;
+}
+
 const CTxMemPoolEntry* CTxMemPool::GetEntry(const Txid& txid) const
 {
     AssertLockHeld(cs);
@@ -1023,7 +1105,7 @@ void CCoinsViewMemPool::Reset()
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
     // Estimate the overhead of mapTx to be 15 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 15 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(txns_randomized) + cachedInnerUsage;
+    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 15 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(txns_randomized) + memusage::DynamicUsage(wtxids_randomized) + cachedInnerUsage;
 }
 
 void CTxMemPool::RemoveUnbroadcastTx(const uint256& txid, const bool unchecked) {
@@ -1069,23 +1151,27 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry)
 void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add)
 {
     AssertLockHeld(cs);
-    CTxMemPoolEntry::Children s;
-    if (add && entry->GetMemPoolChildren().insert(*child).second) {
-        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && entry->GetMemPoolChildren().erase(*child)) {
-        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
+    CTxMemPoolEntry::Children& children = entry->GetMemPoolChildren();
+    cachedInnerUsage -= children.DynamicMemoryUsage();
+    if (add) {
+        children.insert(*child);
+    } else {
+        children.erase(*child);
     }
+    cachedInnerUsage += children.DynamicMemoryUsage();
 }
 
 void CTxMemPool::UpdateParent(txiter entry, txiter parent, bool add)
 {
     AssertLockHeld(cs);
-    CTxMemPoolEntry::Parents s;
-    if (add && entry->GetMemPoolParents().insert(*parent).second) {
-        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && entry->GetMemPoolParents().erase(*parent)) {
-        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
+    CTxMemPoolEntry::Parents& parents = entry->GetMemPoolParents();
+    cachedInnerUsage -= parents.DynamicMemoryUsage();
+    if (add) {
+        parents.insert(*parent);
+    } else {
+        parents.erase(*parent);
     }
+    cachedInnerUsage += parents.DynamicMemoryUsage();
 }
 
 CFeeRate CTxMemPool::GetMinFee(size_t sizelimit) const {
@@ -1128,17 +1214,28 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpends
     while (!mapTx.empty() && DynamicMemoryUsage() > sizelimit) {
         indexed_transaction_set::index<descendant_score>::type::iterator it = mapTx.get<descendant_score>().begin();
 
+        // Evict the part of its cluster that block building would include last, so that
+        // eviction and mining agree on which transactions are least valuable. If the
+        // cluster is too large to linearize, fall back to the descendant set.
+        setEntries stage;
+        CFeeRate removed;
+        const std::vector<ClusterChunk> chunks{LinearizeCluster(mapTx.project<0>(it))};
+        if (!chunks.empty()) {
+            stage.insert(chunks.back().txs.begin(), chunks.back().txs.end());
+            removed = CFeeRate(chunks.back().fee, chunks.back().vsize);
+        } else {
+            CalculateDescendants(mapTx.project<0>(it), stage);
+            removed = CFeeRate(it->GetModFeesWithDescendants(), it->GetSizeWithDescendants());
+        }
+
         // We set the new mempool min fee to the feerate of the removed set, plus the
         // "minimum reasonable fee rate" (ie some value under which we consider txn
         // to have 0 fee). This way, we don't allow txn to enter mempool with feerate
         // equal to txn which were removed with no block in between.
-        CFeeRate removed(it->GetModFeesWithDescendants(), it->GetSizeWithDescendants());
         removed += m_incremental_relay_feerate;
         trackPackageRemoved(removed);
         maxFeeRateRemoved = std::max(maxFeeRateRemoved, removed);
 
-        setEntries stage;
-        CalculateDescendants(mapTx.project<0>(it), stage);
         nTxnRemoved += stage.size();
 
         std::vector<CTransaction> txn;
@@ -1209,6 +1306,9 @@ void CTxMemPool::SetLoadTried(bool load_tried)
     m_load_tried = load_tried;
 }
 
+/** The largest cluster GatherClusters() returns. */
+static constexpr size_t MAX_GATHERED_CLUSTER_SIZE{500};
+
 std::vector<CTxMemPool::txiter> CTxMemPool::GatherClusters(const std::vector<uint256>& txids) const
 {
     AssertLockHeld(cs);
@@ -1222,7 +1322,7 @@ std::vector<CTxMemPool::txiter> CTxMemPool::GatherClusters(const std::vector<uin
     // i = index of where the list of entries to process starts
     for (size_t i{0}; i < clustered_txs.size(); ++i) {
         // DoS protection: if there are 500 or more entries to process, just quit.
-        if (clustered_txs.size() > 500) return {};
+        if (clustered_txs.size() > MAX_GATHERED_CLUSTER_SIZE) return {};
         const txiter& tx_iter = clustered_txs.at(i);
         for (const auto& entries : {tx_iter->GetMemPoolParentsConst(), tx_iter->GetMemPoolChildrenConst()}) {
             for (const CTxMemPoolEntry& entry : entries) {
@@ -1235,3 +1335,77 @@ std::vector<CTxMemPool::txiter> CTxMemPool::GatherClusters(const std::vector<uin
     }
     return clustered_txs;
 }
+
+std::vector<CTxMemPool::ClusterChunk> CTxMemPool::LinearizeCluster(txiter tx) const
+{
+    AssertLockHeld(cs);
+    std::vector<txiter> cluster{GatherClusters({tx->GetTx().GetHash()})};
+    if (cluster.empty()) return {};
+
+    // Order parents before their children, so that any subset of the cluster is valid for a
+    // block in this order.
+    std::sort(cluster.begin(), cluster.end(), [](const txiter& a, const txiter& b) {
+        return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+    });
+    std::map<txiter, size_t, CompareIteratorByHash> index;
+    for (size_t i{0}; i < cluster.size(); ++i) index.emplace(cluster[i], i);
+
+    // Find each transaction's in-cluster ancestors (all of them are), including itself, as a set
+    // of indexes, so that linearizing only takes O(cluster size^2) steps. Also sum the fee and
+    // size of each ancestor set; these only count the not yet linearized part.
+    using ClusterSet = std::bitset<MAX_GATHERED_CLUSTER_SIZE>;
+    std::vector<ClusterSet> ancestors(cluster.size());
+    std::vector<CAmount> anc_fee(cluster.size());
+    std::vector<int64_t> anc_size(cluster.size());
+    for (size_t i{0}; i < cluster.size(); ++i) {
+        ancestors[i].set(i);
+        for (const CTxMemPoolEntry& parent : cluster[i]->GetMemPoolParentsConst()) {
+            ancestors[i] |= ancestors[index.at(mapTx.iterator_to(parent))];
+        }
+        for (size_t a{0}; a <= i; ++a) {
+            if (!ancestors[i][a]) continue;
+            anc_fee[i] += cluster[a]->GetModifiedFee();
+            anc_size[i] += cluster[a]->GetTxSize();
+        }
+    }
+
+    ClusterSet done;
+    std::vector<ClusterChunk> chunks;
+    for (size_t num_done{0}; num_done < cluster.size();) {
+        // Pick the transaction with the best remaining ancestor set feerate, as addPackageTxs does.
+        std::optional<size_t> best;
+        for (size_t i{0}; i < cluster.size(); ++i) {
+            if (done[i]) continue;
+            if (!best || double(anc_fee[i]) * anc_size[*best] > double(anc_fee[*best]) * anc_size[i]) best = i;
+        }
+
+        // Append its remaining ancestors, in an order valid for a block.
+        const ClusterSet picked{ancestors[*best] & ~done};
+        done |= picked;
+        ClusterChunk chunk;
+        for (size_t i{0}; i < cluster.size(); ++i) {
+            if (!picked[i]) continue;
+            ++num_done;
+            chunk.txs.push_back(cluster[i]);
+            chunk.fee += cluster[i]->GetModifiedFee();
+            chunk.vsize += cluster[i]->GetTxSize();
+            for (size_t d{i + 1}; d < cluster.size(); ++d) {
+                if (done[d] || !ancestors[d][i]) continue;
+                anc_fee[d] -= cluster[i]->GetModifiedFee();
+                anc_size[d] -= cluster[i]->GetTxSize();
+            }
+        }
+
+        // Merge with the preceding chunks while it has a higher feerate than they do.
+        while (!chunks.empty() && double(chunk.fee) * chunks.back().vsize > double(chunks.back().fee) * chunk.vsize) {
+            ClusterChunk& prev{chunks.back()};
+            prev.txs.insert(prev.txs.end(), chunk.txs.begin(), chunk.txs.end());
+            prev.fee += chunk.fee;
+            prev.vsize += chunk.vsize;
+            chunk = std::move(prev);
+            chunks.pop_back();
+        }
+        chunks.push_back(std::move(chunk));
+    }
+    return chunks;
+}
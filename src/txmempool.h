@@ -14,6 +14,7 @@
 #include <kernel/mempool_limits.h>         // IWYU pragma: export
 #include <kernel/mempool_options.h>        // IWYU pragma: export
 #include <kernel/mempool_removal_reason.h> // IWYU pragma: export
+#include <kernel/mempool_stats.h>          // IWYU pragma: export
 #include <policy/feerate.h>
 #include <policy/packages.h>
 #include <primitives/transaction.h>
@@ -36,6 +37,7 @@
 #include <set>
 #include <string>
 #include <string_view>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -390,6 +392,7 @@ public:
 
     using txiter = indexed_transaction_set::nth_index<0>::type::const_iterator;
     std::vector<CTransactionRef> txns_randomized GUARDED_BY(cs); //!< All transactions in mapTx, in random order
+    std::vector<uint256> wtxids_randomized GUARDED_BY(cs); //!< Witness hashes of txns_randomized, in the same order, for scans that only need the hashes
 
     typedef std::set<txiter, CompareIteratorByHash> setEntries;
 
@@ -399,6 +402,31 @@ public:
 private:
     typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
 
+    /**
+     * Changes to the cached ancestor and descendant state of mempool entries,
+     * summed up before they are applied, so that each entry is modified (and
+     * re-sorted in the indexes) once, however many of its relatives changed.
+     * The sums are kept in parallel arrays, in the order the entries were
+     * first staged.
+     */
+    struct StagedStateUpdates {
+        std::unordered_map<const CTxMemPoolEntry*, size_t> slots;
+        std::vector<txiter> entries;
+        std::vector<int64_t> ancestor_count;
+        std::vector<int32_t> ancestor_size;
+        std::vector<CAmount> ancestor_fee;
+        std::vector<int64_t> ancestor_sigops;
+        std::vector<int64_t> descendant_count;
+        std::vector<int32_t> descendant_size;
+        std::vector<CAmount> descendant_fee;
+
+        /** Index of entry in the arrays, adding it if it isn't staged yet */
+        size_t Slot(txiter entry);
+    };
+
+    /** Apply the summed state changes, modifying each staged entry once */
+    void ApplyStateUpdates(const StagedStateUpdates& staged) EXCLUSIVE_LOCKS_REQUIRED(cs);
+
 
     void UpdateParent(txiter entry, txiter parent, bool add) EXCLUSIVE_LOCKS_REQUIRED(cs);
     void UpdateChild(txiter entry, txiter child, bool add) EXCLUSIVE_LOCKS_REQUIRED(cs);
@@ -447,6 +475,9 @@ public:
 
     const Limits m_limits;
 
+    /** Latency of mempool operations, filled in by validation. Lock-free, so not guarded by cs. */
+    kernel::MempoolLatencyStats m_latency_stats;
+
     /** Create a new CTxMemPool.
      * Sanity checks will be off by default for performance, because otherwise
      * accepting transactions becomes O(N^2) where N is the number of transactions
@@ -594,6 +625,24 @@ public:
      * more transactions as a DoS protection. */
     std::vector<txiter> GatherClusters(const std::vector<uint256>& txids) const EXCLUSIVE_LOCKS_REQUIRED(cs);
 
+    /** A set of transactions of one cluster that is best mined, or evicted, together. */
+    struct ClusterChunk {
+        /** The transactions, in an order valid for a block */
+        std::vector<txiter> txs;
+        /** Sum of their modified fees */
+        CAmount fee{0};
+        /** Sum of their virtual sizes */
+        int64_t vsize{0};
+    };
+
+    /** Linearize the cluster of a transaction: order it the way block building selects
+     * transactions (by best remaining ancestor set feerate), and split that order into
+     * chunks of non-increasing feerate. Every chunk only depends on the chunks before it,
+     * so the last chunk is what mining would include last, and what can be evicted
+     * without evicting anything else. Returns an empty vector if the cluster is too large
+     * to linearize (see GatherClusters). */
+    std::vector<ClusterChunk> LinearizeCluster(txiter tx) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+
     /** Calculate all in-mempool ancestors of a set of transactions not already in the mempool and
      * check ancestor and descendant limits. Heuristics are used to estimate the ancestor and
      * descendant count of all entries if the package were to be added to the mempool.  The limits
@@ -625,6 +674,8 @@ public:
     }
 
     /** Remove transactions from the mempool until its dynamic size is <= sizelimit.
+      *  Each step evicts the last chunk (see LinearizeCluster) of the cluster of the
+      *  transaction with the lowest descendant score.
       *  pvNoSpendsRemaining, if set, will be populated with the list of outpoints
       *  which are not in mempool which no longer have any spends in this mempool.
       */
@@ -733,6 +784,11 @@ public:
         return m_sequence_number;
     }
 
+    /** Return the transactions added since GetSequence() returned the given value, newest first.
+     *  Transactions added with an entry time earlier than the newest one (re-added after a reorg,
+     *  or loaded from disk) may be missed. */
+    std::vector<CTransactionRef> GetTxsAddedSince(uint64_t sequence) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+
 private:
     /** UpdateForDescendants is used by UpdateTransactionsFromBlock to update
      *  the descendants for a single transaction that has been added to the
@@ -746,8 +802,6 @@ private:
      *      be removed for violation of ancestor limits.
      * @post if updateIt has any non-excluded descendants, cachedDescendants has
      *       a new cache line for updateIt.
-     * @post descendants_to_remove has a new entry for any descendant which exceeded
-     *       ancestor limits relative to updateIt.
      *
      * @param[in] updateIt the entry to update for its descendants
      * @param[in,out] cachedDescendants a cache where each line corresponds to all
@@ -758,12 +812,13 @@ private:
      *     that must not be accounted for (because any descendants in setExclude
      *     were added to the mempool after the transaction being updated and hence
      *     their state is already reflected in the parent state).
-     * @param[out] descendants_to_remove Populated with the txids of entries that
-     *     exceed ancestor limits. It's the responsibility of the caller to
-     *     removeRecursive them.
+     * @param[in,out] staged receives the changes to the ancestor state of the
+     *     descendants and to the descendant state of updateIt. It's the
+     *     responsibility of the caller to apply them and to check the
+     *     descendants against the ancestor limits afterwards.
      */
     void UpdateForDescendants(txiter updateIt, cacheMap& cachedDescendants,
-                              const std::set<uint256>& setExclude, std::set<uint256>& descendants_to_remove) EXCLUSIVE_LOCKS_REQUIRED(cs);
+                              const std::set<uint256>& setExclude, StagedStateUpdates& staged) EXCLUSIVE_LOCKS_REQUIRED(cs);
     /** Update ancestors of hash to add/remove it as a descendant transaction. */
     void UpdateAncestorsOf(bool add, txiter hash, setEntries &setAncestors) EXCLUSIVE_LOCKS_REQUIRED(cs);
     /** Set ancestor state for an entry */
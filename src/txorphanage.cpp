@@ -9,6 +9,7 @@
 #include <policy/policy.h>
 #include <primitives/transaction.h>
 
+#include <algorithm>
 #include <cassert>
 
 /** Expiration time for orphan transactions in seconds */
@@ -31,8 +32,7 @@ bool TxOrphanage::AddTx(const CTransactionRef& tx, NodeId peer)
     // large transaction with a missing parent then we assume
     // it will rebroadcast it later, after the parent transaction(s)
     // have been mined or received.
-    // 100 orphans, each of which is at most 100,000 bytes big is
-    // at most 10 megabytes of orphans and somewhat more byprev index (in the worst case):
+    // The total weight of all orphans is limited separately by LimitOrphans.
     unsigned int sz = GetTransactionWeight(*tx);
     if (sz > MAX_STANDARD_TX_WEIGHT)
     {
@@ -40,17 +40,20 @@ bool TxOrphanage::AddTx(const CTransactionRef& tx, NodeId peer)
         return false;
     }
 
-    auto ret = m_orphans.emplace(hash, OrphanTx{tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME, m_orphan_list.size()});
+    PeerOrphanInfo& peer_info = m_peer_orphanage_info[peer];
+    auto ret = m_orphans.emplace(hash, OrphanTx{tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME, peer_info.m_orphan_list.size(), sz});
     assert(ret.second);
-    m_orphan_list.push_back(ret.first);
+    peer_info.m_orphan_list.push_back(ret.first);
+    peer_info.m_total_weight += sz;
+    m_total_orphan_weight += sz;
     // Allow for lookups in the orphan pool by wtxid, as well as txid
     m_wtxid_to_orphan_it.emplace(tx->GetWitnessHash(), ret.first);
     for (const CTxIn& txin : tx->vin) {
         m_outpoint_to_orphan_it[txin.prevout].insert(ret.first);
     }
 
-    LogPrint(BCLog::TXPACKAGES, "stored orphan tx %s (wtxid=%s) (mapsz %u outsz %u)\n", hash.ToString(), wtxid.ToString(),
-             m_orphans.size(), m_outpoint_to_orphan_it.size());
+    LogPrint(BCLog::TXPACKAGES, "stored orphan tx %s (wtxid=%s) (mapsz %u outsz %u weight %d)\n", hash.ToString(), wtxid.ToString(),
+             m_orphans.size(), m_outpoint_to_orphan_it.size(), m_total_orphan_weight);
     return true;
 }
 
@@ -76,18 +79,24 @@ int TxOrphanage::EraseTxNoLock(const Txid& txid)
             m_outpoint_to_orphan_it.erase(itPrev);
     }
 
+    auto peer_it = m_peer_orphanage_info.find(it->second.fromPeer);
+    assert(peer_it != m_peer_orphanage_info.end());
+    auto& orphan_list = peer_it->second.m_orphan_list;
     size_t old_pos = it->second.list_pos;
-    assert(m_orphan_list[old_pos] == it);
-    if (old_pos + 1 != m_orphan_list.size()) {
-        // Unless we're deleting the last entry in m_orphan_list, move the last
+    assert(orphan_list[old_pos] == it);
+    if (old_pos + 1 != orphan_list.size()) {
+        // Unless we're deleting the last entry in the peer's orphan list, move the last
         // entry to the position we're deleting.
-        auto it_last = m_orphan_list.back();
-        m_orphan_list[old_pos] = it_last;
+        auto it_last = orphan_list.back();
+        orphan_list[old_pos] = it_last;
         it_last->second.list_pos = old_pos;
     }
     const auto& wtxid = it->second.tx->GetWitnessHash();
     LogPrint(BCLog::TXPACKAGES, "   removed orphan tx %s (wtxid=%s)\n", txid.ToString(), wtxid.ToString());
-    m_orphan_list.pop_back();
+    orphan_list.pop_back();
+    peer_it->second.m_total_weight -= it->second.weight;
+    m_total_orphan_weight -= it->second.weight;
+    if (orphan_list.empty()) m_peer_orphanage_info.erase(peer_it);
     m_wtxid_to_orphan_it.erase(it->second.tx->GetWitnessHash());
 
     m_orphans.erase(it);
@@ -100,20 +109,22 @@ void TxOrphanage::EraseForPeer(NodeId peer)
 
     m_peer_work_set.erase(peer);
 
+    auto peer_it = m_peer_orphanage_info.find(peer);
+    if (peer_it == m_peer_orphanage_info.end()) return;
+    // Erasing the peer's last orphan also erases its entry, so collect the txids first.
+    std::vector<Txid> txids;
+    txids.reserve(peer_it->second.m_orphan_list.size());
+    for (const auto& orphan_it : peer_it->second.m_orphan_list) {
+        txids.push_back(orphan_it->first);
+    }
     int nErased = 0;
-    std::map<Txid, OrphanTx>::iterator iter = m_orphans.begin();
-    while (iter != m_orphans.end())
-    {
-        std::map<Txid, OrphanTx>::iterator maybeErase = iter++; // increment to avoid iterator becoming invalid
-        if (maybeErase->second.fromPeer == peer)
-        {
-            nErased += EraseTxNoLock(maybeErase->second.tx->GetHash());
-        }
+    for (const Txid& txid : txids) {
+        nErased += EraseTxNoLock(txid);
     }
     if (nErased > 0) LogPrint(BCLog::TXPACKAGES, "Erased %d orphan tx from peer=%d\n", nErased, peer);
 }
 
-void TxOrphanage::LimitOrphans(unsigned int max_orphans, FastRandomContext& rng)
+void TxOrphanage::LimitOrphans(unsigned int max_orphans, FastRandomContext& rng, int64_t max_weight)
 {
     LOCK(m_mutex);
 
@@ -138,11 +149,18 @@ void TxOrphanage::LimitOrphans(unsigned int max_orphans, FastRandomContext& rng)
         nNextSweep = nMinExpTime + ORPHAN_TX_EXPIRE_INTERVAL;
         if (nErased > 0) LogPrint(BCLog::TXPACKAGES, "Erased %d orphan tx due to expiration\n", nErased);
     }
-    while (m_orphans.size() > max_orphans)
+    while (m_orphans.size() > max_orphans || m_total_orphan_weight > max_weight)
     {
-        // Evict a random orphan:
-        size_t randompos = rng.randrange(m_orphan_list.size());
-        EraseTxNoLock(m_orphan_list[randompos]->first);
+        // Evict a random orphan of the peer using the largest share of the orphanage,
+        // by weight and then by number of orphans:
+        const auto worst_peer = std::max_element(m_peer_orphanage_info.begin(), m_peer_orphanage_info.end(),
+            [](const auto& a, const auto& b) {
+                return std::make_pair(a.second.m_total_weight, a.second.m_orphan_list.size()) <
+                       std::make_pair(b.second.m_total_weight, b.second.m_orphan_list.size());
+            });
+        const auto& orphan_list = worst_peer->second.m_orphan_list;
+        size_t randompos = rng.randrange(orphan_list.size());
+        EraseTxNoLock(orphan_list[randompos]->first);
         ++nEvicted;
     }
     if (nEvicted > 0) LogPrint(BCLog::TXPACKAGES, "orphanage overflow, removed %u tx\n", nEvicted);
@@ -151,7 +169,12 @@ void TxOrphanage::LimitOrphans(unsigned int max_orphans, FastRandomContext& rng)
 void TxOrphanage::AddChildrenToWorkSet(const CTransaction& tx)
 {
     LOCK(m_mutex);
+    AddChildrenToWorkSetNoLock(tx);
+}
 
+void TxOrphanage::AddChildrenToWorkSetNoLock(const CTransaction& tx)
+{
+    AssertLockHeld(m_mutex);
 
     for (unsigned int i = 0; i < tx.vout.size(); i++) {
         const auto it_by_prev = m_outpoint_to_orphan_it.find(COutPoint(tx.GetHash(), i));
@@ -199,6 +222,14 @@ CTransactionRef TxOrphanage::GetTxToReconsider(NodeId peer)
     return nullptr;
 }
 
+size_t TxOrphanage::CountForPeer(NodeId peer) const
+{
+    LOCK(m_mutex);
+    auto peer_it = m_peer_orphanage_info.find(peer);
+    if (peer_it == m_peer_orphanage_info.end()) return 0;
+    return peer_it->second.m_orphan_list.size();
+}
+
 bool TxOrphanage::HaveTxToReconsider(NodeId peer)
 {
     LOCK(m_mutex);
@@ -240,4 +271,11 @@ void TxOrphanage::EraseForBlock(const CBlock& block)
         }
         LogPrint(BCLog::TXPACKAGES, "Erased %d orphan tx included or conflicted by block\n", nErased);
     }
+
+    // The remaining orphans spending outputs of this block may have become valid.
+    // Queue them for reconsideration all at once, rather than waiting for each of
+    // their parents to be relayed again.
+    for (const CTransactionRef& ptx : block.vtx) {
+        AddChildrenToWorkSetNoLock(*ptx);
+    }
 }
@@ -6,17 +6,26 @@
 #define BITCOIN_TXORPHANAGE_H
 
 #include <net.h>
+#include <policy/policy.h>
 #include <primitives/block.h>
 #include <primitives/transaction.h>
 #include <sync.h>
+#include <util/hasher.h>
 
 #include <map>
 #include <set>
+#include <unordered_map>
+
+/** Default maximum total weight of the transactions kept in the orphanage */
+static constexpr int64_t DEFAULT_MAX_ORPHAN_WEIGHT{10 * MAX_STANDARD_TX_WEIGHT};
 
 /** A class to track orphan transactions (failed on TX_MISSING_INPUTS)
  * Since we cannot distinguish orphans from bad transactions with
  * non-existent inputs, we heavily limit the number of orphans
- * we keep and the duration we keep them for.
+ * we keep, their total weight, and the duration we keep them for.
+ * When over the limits, orphans are evicted from the peer that
+ * announced the largest share of them, so that a peer flooding us
+ * with orphans mostly displaces its own.
  */
 class TxOrphanage {
 public:
@@ -39,11 +48,12 @@ public:
     /** Erase all orphans announced by a peer (eg, after that peer disconnects) */
     void EraseForPeer(NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
 
-    /** Erase all orphans included in or invalidated by a new block */
+    /** Erase all orphans included in or invalidated by a new block, and add the
+     *  orphans spending its transactions' outputs to their peers' work sets */
     void EraseForBlock(const CBlock& block) EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
 
-    /** Limit the orphanage to the given maximum */
-    void LimitOrphans(unsigned int max_orphans, FastRandomContext& rng) EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+    /** Limit the orphanage to the given maximum number of orphans and total weight */
+    void LimitOrphans(unsigned int max_orphans, FastRandomContext& rng, int64_t max_weight = DEFAULT_MAX_ORPHAN_WEIGHT) EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
 
     /** Add any orphans that list a particular tx as a parent into the from peer's work set */
     void AddChildrenToWorkSet(const CTransaction& tx) EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);;
@@ -58,6 +68,16 @@ public:
         return m_orphans.size();
     }
 
+    /** Return the total weight of the orphans */
+    int64_t TotalOrphanWeight() const EXCLUSIVE_LOCKS_REQUIRED(!m_mutex)
+    {
+        LOCK(m_mutex);
+        return m_total_orphan_weight;
+    }
+
+    /** Return how many orphans a peer has announced that are still in the orphanage */
+    size_t CountForPeer(NodeId peer) const EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+
 protected:
     /** Guards orphan transactions */
     mutable Mutex m_mutex;
@@ -66,7 +86,9 @@ protected:
         CTransactionRef tx;
         NodeId fromPeer;
         int64_t nTimeExpire;
+        /** Position in the announcing peer's m_orphan_list */
         size_t list_pos;
+        int64_t weight;
     };
 
     /** Map from txid to orphan transaction record. Limited by
@@ -88,18 +110,34 @@ protected:
     };
 
     /** Index from the parents' COutPoint into the m_orphans. Used
-     *  to remove orphan transactions from the m_orphans */
-    std::map<COutPoint, std::set<OrphanMap::iterator, IteratorComparator>> m_outpoint_to_orphan_it GUARDED_BY(m_mutex);
+     *  to remove orphan transactions from the m_orphans, and to find
+     *  the children of a transaction in constant time */
+    std::unordered_map<COutPoint, std::set<OrphanMap::iterator, IteratorComparator>, SaltedOutpointHasher> m_outpoint_to_orphan_it GUARDED_BY(m_mutex);
+
+    struct PeerOrphanInfo {
+        /** This peer's orphan transactions in vector for quick random eviction */
+        std::vector<OrphanMap::iterator> m_orphan_list;
+        /** Total weight of this peer's orphan transactions */
+        int64_t m_total_weight{0};
+    };
 
-    /** Orphan transactions in vector for quick random eviction */
-    std::vector<OrphanMap::iterator> m_orphan_list GUARDED_BY(m_mutex);
+    /** Per-peer accounting of the orphans they announced, used to evict from
+     *  the peer using the largest share of the orphanage. Peers without
+     *  orphans have no entry. */
+    std::map<NodeId, PeerOrphanInfo> m_peer_orphanage_info GUARDED_BY(m_mutex);
+
+    /** Total weight of all orphan transactions */
+    int64_t m_total_orphan_weight GUARDED_BY(m_mutex){0};
 
     /** Index from wtxid into the m_orphans to lookup orphan
      *  transactions using their witness ids. */
-    std::map<Wtxid, OrphanMap::iterator> m_wtxid_to_orphan_it GUARDED_BY(m_mutex);
+    std::unordered_map<Wtxid, OrphanMap::iterator, SaltedTxidHasher> m_wtxid_to_orphan_it GUARDED_BY(m_mutex);
 
     /** Erase an orphan by txid */
     int EraseTxNoLock(const Txid& txid) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+
+    /** Add any orphans that list a particular tx as a parent into their announcing peer's work set */
+    void AddChildrenToWorkSetNoLock(const CTransaction& tx) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
 };
 
 #endif // BITCOIN_TXORPHANAGE_H
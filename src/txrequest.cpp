@@ -8,6 +8,7 @@
 #include <net.h>
 #include <primitives/transaction.h>
 #include <random.h>
+#include <sync.h>
 #include <uint256.h>
 
 #include <boost/multi_index/indexed_by.hpp>
@@ -17,7 +18,9 @@
 #include <boost/multi_index_container.hpp>
 #include <boost/tuple/tuple.hpp>
 
+#include <atomic>
 #include <chrono>
+#include <memory>
 #include <unordered_map>
 #include <utility>
 
@@ -301,30 +304,89 @@ GenTxid ToGenTxid(const Announcement& ann)
     return ann.m_is_wtxid ? GenTxid::Wtxid(ann.m_txhash) : GenTxid::Txid(ann.m_txhash);
 }
 
-}  // namespace
+/** Per-peer statistics of the announcements in all shards, kept up to date by the shards.
+ *
+ * They are kept in one place, under a lock of their own, so that querying a peer's statistics doesn't have to
+ * visit (and lock) every shard. The lock is always taken last, inside a shard's lock if any.
+ */
+class PeerStats {
+    mutable Mutex m_mutex;
+    std::unordered_map<NodeId, PeerInfo> m_peerinfo GUARDED_BY(m_mutex);
 
-/** Actual implementation for TxRequestTracker's data structure. */
-class TxRequestTracker::Impl {
-    //! The current sequence number. Increases for every announcement. This is used to sort txhashes returned by
-    //! GetRequestable in announcement order.
-    SequenceNumber m_current_sequence{0};
+public:
+    //! Account for a new announcement by peer (which starts out CANDIDATE_DELAYED).
+    void Added(NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(!m_mutex)
+    {
+        LOCK(m_mutex);
+        ++m_peerinfo[peer].m_total;
+    }
+
+    //! Account for the removal of an announcement by peer in the given state.
+    void Erased(NodeId peer, State state) EXCLUSIVE_LOCKS_REQUIRED(!m_mutex)
+    {
+        LOCK(m_mutex);
+        auto peerit = m_peerinfo.find(peer);
+        peerit->second.m_completed -= state == State::COMPLETED;
+        peerit->second.m_requested -= state == State::REQUESTED;
+        if (--peerit->second.m_total == 0) m_peerinfo.erase(peerit);
+    }
+
+    //! Account for an announcement by peer changing state.
+    void Modified(NodeId peer, State old_state, State new_state) EXCLUSIVE_LOCKS_REQUIRED(!m_mutex)
+    {
+        const int completed{(new_state == State::COMPLETED) - (old_state == State::COMPLETED)};
+        const int requested{(new_state == State::REQUESTED) - (old_state == State::REQUESTED)};
+        // Transitions between the CANDIDATE states are the common case, and don't change the statistics.
+        if (completed == 0 && requested == 0) return;
+        LOCK(m_mutex);
+        PeerInfo& info{m_peerinfo.find(peer)->second};
+        info.m_completed += completed;
+        info.m_requested += requested;
+    }
+
+    PeerInfo Get(NodeId peer) const EXCLUSIVE_LOCKS_REQUIRED(!m_mutex)
+    {
+        LOCK(m_mutex);
+        auto it = m_peerinfo.find(peer);
+        if (it != m_peerinfo.end()) return it->second;
+        return {};
+    }
+
+    //! Only used for sanity checking.
+    std::unordered_map<NodeId, PeerInfo> GetAll() const EXCLUSIVE_LOCKS_REQUIRED(!m_mutex)
+    {
+        return WITH_LOCK(m_mutex, return m_peerinfo);
+    }
+};
 
+/** The data structure for the announcements of one shard of the txhash space.
+ *
+ * All announcements for a given txhash live in the same shard, so every per-txhash invariant holds within a shard.
+ * Sequence numbers are assigned by the caller, so that they are comparable across shards.
+ */
+class TxRequestShard {
     //! This tracker's priority computer.
     const PriorityComputer m_computer;
 
     //! This tracker's main data structure. See SanityCheck() for the invariants that apply to it.
     Index m_index;
 
-    //! Map with this tracker's per-peer statistics.
-    std::unordered_map<NodeId, PeerInfo> m_peerinfo;
+    //! The per-peer statistics of all shards, which this shard contributes to.
+    PeerStats& m_peerstats;
 
 public:
-    void SanityCheck() const
+    //! Add this shard's announcements to per-peer statistics. Only used for sanity checking.
+    void AddPeerInfo(std::unordered_map<NodeId, PeerInfo>& peerinfo) const
     {
-        // Recompute m_peerdata from m_index. This verifies the data in it as it should just be caching statistics
-        // on m_index. It also verifies the invariant that no PeerInfo announcements with m_total==0 exist.
-        assert(m_peerinfo == RecomputePeerInfo(m_index));
+        for (const auto& [peer, info] : RecomputePeerInfo(m_index)) {
+            peerinfo[peer].m_total += info.m_total;
+            peerinfo[peer].m_completed += info.m_completed;
+            peerinfo[peer].m_requested += info.m_requested;
+        }
+    }
 
+    void SanityCheck() const
+    {
         // Calculate per-txhash statistics from m_index, and validate invariants.
         for (auto& item : ComputeTxHashInfo(m_index, m_computer)) {
             TxHashInfo& info = item.second;
@@ -369,27 +431,21 @@ public:
     }
 
 private:
-    //! Wrapper around Index::...::erase that keeps m_peerinfo up to date.
+    //! Wrapper around Index::...::erase that keeps m_peerstats up to date.
     template<typename Tag>
     Iter<Tag> Erase(Iter<Tag> it)
     {
-        auto peerit = m_peerinfo.find(it->m_peer);
-        peerit->second.m_completed -= it->GetState() == State::COMPLETED;
-        peerit->second.m_requested -= it->GetState() == State::REQUESTED;
-        if (--peerit->second.m_total == 0) m_peerinfo.erase(peerit);
+        m_peerstats.Erased(it->m_peer, it->GetState());
         return m_index.get<Tag>().erase(it);
     }
 
-    //! Wrapper around Index::...::modify that keeps m_peerinfo up to date.
+    //! Wrapper around Index::...::modify that keeps m_peerstats up to date.
     template<typename Tag, typename Modifier>
     void Modify(Iter<Tag> it, Modifier modifier)
     {
-        auto peerit = m_peerinfo.find(it->m_peer);
-        peerit->second.m_completed -= it->GetState() == State::COMPLETED;
-        peerit->second.m_requested -= it->GetState() == State::REQUESTED;
+        const State old_state{it->GetState()};
         m_index.get<Tag>().modify(it, std::move(modifier));
-        peerit->second.m_completed += it->GetState() == State::COMPLETED;
-        peerit->second.m_requested += it->GetState() == State::REQUESTED;
+        m_peerstats.Modified(it->m_peer, old_state, it->GetState());
     }
 
     //! Convert a CANDIDATE_DELAYED announcement into a CANDIDATE_READY. If this makes it the new best
@@ -489,8 +545,6 @@ private:
     //! - CANDIDATE_{READY,BEST} announcements with reqtime > now are turned into CANDIDATE_DELAYED.
     void SetTimePoint(std::chrono::microseconds now, std::vector<std::pair<NodeId, GenTxid>>* expired)
     {
-        if (expired) expired->clear();
-
         // Iterate over all CANDIDATE_DELAYED and REQUESTED from old to new, as long as they're in the past,
         // and convert them to CANDIDATE_READY and COMPLETED respectively.
         while (!m_index.empty()) {
@@ -519,18 +573,19 @@ private:
     }
 
 public:
-    explicit Impl(bool deterministic) :
-        m_computer(deterministic),
+    TxRequestShard(const PriorityComputer& computer, PeerStats& peerstats) :
+        m_computer(computer),
         // Explicitly initialize m_index as we need to pass a reference to m_computer to ByTxHashViewExtractor.
         m_index(boost::make_tuple(
             boost::make_tuple(ByPeerViewExtractor(), std::less<ByPeerView>()),
             boost::make_tuple(ByTxHashViewExtractor(m_computer), std::less<ByTxHashView>()),
             boost::make_tuple(ByTimeViewExtractor(), std::less<ByTimeView>())
-        )) {}
+        )),
+        m_peerstats(peerstats) {}
 
     // Disable copying and assigning (a default copy won't work due the stateful ByTxHashViewExtractor).
-    Impl(const Impl&) = delete;
-    Impl& operator=(const Impl&) = delete;
+    TxRequestShard(const TxRequestShard&) = delete;
+    TxRequestShard& operator=(const TxRequestShard&) = delete;
 
     void DisconnectedPeer(NodeId peer)
     {
@@ -572,7 +627,7 @@ public:
     }
 
     void ReceivedInv(NodeId peer, const GenTxid& gtxid, bool preferred,
-        std::chrono::microseconds reqtime)
+        std::chrono::microseconds reqtime, SequenceNumber sequence)
     {
         // Bail out if we already have a CANDIDATE_BEST announcement for this (txhash, peer) combination. The case
         // where there is a non-CANDIDATE_BEST announcement already will be caught by the uniqueness property of the
@@ -582,42 +637,28 @@ public:
         // Try creating the announcement with CANDIDATE_DELAYED state (which will fail due to the uniqueness
         // of the ByPeer index if a non-CANDIDATE_BEST announcement already exists with the same txhash and peer).
         // Bail out in that case.
-        auto ret = m_index.get<ByPeer>().emplace(gtxid, peer, preferred, reqtime, m_current_sequence);
+        auto ret = m_index.get<ByPeer>().emplace(gtxid, peer, preferred, reqtime, sequence);
         if (!ret.second) return;
 
         // Update accounting metadata.
-        ++m_peerinfo[peer].m_total;
-        ++m_current_sequence;
+        m_peerstats.Added(peer);
     }
 
-    //! Find the GenTxids to request now from peer.
-    std::vector<GenTxid> GetRequestable(NodeId peer, std::chrono::microseconds now,
-        std::vector<std::pair<NodeId, GenTxid>>* expired)
+    //! Move time, appending expired announcements to expired (if non-nullptr), and append the CANDIDATE_BEST
+    //! announcements for peer to selected, together with their sequence numbers.
+    void GetRequestable(NodeId peer, std::chrono::microseconds now,
+        std::vector<std::pair<SequenceNumber, GenTxid>>& selected, std::vector<std::pair<NodeId, GenTxid>>* expired)
     {
         // Move time.
         SetTimePoint(now, expired);
 
         // Find all CANDIDATE_BEST announcements for this peer.
-        std::vector<const Announcement*> selected;
         auto it_peer = m_index.get<ByPeer>().lower_bound(ByPeerView{peer, true, uint256::ZERO});
         while (it_peer != m_index.get<ByPeer>().end() && it_peer->m_peer == peer &&
             it_peer->GetState() == State::CANDIDATE_BEST) {
-            selected.emplace_back(&*it_peer);
+            selected.emplace_back(it_peer->m_sequence, ToGenTxid(*it_peer));
             ++it_peer;
         }
-
-        // Sort by sequence number.
-        std::sort(selected.begin(), selected.end(), [](const Announcement* a, const Announcement* b) {
-            return a->m_sequence < b->m_sequence;
-        });
-
-        // Convert to GenTxid and return.
-        std::vector<GenTxid> ret;
-        ret.reserve(selected.size());
-        std::transform(selected.begin(), selected.end(), std::back_inserter(ret), [](const Announcement* ann) {
-            return ToGenTxid(*ann);
-        });
-        return ret;
     }
 
     void RequestedTx(NodeId peer, const uint256& txhash, std::chrono::microseconds expiry)
@@ -675,40 +716,172 @@ public:
         if (it != m_index.get<ByPeer>().end()) MakeCompleted(m_index.project<ByTxHash>(it));
     }
 
-    size_t CountInFlight(NodeId peer) const
+    //! Count how many announcements are being tracked in total across all peers and transactions.
+    size_t Size() const { return m_index.size(); }
+
+};
+
+}  // namespace
+
+/** Actual implementation for TxRequestTracker's data structure: the txhash space split over a number of shards.
+ *
+ * Every operation on a single txhash only locks the shard it belongs to, so announcements for different
+ * transactions can be processed concurrently. Per-peer operations visit all shards in turn, except for the
+ * per-peer statistics, which the shards keep up to date in one place.
+ */
+class TxRequestTracker::Impl {
+    struct Shard {
+        mutable Mutex m_mutex;
+        TxRequestShard m_tracker GUARDED_BY(m_mutex);
+
+        Shard(const PriorityComputer& computer, PeerStats& peerstats) : m_tracker(computer, peerstats) {}
+    };
+
+    //! The priority computer shared by all shards, so that priorities do not depend on the sharding.
+    const PriorityComputer m_computer;
+
+    //! The per-peer statistics of all shards.
+    PeerStats m_peerstats;
+
+    //! Salt for assigning txhashes to shards.
+    const uint64_t m_shard_k0, m_shard_k1;
+
+    std::vector<std::unique_ptr<Shard>> m_shards;
+
+    //! The next sequence number. Increases for every announcement. This is used to sort txhashes returned by
+    //! GetRequestable in announcement order, across all shards.
+    std::atomic<SequenceNumber> m_next_sequence{0};
+
+    Shard& GetShard(const uint256& txhash) const
     {
-        auto it = m_peerinfo.find(peer);
-        if (it != m_peerinfo.end()) return it->second.m_requested;
-        return 0;
+        return *m_shards[SipHashUint256(m_shard_k0, m_shard_k1, txhash) % m_shards.size()];
     }
 
-    size_t CountCandidates(NodeId peer) const
+public:
+    Impl(bool deterministic, size_t num_shards) :
+        m_computer(deterministic),
+        m_shard_k0{deterministic ? 0 : GetRand<uint64_t>()},
+        m_shard_k1{deterministic ? 0 : GetRand<uint64_t>()}
     {
-        auto it = m_peerinfo.find(peer);
-        if (it != m_peerinfo.end()) return it->second.m_total - it->second.m_requested - it->second.m_completed;
-        return 0;
+        m_shards.reserve(std::max<size_t>(num_shards, 1));
+        for (size_t i = 0; i < std::max<size_t>(num_shards, 1); ++i) {
+            m_shards.push_back(std::make_unique<Shard>(m_computer, m_peerstats));
+        }
     }
 
-    size_t Count(NodeId peer) const
+    void SanityCheck() const
     {
-        auto it = m_peerinfo.find(peer);
-        if (it != m_peerinfo.end()) return it->second.m_total;
-        return 0;
+        std::unordered_map<NodeId, PeerInfo> peerinfo;
+        for (const auto& shard : m_shards) {
+            LOCK(shard->m_mutex);
+            shard->m_tracker.SanityCheck();
+            shard->m_tracker.AddPeerInfo(peerinfo);
+        }
+        // Recompute m_peerstats from the shards' indexes. This verifies the data in it as it should just be
+        // caching statistics on them. It also verifies the invariant that no PeerInfo announcements with
+        // m_total==0 exist.
+        assert(m_peerstats.GetAll() == peerinfo);
     }
 
-    //! Count how many announcements are being tracked in total across all peers and transactions.
-    size_t Size() const { return m_index.size(); }
+    void PostGetRequestableSanityCheck(std::chrono::microseconds now) const
+    {
+        for (const auto& shard : m_shards) {
+            LOCK(shard->m_mutex);
+            shard->m_tracker.PostGetRequestableSanityCheck(now);
+        }
+    }
+
+    void DisconnectedPeer(NodeId peer)
+    {
+        for (const auto& shard : m_shards) {
+            LOCK(shard->m_mutex);
+            shard->m_tracker.DisconnectedPeer(peer);
+        }
+    }
+
+    void ForgetTxHash(const uint256& txhash)
+    {
+        Shard& shard{GetShard(txhash)};
+        LOCK(shard.m_mutex);
+        shard.m_tracker.ForgetTxHash(txhash);
+    }
+
+    void ReceivedInv(NodeId peer, const GenTxid& gtxid, bool preferred, std::chrono::microseconds reqtime)
+    {
+        Shard& shard{GetShard(gtxid.GetHash())};
+        LOCK(shard.m_mutex);
+        // Taking the sequence number under the shard lock keeps them increasing within every shard. Numbers
+        // consumed by announcements that turn out to be duplicates are simply skipped.
+        shard.m_tracker.ReceivedInv(peer, gtxid, preferred, reqtime, m_next_sequence++);
+    }
+
+    std::vector<GenTxid> GetRequestable(NodeId peer, std::chrono::microseconds now,
+        std::vector<std::pair<NodeId, GenTxid>>* expired)
+    {
+        if (expired) expired->clear();
+
+        std::vector<std::pair<SequenceNumber, GenTxid>> selected;
+        for (const auto& shard : m_shards) {
+            LOCK(shard->m_mutex);
+            shard->m_tracker.GetRequestable(peer, now, selected, expired);
+        }
+
+        // Sort by sequence number.
+        std::sort(selected.begin(), selected.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+        // Convert to GenTxid and return.
+        std::vector<GenTxid> ret;
+        ret.reserve(selected.size());
+        std::transform(selected.begin(), selected.end(), std::back_inserter(ret), [](const auto& entry) {
+            return entry.second;
+        });
+        return ret;
+    }
+
+    void RequestedTx(NodeId peer, const uint256& txhash, std::chrono::microseconds expiry)
+    {
+        Shard& shard{GetShard(txhash)};
+        LOCK(shard.m_mutex);
+        shard.m_tracker.RequestedTx(peer, txhash, expiry);
+    }
+
+    void ReceivedResponse(NodeId peer, const uint256& txhash)
+    {
+        Shard& shard{GetShard(txhash)};
+        LOCK(shard.m_mutex);
+        shard.m_tracker.ReceivedResponse(peer, txhash);
+    }
+
+    //! Sum a per-shard statistic over all shards.
+    template<typename Fn>
+    size_t Sum(Fn fn) const
+    {
+        size_t ret{0};
+        for (const auto& shard : m_shards) {
+            LOCK(shard->m_mutex);
+            ret += fn(shard->m_tracker);
+        }
+        return ret;
+    }
+
+    size_t CountInFlight(NodeId peer) const { return m_peerstats.Get(peer).m_requested; }
+    size_t CountCandidates(NodeId peer) const
+    {
+        const PeerInfo info{m_peerstats.Get(peer)};
+        return info.m_total - info.m_requested - info.m_completed;
+    }
+    size_t Count(NodeId peer) const { return m_peerstats.Get(peer).m_total; }
+    size_t Size() const { return Sum([](const TxRequestShard& t) { return t.Size(); }); }
 
     uint64_t ComputePriority(const uint256& txhash, NodeId peer, bool preferred) const
     {
         // Return Priority as a uint64_t as Priority is internal.
         return uint64_t{m_computer(txhash, peer, preferred)};
     }
-
 };
 
-TxRequestTracker::TxRequestTracker(bool deterministic) :
-    m_impl{std::make_unique<TxRequestTracker::Impl>(deterministic)} {}
+TxRequestTracker::TxRequestTracker(bool deterministic, size_t num_shards) :
+    m_impl{std::make_unique<TxRequestTracker::Impl>(deterministic, num_shards)} {}
 
 TxRequestTracker::~TxRequestTracker() = default;
 
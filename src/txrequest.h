@@ -14,6 +14,9 @@
 
 #include <stdint.h>
 
+/** Default number of shards the txhash space of a TxRequestTracker is split over. */
+static constexpr size_t DEFAULT_TXREQUEST_SHARDS{16};
+
 /** Data structure to keep track of, and schedule, transaction downloads from peers.
  *
  * === Specification ===
@@ -91,7 +94,14 @@
  * - Memory usage is proportional to the total number of tracked announcements (Size()) plus the number of
  *   peers with a nonzero number of tracked announcements.
  * - CPU usage is generally logarithmic in the total number of tracked announcements, plus the number of
- *   announcements affected by an operation (amortized O(1) per announcement).
+ *   announcements affected by an operation (amortized O(1) per announcement). Operations on a peer (rather than
+ *   a txhash) additionally visit every shard.
+ *
+ * Thread safety:
+ * - All methods may be called concurrently. Announcements are partitioned over shards by (salted) txhash, each
+ *   with its own lock, so ReceivedInv, RequestedTx, ReceivedResponse and ForgetTxHash calls for different
+ *   transactions rarely contend. The per-peer counts are summed over the shards without a global lock, so they
+ *   are only exact when no other thread is modifying the tracker.
  */
 class TxRequestTracker {
     // Avoid littering this header file with implementation details.
@@ -100,7 +110,7 @@ class TxRequestTracker {
 
 public:
     //! Construct a TxRequestTracker.
-    explicit TxRequestTracker(bool deterministic = false);
+    explicit TxRequestTracker(bool deterministic = false, size_t num_shards = DEFAULT_TXREQUEST_SHARDS);
     ~TxRequestTracker();
 
     // Conceptually, the data structure consists of a collection of "announcements", one for each peer/txhash
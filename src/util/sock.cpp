@@ -11,6 +11,7 @@
 #include <util/threadinterrupt.h>
 #include <util/time.h>
 
+#include <array>
 #include <memory>
 #include <stdexcept>
 #include <string>
@@ -19,6 +20,13 @@
 #include <poll.h>
 #endif
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
+/** Maximum number of buffers sent by one Sock::SendMany() call. */
+static constexpr size_t MAX_SEND_MANY_BUFFERS{16};
+
 static inline bool IOErrorIsPermanent(int err)
 {
     return err != WSAEAGAIN && err != WSAEINTR && err != WSAEWOULDBLOCK && err != WSAEINPROGRESS;
@@ -47,6 +55,38 @@ ssize_t Sock::Send(const void* data, size_t len, int flags) const
     return send(m_socket, static_cast<const char*>(data), len, flags);
 }
 
+ssize_t Sock::SendMany(Span<const Span<const unsigned char>> buffers, int flags) const
+{
+#ifdef WIN32
+    std::array<WSABUF, MAX_SEND_MANY_BUFFERS> bufs;
+    DWORD count{0};
+    for (const auto& buffer : buffers) {
+        if (count == bufs.size()) break;
+        bufs[count].buf = reinterpret_cast<CHAR*>(const_cast<unsigned char*>(buffer.data()));
+        bufs[count].len = static_cast<ULONG>(buffer.size());
+        ++count;
+    }
+    DWORD sent{0};
+    if (WSASend(m_socket, bufs.data(), count, &sent, flags, nullptr, nullptr) == SOCKET_ERROR) {
+        return SOCKET_ERROR;
+    }
+    return sent;
+#else
+    std::array<iovec, MAX_SEND_MANY_BUFFERS> iov;
+    size_t count{0};
+    for (const auto& buffer : buffers) {
+        if (count == iov.size()) break;
+        iov[count].iov_base = const_cast<unsigned char*>(buffer.data());
+        iov[count].iov_len = buffer.size();
+        ++count;
+    }
+    msghdr msg{};
+    msg.msg_iov = iov.data();
+    msg.msg_iovlen = count;
+    return sendmsg(m_socket, &msg, flags);
+#endif
+}
+
 ssize_t Sock::Recv(void* buf, size_t len, int flags) const
 {
     return recv(m_socket, static_cast<char*>(buf), len, flags);
@@ -419,6 +459,104 @@ bool Sock::operator==(SOCKET s) const
     return m_socket == s;
 };
 
+#ifdef USE_EPOLL
+/** Maximum number of events to retrieve in one SockEpoll::Wait() call. */
+static constexpr int MAX_EPOLL_EVENTS{256};
+
+static epoll_event MakeEpollEvent(uint64_t id, Sock::Event requested, bool edge_triggered)
+{
+    epoll_event ev{};
+    ev.data.u64 = id;
+    if (requested & Sock::RECV) {
+        ev.events |= EPOLLIN | EPOLLRDHUP;
+    }
+    if (requested & Sock::SEND) {
+        ev.events |= EPOLLOUT;
+    }
+    if (edge_triggered) {
+        ev.events |= EPOLLET;
+    }
+    return ev;
+}
+#endif /* USE_EPOLL */
+
+SockEpoll::SockEpoll()
+{
+#ifdef USE_EPOLL
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll_fd < 0) {
+        LogPrintf("Unable to create epoll instance: %s\n", NetworkErrorString(WSAGetLastError()));
+    }
+#endif
+}
+
+SockEpoll::~SockEpoll()
+{
+#ifdef USE_EPOLL
+    if (m_epoll_fd >= 0) {
+        close(m_epoll_fd);
+    }
+#endif
+}
+
+bool SockEpoll::Add(const Sock& sock, uint64_t id, Sock::Event requested, bool edge_triggered)
+{
+#ifdef USE_EPOLL
+    epoll_event ev{MakeEpollEvent(id, requested, edge_triggered)};
+    return epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, sock.m_socket, &ev) == 0;
+#else
+    return false;
+#endif
+}
+
+bool SockEpoll::Modify(const Sock& sock, uint64_t id, Sock::Event requested, bool edge_triggered)
+{
+#ifdef USE_EPOLL
+    epoll_event ev{MakeEpollEvent(id, requested, edge_triggered)};
+    return epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, sock.m_socket, &ev) == 0;
+#else
+    return false;
+#endif
+}
+
+bool SockEpoll::Remove(const Sock& sock)
+{
+#ifdef USE_EPOLL
+    return epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, sock.m_socket, nullptr) == 0;
+#else
+    return false;
+#endif
+}
+
+bool SockEpoll::Wait(std::chrono::milliseconds timeout, std::vector<Occurred>& occurred)
+{
+    occurred.clear();
+#ifdef USE_EPOLL
+    std::array<epoll_event, MAX_EPOLL_EVENTS> events;
+    const int n{epoll_wait(m_epoll_fd, events.data(), events.size(), count_milliseconds(timeout))};
+    if (n < 0) {
+        return WSAGetLastError() == WSAEINTR;
+    }
+    occurred.reserve(n);
+    for (int i = 0; i < n; ++i) {
+        Sock::Event ev{0};
+        if (events[i].events & EPOLLIN) {
+            ev |= Sock::RECV;
+        }
+        if (events[i].events & EPOLLOUT) {
+            ev |= Sock::SEND;
+        }
+        if (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+            ev |= Sock::ERR;
+        }
+        occurred.push_back({events[i].data.u64, ev});
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
 std::string NetworkErrorString(int err)
 {
 #if defined(WIN32)
@@ -6,6 +6,7 @@
 #define BITCOIN_UTIL_SOCK_H
 
 #include <compat/compat.h>
+#include <span.h>
 #include <util/threadinterrupt.h>
 #include <util/time.h>
 
@@ -13,6 +14,7 @@
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 /**
  * Maximum time to wait for I/O readiness.
@@ -64,6 +66,14 @@ public:
      */
     [[nodiscard]] virtual ssize_t Send(const void* data, size_t len, int flags) const;
 
+    /**
+     * sendmsg(2) (WSASend() on Windows) wrapper, sending the given buffers in order with a
+     * single gathering write. Equivalent to `Send()` of their concatenation, without copying
+     * them together. Code that uses this wrapper can be unit tested if this method is
+     * overridden by a mock Sock implementation.
+     */
+    [[nodiscard]] virtual ssize_t SendMany(Span<const Span<const unsigned char>> buffers, int flags) const;
+
     /**
      * recv(2) wrapper. Equivalent to `recv(m_socket, buf, len, flags);`. Code that uses this
      * wrapper can be unit tested if this method is overridden by a mock Sock implementation.
@@ -269,6 +279,8 @@ public:
     bool operator==(SOCKET s) const;
 
 protected:
+    friend class SockEpoll;
+
     /**
      * Contained socket. `INVALID_SOCKET` designates the object is empty.
      */
@@ -281,6 +293,69 @@ private:
     void Close();
 };
 
+/**
+ * A persistent set of sockets to wait on, backed by epoll(7) where available.
+ * Unlike `Sock::WaitMany()`, which hands the whole set of sockets to the kernel on every
+ * call, sockets stay registered until they are removed or closed, so the cost of a wait
+ * grows with the number of ready sockets rather than with the number of registered ones.
+ *
+ * Sockets can be registered edge-triggered, in which case an event is reported only once
+ * per readiness change: the caller has to remember the readiness until it has read or
+ * written the socket until the operation would block.
+ */
+class SockEpoll
+{
+public:
+    /**
+     * Create the epoll instance. Check `IsValid()` to see whether this succeeded; it never
+     * does on platforms without epoll(7).
+     */
+    SockEpoll();
+    ~SockEpoll();
+
+    SockEpoll(const SockEpoll&) = delete;
+    SockEpoll& operator=(const SockEpoll&) = delete;
+
+    bool IsValid() const { return m_epoll_fd >= 0; }
+
+    /**
+     * Start waiting for events on a socket.
+     * @param[in] sock Socket to register. It is removed automatically once it is closed.
+     * @param[in] id Identifier to report the socket's events with.
+     * @param[in] requested Events to wait for (`Sock::RECV` and/or `Sock::SEND`). `Sock::ERR` is
+     * always reported.
+     * @param[in] edge_triggered Whether to report events only when readiness changes.
+     * @return true on success
+     */
+    [[nodiscard]] bool Add(const Sock& sock, uint64_t id, Sock::Event requested, bool edge_triggered);
+
+    /**
+     * Change the events waited for on a registered socket. With edge triggering, events that
+     * are ready at the time of the change are reported again.
+     */
+    [[nodiscard]] bool Modify(const Sock& sock, uint64_t id, Sock::Event requested, bool edge_triggered);
+
+    /** Stop waiting for events on a registered socket. */
+    bool Remove(const Sock& sock);
+
+    /** Events that occurred on the socket registered with `id`. */
+    struct Occurred {
+        uint64_t id;
+        Sock::Event occurred;
+    };
+
+    /**
+     * Wait for events on the registered sockets.
+     * @param[in] timeout Wait this long for at least one event to occur.
+     * @param[out] occurred The events that occurred, empty on timeout.
+     * @return true on success (or timeout), false otherwise
+     */
+    [[nodiscard]] bool Wait(std::chrono::milliseconds timeout, std::vector<Occurred>& occurred);
+
+private:
+    int m_epoll_fd{-1};
+};
+
 /** Return readable error string for a network error code */
 std::string NetworkErrorString(int err);
 
@@ -73,6 +73,7 @@
 #include <optional>
 #include <string>
 #include <tuple>
+#include <unordered_set>
 #include <utility>
 
 using kernel::CCoinsStats;
@@ -138,6 +139,11 @@ bool CheckInputScripts(const CTransaction& tx, TxValidationState& state,
                        bool cacheFullScriptStore, PrecomputedTransactionData& txdata,
                        std::vector<CScriptCheck>* pvChecks = nullptr)
                        EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+static bool CheckInputScriptsParallel(const CTransaction& tx, TxValidationState& state,
+                                      const CCoinsViewCache& inputs, unsigned int flags, bool cacheSigStore,
+                                      bool cacheFullScriptStore, PrecomputedTransactionData& txdata,
+                                      CCheckQueue<CScriptCheck>& queue)
+                                      EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
 bool CheckFinalTxAtTip(const CBlockIndex& active_chain_tip, const CTransaction& tx)
 {
@@ -274,7 +280,10 @@ static void LimitMempoolSize(CTxMemPool& pool, CCoinsViewCache& coins_cache)
     }
 
     std::vector<COutPoint> vNoSpendsRemaining;
-    pool.TrimToSize(pool.m_max_size_bytes, &vNoSpendsRemaining);
+    {
+        const kernel::ScopedLatencyTimer timer{pool.m_latency_stats[kernel::MempoolPhase::TRIM_TO_SIZE]};
+        pool.TrimToSize(pool.m_max_size_bytes, &vNoSpendsRemaining);
+    }
     for (const COutPoint& removed : vNoSpendsRemaining)
         coins_cache.Uncache(removed);
 }
@@ -396,7 +405,8 @@ void Chainstate::MaybeUpdateMempoolForReorg(
 * */
 static bool CheckInputsFromMempoolAndCache(const CTransaction& tx, TxValidationState& state,
                 const CCoinsViewCache& view, const CTxMemPool& pool,
-                unsigned int flags, PrecomputedTransactionData& txdata, CCoinsViewCache& coins_tip)
+                unsigned int flags, PrecomputedTransactionData& txdata, CCoinsViewCache& coins_tip,
+                CCheckQueue<CScriptCheck>& script_check_queue)
                 EXCLUSIVE_LOCKS_REQUIRED(cs_main, pool.cs)
 {
     AssertLockHeld(cs_main);
@@ -428,7 +438,7 @@ static bool CheckInputsFromMempoolAndCache(const CTransaction& tx, TxValidationS
     }
 
     // Call CheckInputScripts() to cache signature and script validity against current tip consensus rules.
-    return CheckInputScripts(tx, state, view, flags, /* cacheSigStore= */ true, /* cacheFullScriptStore= */ true, txdata);
+    return CheckInputScriptsParallel(tx, state, view, flags, /* cacheSigStore= */ true, /* cacheFullScriptStore= */ true, txdata, script_check_queue);
 }
 
 namespace {
@@ -472,6 +482,11 @@ public:
          * policies such as mempool min fee and min relay fee.
          */
         const bool m_package_feerates;
+        /** When true, the transaction is one of a batch of transactions that are otherwise
+         * validated independently (see AcceptTransactionBatch()). As with package submission,
+         * the mempool is only trimmed once, after the whole batch.
+         */
+        const bool m_batch_submission;
 
         /** Parameters for single transaction mempool validation. */
         static ATMPArgs SingleAccept(const CChainParams& chainparams, int64_t accept_time,
@@ -485,6 +500,7 @@ public:
                             /* m_allow_replacement */ true,
                             /* m_package_submission */ false,
                             /* m_package_feerates */ false,
+                            /* m_batch_submission */ false,
             };
         }
 
@@ -499,6 +515,7 @@ public:
                             /* m_allow_replacement */ false,
                             /* m_package_submission */ false, // not submitting to mempool
                             /* m_package_feerates */ false,
+                            /* m_batch_submission */ false,
             };
         }
 
@@ -513,6 +530,7 @@ public:
                             /* m_allow_replacement */ false,
                             /* m_package_submission */ true,
                             /* m_package_feerates */ true,
+                            /* m_batch_submission */ false,
             };
         }
 
@@ -526,6 +544,22 @@ public:
                             /* m_allow_replacement */ true,
                             /* m_package_submission */ true, // do not LimitMempoolSize in Finalize()
                             /* m_package_feerates */ false, // only 1 transaction
+                            /* m_batch_submission */ false,
+            };
+        }
+
+        /** Parameters for a transaction in a batch of independently validated transactions. */
+        static ATMPArgs BatchAccept(const CChainParams& chainparams, int64_t accept_time,
+                                    std::vector<COutPoint>& coins_to_uncache) {
+            return ATMPArgs{/* m_chainparams */ chainparams,
+                            /* m_accept_time */ accept_time,
+                            /* m_bypass_limits */ false,
+                            /* m_coins_to_uncache */ coins_to_uncache,
+                            /* m_test_accept */ false,
+                            /* m_allow_replacement */ true,
+                            /* m_package_submission */ false,
+                            /* m_package_feerates */ false,
+                            /* m_batch_submission */ true, // do not LimitMempoolSize in Finalize()
             };
         }
 
@@ -539,7 +573,8 @@ public:
                  bool test_accept,
                  bool allow_replacement,
                  bool package_submission,
-                 bool package_feerates)
+                 bool package_feerates,
+                 bool batch_submission)
             : m_chainparams{chainparams},
               m_accept_time{accept_time},
               m_bypass_limits{bypass_limits},
@@ -547,7 +582,8 @@ public:
               m_test_accept{test_accept},
               m_allow_replacement{allow_replacement},
               m_package_submission{package_submission},
-              m_package_feerates{package_feerates}
+              m_package_feerates{package_feerates},
+              m_batch_submission{batch_submission}
         {
         }
     };
@@ -584,6 +620,15 @@ public:
      */
     PackageMempoolAcceptResult AcceptPackage(const Package& package, ATMPArgs& args) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+    /**
+     * Batch acceptance. Each transaction is validated as if submitted on its own, in order, so
+     * later transactions may spend or replace earlier ones. The mempool is trimmed once at the
+     * end; results of transactions that are evicted then are changed to failures.
+     */
+    std::vector<MempoolAcceptResult> AcceptTransactionBatch(const std::vector<CTransactionRef>& txns, int64_t accept_time,
+                                                            std::vector<std::vector<COutPoint>>& coins_to_uncache)
+        EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 private:
     // All the intermediate state that gets passed between the various levels
     // of checking a given transaction.
@@ -702,6 +747,7 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
 {
     AssertLockHeld(cs_main);
     AssertLockHeld(m_pool.cs);
+    const kernel::ScopedLatencyTimer timer{m_pool.m_latency_stats[kernel::MempoolPhase::PRE_CHECKS]};
     const CTransactionRef& ptx = ws.m_ptx;
     const CTransaction& tx = *ws.m_ptx;
     const Txid& hash = ws.m_hash;
@@ -1051,6 +1097,7 @@ bool MemPoolAccept::PolicyScriptChecks(const ATMPArgs& args, Workspace& ws)
 {
     AssertLockHeld(cs_main);
     AssertLockHeld(m_pool.cs);
+    const kernel::ScopedLatencyTimer timer{m_pool.m_latency_stats[kernel::MempoolPhase::POLICY_SCRIPTS]};
     const CTransaction& tx = *ws.m_ptx;
     TxValidationState& state = ws.m_state;
 
@@ -1058,7 +1105,7 @@ bool MemPoolAccept::PolicyScriptChecks(const ATMPArgs& args, Workspace& ws)
 
     // Check input scripts and signatures.
     // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-    if (!CheckInputScripts(tx, state, m_view, scriptVerifyFlags, true, false, ws.m_precomputed_txdata)) {
+    if (!CheckInputScriptsParallel(tx, state, m_view, scriptVerifyFlags, true, false, ws.m_precomputed_txdata, m_active_chainstate.m_chainman.GetCheckQueue())) {
         // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
         // need to turn both off, and compare against just turning off CLEANSTACK
         // to see if the failure is specifically due to witness validation.
@@ -1079,6 +1126,7 @@ bool MemPoolAccept::ConsensusScriptChecks(const ATMPArgs& args, Workspace& ws)
 {
     AssertLockHeld(cs_main);
     AssertLockHeld(m_pool.cs);
+    const kernel::ScopedLatencyTimer timer{m_pool.m_latency_stats[kernel::MempoolPhase::CONSENSUS_SCRIPTS]};
     const CTransaction& tx = *ws.m_ptx;
     const uint256& hash = ws.m_hash;
     TxValidationState& state = ws.m_state;
@@ -1100,7 +1148,8 @@ bool MemPoolAccept::ConsensusScriptChecks(const ATMPArgs& args, Workspace& ws)
     // transactions into the mempool can be exploited as a DoS attack.
     unsigned int currentBlockScriptVerifyFlags{GetBlockScriptFlags(*m_active_chainstate.m_chain.Tip(), m_active_chainstate.m_chainman)};
     if (!CheckInputsFromMempoolAndCache(tx, state, m_view, m_pool, currentBlockScriptVerifyFlags,
-                                        ws.m_precomputed_txdata, m_active_chainstate.CoinsTip())) {
+                                        ws.m_precomputed_txdata, m_active_chainstate.CoinsTip(),
+                                        m_active_chainstate.m_chainman.GetCheckQueue())) {
         LogPrintf("BUG! PLEASE REPORT THIS! CheckInputScripts failed against latest-block but not STANDARD flags %s, %s\n", hash.ToString(), state.ToString());
         return Assume(false);
     }
@@ -1112,6 +1161,7 @@ bool MemPoolAccept::Finalize(const ATMPArgs& args, Workspace& ws)
 {
     AssertLockHeld(cs_main);
     AssertLockHeld(m_pool.cs);
+    const kernel::ScopedLatencyTimer timer{m_pool.m_latency_stats[kernel::MempoolPhase::FINALIZE]};
     const CTransaction& tx = *ws.m_ptx;
     const uint256& hash = ws.m_hash;
     TxValidationState& state = ws.m_state;
@@ -1148,7 +1198,7 @@ bool MemPoolAccept::Finalize(const ATMPArgs& args, Workspace& ws)
     // If we are validating a package, don't trim here because we could evict a previous transaction
     // in the package. LimitMempoolSize() should be called at the very end to make sure the mempool
     // is still within limits and package submission happens atomically.
-    if (!args.m_package_submission && !bypass_limits) {
+    if (!args.m_package_submission && !args.m_batch_submission && !bypass_limits) {
         LimitMempoolSize(m_pool, m_active_chainstate.CoinsTip());
         if (!m_pool.exists(GenTxid::Txid(hash)))
             // The tx no longer meets our (new) mempool minimum feerate but could be reconsidered in a package.
@@ -1623,8 +1673,80 @@ PackageMempoolAcceptResult MemPoolAccept::AcceptPackage(const Package& package,
     return PackageMempoolAcceptResult(package_state_final, std::move(results_final));
 }
 
+std::vector<MempoolAcceptResult> MemPoolAccept::AcceptTransactionBatch(const std::vector<CTransactionRef>& txns, int64_t accept_time,
+                                                                      std::vector<std::vector<COutPoint>>& coins_to_uncache)
+{
+    AssertLockHeld(cs_main);
+    LOCK(m_pool.cs);
+
+    std::vector<MempoolAcceptResult> results;
+    results.reserve(txns.size());
+    coins_to_uncache.resize(txns.size());
+    for (size_t i = 0; i < txns.size(); ++i) {
+        auto args = ATMPArgs::BatchAccept(m_active_chainstate.m_chainman.GetParams(), accept_time, coins_to_uncache[i]);
+        {
+            const kernel::ScopedLatencyTimer timer{m_pool.m_latency_stats[kernel::MempoolPhase::ACCEPT_TRANSACTION]};
+            results.push_back(AcceptSingleTransaction(txns[i], args));
+        }
+        // Let the next transaction see the mempool as it is now, rather than the coins
+        // fetched for this one.
+        CleanupTemporaryCoins();
+    }
+
+    // Make sure we haven't exceeded max mempool size. Transactions of the batch may be evicted.
+    LimitMempoolSize(m_pool, m_active_chainstate.CoinsTip());
+    // Transactions replaced by a later one of the batch were accepted, and keep their result.
+    std::set<Wtxid> replaced;
+    for (const MempoolAcceptResult& result : results) {
+        if (result.m_result_type != MempoolAcceptResult::ResultType::VALID) continue;
+        for (const CTransactionRef& tx : result.m_replaced_transactions.value()) replaced.insert(tx->GetWitnessHash());
+    }
+    std::vector<MempoolAcceptResult> results_final;
+    results_final.reserve(txns.size());
+    for (size_t i = 0; i < txns.size(); ++i) {
+        const MempoolAcceptResult& result{results[i]};
+        const Wtxid& wtxid{txns[i]->GetWitnessHash()};
+        if (result.m_result_type == MempoolAcceptResult::ResultType::VALID && !m_pool.exists(GenTxid::Wtxid(wtxid)) && !replaced.count(wtxid)) {
+            // Same as a single transaction trimmed in Finalize(): it could be reconsidered in a package.
+            TxValidationState mempool_full_state;
+            mempool_full_state.Invalid(TxValidationResult::TX_RECONSIDERABLE, "mempool full");
+            results_final.push_back(MempoolAcceptResult::FeeFailure(mempool_full_state, result.m_effective_feerate.value(),
+                                                                    result.m_wtxids_fee_calculations.value()));
+        } else {
+            results_final.push_back(result);
+        }
+    }
+    return results_final;
+}
+
 } // anon namespace
 
+std::vector<MempoolAcceptResult> AcceptTransactionsToMemoryPool(Chainstate& active_chainstate, const std::vector<CTransactionRef>& txns,
+                                                                int64_t accept_time)
+{
+    AssertLockHeld(::cs_main);
+    assert(active_chainstate.GetMempool() != nullptr);
+    CTxMemPool& pool{*active_chainstate.GetMempool()};
+
+    std::vector<std::vector<COutPoint>> coins_to_uncache;
+    std::vector<MempoolAcceptResult> results{MemPoolAccept(pool, active_chainstate).AcceptTransactionBatch(txns, accept_time, coins_to_uncache)};
+    for (size_t i = 0; i < txns.size(); ++i) {
+        if (results[i].m_result_type == MempoolAcceptResult::ResultType::VALID) continue;
+        // See AcceptToMemoryPool()
+        for (const COutPoint& hashTx : coins_to_uncache[i]) {
+            active_chainstate.CoinsTip().Uncache(hashTx);
+        }
+        TRACE2(mempool, rejected,
+                txns[i]->GetHash().data(),
+                results[i].m_state.GetRejectReason().c_str()
+        );
+    }
+    // Ensure the coins cache is still within limits, once for the whole batch.
+    BlockValidationState state_dummy;
+    active_chainstate.FlushStateToDisk(state_dummy, FlushStateMode::PERIODIC);
+    return results;
+}
+
 MempoolAcceptResult AcceptToMemoryPool(Chainstate& active_chainstate, const CTransactionRef& tx,
                                        int64_t accept_time, bool bypass_limits, bool test_accept)
     EXCLUSIVE_LOCKS_REQUIRED(::cs_main)
@@ -1633,6 +1755,7 @@ MempoolAcceptResult AcceptToMemoryPool(Chainstate& active_chainstate, const CTra
     const CChainParams& chainparams{active_chainstate.m_chainman.GetParams()};
     assert(active_chainstate.GetMempool() != nullptr);
     CTxMemPool& pool{*active_chainstate.GetMempool()};
+    const kernel::ScopedLatencyTimer timer{pool.m_latency_stats[kernel::MempoolPhase::ACCEPT_TRANSACTION]};
 
     std::vector<COutPoint> coins_to_uncache;
     auto args = MemPoolAccept::ATMPArgs::SingleAccept(chainparams, accept_time, bypass_limits, coins_to_uncache, test_accept);
@@ -1662,6 +1785,7 @@ PackageMempoolAcceptResult ProcessNewPackage(Chainstate& active_chainstate, CTxM
     AssertLockHeld(cs_main);
     assert(!package.empty());
     assert(std::all_of(package.cbegin(), package.cend(), [](const auto& tx){return tx != nullptr;}));
+    const kernel::ScopedLatencyTimer timer{pool.m_latency_stats[kernel::MempoolPhase::ACCEPT_PACKAGE]};
 
     std::vector<COutPoint> coins_to_uncache;
     const CChainParams& chainparams = active_chainstate.m_chainman.GetParams();
@@ -1886,7 +2010,7 @@ bool CScriptCheck::operator()() {
     return VerifyScript(scriptSig, m_tx_out.scriptPubKey, witness, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, m_tx_out.nValue, cacheStore, *txdata), &error);
 }
 
-static CuckooCache::cache<uint256, SignatureCacheHasher> g_scriptExecutionCache;
+static ShardedCuckooCache g_scriptExecutionCache;
 static CSHA256 g_scriptExecutionCacheHasher;
 
 bool InitScriptExecutionCache(size_t max_size_bytes)
@@ -1908,6 +2032,15 @@ bool InitScriptExecutionCache(size_t max_size_bytes)
     return true;
 }
 
+/** The key of a transaction's validity under the given flags in the script execution cache. */
+static uint256 ScriptExecutionCacheEntry(const CTransaction& tx, unsigned int flags)
+{
+    uint256 hashCacheEntry;
+    CSHA256 hasher = g_scriptExecutionCacheHasher;
+    hasher.Write(UCharCast(tx.GetWitnessHash().begin()), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
+    return hashCacheEntry;
+}
+
 /**
  * Check whether all of this transaction's input scripts succeed.
  *
@@ -1943,10 +2076,7 @@ bool CheckInputScripts(const CTransaction& tx, TxValidationState& state,
     // correct (ie that the transaction hash which is in tx's prevouts
     // properly commits to the scriptPubKey in the inputs view of that
     // transaction).
-    uint256 hashCacheEntry;
-    CSHA256 hasher = g_scriptExecutionCacheHasher;
-    hasher.Write(UCharCast(tx.GetWitnessHash().begin()), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
-    AssertLockHeld(cs_main); //TODO: Remove this requirement by making CuckooCache not require external locks
+    const uint256 hashCacheEntry{ScriptExecutionCacheEntry(tx, flags)};
     if (g_scriptExecutionCache.contains(hashCacheEntry, !cacheFullScriptStore)) {
         return true;
     }
@@ -2014,6 +2144,48 @@ bool CheckInputScripts(const CTransaction& tx, TxValidationState& state,
     return true;
 }
 
+/** Transactions with fewer inputs are not worth handing to the script check threads. */
+static constexpr size_t MIN_PARALLEL_SCRIPT_CHECK_INPUTS{4};
+
+/**
+ * Same as CheckInputScripts without pvChecks, but with the script checks of a transaction with
+ * many inputs spread over the script check threads (and the calling thread). Only success is
+ * decided in parallel: if any check fails, they are all run again inline so that state gets the
+ * same reason it would have without parallelism. Used for mempool acceptance. Every user of
+ * the script check queue (block validation, mempool acceptance and the script warm-up when
+ * loading the mempool) only controls it while holding cs_main, so this never waits for the
+ * queue to be released; it only takes turns with them for cs_main.
+ */
+static bool CheckInputScriptsParallel(const CTransaction& tx, TxValidationState& state,
+                                      const CCoinsViewCache& inputs, unsigned int flags, bool cacheSigStore,
+                                      bool cacheFullScriptStore, PrecomputedTransactionData& txdata,
+                                      CCheckQueue<CScriptCheck>& queue)
+{
+    AssertLockHeld(cs_main);
+    if (tx.vin.size() < MIN_PARALLEL_SCRIPT_CHECK_INPUTS || !queue.HasThreads()) {
+        return CheckInputScripts(tx, state, inputs, flags, cacheSigStore, cacheFullScriptStore, txdata);
+    }
+
+    std::vector<CScriptCheck> checks;
+    if (!CheckInputScripts(tx, state, inputs, flags, cacheSigStore, cacheFullScriptStore, txdata, &checks)) return false;
+    if (checks.empty()) return true; // script execution cache hit
+
+    bool all_ok;
+    {
+        CCheckQueueControl<CScriptCheck> control(&queue);
+        control.Add(std::move(checks));
+        all_ok = control.Wait();
+    }
+    if (!all_ok) {
+        return CheckInputScripts(tx, state, inputs, flags, cacheSigStore, cacheFullScriptStore, txdata);
+    }
+
+    if (cacheFullScriptStore) {
+        g_scriptExecutionCache.insert(ScriptExecutionCacheEntry(tx, flags));
+    }
+    return true;
+}
+
 bool FatalError(Notifications& notifications, BlockValidationState& state, const std::string& strMessage, const bilingual_str& userMessage)
 {
     notifications.fatalError(strMessage, userMessage);
@@ -2205,6 +2377,46 @@ static SteadyClock::duration time_index{};
 static SteadyClock::duration time_total{};
 static int64_t num_blocks_total = 0;
 
+void Chainstate::PrefetchInputs(const CBlock& block)
+{
+    AssertLockHeld(cs_main);
+    auto& queue{m_chainman.m_input_fetch_queue};
+    if (!queue.HasThreads()) return;
+
+    // Outputs created by the block itself are never in the database.
+    std::unordered_set<uint256, SaltedTxidHasher> block_txids;
+    block_txids.reserve(block.vtx.size());
+    for (const auto& tx : block.vtx) {
+        block_txids.insert(tx->GetHash());
+    }
+
+    CCoinsViewCache& tip{CoinsTip()};
+    std::vector<COutPoint> outpoints;
+    for (const auto& tx : block.vtx) {
+        if (tx->IsCoinBase()) continue;
+        for (const CTxIn& txin : tx->vin) {
+            if (block_txids.count(txin.prevout.hash) || tip.HaveCoinInCache(txin.prevout)) continue;
+            outpoints.push_back(txin.prevout);
+        }
+    }
+    if (outpoints.empty()) return;
+
+    std::vector<Coin> coins(outpoints.size());
+    std::vector<CCoinFetch> fetches;
+    fetches.reserve(outpoints.size());
+    for (size_t i = 0; i < outpoints.size(); ++i) {
+        fetches.emplace_back(CoinsErrorCatcher(), outpoints[i], coins[i]);
+    }
+    CCheckQueueControl<CCoinFetch> control(&queue);
+    control.Add(std::move(fetches));
+    control.Wait();
+
+    for (size_t i = 0; i < outpoints.size(); ++i) {
+        tip.EmplaceCoinFromBase(outpoints[i], std::move(coins[i]));
+    }
+    LogPrint(BCLog::BENCH, "    - Prefetched %u inputs\n", outpoints.size());
+}
+
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins.
  *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
  *  can fail if those validity checks fail (among other reasons). */
@@ -2961,13 +3173,18 @@ bool Chainstate::ConnectTip(BlockValidationState& state, CBlockIndex* pindexNew,
         pthisBlock = pblock;
     }
     const CBlock& blockConnecting = *pthisBlock;
-    // Apply the block atomically to the chain state.
-    const auto time_2{SteadyClock::now()};
-    SteadyClock::time_point time_3;
+    const auto time_prefetch{SteadyClock::now()};
     // When adding aggregate statistics in the future, keep in mind that
     // num_blocks_total may be zero until the ConnectBlock() call below.
     LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms\n",
-             Ticks<MillisecondsDouble>(time_2 - time_1));
+             Ticks<MillisecondsDouble>(time_prefetch - time_1));
+    // Warm the coins cache with the block's inputs in parallel.
+    PrefetchInputs(blockConnecting);
+    // Apply the block atomically to the chain state.
+    const auto time_2{SteadyClock::now()};
+    SteadyClock::time_point time_3;
+    LogPrint(BCLog::BENCH, "  - Prefetch inputs: %.2fms\n",
+             Ticks<MillisecondsDouble>(time_2 - time_prefetch));
     {
         CCoinsViewCache view(&CoinsTip());
         bool rv = ConnectBlock(blockConnecting, state, pindexNew, view);
@@ -3005,6 +3222,7 @@ bool Chainstate::ConnectTip(BlockValidationState& state, CBlockIndex* pindexNew,
              Ticks<MillisecondsDouble>(time_chainstate) / num_blocks_total);
     // Remove conflicting transactions from the mempool.;
     if (m_mempool) {
+        const kernel::ScopedLatencyTimer timer{m_mempool->m_latency_stats[kernel::MempoolPhase::REMOVE_FOR_BLOCK]};
         m_mempool->removeForBlock(blockConnecting.vtx, pindexNew->nHeight);
         disconnectpool.removeForBlock(blockConnecting.vtx);
     }
@@ -3675,15 +3893,67 @@ void ChainstateManager::ReceivedBlockTransactions(const CBlock& block, CBlockInd
     }
 }
 
+namespace {
+/**
+ * Bounded set of recently seen headers with a valid proof of work. Verifying a graph solution
+ * is expensive, and a header is checked several times on its way in: when the message carrying
+ * it is pre-processed, in net_processing, and in CheckBlockHeader() under cs_main.
+ *
+ * Headers are identified by the hash of their full serialization, as GetHash() does not
+ * commit to all of the fields of early headers, together with the consensus parameters the
+ * check depends on. Only headers that passed are inserted, so peers can't cheaply evict
+ * entries.
+ */
+class HeaderPowCache
+{
+    static constexpr size_t MAX_ENTRIES{10000};
+
+    Mutex m_mutex;
+    std::unordered_set<uint256, SaltedTxidHasher> m_hashes GUARDED_BY(m_mutex);
+    std::deque<uint256> m_insertion_order GUARDED_BY(m_mutex);
+
+public:
+    bool Contains(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(!m_mutex)
+    {
+        LOCK(m_mutex);
+        return m_hashes.count(hash);
+    }
+
+    void Insert(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(!m_mutex)
+    {
+        LOCK(m_mutex);
+        if (!m_hashes.insert(hash).second) return;
+        m_insertion_order.push_back(hash);
+        if (m_insertion_order.size() > MAX_ENTRIES) {
+            m_hashes.erase(m_insertion_order.front());
+            m_insertion_order.pop_front();
+        }
+    }
+};
+
+HeaderPowCache g_header_pow_cache;
+} // namespace
+
+bool CheckHeaderProofOfWork(const CBlockHeader& header, const Consensus::Params& consensusParams)
+{
+    const uint256 cache_key{(HashWriter{} << consensusParams.powLimit << header).GetSHA256()};
+    if (g_header_pow_cache.Contains(cache_key)) return true;
+    if (!CheckProofOfWork(header.nTime,
+                          header.GetSHA256(),
+                          header.GetHash(),
+                          header.nBits,
+                          header.vdfSolution,
+                          consensusParams)) {
+        return false;
+    }
+    g_header_pow_cache.Insert(cache_key);
+    return true;
+}
+
 static bool CheckBlockHeader(const CBlockHeader& block, BlockValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true)
 {
     // Check proof of work matches claimed amount
-    if (fCheckPOW && !CheckProofOfWork(block.nTime,
-                                       block.GetSHA256(),
-                                       block.GetHash(),
-                                       block.nBits,
-                                       block.vdfSolution,
-                                       consensusParams))
+    if (fCheckPOW && !CheckHeaderProofOfWork(block, consensusParams))
         return state.Invalid(BlockValidationResult::BLOCK_INVALID_HEADER, "high-hash", "proof of work failed");
 
     return true;
@@ -3877,12 +4147,7 @@ std::vector<unsigned char> ChainstateManager::GenerateCoinbaseCommitment(CBlock&
 bool HasValidProofOfWork(const std::vector<CBlockHeader>& headers, const Consensus::Params& consensusParams)
 {
     return std::all_of(headers.cbegin(), headers.cend(),
-            [&](const auto& header) { return CheckProofOfWork(header.nTime,
-                                                              header.GetSHA256(),
-                                                              header.GetHash(),
-                                                              header.nBits,
-                                                              header.vdfSolution,
-                                                              consensusParams);});
+            [&](const auto& header) { return CheckHeaderProofOfWork(header, consensusParams); });
 }
 
 bool IsBlockMutated(const CBlock& block, bool check_witness_root)
@@ -4358,6 +4623,20 @@ MempoolAcceptResult ChainstateManager::ProcessTransaction(const CTransactionRef&
     return result;
 }
 
+std::vector<MempoolAcceptResult> ChainstateManager::ProcessTransactions(const std::vector<CTransactionRef>& txns)
+{
+    AssertLockHeld(cs_main);
+    Chainstate& active_chainstate = ActiveChainstate();
+    if (!active_chainstate.GetMempool()) {
+        TxValidationState state;
+        state.Invalid(TxValidationResult::TX_NO_MEMPOOL, "no-mempool");
+        return std::vector<MempoolAcceptResult>(txns.size(), MempoolAcceptResult::Failure(state));
+    }
+    auto results = AcceptTransactionsToMemoryPool(active_chainstate, txns, GetTime());
+    active_chainstate.GetMempool()->check(active_chainstate.CoinsTip(), active_chainstate.m_chain.Height() + 1);
+    return results;
+}
+
 bool TestBlockValidity(BlockValidationState& state,
                        const CChainParams& chainparams,
                        Chainstate& chainstate,
@@ -5917,6 +6196,7 @@ static ChainstateManager::Options&& Flatten(ChainstateManager::Options&& opts)
 
 ChainstateManager::ChainstateManager(const util::SignalInterrupt& interrupt, Options options, node::BlockManager::Options blockman_options)
     : m_script_check_queue{/*batch_size=*/128, options.worker_threads_num},
+      m_input_fetch_queue{/*batch_size=*/16, options.worker_threads_num, "inputfetch"},
       m_interrupt{interrupt},
       m_options{Flatten(std::move(options))},
       m_blockman{interrupt, std::move(blockman_options)}
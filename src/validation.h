@@ -271,6 +271,18 @@ MempoolAcceptResult AcceptToMemoryPool(Chainstate& active_chainstate, const CTra
                                        int64_t accept_time, bool bypass_limits, bool test_accept)
     EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+/**
+ * Try to add several transactions to the mempool, each validated as if submitted on its own
+ * through AcceptToMemoryPool(), in order. The mempool is trimmed and the coins cache flushed
+ * once for the whole batch. This is an internal function and is exposed only for testing.
+ * Client code should use ChainstateManager::ProcessTransactions()
+ *
+ * @returns a MempoolAcceptResult for each transaction, in the same order.
+ */
+std::vector<MempoolAcceptResult> AcceptTransactionsToMemoryPool(Chainstate& active_chainstate, const std::vector<CTransactionRef>& txns,
+                                                                int64_t accept_time)
+    EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 /**
 * Validate (and maybe submit) a package to the mempool. See doc/policy/packages.md for full details
 * on package validation rules.
@@ -359,6 +371,34 @@ static_assert(std::is_nothrow_move_assignable_v<CScriptCheck>);
 static_assert(std::is_nothrow_move_constructible_v<CScriptCheck>);
 static_assert(std::is_nothrow_destructible_v<CScriptCheck>);
 
+/**
+ * Closure representing one lookup of a block input in the coins database.
+ * The result is written to a caller-owned Coin, which must outlive the check.
+ */
+class CCoinFetch
+{
+private:
+    const CCoinsView* m_view;
+    COutPoint m_outpoint;
+    Coin* m_coin;
+
+public:
+    CCoinFetch(const CCoinsView& view, const COutPoint& outpoint, Coin& coin) :
+        m_view(&view), m_outpoint(outpoint), m_coin(&coin) { }
+
+    CCoinFetch(const CCoinFetch&) = delete;
+    CCoinFetch& operator=(const CCoinFetch&) = delete;
+    CCoinFetch(CCoinFetch&&) = default;
+    CCoinFetch& operator=(CCoinFetch&&) = default;
+
+    bool operator()()
+    {
+        // A missing coin is not an error here; ConnectBlock() reports it.
+        m_view->GetCoin(m_outpoint, *m_coin);
+        return true;
+    }
+};
+
 /** Initializes the script-execution cache */
 [[nodiscard]] bool InitScriptExecutionCache(size_t max_size_bytes);
 
@@ -376,6 +416,13 @@ bool TestBlockValidity(BlockValidationState& state,
                        bool fCheckPOW = true,
                        bool fCheckMerkleRoot = true) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+/**
+ * Check that the proof of work of a block header matches the value in nBits. Headers that pass
+ * are remembered for a while, so checking the same header again doesn't verify its graph
+ * solution again. Safe to call concurrently.
+ */
+bool CheckHeaderProofOfWork(const CBlockHeader& header, const Consensus::Params& consensusParams);
+
 /** Check with the proof of work on each blockheader matches the value in nBits */
 bool HasValidProofOfWork(const std::vector<CBlockHeader>& headers, const Consensus::Params& consensusParams);
 
@@ -692,6 +739,14 @@ public:
     bool ConnectBlock(const CBlock& block, BlockValidationState& state, CBlockIndex* pindex,
                       CCoinsViewCache& view, bool fJustCheck = false) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+    /**
+     * Read the coins spent by a block from the coins database on the input
+     * fetch worker threads and add them to the coins tip cache, so that a
+     * following ConnectBlock() does not have to look them up one by one.
+     * Coins that are already cached or created within the block are skipped.
+     */
+    void PrefetchInputs(const CBlock& block) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
     // Apply the effects of a block disconnection on the UTXO set.
     bool DisconnectTip(BlockValidationState& state, DisconnectedBlockTransactions* disconnectpool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_mempool->cs);
 
@@ -919,6 +974,10 @@ private:
     //! A queue for script verifications that have to be performed by worker threads.
     CCheckQueue<CScriptCheck> m_script_check_queue;
 
+    //! A queue for block input lookups that are performed by worker threads
+    //! before the block is connected.
+    CCheckQueue<CCoinFetch> m_input_fetch_queue;
+
 public:
     using Options = kernel::ChainstateManagerOpts;
 
@@ -1205,6 +1264,16 @@ public:
     [[nodiscard]] MempoolAcceptResult ProcessTransaction(const CTransactionRef& tx, bool test_accept=false)
         EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+    /**
+     * Try to add transactions to the memory pool, as ProcessTransaction() would one after the
+     * other, but trimming the mempool only once at the end.
+     *
+     * @param[in]  txns            The transactions to submit, in order.
+     * @returns a MempoolAcceptResult for each transaction, in the same order.
+     */
+    [[nodiscard]] std::vector<MempoolAcceptResult> ProcessTransactions(const std::vector<CTransactionRef>& txns)
+        EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
     //! Load the block tree and coins database from disk, initializing state if we're running with -reindex
     bool LoadBlockIndex() EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
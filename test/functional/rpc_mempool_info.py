@@ -7,6 +7,7 @@
 from test_framework.test_framework import BitcoinTestFramework
 from test_framework.util import (
     assert_equal,
+    assert_greater_than_or_equal,
     assert_raises_rpc_error,
 )
 from test_framework.wallet import MiniWallet
@@ -94,6 +95,16 @@ class RPCMempoolInfoTest(BitcoinTestFramework):
         self.log.info("Missing txid")
         assert_raises_rpc_error(-3, "Missing txid", self.nodes[0].gettxspendingprevout, [{'vout' : 3}])
 
+        self.log.info("Check mempool latency stats")
+        stats = self.nodes[0].getmempoolstats()
+        assert_equal(sorted(stats.keys()), sorted(["accept_transaction", "accept_package", "prechecks", "policy_scripts",
+                                                   "consensus_scripts", "finalize", "remove_for_block", "trim_to_size"]))
+        for operation in ["accept_transaction", "prechecks", "policy_scripts", "consensus_scripts", "finalize"]:
+            assert_greater_than_or_equal(stats[operation]["count"], 8)
+        for operation in stats.values():
+            assert_equal(sum(bucket["count"] for bucket in operation["histogram"]), operation["count"])
+            assert_greater_than_or_equal(operation["total_us"], operation["max_us"])
+
 
 if __name__ == '__main__':
     RPCMempoolInfoTest().main()